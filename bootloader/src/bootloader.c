@@ -4,8 +4,11 @@
 #include <ch.h>
 #include <hal.h>
 #include <common/crc64_we.h>
+#include <common/lzss.h>
 #include <modules/flash/flash.h>
+#include <modules/param/param.h>
 #include <modules/uavcan/uavcan.h>
+#include <modules/uavcan/uavcan_service_client.h>
 #include <modules/can/can.h>
 #include <modules/timing/timing.h>
 #include <modules/system/system.h>
@@ -26,6 +29,25 @@
 #define WT BOOTLOADER_APP_THREAD
 WORKER_THREAD_DECLARE_EXTERN(WT)
 
+// Number of file.Read requests kept in flight during a firmware update
+#ifndef BOOTLOADER_READ_WINDOW
+#define BOOTLOADER_READ_WINDOW 4
+#endif
+
+// file.Read responses carry at most this many bytes, and a shorter one marks the end of the file
+#define BOOTLOADER_READ_CHUNK_SIZE 256
+
+// When TRUE the image CRC is recomputed at every boot, even if a verified image record matches the image
+#ifndef BOOTLOADER_FULL_VERIFY
+#define BOOTLOADER_FULL_VERIFY FALSE
+#endif
+
+#define BOOTLOADER_DESCRIPTOR_OFS_UNKNOWN UINT32_MAX
+
+// Decompressed output is collected here and written to flash in whole buffers, so this must be a multiple of the flash
+// word size. Earlier output is read back from flash, so no other decompression window is needed.
+#define BOOTLOADER_DECOMPRESS_BUF_SIZE 256
+
 struct app_header_s {
     uint32_t stacktop;
     uint32_t entrypoint;
@@ -37,23 +59,55 @@ extern uint8_t _app_flash_sec[], _app_flash_sec_end;
 // NOTE: BOARD_CONFIG_HW_INFO_STRUCTURE defined in the board config file
 static const struct shared_hw_info_s _hw_info = BOARD_CONFIG_HW_INFO_STRUCTURE;
 
+struct read_slot_s {
+    bool in_use;
+    bool received;
+    uint32_t ofs;
+    uint16_t data_len;
+    struct uavcan_service_client_request_s request;
+    struct uavcan_protocol_file_Read_req_s req_msg;
+    uint8_t data[BOOTLOADER_READ_CHUNK_SIZE];
+};
+
 static struct {
     bool in_progress;
+    bool compressed;
     uint32_t ofs;
+    uint32_t write_ofs;
     uint32_t app_start_ofs;
+    uint32_t request_ofs;
+    uint32_t end_ofs;
+    systime_t start_systime;
+    uint64_t image_crc;
+    uint32_t image_crc_ofs;
+    uint32_t descriptor_ofs;
+    uint32_t image_size;
     uint8_t uavcan_idx;
-    uint8_t retries;
     uint8_t source_node_id;
     int32_t last_erased_page;
-    struct worker_thread_timer_task_s read_timeout_task;
+    uint32_t erase_ahead_ofs;
     char path[201];
+    struct lzss_decoder_s decoder;
+    uint16_t decompress_buf_len;
+    uint8_t decompress_buf[BOOTLOADER_DECOMPRESS_BUF_SIZE];
 } flash_state;
 
+static struct read_slot_s read_slots[BOOTLOADER_READ_WINDOW];
+
+// The verified image record lets a normal boot skip the image CRC. The flash generation is bumped whenever an update
+// starts rewriting the app section, which invalidates the record until the new image has been verified.
+PARAM_DEFINE_UINT32_PARAM_STATIC(app_flash_generation, "bootloader.flash_gen", 0, 0, UINT32_MAX)
+PARAM_DEFINE_UINT32_PARAM_STATIC(verified_image_generation, "bootloader.verified_gen", 0, 0, UINT32_MAX)
+PARAM_DEFINE_UINT32_PARAM_STATIC(verified_image_size, "bootloader.verified_size", 0, 0, UINT32_MAX)
+PARAM_DEFINE_INT64_PARAM_STATIC(verified_image_crc, "bootloader.verified_crc", 0, INT64_MIN, INT64_MAX)
+
 static struct {
     bool in_progress;
     size_t ofs;
     int32_t last_erased_page;
     struct worker_thread_timer_task_s boot_timer_task;
+    struct worker_thread_timer_task_s begin_flash_task;
+    struct worker_thread_timer_task_s erase_ahead_task;
 } bootloader_state;
 
 static struct {
@@ -64,16 +118,31 @@ static struct {
 } app_info;
 
 static struct worker_thread_listener_task_s beginfirmwareupdate_req_listener_task;
-static struct worker_thread_listener_task_s file_read_res_task;
+static struct uavcan_service_client_s file_read_client;
 static struct worker_thread_listener_task_s restart_req_listener_task;
 static struct worker_thread_timer_task_s delayed_restart_task;
 static struct worker_thread_listener_task_s getnodeinfo_req_listener_task;
 
 static void file_beginfirmwareupdate_request_handler(size_t msg_size, const void* buf, void* ctx);
 static void begin_flash_from_path(uint8_t uavcan_idx, uint8_t source_node_id, const char* path);
-static void file_read_response_handler(size_t msg_size, const void* buf, void* ctx);
-static void do_resend_read_request(void);
-static void do_send_read_request(void);
+static void file_read_response_handler(struct uavcan_service_client_request_s* request, const struct uavcan_deserialized_message_s* msg_wrapper, void* ctx);
+static void begin_flash_task_func(struct worker_thread_timer_task_s* task);
+static void fill_read_window(void);
+static void write_received_chunks(void);
+static bool write_file_data(uint32_t file_ofs, const uint8_t* data, uint16_t len);
+static bool write_app_data(const uint8_t* data, uint16_t len);
+static void decompress_output_func(uint8_t byte, void* ctx);
+static uint8_t decompress_history_func(uint32_t ofs, void* ctx);
+static void flush_decompress_buf(void);
+static uint32_t get_max_file_size(void);
+static void cancel_read_requests(void);
+static void erase_app_pages_through_ofs(uint32_t ofs);
+static void erase_ahead_task_func(struct worker_thread_timer_task_s* task);
+static void update_image_crc(bool final);
+static bool image_crc_valid(void);
+static uint64_t compute_app_image_crc(const struct shared_app_descriptor_s* descriptor);
+static bool verified_image_record_matches(const struct shared_app_descriptor_s* descriptor);
+static void store_verified_image_record(uint64_t image_crc, uint32_t image_size);
 static uint32_t get_app_sec_size(void);
 static void start_boot(struct worker_thread_timer_task_s* task);
 static void update_app_info(void);
@@ -90,7 +159,6 @@ static void bootloader_pre_init(void);
 static void bootloader_init(void);
 static void restart_req_handler(size_t msg_size, const void* buf, void* ctx);
 static void delayed_restart_func(struct worker_thread_timer_task_s* task);
-static void read_request_response_timeout(struct worker_thread_timer_task_s* task);
 static uint32_t get_app_page_from_ofs(uint32_t ofs);
 static uint32_t get_app_address_from_ofs(uint32_t ofs);
 static void getnodeinfo_req_handler(size_t msg_size, const void* buf, void* ctx);
@@ -107,8 +175,7 @@ RUN_AFTER(UAVCAN_INIT) {
     struct pubsub_topic_s* beginfirmwareupdate_req_topic = uavcan_get_message_topic(0, &uavcan_protocol_file_BeginFirmwareUpdate_req_descriptor);
     worker_thread_add_listener_task(&WT, &beginfirmwareupdate_req_listener_task, beginfirmwareupdate_req_topic, file_beginfirmwareupdate_request_handler, NULL);
 
-    struct pubsub_topic_s* file_read_topic = uavcan_get_message_topic(0, &uavcan_protocol_file_Read_res_descriptor);
-    worker_thread_add_listener_task(&WT, &file_read_res_task, file_read_topic, file_read_response_handler, NULL);
+    uavcan_service_client_init(&file_read_client, &WT);
 
     struct pubsub_topic_s* restart_topic = uavcan_get_message_topic(0, &uavcan_protocol_RestartNode_req_descriptor);
     worker_thread_add_listener_task(&WT, &restart_req_listener_task, restart_topic, restart_req_handler, NULL);
@@ -174,65 +241,300 @@ static void begin_flash_from_path(uint8_t uavcan_idx, uint8_t source_node_id, co
     memset(&flash_state, 0, sizeof(flash_state));
     flash_state.in_progress = true;
     flash_state.ofs = 0; 
+    flash_state.write_ofs = 0;
+    flash_state.request_ofs = 0;
+    flash_state.end_ofs = UINT32_MAX;
+    flash_state.start_systime = chVTGetSystemTimeX();
+    flash_state.image_crc = 0;
+    flash_state.image_crc_ofs = 0;
+    flash_state.descriptor_ofs = BOOTLOADER_DESCRIPTOR_OFS_UNKNOWN;
     flash_state.source_node_id = source_node_id;
     flash_state.uavcan_idx = uavcan_idx;
     strncpy(flash_state.path, path, 200);
-    worker_thread_add_timer_task(&WT, &flash_state.read_timeout_task, read_request_response_timeout, NULL, LL_MS2ST(500), false);
-    do_send_read_request();
+    flash_state.last_erased_page = -1;
 
+    app_flash_generation++;
+    param_store_all();
     corrupt_app();
-    flash_state.last_erased_page = -1;
+
+    // bootloader_init starts an update before WT runs, and file.Read requests are only issued from WT
+    worker_thread_remove_timer_task(&WT, &bootloader_state.begin_flash_task);
+    worker_thread_add_timer_task(&WT, &bootloader_state.begin_flash_task, begin_flash_task_func, NULL, TIME_IMMEDIATE, false);
 }
 
-static void file_read_response_handler(size_t msg_size, const void* buf, void* ctx) {
-    (void)msg_size;
-    (void)ctx;
+static void begin_flash_task_func(struct worker_thread_timer_task_s* task) {
+    (void)task;
+    if (flash_state.in_progress) {
+        fill_read_window();
+    }
+}
+
+static void file_read_response_handler(struct uavcan_service_client_request_s* request, const struct uavcan_deserialized_message_s* msg_wrapper, void* ctx) {
+    (void)request;
+    struct read_slot_s* slot = ctx;
     if (flash_state.in_progress) {
-        const struct uavcan_deserialized_message_s* msg_wrapper = buf;
+        // retried for 5 seconds without a response
+        if (!msg_wrapper) {
+            do_fail_update();
+            return;
+        }
+
         const struct uavcan_protocol_file_Read_res_s *res = (const struct uavcan_protocol_file_Read_res_s*)msg_wrapper->msg;
 
-        if (res->error.value != 0 || flash_state.ofs + res->data_len > get_app_sec_size()) {
+        if (res->error.value != 0 || slot->ofs + res->data_len > get_max_file_size()) {
             do_fail_update();
             return;
         }
 
-        int32_t curr_page = get_app_page_from_ofs(flash_state.ofs + res->data_len);
-        if (curr_page > flash_state.last_erased_page) {
-            for (int32_t i=flash_state.last_erased_page+1; i<=curr_page; i++) {
-                erase_app_page(i);
+        // Responses may arrive out of order, so each is held in its slot until everything before it is written
+        memcpy(slot->data, res->data, res->data_len);
+        slot->data_len = res->data_len;
+        slot->received = true;
+
+        if (res->data_len < BOOTLOADER_READ_CHUNK_SIZE && slot->ofs + res->data_len < flash_state.end_ofs) {
+            flash_state.end_ofs = slot->ofs + res->data_len;
+        }
+
+        write_received_chunks();
+        if (flash_state.in_progress) {
+            fill_read_window();
+        }
+    }
+}
+
+static void write_received_chunks(void) {
+    bool written = true;
+    while (written) {
+        written = false;
+        for (uint8_t i=0; i<BOOTLOADER_READ_WINDOW; i++) {
+            struct read_slot_s* slot = &read_slots[i];
+            if (!slot->in_use || !slot->received || slot->ofs != flash_state.ofs) {
+                continue;
             }
+
+            if (!write_file_data(slot->ofs, slot->data, slot->data_len)) {
+                do_fail_update();
+                return;
+            }
+            slot->in_use = false;
+            flash_state.ofs += slot->data_len;
+
+            // Achieved download rate in bytes per second
+            systime_t elapsed = chVTGetSystemTimeX() - flash_state.start_systime;
+            if (elapsed > 0) {
+                uint64_t rate = (uint64_t)flash_state.ofs * CH_CFG_ST_FREQUENCY / elapsed;
+                set_node_vendor_specific_status_code(rate > UINT16_MAX ? UINT16_MAX : rate);
+            }
+
+            if (slot->data_len < BOOTLOADER_READ_CHUNK_SIZE) {
+                if (flash_state.compressed) {
+                    if (!lzss_decoder_finished(&flash_state.decoder)) {
+                        do_fail_update();
+                        return;
+                    }
+                    flush_decompress_buf();
+                }
+                update_image_crc(true);
+                cancel_read_requests();
+                on_update_complete();
+                return;
+            }
+
+            written = true;
         }
-        struct flash_write_buf_s buf = {res->data_len, (void*)res->data};
-        flash_write((void*)get_app_address_from_ofs(flash_state.ofs), 1, &buf);
+    }
+}
 
-        if (res->data_len < 256) {
-            on_update_complete();
-        } else {
-            flash_state.ofs += res->data_len;
-            do_send_read_request();
+// Writes the file data at file_ofs to the app section, decompressing it first if the file starts with LZSS_MAGIC
+static bool write_file_data(uint32_t file_ofs, const uint8_t* data, uint16_t len) {
+    if (file_ofs == 0) {
+        flash_state.compressed = len >= LZSS_HEADER_SIZE && !memcmp(data, LZSS_MAGIC, LZSS_MAGIC_SIZE);
+        if (flash_state.compressed) {
+            // The header is fed on its own so that the decompressed size is checked before anything is written
+            lzss_decoder_init(&flash_state.decoder, decompress_output_func, decompress_history_func, NULL);
+            if (!lzss_decoder_feed(&flash_state.decoder, data, LZSS_HEADER_SIZE) || lzss_decoder_get_output_size(&flash_state.decoder) > get_app_sec_size()) {
+                return false;
+            }
+            data += LZSS_HEADER_SIZE;
+            len -= LZSS_HEADER_SIZE;
         }
     }
+
+    if (flash_state.compressed) {
+        return lzss_decoder_feed(&flash_state.decoder, data, len);
+    }
+
+    return write_app_data(data, len);
+}
+
+static bool write_app_data(const uint8_t* data, uint16_t len) {
+    if (flash_state.write_ofs + len > get_app_sec_size()) {
+        return false;
+    }
+
+    erase_app_pages_through_ofs(flash_state.write_ofs + len);
+    struct flash_write_buf_s buf = {len, data};
+    flash_write((void*)get_app_address_from_ofs(flash_state.write_ofs), 1, &buf);
+    flash_state.write_ofs += len;
+    update_image_crc(false);
+    return true;
+}
+
+static void decompress_output_func(uint8_t byte, void* ctx) {
+    (void)ctx;
+    flash_state.decompress_buf[flash_state.decompress_buf_len++] = byte;
+    if (flash_state.decompress_buf_len == BOOTLOADER_DECOMPRESS_BUF_SIZE) {
+        flush_decompress_buf();
+    }
 }
 
-static void do_resend_read_request(void) {
-    struct uavcan_protocol_file_Read_req_s read_req;
-    read_req.offset =  flash_state.ofs;
-    strncpy(read_req.path.path,flash_state.path,sizeof(read_req.path));
-    read_req.path.path_len = strnlen(flash_state.path,sizeof(read_req.path));
-    uavcan_request(flash_state.uavcan_idx, &uavcan_protocol_file_Read_req_descriptor, CANARD_TRANSFER_PRIORITY_HIGH, flash_state.source_node_id, &read_req);
-    worker_thread_timer_task_reschedule(&WT, &flash_state.read_timeout_task, LL_MS2ST(500));
-    flash_state.retries++;
+static uint8_t decompress_history_func(uint32_t ofs, void* ctx) {
+    (void)ctx;
+    if (ofs >= flash_state.write_ofs) {
+        return flash_state.decompress_buf[ofs - flash_state.write_ofs];
+    }
+    return _app_flash_sec[ofs];
 }
 
-static void do_send_read_request(void) {
-    do_resend_read_request();
-    flash_state.retries = 0;
+static void flush_decompress_buf(void) {
+    // Can't run out of room, since the decompressed size was checked against the app section when the header was read
+    write_app_data(flash_state.decompress_buf, flash_state.decompress_buf_len);
+    flash_state.decompress_buf_len = 0;
+}
+
+static void fill_read_window(void) {
+    for (uint8_t i=0; i<BOOTLOADER_READ_WINDOW; i++) {
+        struct read_slot_s* slot = &read_slots[i];
+
+        // An image that fills the app section exactly is ended by an empty read at its end
+        if (flash_state.request_ofs > get_max_file_size() || flash_state.request_ofs > flash_state.end_ofs) {
+            break;
+        }
+
+        if (slot->in_use) {
+            continue;
+        }
+
+        slot->in_use = true;
+        slot->received = false;
+        slot->ofs = flash_state.request_ofs;
+        slot->req_msg.offset = slot->ofs;
+        strncpy(slot->req_msg.path.path,flash_state.path,sizeof(slot->req_msg.path));
+        slot->req_msg.path.path_len = strnlen(flash_state.path,sizeof(slot->req_msg.path));
+        if (!uavcan_service_client_request(&file_read_client, &slot->request, flash_state.uavcan_idx, &uavcan_protocol_file_Read_req_descriptor, CANARD_TRANSFER_PRIORITY_HIGH, flash_state.source_node_id, &slot->req_msg, LL_MS2ST(500), 10, file_read_response_handler, slot)) {
+            do_fail_update();
+            return;
+        }
+        flash_state.request_ofs += BOOTLOADER_READ_CHUNK_SIZE;
+    }
+
+    // Pages for the data in flight are erased while its requests are outstanding, rather than as each response comes in.
+    // A compressed image expands to more than this, and the rest is erased as it is written.
+    uint32_t erase_ofs = flash_state.write_ofs + (flash_state.request_ofs - flash_state.ofs);
+    flash_state.erase_ahead_ofs = erase_ofs < get_app_sec_size() ? erase_ofs : get_app_sec_size();
+    worker_thread_remove_timer_task(&WT, &bootloader_state.erase_ahead_task);
+    worker_thread_add_timer_task(&WT, &bootloader_state.erase_ahead_task, erase_ahead_task_func, NULL, TIME_IMMEDIATE, false);
+}
+
+// Erases one page up to erase_ahead_ofs per run, so that WT handles responses and request timeouts between erases
+static void erase_ahead_task_func(struct worker_thread_timer_task_s* task) {
+    (void)task;
+    if (!flash_state.in_progress || flash_state.erase_ahead_ofs == 0) {
+        return;
+    }
+
+    int32_t last_page = get_app_page_from_ofs(flash_state.erase_ahead_ofs-1);
+    if (flash_state.last_erased_page < last_page) {
+        erase_app_page(flash_state.last_erased_page+1);
+    }
+
+    if (flash_state.last_erased_page < last_page) {
+        worker_thread_add_timer_task(&WT, &bootloader_state.erase_ahead_task, erase_ahead_task_func, NULL, TIME_IMMEDIATE, false);
+    }
+}
+
+static void cancel_read_requests(void) {
+    for (uint8_t i=0; i<BOOTLOADER_READ_WINDOW; i++) {
+        uavcan_service_client_cancel(&read_slots[i].request);
+        read_slots[i].in_use = false;
+    }
+}
+
+static void erase_app_pages_through_ofs(uint32_t ofs) {
+    if (ofs == 0) {
+        return;
+    }
+
+    int32_t curr_page = get_app_page_from_ofs(ofs-1);
+    for (int32_t i=flash_state.last_erased_page+1; i<=curr_page; i++) {
+        erase_app_page(i);
+    }
+}
+
+// Runs the image CRC over the data written so far, in the same way as compute_app_image_crc, so that verifying the new
+// image doesn't need another pass over it. The descriptor's own CRC field is counted as zero, so the CRC holds back the
+// bytes where a descriptor could start until all of it has been written.
+static void update_image_crc(bool final) {
+    const uint8_t* app = _app_flash_sec;
+    uint32_t written = flash_state.write_ofs;
+
+    if (flash_state.descriptor_ofs == BOOTLOADER_DESCRIPTOR_OFS_UNKNOWN) {
+        uint32_t hold_back = final ? sizeof(uint64_t) : sizeof(struct shared_app_descriptor_s);
+        uint32_t scan_end = written > hold_back ? written - hold_back : 0;
+        uint32_t i;
+
+        for (i=flash_state.image_crc_ofs; i<scan_end; i++) {
+            if (app[i] == SHARED_APP_DESCRIPTOR_SIGNATURE[0] && !memcmp(&app[i], SHARED_APP_DESCRIPTOR_SIGNATURE, sizeof(uint64_t))) {
+                break;
+            }
+        }
+
+        if (i >= scan_end) {
+            if (scan_end > flash_state.image_crc_ofs) {
+                flash_state.image_crc = crc64_we(&app[flash_state.image_crc_ofs], scan_end-flash_state.image_crc_ofs, flash_state.image_crc);
+                flash_state.image_crc_ofs = scan_end;
+            }
+            return;
+        }
+
+        const struct shared_app_descriptor_s* descriptor = (const struct shared_app_descriptor_s*)&app[i];
+        uint32_t pre_crc_end = (uint32_t)&descriptor->image_crc - (uint32_t)app;
+        uint64_t zero64 = 0;
+
+        flash_state.image_crc = crc64_we(&app[flash_state.image_crc_ofs], pre_crc_end-flash_state.image_crc_ofs, flash_state.image_crc);
+        flash_state.image_crc = crc64_we((uint8_t*)&zero64, sizeof(zero64), flash_state.image_crc);
+        flash_state.image_crc_ofs = pre_crc_end + sizeof(uint64_t);
+        flash_state.descriptor_ofs = i;
+        flash_state.image_size = descriptor->image_size;
+    }
+
+    uint32_t crc_end = flash_state.image_size < written ? flash_state.image_size : written;
+    if (crc_end > flash_state.image_crc_ofs) {
+        flash_state.image_crc = crc64_we(&app[flash_state.image_crc_ofs], crc_end-flash_state.image_crc_ofs, flash_state.image_crc);
+        flash_state.image_crc_ofs = crc_end;
+    }
+}
+
+static bool image_crc_valid(void) {
+    if (flash_state.descriptor_ofs == BOOTLOADER_DESCRIPTOR_OFS_UNKNOWN) {
+        return false;
+    }
+
+    const struct shared_app_descriptor_s* descriptor = (const struct shared_app_descriptor_s*)&_app_flash_sec[flash_state.descriptor_ofs];
+
+    return flash_state.image_size >= sizeof(struct shared_app_descriptor_s) && flash_state.image_size <= get_app_sec_size() &&
+           flash_state.image_crc_ofs == flash_state.image_size && flash_state.image_crc == descriptor->image_crc;
 }
 
 static uint32_t get_app_sec_size(void) {
     return (uint32_t)&_app_flash_sec_end - (uint32_t)&_app_flash_sec[0];
 }
 
+// An LZSS stream is at most one flag byte per 8 literals larger than its output
+static uint32_t get_max_file_size(void) {
+    return LZSS_HEADER_SIZE + get_app_sec_size() + (get_app_sec_size()+7)/8;
+}
+
 static uint32_t get_app_page_from_ofs(uint32_t ofs)
 {
     return flash_get_page_num((void*)((uint32_t)&_app_flash_sec[0] + ofs)) - flash_get_page_num((void*)((uint32_t)&_app_flash_sec[0]));
@@ -252,17 +554,16 @@ static void update_app_info(void) {
 
 
     if (descriptor && descriptor->image_size >= sizeof(struct shared_app_descriptor_s) && descriptor->image_size <= get_app_sec_size()) {
-        uint32_t pre_crc_len = ((uint32_t)&descriptor->image_crc) - ((uint32_t)_app_flash_sec);
-        uint32_t post_crc_len = descriptor->image_size - pre_crc_len - sizeof(uint64_t);
-        uint8_t* pre_crc_origin = _app_flash_sec;
-        uint8_t* post_crc_origin = (uint8_t*)((&descriptor->image_crc)+1);
-        uint64_t zero64 = 0;
-
-        app_info.image_crc_computed = crc64_we(pre_crc_origin, pre_crc_len, 0);
-        app_info.image_crc_computed = crc64_we((uint8_t*)&zero64, sizeof(zero64), app_info.image_crc_computed);
-        app_info.image_crc_computed = crc64_we(post_crc_origin, post_crc_len, app_info.image_crc_computed);
-
-        app_info.image_crc_correct = (app_info.image_crc_computed == descriptor->image_crc);
+        if (verified_image_record_matches(descriptor)) {
+            app_info.image_crc_computed = descriptor->image_crc;
+            app_info.image_crc_correct = true;
+        } else {
+            app_info.image_crc_computed = compute_app_image_crc(descriptor);
+            app_info.image_crc_correct = (app_info.image_crc_computed == descriptor->image_crc);
+            if (app_info.image_crc_correct && !flash_state.in_progress) {
+                store_verified_image_record(descriptor->image_crc, descriptor->image_size);
+            }
+        }
     }
     if (flash_state.in_progress) {
         set_node_health(UAVCAN_PROTOCOL_NODESTATUS_HEALTH_OK);
@@ -276,6 +577,35 @@ static void update_app_info(void) {
     }
 }
 
+static uint64_t compute_app_image_crc(const struct shared_app_descriptor_s* descriptor) {
+    uint32_t pre_crc_len = ((uint32_t)&descriptor->image_crc) - ((uint32_t)_app_flash_sec);
+    uint32_t post_crc_len = descriptor->image_size - pre_crc_len - sizeof(uint64_t);
+    uint8_t* pre_crc_origin = _app_flash_sec;
+    uint8_t* post_crc_origin = (uint8_t*)((&descriptor->image_crc)+1);
+    uint64_t zero64 = 0;
+
+    uint64_t crc = crc64_we(pre_crc_origin, pre_crc_len, 0);
+    crc = crc64_we((uint8_t*)&zero64, sizeof(zero64), crc);
+    crc = crc64_we(post_crc_origin, post_crc_len, crc);
+    return crc;
+}
+
+static bool verified_image_record_matches(const struct shared_app_descriptor_s* descriptor) {
+#if BOOTLOADER_FULL_VERIFY
+    (void)descriptor;
+    return false;
+#else
+    return verified_image_generation == app_flash_generation && verified_image_size == descriptor->image_size && (uint64_t)verified_image_crc == descriptor->image_crc;
+#endif
+}
+
+static void store_verified_image_record(uint64_t image_crc, uint32_t image_size) {
+    verified_image_generation = app_flash_generation;
+    verified_image_size = image_size;
+    verified_image_crc = (int64_t)image_crc;
+    param_store_all();
+}
+
 static void corrupt_app(void) {
     erase_app_page(0);
     update_app_info();
@@ -358,13 +688,18 @@ static void erase_app_page(uint32_t page_num) {
 }
 
 static void do_fail_update(void) {
+    cancel_read_requests();
     memset(&flash_state, 0, sizeof(flash_state));
+    set_node_vendor_specific_status_code(0);
     corrupt_app();
 }
 
 static void on_update_complete(void) {
+    // The image was verified as it was written, so update_app_info can take it from the record
+    if (image_crc_valid()) {
+        store_verified_image_record(flash_state.image_crc, flash_state.image_size);
+    }
     flash_state.in_progress = false;
-    worker_thread_remove_timer_task(&WT, &flash_state.read_timeout_task);
     update_app_info();
     command_boot_if_app_valid(SHARED_BOOT_REASON_FIRMWARE_UPDATE);
 }
@@ -411,13 +746,3 @@ static void delayed_restart_func(struct worker_thread_timer_task_s* task) {
     // otherwise, just reset
     NVIC_SystemReset();
 }
-
-static void read_request_response_timeout(struct worker_thread_timer_task_s* task) {
-    (void)task;
-    if (flash_state.in_progress) {
-        do_resend_read_request();
-        if (flash_state.retries > 10) { // retry for 5 seconds
-            do_fail_update();
-        }
-    }
-}
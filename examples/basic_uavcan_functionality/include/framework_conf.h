@@ -5,7 +5,7 @@
 //
 
 #define TIMING_WORKER_THREAD                            lpwork_thread
-#define UAVCAN_NODESTATUS_PUBLISHER_WORKER_THREAD       lpwork_thread
+#define UAVCAN_PUBLISH_SCHEDULER_WORKER_THREAD          lpwork_thread
 #define CAN_AUTOBAUD_WORKER_THREAD                      lpwork_thread
 #define UAVCAN_PARAM_INTERFACE_WORKER_THREAD            lpwork_thread
 #define UAVCAN_GETNODEINFO_SERVER_WORKER_THREAD         lpwork_thread
@@ -0,0 +1,10 @@
+#pragma once
+
+#include <stdint.h>
+
+// - Copies src_len bits starting at bit src_offset of src to dst starting at bit dst_offset. Bits are numbered from the most
+//   significant bit of each byte, as in UAVCAN serialization. Bits of dst outside the copied range are left unchanged.
+void copy_bit_array(const uint8_t* src, uint32_t src_offset, uint32_t src_len, uint8_t* dst, uint32_t dst_offset);
+
+// - Same as copy_bit_array, but copies at most a byte per step. Used by copy_bit_array for unaligned heads and tails.
+void copy_bit_array_bitwise(const uint8_t* src, uint32_t src_offset, uint32_t src_len, uint8_t* dst, uint32_t dst_offset);
@@ -16,6 +16,7 @@
 #pragma once
 
 #include <math.h>
+#include <stddef.h>
 #include <stdint.h>
 
 #define M_SQRT2_F ((float)M_SQRT2)
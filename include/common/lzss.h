@@ -0,0 +1,51 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// LZSS stream format, as produced by tools/uavcan_upload.py --compress:
+//   header: LZSS_MAGIC, then the decompressed size as a little-endian uint32
+//   body: a flag byte followed by up to 8 items, flag bits LSB first. A set bit is a literal byte. A clear bit is a
+//         2-byte match: distance-1 in the low 8 bits of the first byte and the high 4 bits of the second, and
+//         length-LZSS_MIN_MATCH in the low 4 bits of the second.
+#define LZSS_MAGIC "ODLZ"
+#define LZSS_MAGIC_SIZE 4
+#define LZSS_HEADER_SIZE 8
+#define LZSS_MAX_DISTANCE 4096
+#define LZSS_MIN_MATCH 3
+#define LZSS_MAX_MATCH 18
+
+// - Called with each decompressed byte in order.
+typedef void (*lzss_output_func_ptr_t)(uint8_t byte, void* ctx);
+
+// - Returns the decompressed byte at ofs, which is always within LZSS_MAX_DISTANCE of the output so far. The decoder
+//   keeps no window of its own, so the caller reads it back from wherever the output went.
+typedef uint8_t (*lzss_history_func_ptr_t)(uint32_t ofs, void* ctx);
+
+struct lzss_decoder_s {
+    uint8_t state;
+    uint8_t header_len;
+    uint8_t header[LZSS_HEADER_SIZE];
+    uint8_t flags;
+    uint8_t flags_left;
+    uint8_t match_byte0;
+    uint32_t out_len;
+    uint32_t out_size;
+    lzss_output_func_ptr_t output_cb;
+    lzss_history_func_ptr_t history_cb;
+    void* ctx;
+};
+
+void lzss_decoder_init(struct lzss_decoder_s* decoder, lzss_output_func_ptr_t output_cb, lzss_history_func_ptr_t history_cb, void* ctx);
+
+// - Decompresses len more bytes of the stream, which may be split anywhere. Returns false if the stream is malformed:
+//   bad magic, a match reaching back before the start of the output, or output past the size in the header.
+bool lzss_decoder_feed(struct lzss_decoder_s* decoder, const uint8_t* buf, size_t len);
+
+// - Returns true once the header has been read, after which lzss_decoder_get_output_size is valid.
+bool lzss_decoder_header_complete(const struct lzss_decoder_s* decoder);
+uint32_t lzss_decoder_get_output_size(const struct lzss_decoder_s* decoder);
+
+// - Returns true if the whole of the decompressed output has been produced.
+bool lzss_decoder_finished(const struct lzss_decoder_s* decoder);
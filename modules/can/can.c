@@ -7,6 +7,10 @@
 #include <modules/pubsub/pubsub.h>
 #include <modules/worker_thread/worker_thread.h>
 
+#ifdef MODULE_CAN_CAPTURE_ENABLED
+#include <modules/can_capture/can_capture.h>
+#endif
+
 #ifndef CAN_TRX_WORKER_THREAD
 #error Please define CAN_TRX_WORKER_THREAD in framework_conf.h.
 #endif
@@ -15,15 +19,43 @@
 #error Please define CAN_EXPIRE_WORKER_THREAD in framework_conf.h.
 #endif
 
+#ifndef CAN_STATISTICS_WORKER_THREAD
+#define CAN_STATISTICS_WORKER_THREAD CAN_EXPIRE_WORKER_THREAD
+#endif
+
 #define WT_TRX CAN_TRX_WORKER_THREAD
 #define WT_EXPIRE CAN_EXPIRE_WORKER_THREAD
+#define WT_STATISTICS CAN_STATISTICS_WORKER_THREAD
 WORKER_THREAD_DECLARE_EXTERN(WT_TRX)
 WORKER_THREAD_DECLARE_EXTERN(WT_EXPIRE)
+WORKER_THREAD_DECLARE_EXTERN(WT_STATISTICS)
 
 #ifndef CAN_TX_QUEUE_LEN
 #define CAN_TX_QUEUE_LEN 64
 #endif
 
+#ifndef CAN_TX_TRANSFER_POOL_LEN
+#define CAN_TX_TRANSFER_POOL_LEN 16
+#endif
+
+// Transfer entries that only transfers with a completion topic may use. Multi-frame transfers without one are only tracked
+// so that they can be abandoned as a whole, and must not crowd out transfers whose senders wait on a completion.
+#ifndef CAN_TX_TRANSFER_POOL_COMPLETION_RESERVE
+#define CAN_TX_TRANSFER_POOL_COMPLETION_RESERVE 4
+#endif
+
+#if CAN_TX_TRANSFER_POOL_COMPLETION_RESERVE >= CAN_TX_TRANSFER_POOL_LEN
+#error CAN_TX_TRANSFER_POOL_COMPLETION_RESERVE must be less than CAN_TX_TRANSFER_POOL_LEN
+#endif
+
+#ifndef CAN_BUS_LOAD_BUCKET_INTERVAL_MS
+#define CAN_BUS_LOAD_BUCKET_INTERVAL_MS 100
+#endif
+
+#ifndef CAN_BUS_LOAD_WINDOW_BUCKETS
+#define CAN_BUS_LOAD_WINDOW_BUCKETS 10
+#endif
+
 #define MAX_NUM_TX_MAILBOXES 3
 
 enum can_tx_mailbox_state_t {
@@ -37,6 +69,14 @@ struct can_tx_mailbox_s {
     enum can_tx_mailbox_state_t state;
 };
 
+struct can_tx_transfer_s {
+    struct pubsub_topic_s* completion_topic;
+    systime_t creation_systime;
+    uint8_t num_frames;
+    uint8_t frames_remaining;
+    uint8_t frames_failed;
+};
+
 struct can_instance_s {
     uint8_t idx;
 
@@ -53,6 +93,9 @@ struct can_instance_s {
     uint8_t num_tx_mailboxes;
 
     memory_pool_t frame_pool;
+    size_t frame_pool_free;
+    memory_pool_t transfer_pool;
+    uint8_t transfers_without_completion;
     struct can_tx_queue_s tx_queue;
 
     struct pubsub_topic_s rx_topic;
@@ -62,6 +105,12 @@ struct can_instance_s {
 
     struct worker_thread_timer_task_s expire_timer_task;
 
+    struct can_statistics_s statistics;
+    uint32_t bus_load_bucket_bits[CAN_BUS_LOAD_WINDOW_BUCKETS+1];
+    uint8_t bus_load_bucket_idx;
+    struct pubsub_topic_s statistics_topic;
+    struct worker_thread_timer_task_s statistics_timer_task;
+
     struct can_instance_s* next;
 };
 
@@ -70,10 +119,18 @@ MEMORYPOOL_DECL(can_instance_pool, sizeof(struct can_instance_s), chCoreAllocAli
 static struct can_instance_s* can_instance_list_head;
 
 static void can_expire_handler(struct worker_thread_timer_task_s* task);
+static void can_statistics_handler(struct worker_thread_timer_task_s* task);
 static void can_reschedule_expire_timer_I(struct can_instance_s* instance);
 static void can_reschedule_expire_timer(struct can_instance_s* instance);
 static void can_try_enqueue_waiting_frame_I(struct can_instance_s* instance);
 static void can_try_enqueue_waiting_frame(struct can_instance_s* instance);
+static void can_park_tx_mailboxes_I(struct can_instance_s* instance);
+static struct can_tx_frame_s* can_allocate_tx_frame_I(struct can_instance_s* instance, struct can_tx_quota_s* quota, bool limit_quota);
+static struct can_tx_frame_s* can_allocate_tx_frames_limited_I(struct can_instance_s* instance, struct can_tx_quota_s* quota, size_t num_frames, bool limit_quota);
+static void can_release_tx_frame_I(struct can_instance_s* instance, struct can_tx_frame_s* frame);
+static void can_tx_frame_completed_I(struct can_instance_s* instance, struct can_tx_frame_s* frame, bool success, systime_t completion_systime, uint64_t completion_timestamp_us);
+static void can_abandon_tx_transfer_I(struct can_instance_s* instance, struct can_tx_transfer_s* transfer, systime_t completion_systime, uint64_t completion_timestamp_us);
+static struct pubsub_topic_s* can_tx_frame_release_and_complete_transfer_I(struct can_instance_s* instance, struct can_tx_frame_s* frame, bool success, systime_t completion_systime, uint64_t completion_timestamp_us, struct can_transmit_completion_msg_s* msg);
 
 bool can_iterate_instances(struct can_instance_s** instance_ptr) {
     if (!instance_ptr) {
@@ -108,6 +165,64 @@ struct pubsub_topic_s* can_get_rx_topic(struct can_instance_s* instance) {
     return &instance->rx_topic;
 }
 
+struct pubsub_topic_s* can_get_statistics_topic(struct can_instance_s* instance) {
+    chDbgCheck(instance != NULL);
+    if (!instance) {
+        return NULL;
+    }
+
+    return &instance->statistics_topic;
+}
+
+bool can_get_statistics(struct can_instance_s* instance, struct can_statistics_s* ret) {
+    if (!instance || !ret) {
+        return false;
+    }
+
+    chSysLock();
+    *ret = instance->statistics;
+    chSysUnlock();
+    return true;
+}
+
+uint64_t can_systime_to_timestamp_us_I(systime_t systime) {
+    static systime_t last_systime;
+    static uint64_t last_systime_extended;
+
+    chDbgCheckClassI();
+
+    // Extend to 64 bits relative to the last conversion, so that times slightly in the past also convert correctly. This is only
+    // correct if conversions are less than half the systime range apart - the statistics timer refreshes it while the bus is idle.
+    systime_t ticks_ahead = systime - last_systime;
+    uint64_t systime_extended;
+    if (ticks_ahead <= TIME_INFINITE/2) {
+        systime_extended = last_systime_extended + ticks_ahead;
+        last_systime = systime;
+        last_systime_extended = systime_extended;
+    } else {
+        systime_extended = last_systime_extended - (systime_t)(last_systime - systime);
+    }
+
+    return systime_extended * 1000000 / CH_CFG_ST_FREQUENCY;
+}
+
+uint64_t can_get_timestamp_us_I(struct can_instance_s* instance) {
+    chDbgCheckClassI();
+
+    if (instance && instance->driver_iface->get_timestamp_us_I) {
+        return instance->driver_iface->get_timestamp_us_I(instance->driver_ctx);
+    }
+
+    return can_systime_to_timestamp_us_I(chVTGetSystemTimeX());
+}
+
+uint64_t can_get_timestamp_us(struct can_instance_s* instance) {
+    chSysLock();
+    uint64_t ret = can_get_timestamp_us_I(instance);
+    chSysUnlock();
+    return ret;
+}
+
 uint32_t can_get_baudrate(struct can_instance_s* instance) {
     if (!instance) {
         return 0;
@@ -167,7 +282,7 @@ void can_start_I(struct can_instance_s* instance, bool silent, bool auto_retrans
     }
 
     if (instance->started) {
-        // TODO prevent dropped frames when re-starting CAN driver
+        // Frames in the mailboxes are parked back in the tx queue and resume once the driver is restarted
         can_stop_I(instance);
     }
 
@@ -179,6 +294,8 @@ void can_start_I(struct can_instance_s* instance, bool silent, bool auto_retrans
         instance->baudrate_confirmed = false;
     }
     instance->baudrate = baudrate;
+
+    can_try_enqueue_waiting_frame_I(instance);
 }
 
 void can_start(struct can_instance_s* instance, bool silent, bool auto_retransmit, uint32_t baudrate) {
@@ -188,13 +305,16 @@ void can_start(struct can_instance_s* instance, bool silent, bool auto_retransmi
 }
 
 void can_stop_I(struct can_instance_s* instance) {
+    chDbgCheckClassI();
     if (!instance) {
         return;
     }
 
+    // The driver may still report mailboxes that complete while it stops, which must not load new frames
     if (instance->started) {
+        instance->started = false;
         instance->driver_iface->stop(instance->driver_ctx);
-        instance->started = true;
+        can_park_tx_mailboxes_I(instance);
     }
 }
 
@@ -204,14 +324,74 @@ void can_stop(struct can_instance_s* instance) {
     chSysUnlock();
 }
 
-struct can_tx_frame_s* can_allocate_tx_frame_and_append_I(struct can_instance_s* instance, struct can_tx_frame_s** frame_list) {
+void can_tx_quota_init(struct can_tx_quota_s* quota, uint16_t max_frames) {
+    if (!quota) {
+        return;
+    }
+
+    quota->max_frames = max_frames;
+    quota->frames_in_use = 0;
+    quota->alloc_failures = 0;
+}
+
+size_t can_get_tx_frames_free_I(struct can_instance_s* instance, const struct can_tx_quota_s* quota) {
     chDbgCheckClassI();
-    
-    if (!instance || !frame_list) {
+
+    if (!instance) {
+        return 0;
+    }
+
+    size_t ret = instance->frame_pool_free;
+    if (quota) {
+        ret = MIN(ret, (size_t)(quota->max_frames - MIN(quota->frames_in_use, quota->max_frames)));
+    }
+
+    return ret;
+}
+
+size_t can_get_tx_frames_free(struct can_instance_s* instance, const struct can_tx_quota_s* quota) {
+    chSysLock();
+    size_t ret = can_get_tx_frames_free_I(instance, quota);
+    chSysUnlock();
+    return ret;
+}
+
+static struct can_tx_frame_s* can_allocate_tx_frame_I(struct can_instance_s* instance, struct can_tx_quota_s* quota, bool limit_quota) {
+    chDbgCheckClassI();
+
+    if (quota && limit_quota && quota->frames_in_use >= quota->max_frames) {
+        quota->alloc_failures++;
+        instance->statistics.tx_alloc_failures++;
         return NULL;
     }
     
     struct can_tx_frame_s* new_frame = chPoolAllocI(&instance->frame_pool);
+    if (!new_frame) {
+        if (quota) {
+            quota->alloc_failures++;
+        }
+        instance->statistics.tx_alloc_failures++;
+        return NULL;
+    }
+
+    instance->frame_pool_free--;
+    new_frame->quota = quota;
+    if (quota) {
+        quota->frames_in_use++;
+    }
+    new_frame->next = NULL;
+
+    return new_frame;
+}
+
+struct can_tx_frame_s* can_allocate_tx_frame_and_append_I(struct can_instance_s* instance, struct can_tx_quota_s* quota, struct can_tx_frame_s** frame_list) {
+    chDbgCheckClassI();
+    
+    if (!instance || !frame_list) {
+        return NULL;
+    }
+
+    struct can_tx_frame_s* new_frame = can_allocate_tx_frame_I(instance, quota, true);
     if (!new_frame) {
         return NULL;
     }
@@ -221,28 +401,68 @@ struct can_tx_frame_s* can_allocate_tx_frame_and_append_I(struct can_instance_s*
     return new_frame;
 }
 
-struct can_tx_frame_s* can_allocate_tx_frame_and_append(struct can_instance_s* instance, struct can_tx_frame_s** frame_list) {
+struct can_tx_frame_s* can_allocate_tx_frame_and_append(struct can_instance_s* instance, struct can_tx_quota_s* quota, struct can_tx_frame_s** frame_list) {
     chSysLock();
-    struct can_tx_frame_s* ret = can_allocate_tx_frame_and_append_I(instance, frame_list);
+    struct can_tx_frame_s* ret = can_allocate_tx_frame_and_append_I(instance, quota, frame_list);
     chSysUnlock();
     return ret;
 }
 
-struct can_tx_frame_s* can_allocate_tx_frames(struct can_instance_s* instance, size_t num_frames) {
+static struct can_tx_frame_s* can_allocate_tx_frames_limited_I(struct can_instance_s* instance, struct can_tx_quota_s* quota, size_t num_frames, bool limit_quota) {
+    chDbgCheckClassI();
+
     if (!instance) {
         return NULL;
     }
-    
+
+    // Fail before taking anything from the pool rather than building and then freeing a partial list
+    if (can_get_tx_frames_free_I(instance, limit_quota ? quota : NULL) < num_frames) {
+        if (quota) {
+            quota->alloc_failures++;
+        }
+        instance->statistics.tx_alloc_failures++;
+        return NULL;
+    }
+
     struct can_tx_frame_s* ret = NULL;
+    struct can_tx_frame_s** insert_ptr = &ret;
     for (size_t i=0; i<num_frames; i++) {
-        if (!can_allocate_tx_frame_and_append(instance, &ret)) {
-            can_free_tx_frames(instance, &ret);
+        *insert_ptr = can_allocate_tx_frame_I(instance, quota, limit_quota);
+        if (!*insert_ptr) {
+            while (ret != NULL) {
+                struct can_tx_frame_s* next_frame = ret->next;
+                can_release_tx_frame_I(instance, ret);
+                ret = next_frame;
+            }
             return NULL;
         }
+        insert_ptr = &(*insert_ptr)->next;
     }
     return ret;
 }
 
+struct can_tx_frame_s* can_allocate_tx_frames_I(struct can_instance_s* instance, struct can_tx_quota_s* quota, size_t num_frames) {
+    return can_allocate_tx_frames_limited_I(instance, quota, num_frames, true);
+}
+
+struct can_tx_frame_s* can_allocate_tx_frames(struct can_instance_s* instance, struct can_tx_quota_s* quota, size_t num_frames) {
+    chSysLock();
+    struct can_tx_frame_s* ret = can_allocate_tx_frames_I(instance, quota, num_frames);
+    chSysUnlock();
+    return ret;
+}
+
+struct can_tx_frame_s* can_allocate_tx_frames_over_quota_I(struct can_instance_s* instance, struct can_tx_quota_s* quota, size_t num_frames) {
+    return can_allocate_tx_frames_limited_I(instance, quota, num_frames, false);
+}
+
+struct can_tx_frame_s* can_allocate_tx_frames_over_quota(struct can_instance_s* instance, struct can_tx_quota_s* quota, size_t num_frames) {
+    chSysLock();
+    struct can_tx_frame_s* ret = can_allocate_tx_frames_over_quota_I(instance, quota, num_frames);
+    chSysUnlock();
+    return ret;
+}
+
 void can_enqueue_tx_frames(struct can_instance_s* instance, struct can_tx_frame_s** frame_list, systime_t tx_timeout, struct pubsub_topic_s* completion_topic) {
     if (!instance) {
         return;
@@ -250,17 +470,42 @@ void can_enqueue_tx_frames(struct can_instance_s* instance, struct can_tx_frame_
     
     systime_t t_now = chVTGetSystemTimeX();
 
+    uint8_t num_frames = 0;
+    for (struct can_tx_frame_s* frame = *frame_list; frame != NULL; frame = frame->next) {
+        num_frames++;
+    }
+
+    // The transfer is tracked across all of its frames, so that multi-frame transfers can be abandoned as a whole
+    struct can_tx_transfer_s* transfer = NULL;
+    if (completion_topic || num_frames > 1) {
+        chSysLock();
+        if (completion_topic || instance->transfers_without_completion < CAN_TX_TRANSFER_POOL_LEN-CAN_TX_TRANSFER_POOL_COMPLETION_RESERVE) {
+            transfer = chPoolAllocI(&instance->transfer_pool);
+        }
+        if (transfer) {
+            transfer->completion_topic = completion_topic;
+            transfer->creation_systime = t_now;
+            transfer->num_frames = num_frames;
+            transfer->frames_remaining = num_frames;
+            transfer->frames_failed = 0;
+            if (!completion_topic) {
+                instance->transfers_without_completion++;
+            }
+        } else if (completion_topic) {
+            instance->statistics.tx_completions_dropped++;
+        } else {
+            instance->statistics.tx_transfers_untracked++;
+        }
+        chSysUnlock();
+    }
+
     struct can_tx_frame_s* frame = *frame_list;
     while (frame != NULL) {
         struct can_tx_frame_s* next_frame = frame->next;
 
         frame->creation_systime = t_now;
         frame->tx_timeout = tx_timeout;
-        if (!frame->next) {
-            frame->completion_topic = completion_topic;
-        } else {
-            frame->completion_topic = NULL;
-        }
+        frame->transfer = transfer;
         can_tx_queue_push(&instance->tx_queue, frame);
 
         frame = next_frame;
@@ -277,13 +522,28 @@ void can_free_tx_frames(struct can_instance_s* instance, struct can_tx_frame_s**
         return;
     }
     
-    for (struct can_tx_frame_s* frame = *frame_list; frame != NULL; frame = frame->next) {
-        chPoolFree(&instance->frame_pool, frame);
+    chSysLock();
+    struct can_tx_frame_s* frame = *frame_list;
+    while (frame != NULL) {
+        struct can_tx_frame_s* next_frame = frame->next;
+        can_release_tx_frame_I(instance, frame);
+        frame = next_frame;
     }
+    chSysUnlock();
     
     *frame_list = NULL;
 }
 
+static void can_release_tx_frame_I(struct can_instance_s* instance, struct can_tx_frame_s* frame) {
+    chDbgCheckClassI();
+
+    if (frame->quota) {
+        frame->quota->frames_in_use--;
+    }
+    chPoolFreeI(&instance->frame_pool, frame);
+    instance->frame_pool_free++;
+}
+
 struct can_instance_s* can_driver_register(uint8_t can_idx, void* driver_ctx, const struct can_driver_iface_s* driver_iface, uint8_t num_tx_mailboxes, uint8_t num_rx_mailboxes, uint8_t rx_fifo_depth) {
     if (can_get_instance(can_idx) != NULL) {
         return NULL;
@@ -323,16 +583,34 @@ struct can_instance_s* can_driver_register(uint8_t can_idx, void* driver_ctx, co
     
     chPoolObjectInit(&instance->frame_pool, sizeof(struct can_tx_frame_s), NULL);
     chPoolLoadArray(&instance->frame_pool, tx_queue_mem, CAN_TX_QUEUE_LEN);
+    instance->frame_pool_free = CAN_TX_QUEUE_LEN;
+
+    void* transfer_pool_mem = chCoreAlloc(CAN_TX_TRANSFER_POOL_LEN*sizeof(struct can_tx_transfer_s));
+
+    if (!transfer_pool_mem) {
+        return NULL;
+    }
+
+    chPoolObjectInit(&instance->transfer_pool, sizeof(struct can_tx_transfer_s), NULL);
+    chPoolLoadArray(&instance->transfer_pool, transfer_pool_mem, CAN_TX_TRANSFER_POOL_LEN);
+    instance->transfers_without_completion = 0;
 
     can_tx_queue_init(&instance->tx_queue);
 
+    memset(&instance->statistics, 0, sizeof(instance->statistics));
+    memset(instance->bus_load_bucket_bits, 0, sizeof(instance->bus_load_bucket_bits));
+    instance->bus_load_bucket_idx = 0;
+    pubsub_init_topic(&instance->statistics_topic, NULL);
+
     pubsub_init_topic(&instance->rx_topic, NULL); // TODO specific/configurable topic group
     worker_thread_add_publisher_task(&WT_TRX, &instance->rx_publisher_task, sizeof(struct can_rx_frame_s), num_rx_mailboxes*rx_fifo_depth);
 
-    worker_thread_add_publisher_task(&WT_TRX, &instance->tx_publisher_task, sizeof(struct can_transmit_completion_msg_s), num_tx_mailboxes);
+    worker_thread_add_publisher_task(&WT_TRX, &instance->tx_publisher_task, sizeof(struct can_transmit_completion_msg_s), CAN_TX_TRANSFER_POOL_LEN);
 
     worker_thread_add_timer_task(&WT_EXPIRE, &instance->expire_timer_task, can_expire_handler, instance, TIME_INFINITE, false);
 
+    worker_thread_add_timer_task(&WT_STATISTICS, &instance->statistics_timer_task, can_statistics_handler, instance, MS2ST(CAN_BUS_LOAD_BUCKET_INTERVAL_MS), true);
+
     LINKED_LIST_APPEND(struct can_instance_s, can_instance_list_head, instance);
 
     return instance;
@@ -340,7 +618,11 @@ struct can_instance_s* can_driver_register(uint8_t can_idx, void* driver_ctx, co
 
 static void can_try_enqueue_waiting_frame_I(struct can_instance_s* instance) {
     chDbgCheckClassI();
-    
+
+    if (!instance->started) {
+        return;
+    }
+
     // Enqueue the next frame if it will be the highest priority
     bool have_empty_mailbox = false;
     uint8_t empty_mailbox_idx;
@@ -379,6 +661,35 @@ static void can_try_enqueue_waiting_frame(struct can_instance_s* instance) {
     chSysUnlock();
 }
 
+static void can_park_tx_mailboxes_I(struct can_instance_s* instance) {
+    chDbgCheckClassI();
+
+    // The driver has been stopped and will not report on the mailboxes it left loaded. Pending frames go back to the
+    // front of their priority level in the tx queue, frames that were being aborted have expired and are completed as
+    // failed.
+    for (uint8_t i=0; i < instance->num_tx_mailboxes; i++) {
+        if (instance->tx_mailbox[i].state == CAN_TX_MAILBOX_PENDING) {
+            can_tx_queue_push_ahead_I(&instance->tx_queue, instance->tx_mailbox[i].frame);
+            instance->tx_mailbox[i].state = CAN_TX_MAILBOX_EMPTY;
+        }
+    }
+
+    // Pending frames are parked first, so that abandoning a transfer also removes its frames from the other mailboxes
+    systime_t t_now = chVTGetSystemTimeX();
+    for (uint8_t i=0; i < instance->num_tx_mailboxes; i++) {
+        if (instance->tx_mailbox[i].state == CAN_TX_MAILBOX_ABORTING) {
+            struct can_tx_frame_s* frame = instance->tx_mailbox[i].frame;
+            uint64_t timestamp_us = can_get_timestamp_us_I(instance);
+            instance->tx_mailbox[i].state = CAN_TX_MAILBOX_EMPTY;
+            instance->statistics.tx_failed++;
+            if (frame->transfer) {
+                can_abandon_tx_transfer_I(instance, frame->transfer, t_now, timestamp_us);
+            }
+            can_tx_frame_completed_I(instance, frame, false, t_now, timestamp_us);
+        }
+    }
+}
+
 static void can_reschedule_expire_timer_I(struct can_instance_s* instance) {
     chDbgCheckClassI();
 
@@ -413,22 +724,73 @@ static void can_reschedule_expire_timer(struct can_instance_s* instance) {
     chSysUnlock();
 }
 
-static void can_tx_frame_completed_I(struct can_instance_s* instance, struct can_tx_frame_s* frame, bool success, systime_t completion_systime) {
+// Releases frame and accounts for it in its transfer. Returns the topic to publish msg to if this completed the transfer.
+static struct pubsub_topic_s* can_tx_frame_release_and_complete_transfer_I(struct can_instance_s* instance, struct can_tx_frame_s* frame, bool success, systime_t completion_systime, uint64_t completion_timestamp_us, struct can_transmit_completion_msg_s* msg) {
     chDbgCheckClassI();
 
-    if (frame->completion_topic) {
-        struct can_transmit_completion_msg_s msg = { success, completion_systime };
-        worker_thread_publisher_task_publish_I(&instance->tx_publisher_task, frame->completion_topic, sizeof(struct can_transmit_completion_msg_s), pubsub_copy_writer_func, &msg);
+    struct can_tx_transfer_s* transfer = frame->transfer;
+    can_release_tx_frame_I(instance, frame);
+
+    if (!transfer) {
+        return NULL;
     }
-    chPoolFreeI(&instance->frame_pool, frame);
+
+    if (!success) {
+        transfer->frames_failed++;
+    }
+
+    transfer->frames_remaining--;
+    if (transfer->frames_remaining != 0) {
+        return NULL;
+    }
+
+    struct pubsub_topic_s* completion_topic = transfer->completion_topic;
+    if (completion_topic) {
+        msg->completion_systime = completion_systime;
+        msg->completion_timestamp_us = completion_timestamp_us;
+        msg->transmit_success = transfer->frames_failed == 0;
+        msg->creation_systime = transfer->creation_systime;
+        msg->num_frames = transfer->num_frames;
+        msg->num_frames_failed = transfer->frames_failed;
+    } else {
+        instance->transfers_without_completion--;
+    }
+    chPoolFreeI(&instance->transfer_pool, transfer);
+
+    return completion_topic;
 }
 
-static void can_tx_frame_completed(struct can_instance_s* instance, struct can_tx_frame_s* frame, bool success, systime_t completion_systime) {
-    if (frame->completion_topic) {
-        struct can_transmit_completion_msg_s msg = { success, completion_systime };
-        pubsub_publish_message(frame->completion_topic, sizeof(struct can_transmit_completion_msg_s), pubsub_copy_writer_func, &msg);
+static void can_tx_frame_completed_I(struct can_instance_s* instance, struct can_tx_frame_s* frame, bool success, systime_t completion_systime, uint64_t completion_timestamp_us) {
+    chDbgCheckClassI();
+
+    struct can_transmit_completion_msg_s msg;
+    struct pubsub_topic_s* completion_topic = can_tx_frame_release_and_complete_transfer_I(instance, frame, success, completion_systime, completion_timestamp_us, &msg);
+    if (completion_topic) {
+        if (!worker_thread_publisher_task_publish_I(&instance->tx_publisher_task, completion_topic, sizeof(struct can_transmit_completion_msg_s), pubsub_copy_writer_func, &msg)) {
+            instance->statistics.tx_completions_dropped++;
+        }
+    }
+}
+
+static void can_tx_frame_completed(struct can_instance_s* instance, struct can_tx_frame_s* frame, bool success, systime_t completion_systime, uint64_t completion_timestamp_us) {
+    struct can_transmit_completion_msg_s msg;
+    chSysLock();
+    struct pubsub_topic_s* completion_topic = can_tx_frame_release_and_complete_transfer_I(instance, frame, success, completion_systime, completion_timestamp_us, &msg);
+    chSysUnlock();
+    if (completion_topic) {
+        pubsub_publish_message(completion_topic, sizeof(struct can_transmit_completion_msg_s), pubsub_copy_writer_func, &msg);
+    }
+}
+
+static void can_abandon_tx_transfer_I(struct can_instance_s* instance, struct can_tx_transfer_s* transfer, systime_t completion_systime, uint64_t completion_timestamp_us) {
+    chDbgCheckClassI();
+
+    // The receiver cannot reassemble a transfer with a missing frame, so its remaining queued frames would only waste bus time
+    struct can_tx_frame_s* frame;
+    while ((frame = can_tx_queue_pop_transfer_I(&instance->tx_queue, transfer)) != NULL) {
+        instance->statistics.tx_failed++;
+        can_tx_frame_completed_I(instance, frame, false, completion_systime, completion_timestamp_us);
     }
-    chPoolFree(&instance->frame_pool, frame);
 }
 
 static void can_expire_handler(struct worker_thread_timer_task_s* task) {
@@ -448,7 +810,12 @@ static void can_expire_handler(struct worker_thread_timer_task_s* task) {
     // Abort expired queue items
     struct can_tx_frame_s* frame;
     while ((frame = can_tx_queue_pop_expired(&instance->tx_queue)) != NULL) {
-        can_tx_frame_completed(instance, frame, false, chVTGetSystemTimeX());
+        chSysLock();
+        instance->statistics.tx_expired++;
+        systime_t completion_systime = chVTGetSystemTimeX();
+        uint64_t completion_timestamp_us = can_get_timestamp_us_I(instance);
+        chSysUnlock();
+        can_tx_frame_completed(instance, frame, false, completion_systime, completion_timestamp_us);
     }
 
     can_try_enqueue_waiting_frame(instance);
@@ -456,18 +823,38 @@ static void can_expire_handler(struct worker_thread_timer_task_s* task) {
     can_reschedule_expire_timer(instance);
 }
 
-void can_driver_tx_request_complete_I(struct can_instance_s* instance, uint8_t mb_idx, bool transmit_success, systime_t completion_systime) {
+void can_driver_tx_request_complete_I(struct can_instance_s* instance, uint8_t mb_idx, bool transmit_success, systime_t completion_systime, uint64_t completion_timestamp_us) {
     chDbgCheckClassI();
     chDbgCheck(instance->tx_mailbox[mb_idx].state == CAN_TX_MAILBOX_PENDING || instance->tx_mailbox[mb_idx].state == CAN_TX_MAILBOX_ABORTING);
 
-    can_tx_frame_completed_I(instance, instance->tx_mailbox[mb_idx].frame, transmit_success, completion_systime);
+    struct can_tx_frame_s* frame = instance->tx_mailbox[mb_idx].frame;
+    struct can_tx_transfer_s* transfer = frame->transfer;
+
+    if (transmit_success) {
+        instance->statistics.tx_frames++;
+        instance->bus_load_bucket_bits[instance->bus_load_bucket_idx] += can_get_frame_bit_length_X(&frame->content);
+#ifdef MODULE_CAN_CAPTURE_ENABLED
+        can_capture_frame_I(instance->idx, &frame->content, completion_timestamp_us, true);
+#endif
+    } else {
+        instance->statistics.tx_failed++;
+    }
+
     instance->tx_mailbox[mb_idx].state = CAN_TX_MAILBOX_EMPTY;
 
+    // Abandon the rest of the transfer before completing this frame, so that the transfer outlives the abandoned frames
+    if (!transmit_success && transfer) {
+        can_abandon_tx_transfer_I(instance, transfer, completion_systime, completion_timestamp_us);
+    }
+
+    can_tx_frame_completed_I(instance, frame, transmit_success, completion_systime, completion_timestamp_us);
+
     can_try_enqueue_waiting_frame_I(instance);
 }
 
 struct can_fill_rx_frame_params_s {
     systime_t rx_systime;
+    uint64_t rx_timestamp_us;
     struct can_frame_s* frame;
 };
 
@@ -481,14 +868,95 @@ static void can_fill_rx_frame_I(size_t msg_size, void* msg, void* ctx) {
 
     frame->content = *params->frame;
     frame->rx_systime = params->rx_systime;
+    frame->rx_timestamp_us = params->rx_timestamp_us;
 }
 
-void can_driver_rx_frame_received_I(struct can_instance_s* instance, uint8_t mb_idx, systime_t rx_systime, struct can_frame_s* frame) {
+void can_driver_rx_frame_received_I(struct can_instance_s* instance, uint8_t mb_idx, systime_t rx_systime, uint64_t rx_timestamp_us, struct can_frame_s* frame) {
     (void)mb_idx;
 
     chDbgCheckClassI();
 
-    struct can_fill_rx_frame_params_s can_fill_rx_frame_params = {rx_systime, frame};
-    worker_thread_publisher_task_publish_I(&instance->rx_publisher_task, &instance->rx_topic, sizeof(struct can_rx_frame_s), can_fill_rx_frame_I, &can_fill_rx_frame_params);
+    instance->statistics.rx_frames++;
+    instance->bus_load_bucket_bits[instance->bus_load_bucket_idx] += can_get_frame_bit_length_X(frame);
+#ifdef MODULE_CAN_CAPTURE_ENABLED
+    can_capture_frame_I(instance->idx, frame, rx_timestamp_us, false);
+#endif
+
+    struct can_fill_rx_frame_params_s can_fill_rx_frame_params = {rx_systime, rx_timestamp_us, frame};
+    if (!worker_thread_publisher_task_publish_I(&instance->rx_publisher_task, &instance->rx_topic, sizeof(struct can_rx_frame_s), can_fill_rx_frame_I, &can_fill_rx_frame_params)) {
+        instance->statistics.rx_dropped++;
+    }
     instance->baudrate_confirmed = true;
 }
+
+void can_driver_tx_arbitration_lost_I(struct can_instance_s* instance, uint8_t mb_idx) {
+    (void)mb_idx;
+
+    chDbgCheckClassI();
+
+    instance->statistics.tx_arbitration_lost++;
+}
+
+void can_driver_rx_overrun_I(struct can_instance_s* instance, uint8_t mb_idx) {
+    (void)mb_idx;
+
+    chDbgCheckClassI();
+
+    instance->statistics.rx_overruns++;
+}
+
+void can_driver_error_status_update_I(struct can_instance_s* instance, uint8_t tx_error_counter, uint8_t rx_error_counter, bool error_passive, bool bus_off, uint8_t last_error_code) {
+    chDbgCheckClassI();
+
+    if (bus_off && !instance->statistics.bus_off) {
+        instance->statistics.bus_off_events++;
+    }
+
+    if (last_error_code != CAN_ERROR_CODE_NONE) {
+        instance->statistics.protocol_errors++;
+        instance->statistics.last_error_code = last_error_code;
+    }
+
+    instance->statistics.tx_error_counter = tx_error_counter;
+    instance->statistics.rx_error_counter = rx_error_counter;
+    instance->statistics.error_passive = error_passive;
+    instance->statistics.bus_off = bus_off;
+}
+
+static void can_statistics_handler(struct worker_thread_timer_task_s* task) {
+    struct can_instance_s* instance = worker_thread_task_get_user_context(task);
+
+    chSysLock();
+
+    can_systime_to_timestamp_us_I(chVTGetSystemTimeX());
+
+    // Some error status changes, such as automatic bus-off recovery, are not signalled by the hardware
+    if (instance->started && instance->driver_iface->poll_error_status_I) {
+        instance->driver_iface->poll_error_status_I(instance->driver_ctx);
+    }
+
+    // Close the current bucket and sum the window of completed buckets behind it
+    instance->bus_load_bucket_idx = (instance->bus_load_bucket_idx + 1) % LEN(instance->bus_load_bucket_bits);
+    instance->bus_load_bucket_bits[instance->bus_load_bucket_idx] = 0;
+
+    uint64_t window_bits = 0;
+    for (uint8_t i=0; i<LEN(instance->bus_load_bucket_bits); i++) {
+        window_bits += instance->bus_load_bucket_bits[i];
+    }
+
+    uint64_t window_capacity_bits = (uint64_t)instance->baudrate * CAN_BUS_LOAD_WINDOW_BUCKETS * CAN_BUS_LOAD_BUCKET_INTERVAL_MS / 1000;
+    if (window_capacity_bits > 0) {
+        instance->statistics.bus_load_permille = MIN(window_bits * 1000 / window_capacity_bits, 1000);
+    } else {
+        instance->statistics.bus_load_permille = 0;
+    }
+
+    struct can_statistics_s statistics = instance->statistics;
+    bool bucket_idx_wrapped = instance->bus_load_bucket_idx == 0;
+
+    chSysUnlock();
+
+    if (bucket_idx_wrapped) {
+        pubsub_publish_message(&instance->statistics_topic, sizeof(struct can_statistics_s), pubsub_copy_writer_func, &statistics);
+    }
+}
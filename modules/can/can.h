@@ -8,32 +8,100 @@
 
 struct can_instance_s;
 
+// - Published once per transfer after its last frame has completed. transmit_success is only set if every frame of the
+//   transfer was transmitted.
 struct can_transmit_completion_msg_s {
     systime_t completion_systime;
+    uint64_t completion_timestamp_us;
     bool transmit_success;
+    systime_t creation_systime;
+    uint8_t num_frames;
+    uint8_t num_frames_failed;
+};
+
+enum can_error_code_t {
+    CAN_ERROR_CODE_NONE = 0,
+    CAN_ERROR_CODE_STUFF,
+    CAN_ERROR_CODE_FORM,
+    CAN_ERROR_CODE_ACK,
+    CAN_ERROR_CODE_BIT_RECESSIVE,
+    CAN_ERROR_CODE_BIT_DOMINANT,
+    CAN_ERROR_CODE_CRC
+};
+
+struct can_statistics_s {
+    uint32_t tx_frames;
+    uint32_t tx_failed;
+    uint32_t tx_expired;
+    uint32_t tx_alloc_failures;
+    uint32_t tx_completions_dropped;
+    uint32_t tx_transfers_untracked; // multi-frame transfers without a completion topic that had no transfer entry, and won't be abandoned as a whole if a frame fails
+    uint32_t tx_arbitration_lost;
+    uint32_t rx_frames;
+    uint32_t rx_overruns; // frames lost in the controller's receive FIFO
+    uint32_t rx_dropped; // frames lost because the receive publisher queue was full
+    uint32_t protocol_errors;
+    uint32_t bus_off_events;
+    uint8_t tx_error_counter;
+    uint8_t rx_error_counter;
+    uint8_t last_error_code; // enum can_error_code_t
+    bool error_passive;
+    bool bus_off;
+    uint16_t bus_load_permille; // measured over the last CAN_BUS_LOAD_WINDOW_BUCKETS*CAN_BUS_LOAD_BUCKET_INTERVAL_MS
 };
 
 struct can_instance_s* can_get_instance(uint8_t can_idx);
 
 bool can_iterate_instances(struct can_instance_s** instance_ptr);
 
+// - Starts the driver, or reconfigures it if already started. Frames the driver leaves loaded in its mailboxes when it
+//   stops are requeued and transmitted after the restart rather than dropped. Frames it completes while stopping, as the
+//   virtual driver does, are not.
 void can_start_I(struct can_instance_s* instance, bool silent, bool auto_retransmit, uint32_t baudrate);
 void can_start(struct can_instance_s* instance, bool silent, bool auto_retransmit, uint32_t baudrate);
 
+// - Stops the driver. Queued frames are kept until they expire or the driver is started again.
 void can_stop_I(struct can_instance_s* instance);
 void can_stop(struct can_instance_s* instance);
 
 struct pubsub_topic_s* can_get_rx_topic(struct can_instance_s* instance);
 
+// - Returns a topic on which a struct can_statistics_s is published once per bus load window.
+struct pubsub_topic_s* can_get_statistics_topic(struct can_instance_s* instance);
+bool can_get_statistics(struct can_instance_s* instance, struct can_statistics_s* ret);
+
+// - Returns the current time in the timebase of rx_timestamp_us and completion_timestamp_us. This is the driver's high
+//   resolution clock if it provides one, otherwise the system time.
+uint64_t can_get_timestamp_us_I(struct can_instance_s* instance);
+uint64_t can_get_timestamp_us(struct can_instance_s* instance);
+
 void can_set_silent_mode(struct can_instance_s* instance, bool silent);
 void can_set_auto_retransmit_mode(struct can_instance_s* instance, bool auto_retransmit);
 void can_set_baudrate(struct can_instance_s* instance, uint32_t baudrate);
 uint32_t can_get_baudrate(struct can_instance_s* instance);
 bool can_get_baudrate_confirmed(struct can_instance_s* instance);
 
-struct can_tx_frame_s* can_allocate_tx_frame_and_append_I(struct can_instance_s* instance, struct can_tx_frame_s** frame_list);
-struct can_tx_frame_s* can_allocate_tx_frame_and_append(struct can_instance_s* instance, struct can_tx_frame_s** frame_list);
-struct can_tx_frame_s* can_allocate_tx_frames(struct can_instance_s* instance, size_t num_frames);
+void can_tx_quota_init(struct can_tx_quota_s* quota, uint16_t max_frames);
+
+// - Returns the number of tx frames that can currently be allocated against quota, which may be NULL. Callers can check
+//   this before serializing a transfer rather than discovering mid-way that the frame pool is exhausted.
+size_t can_get_tx_frames_free_I(struct can_instance_s* instance, const struct can_tx_quota_s* quota);
+size_t can_get_tx_frames_free(struct can_instance_s* instance, const struct can_tx_quota_s* quota);
+
+// - Allocation fails if the frame pool is empty or quota (which may be NULL) is used up. Frames count against quota until
+//   they are completed or freed.
+struct can_tx_frame_s* can_allocate_tx_frame_and_append_I(struct can_instance_s* instance, struct can_tx_quota_s* quota, struct can_tx_frame_s** frame_list);
+struct can_tx_frame_s* can_allocate_tx_frame_and_append(struct can_instance_s* instance, struct can_tx_quota_s* quota, struct can_tx_frame_s** frame_list);
+// - Allocates num_frames linked frames in one go, or none at all.
+struct can_tx_frame_s* can_allocate_tx_frames_I(struct can_instance_s* instance, struct can_tx_quota_s* quota, size_t num_frames);
+struct can_tx_frame_s* can_allocate_tx_frames(struct can_instance_s* instance, struct can_tx_quota_s* quota, size_t num_frames);
+// - As can_allocate_tx_frames, but the frames count against quota without being limited by it. For a transfer larger
+//   than its quota, which its source admits only while the quota has no frames in use.
+struct can_tx_frame_s* can_allocate_tx_frames_over_quota_I(struct can_instance_s* instance, struct can_tx_quota_s* quota, size_t num_frames);
+struct can_tx_frame_s* can_allocate_tx_frames_over_quota(struct can_instance_s* instance, struct can_tx_quota_s* quota, size_t num_frames);
+// - Queues frame_list as a single transfer. If completion_topic is not NULL, one struct can_transmit_completion_msg_s is
+//   published to it once all frames have been transmitted, failed or expired. A failed frame abandons the frames of its
+//   transfer that are still queued.
 void can_enqueue_tx_frames(struct can_instance_s* instance, struct can_tx_frame_s** frame_list, systime_t tx_timeout, struct pubsub_topic_s* completion_topic);
 void can_free_tx_frames(struct can_instance_s* instance, struct can_tx_frame_s** frame_list);
 
@@ -8,14 +8,22 @@ typedef bool (*driver_mailbox_abort_t)(void* ctx, uint8_t mb_idx);
 typedef bool (*driver_load_tx_mailbox_t)(void* ctx, uint8_t mb_idx, struct can_frame_s* frame);
 typedef bool (*driver_pop_rx_frame_t)(void* ctx, uint8_t mb_idx, struct can_frame_s* frame);
 typedef bool (*driver_rx_frame_available_t)(void* ctx, uint8_t mb_idx);
+typedef uint64_t (*driver_get_timestamp_us_t)(void* ctx);
+typedef void (*driver_poll_error_status_t)(void* ctx);
 
 struct can_driver_iface_s {
     driver_start_t start;
     driver_stop_t stop;
     driver_mailbox_abort_t abort_tx_mailbox_I;
     driver_load_tx_mailbox_t load_tx_mailbox_I;
+    driver_get_timestamp_us_t get_timestamp_us_I; // optional - may be NULL to use the system time
+    driver_poll_error_status_t poll_error_status_I; // optional - may be NULL if every error status change raises an interrupt
 };
 
 struct can_instance_s* can_driver_register(uint8_t can_idx, void* driver_ctx, const struct can_driver_iface_s* driver_iface, uint8_t num_tx_mailboxes, uint8_t num_rx_mailboxes, uint8_t rx_fifo_depth);
-void can_driver_tx_request_complete_I(struct can_instance_s* instance, uint8_t mb_idx, bool transmit_success, systime_t completion_systime);
-void can_driver_rx_frame_received_I(struct can_instance_s* instance, uint8_t mb_idx, systime_t rx_systime, struct can_frame_s* frame);
+uint64_t can_systime_to_timestamp_us_I(systime_t systime);
+void can_driver_tx_request_complete_I(struct can_instance_s* instance, uint8_t mb_idx, bool transmit_success, systime_t completion_systime, uint64_t completion_timestamp_us);
+void can_driver_tx_arbitration_lost_I(struct can_instance_s* instance, uint8_t mb_idx);
+void can_driver_rx_overrun_I(struct can_instance_s* instance, uint8_t mb_idx);
+void can_driver_error_status_update_I(struct can_instance_s* instance, uint8_t tx_error_counter, uint8_t rx_error_counter, bool error_passive, bool bus_off, uint8_t last_error_code);
+void can_driver_rx_frame_received_I(struct can_instance_s* instance, uint8_t mb_idx, systime_t rx_systime, uint64_t rx_timestamp_us, struct can_frame_s* frame);
@@ -24,12 +24,23 @@ struct can_frame_s {
 struct can_rx_frame_s {
     struct can_frame_s content;
     systime_t rx_systime;
+    uint64_t rx_timestamp_us;
 };
 
+// - Limits the number of tx frames a source may hold at once, so that one source cannot exhaust the shared frame pool.
+struct can_tx_quota_s {
+    uint16_t max_frames;
+    uint16_t frames_in_use;
+    uint32_t alloc_failures;
+};
+
+struct can_tx_transfer_s;
+
 struct can_tx_frame_s {
     struct can_frame_s content;
     systime_t creation_systime;
     systime_t tx_timeout;
-    struct pubsub_topic_s* completion_topic;
+    struct can_tx_transfer_s* transfer;
+    struct can_tx_quota_s* quota;
     struct can_tx_frame_s* next;
 };
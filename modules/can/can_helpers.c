@@ -1,4 +1,5 @@
 #include "can_helpers.h"
+#include <common/helpers.h>
 
 bool can_tx_frame_expired_X(struct can_tx_frame_s* frame) {
     return chVTGetSystemTimeX() - frame->creation_systime > frame->tx_timeout;
@@ -14,7 +15,9 @@ systime_t can_tx_frame_time_until_expire_X(struct can_tx_frame_s* frame, systime
         return TIME_IMMEDIATE;
     }
 
-    return frame->tx_timeout - time_elapsed;
+    // can_tx_frame_expired_X only holds once more than tx_timeout has elapsed. Returning 0 at exactly tx_timeout would
+    // run the expire handler again without anything having expired, for as long as the system time stays on that tick.
+    return frame->tx_timeout - time_elapsed + 1;
 }
 
 can_frame_priority_t can_get_frame_priority_X(const struct can_frame_s* frame) {
@@ -37,3 +40,14 @@ can_frame_priority_t can_get_frame_priority_X(const struct can_frame_s* frame) {
 can_frame_priority_t can_get_tx_frame_priority_X(const struct can_tx_frame_s* frame) {
     return can_get_frame_priority_X(&frame->content);
 }
+
+uint32_t can_get_frame_bit_length_X(const struct can_frame_s* frame) {
+    // Nominal frame length from SOF through interframe space, excluding stuff bits
+    uint32_t ret = frame->IDE ? 67 : 47;
+
+    if (!frame->RTR) {
+        ret += 8*MIN(frame->DLC, 8);
+    }
+
+    return ret;
+}
@@ -140,6 +140,23 @@ struct can_tx_frame_s* can_tx_queue_pop_expired(struct can_tx_queue_s* instance)
     return ret;
 }
 
+struct can_tx_frame_s* can_tx_queue_pop_transfer_I(struct can_tx_queue_s* instance, const struct can_tx_transfer_s* transfer) {
+    chDbgCheckClassI();
+
+    struct can_tx_frame_s* ret = NULL;
+    struct can_tx_frame_s** frame_ptr = &instance->head;
+    while (*frame_ptr && (*frame_ptr)->transfer != transfer) {
+        frame_ptr = &(*frame_ptr)->next;
+    }
+
+    if (*frame_ptr) {
+        ret = *frame_ptr;
+        *frame_ptr = (*frame_ptr)->next;
+    }
+
+    return ret;
+}
+
 #if CH_DBG_ENABLE_CHECKS
 static bool can_tx_queue_frame_exists_in_queue(struct can_tx_queue_s* instance, struct can_tx_frame_s* check_frame) {
     struct can_tx_frame_s* frame = NULL;
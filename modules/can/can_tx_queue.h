@@ -25,4 +25,6 @@ void can_tx_queue_pop(struct can_tx_queue_s* instance);
 struct can_tx_frame_s* can_tx_queue_pop_expired_I(struct can_tx_queue_s* instance);
 struct can_tx_frame_s* can_tx_queue_pop_expired(struct can_tx_queue_s* instance);
 
+struct can_tx_frame_s* can_tx_queue_pop_transfer_I(struct can_tx_queue_s* instance, const struct can_tx_transfer_s* transfer);
+
 void can_tx_queue_remove_I(struct can_tx_queue_s* instance, struct can_tx_frame_s* frame);
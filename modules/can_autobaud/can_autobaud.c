@@ -17,14 +17,32 @@
 #define WT CAN_AUTOBAUD_WORKER_THREAD
 WORKER_THREAD_DECLARE_EXTERN(WT)
 
+// Each candidate baudrate is sampled in short windows. Once CAN_AUTOBAUD_ERROR_THRESHOLD protocol errors have been seen at a
+// candidate without a valid frame, the candidate is wrong and the next one is tried straight away. A single error may just be
+// noise on a bus running at the candidate baudrate. A quiet bus gives no evidence either way, so the candidate is kept for up to
+// CAN_AUTOBAUD_SWITCH_INTERVAL_US before moving on.
+#ifndef CAN_AUTOBAUD_SAMPLE_INTERVAL_US
+#define CAN_AUTOBAUD_SAMPLE_INTERVAL_US 20000
+#endif
+
+#ifndef CAN_AUTOBAUD_SWITCH_INTERVAL_US
 #define CAN_AUTOBAUD_SWITCH_INTERVAL_US 1000000
+#endif
+
+#ifndef CAN_AUTOBAUD_ERROR_THRESHOLD
+#define CAN_AUTOBAUD_ERROR_THRESHOLD 4
+#endif
 
 static const uint32_t valid_baudrates[] = {1000000, 500000, 250000, 125000};
 
 static uint8_t baudrate_idx = 0;
+static uint32_t baudrate_dwell_us;
+static uint32_t candidate_start_protocol_errors;
 static void autobaud_timer_task_func(struct worker_thread_timer_task_s* task);
+static uint32_t get_unconfirmed_protocol_errors(void);
 static struct worker_thread_timer_task_s autobaud_timer_task;
 
+#if defined(MODULE_APP_DESCRIPTOR_ENABLED) || defined(MODULE_BOOT_MSG_ENABLED)
 static bool is_baudrate_valid(uint32_t baudrate) {
     for (uint8_t i=0; i<LEN(valid_baudrates); i++) {
         if (baudrate == valid_baudrates[i]) {
@@ -33,6 +51,7 @@ static bool is_baudrate_valid(uint32_t baudrate) {
     }
     return false;
 }
+#endif
 
 RUN_AFTER(CAN_INIT) {
     uint32_t canbus_baud = 1000000;
@@ -70,25 +89,61 @@ RUN_AFTER(CAN_INIT) {
     }
 
     if (canbus_autobaud_enable) {
-        worker_thread_add_timer_task(&WT, &autobaud_timer_task, autobaud_timer_task_func, NULL, LL_US2ST(CAN_AUTOBAUD_SWITCH_INTERVAL_US), false);
+        baudrate_dwell_us = 0;
+        candidate_start_protocol_errors = get_unconfirmed_protocol_errors();
+        worker_thread_add_timer_task(&WT, &autobaud_timer_task, autobaud_timer_task_func, NULL, LL_US2ST(CAN_AUTOBAUD_SAMPLE_INTERVAL_US), false);
     }
 }
 
-static void autobaud_timer_task_func(struct worker_thread_timer_task_s* task) {
-    baudrate_idx = (baudrate_idx + 1) % LEN(valid_baudrates);
+static uint32_t get_unconfirmed_protocol_errors(void) {
+    uint32_t ret = 0;
+    struct can_instance_s* can_instance = NULL;
+    while (can_iterate_instances(&can_instance)) {
+        struct can_statistics_s statistics;
+        if (!can_get_baudrate_confirmed(can_instance) && can_get_statistics(can_instance, &statistics)) {
+            ret += statistics.protocol_errors;
+        }
+    }
+    return ret;
+}
 
+static void autobaud_timer_task_func(struct worker_thread_timer_task_s* task) {
+    // Instances are confirmed by the CAN driver as soon as a valid frame is received
     bool autobaud_complete = true;
     struct can_instance_s* can_instance = NULL;
     while (can_iterate_instances(&can_instance)) {
         if (can_get_baudrate_confirmed(can_instance)) {
             can_set_silent_mode(can_instance, false);
         } else {
-            can_set_baudrate(can_instance, valid_baudrates[baudrate_idx]);
             autobaud_complete = false;
         }
     }
 
-    if (!autobaud_complete) {
-        worker_thread_timer_task_reschedule(&WT, task, LL_US2ST(CAN_AUTOBAUD_SWITCH_INTERVAL_US));
+    if (autobaud_complete) {
+        return;
+    }
+
+    // The sum drops if an instance has been confirmed since the candidate was selected
+    uint32_t protocol_errors = get_unconfirmed_protocol_errors();
+    if (protocol_errors < candidate_start_protocol_errors) {
+        candidate_start_protocol_errors = protocol_errors;
     }
+    bool error_threshold_reached = protocol_errors - candidate_start_protocol_errors >= CAN_AUTOBAUD_ERROR_THRESHOLD;
+    baudrate_dwell_us += CAN_AUTOBAUD_SAMPLE_INTERVAL_US;
+
+    if (error_threshold_reached || baudrate_dwell_us >= CAN_AUTOBAUD_SWITCH_INTERVAL_US) {
+        baudrate_idx = (baudrate_idx + 1) % LEN(valid_baudrates);
+        baudrate_dwell_us = 0;
+
+        can_instance = NULL;
+        while (can_iterate_instances(&can_instance)) {
+            if (!can_get_baudrate_confirmed(can_instance)) {
+                can_set_baudrate(can_instance, valid_baudrates[baudrate_idx]);
+            }
+        }
+
+        candidate_start_protocol_errors = get_unconfirmed_protocol_errors();
+    }
+
+    worker_thread_timer_task_reschedule(&WT, task, LL_US2ST(CAN_AUTOBAUD_SAMPLE_INTERVAL_US));
 }
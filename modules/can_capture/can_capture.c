@@ -0,0 +1,88 @@
+#include "can_capture.h"
+#include <common/helpers.h>
+#include <string.h>
+#include <ch.h>
+
+#ifndef CAN_CAPTURE_BUFFER_RECORDS
+#define CAN_CAPTURE_BUFFER_RECORDS 128
+#endif
+
+#ifndef CAN_CAPTURE_READ_RECORDS_PER_LOCK
+#define CAN_CAPTURE_READ_RECORDS_PER_LOCK 8
+#endif
+
+#ifndef CAN_CAPTURE_ENABLED_AT_BOOT
+#define CAN_CAPTURE_ENABLED_AT_BOOT TRUE
+#endif
+
+static struct can_capture_record_s capture_buffer[CAN_CAPTURE_BUFFER_RECORDS];
+static size_t capture_head;
+static size_t capture_count;
+static uint32_t capture_dropped_count;
+static bool capture_enabled = CAN_CAPTURE_ENABLED_AT_BOOT;
+
+void can_capture_frame_I(uint8_t can_idx, const struct can_frame_s* frame, uint64_t timestamp_us, bool tx) {
+    chDbgCheckClassI();
+
+    if (!capture_enabled) {
+        return;
+    }
+
+    if (capture_count == CAN_CAPTURE_BUFFER_RECORDS) {
+        capture_dropped_count++;
+        return;
+    }
+
+    size_t idx = capture_head + capture_count;
+    if (idx >= CAN_CAPTURE_BUFFER_RECORDS) {
+        idx -= CAN_CAPTURE_BUFFER_RECORDS;
+    }
+
+    struct can_capture_record_s* record = &capture_buffer[idx];
+    record->timestamp_us = timestamp_us;
+    record->id = frame->IDE ? frame->EID : frame->SID;
+    record->can_idx = can_idx;
+    record->flags = (frame->IDE ? CAN_CAPTURE_FLAG_IDE : 0) | (frame->RTR ? CAN_CAPTURE_FLAG_RTR : 0) | (tx ? CAN_CAPTURE_FLAG_TX : 0);
+    record->dlc = frame->DLC;
+    record->reserved = 0;
+    memcpy(record->data, frame->data, 8);
+
+    capture_count++;
+}
+
+size_t can_capture_read(struct can_capture_record_s* records, size_t max_records) {
+    if (!records) {
+        return 0;
+    }
+
+    size_t ret = 0;
+    while (ret < max_records) {
+        // Copy in short contiguous runs to bound the time spent in the critical section
+        chSysLock();
+        size_t copy_count = MIN(MIN(capture_count, CAN_CAPTURE_BUFFER_RECORDS - capture_head), MIN(max_records - ret, CAN_CAPTURE_READ_RECORDS_PER_LOCK));
+        memcpy(&records[ret], &capture_buffer[capture_head], copy_count*sizeof(struct can_capture_record_s));
+        capture_head = (capture_head + copy_count) % CAN_CAPTURE_BUFFER_RECORDS;
+        capture_count -= copy_count;
+        chSysUnlock();
+
+        if (copy_count == 0) {
+            break;
+        }
+        ret += copy_count;
+    }
+
+    return ret;
+}
+
+void can_capture_set_enabled(bool enabled) {
+    chSysLock();
+    capture_enabled = enabled;
+    chSysUnlock();
+}
+
+uint32_t can_capture_get_dropped_count(void) {
+    chSysLock();
+    uint32_t ret = capture_dropped_count;
+    chSysUnlock();
+    return ret;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <modules/can/can_frame_types.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define CAN_CAPTURE_FLAG_IDE (1<<0)
+#define CAN_CAPTURE_FLAG_RTR (1<<1)
+#define CAN_CAPTURE_FLAG_TX (1<<2)
+
+// Records are little-endian and read out back-to-back; can_capture_convert.py converts a file of them to pcap or candump
+struct __attribute__((packed)) can_capture_record_s {
+    uint64_t timestamp_us;
+    uint32_t id;
+    uint8_t can_idx;
+    uint8_t flags;
+    uint8_t dlc;
+    uint8_t reserved;
+    uint8_t data[8];
+};
+
+// - Called by the can module for every frame received and every frame successfully transmitted. If the ring is full the
+//   frame is dropped and counted, so that the records that are read out stay contiguous.
+void can_capture_frame_I(uint8_t can_idx, const struct can_frame_s* frame, uint64_t timestamp_us, bool tx);
+
+// - Moves up to max_records of the oldest records out of the ring. Returns the number of records copied.
+size_t can_capture_read(struct can_capture_record_s* records, size_t max_records);
+
+void can_capture_set_enabled(bool enabled);
+uint32_t can_capture_get_dropped_count(void);
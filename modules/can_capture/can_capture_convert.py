@@ -0,0 +1,78 @@
+#!/usr/bin/env python
+# Converts a file of struct can_capture_record_s, as read out with can_capture_read(), to pcap or candump log format.
+import argparse
+import struct
+import sys
+
+RECORD_FMT = "<QIBBBB8s"
+RECORD_LEN = struct.calcsize(RECORD_FMT)
+
+CAN_CAPTURE_FLAG_IDE = 1<<0
+CAN_CAPTURE_FLAG_RTR = 1<<1
+CAN_CAPTURE_FLAG_TX = 1<<2
+
+LINKTYPE_CAN_SOCKETCAN = 227
+CAN_EFF_FLAG = 0x80000000
+CAN_RTR_FLAG = 0x40000000
+
+def read_records(f):
+    while True:
+        data = f.read(RECORD_LEN)
+        if len(data) < RECORD_LEN:
+            return
+        timestamp_us, can_id, can_idx, flags, dlc, _, payload = struct.unpack(RECORD_FMT, data)
+        yield timestamp_us, can_id, can_idx, flags, min(dlc, 8), payload
+
+def write_pcap(records, out):
+    out.write(struct.pack("<IHHiIII", 0xa1b2c3d4, 2, 4, 0, 0, 16, LINKTYPE_CAN_SOCKETCAN))
+    for timestamp_us, can_id, can_idx, flags, dlc, payload in records:
+        if flags & CAN_CAPTURE_FLAG_IDE:
+            can_id |= CAN_EFF_FLAG
+        if flags & CAN_CAPTURE_FLAG_RTR:
+            can_id |= CAN_RTR_FLAG
+        # SocketCAN frame header is in network byte order for this link type
+        frame = struct.pack(">IB3x8s", can_id, dlc, payload)
+        out.write(struct.pack("<IIII", timestamp_us // 1000000, timestamp_us % 1000000, len(frame), len(frame)))
+        out.write(frame)
+
+def write_candump(records, out, interface_prefix):
+    for timestamp_us, can_id, can_idx, flags, dlc, payload in records:
+        if flags & CAN_CAPTURE_FLAG_IDE:
+            id_str = "%08X" % (can_id,)
+        else:
+            id_str = "%03X" % (can_id,)
+        if flags & CAN_CAPTURE_FLAG_RTR:
+            data_str = "R"
+        else:
+            data_str = "".join("%02X" % (b,) for b in bytearray(payload[:dlc]))
+        line = "(%u.%06u) %s%u %s#%s\n" % (timestamp_us // 1000000, timestamp_us % 1000000, interface_prefix, can_idx, id_str, data_str)
+        out.write(line.encode('ascii'))
+
+parser = argparse.ArgumentParser(description='Convert a can_capture dump to pcap or candump log format')
+parser.add_argument('input', help='file of raw can_capture records')
+parser.add_argument('output', help='output file, or - for stdout')
+parser.add_argument('--format', choices=['pcap', 'candump'], default='pcap')
+parser.add_argument('--direction', choices=['all', 'rx', 'tx'], default='all')
+parser.add_argument('--interface-prefix', default='can', help='candump interface name prefix, followed by the CAN index')
+args = parser.parse_args()
+
+with open(args.input, 'rb') as f:
+    records = list(read_records(f))
+
+if args.direction == 'rx':
+    records = [r for r in records if not r[3] & CAN_CAPTURE_FLAG_TX]
+elif args.direction == 'tx':
+    records = [r for r in records if r[3] & CAN_CAPTURE_FLAG_TX]
+
+if args.output == '-':
+    out = getattr(sys.stdout, 'buffer', sys.stdout)
+else:
+    out = open(args.output, 'wb')
+
+if args.format == 'pcap':
+    write_pcap(records, out)
+else:
+    write_candump(records, out, args.interface_prefix)
+
+if out is not getattr(sys.stdout, 'buffer', sys.stdout):
+    out.close()
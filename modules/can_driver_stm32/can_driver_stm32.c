@@ -1,6 +1,7 @@
 #include <common/ctor.h>
 #include <hal.h>
 #include <modules/can/can_driver.h>
+#include <modules/can/can.h>
 
 #if !defined(CAN1) && defined(CAN)
 #define CAN1 CAN
@@ -15,6 +16,10 @@
 #undef CAN_BTR_SJW
 #define CAN_BTR_SJW(n) ((n) << 24)
 
+#ifndef CAN_DRIVER_STM32_USE_DWT_TIMESTAMP
+#define CAN_DRIVER_STM32_USE_DWT_TIMESTAMP FALSE
+#endif
+
 #define NUM_TX_MAILBOXES 3
 #define NUM_RX_MAILBOXES 2
 #define RX_FIFO_DEPTH 3
@@ -23,12 +28,22 @@ static void can_driver_stm32_start(void* ctx, bool silent, bool auto_retransmit,
 static void can_driver_stm32_stop(void* ctx);
 bool can_driver_stm32_abort_tx_mailbox_I(void* ctx, uint8_t mb_idx);
 bool can_driver_stm32_load_tx_mailbox_I(void* ctx, uint8_t mb_idx, struct can_frame_s* frame);
+#if CAN_DRIVER_STM32_USE_DWT_TIMESTAMP
+static uint64_t can_driver_stm32_get_timestamp_us_I(void* ctx);
+#endif
+static void can_driver_stm32_poll_error_status_I(void* ctx);
 
 static const struct can_driver_iface_s can_driver_stm32_iface = {
     can_driver_stm32_start,
     can_driver_stm32_stop,
     can_driver_stm32_abort_tx_mailbox_I,
     can_driver_stm32_load_tx_mailbox_I,
+#if CAN_DRIVER_STM32_USE_DWT_TIMESTAMP
+    can_driver_stm32_get_timestamp_us_I,
+#else
+    NULL,
+#endif
+    can_driver_stm32_poll_error_status_I,
 };
 
 struct can_driver_stm32_instance_s {
@@ -38,16 +53,52 @@ struct can_driver_stm32_instance_s {
 
 static struct can_driver_stm32_instance_s can1_instance;
 
+#if CAN_DRIVER_STM32_USE_DWT_TIMESTAMP
+// The 32-bit cycle counter wraps in under a minute, so it is extended to 64 bits on every read and at least once per second
+static uint32_t dwt_last_cyccnt;
+static uint64_t dwt_cycles;
+static virtual_timer_t dwt_extend_timer;
+
+static void can_driver_stm32_dwt_extend_timer_cb(void* ctx) {
+    chSysLockFromISR();
+    can_driver_stm32_get_timestamp_us_I(ctx);
+    chVTSetI(&dwt_extend_timer, S2ST(1), can_driver_stm32_dwt_extend_timer_cb, ctx);
+    chSysUnlockFromISR();
+}
+#endif
+
 RUN_ON(CAN_INIT) {
+#if CAN_DRIVER_STM32_USE_DWT_TIMESTAMP
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+    dwt_last_cyccnt = DWT->CYCCNT;
+    chVTObjectInit(&dwt_extend_timer);
+    chVTSet(&dwt_extend_timer, S2ST(1), can_driver_stm32_dwt_extend_timer_cb, NULL);
+#endif
+
     // TODO make this index configurable and enable multiple instances
     can1_instance.can = CAN1;
     can1_instance.frontend = can_driver_register(0, &can1_instance, &can_driver_stm32_iface, NUM_TX_MAILBOXES, NUM_RX_MAILBOXES, RX_FIFO_DEPTH);
 }
 
+#if CAN_DRIVER_STM32_USE_DWT_TIMESTAMP
+static uint64_t can_driver_stm32_get_timestamp_us_I(void* ctx) {
+    (void)ctx;
+
+    uint32_t cyccnt = DWT->CYCCNT;
+    dwt_cycles += (uint32_t)(cyccnt - dwt_last_cyccnt);
+    dwt_last_cyccnt = cyccnt;
+
+    return dwt_cycles / (STM32_HCLK / 1000000);
+}
+#endif
+
 static void can_driver_stm32_start(void* ctx, bool silent, bool auto_retransmit, uint32_t baudrate) {
     struct can_driver_stm32_instance_s* instance = ctx;
 
+    // Start from reset, so that nothing from before the last stop is left in the mailboxes or interrupt flags
     rccEnableCAN1(FALSE);
+    rccResetCAN1();
 
     instance->can->FMR = (instance->can->FMR & 0xFFFF0000) | CAN_FMR_FINIT;
     instance->can->sFilterRegister[0].FR1 = 0;
@@ -118,12 +169,34 @@ static void can_driver_stm32_start(void* ctx, bool silent, bool auto_retransmit,
 
     instance->can->MCR = CAN_MCR_ABOM | CAN_MCR_AWUM | (auto_retransmit?0:CAN_MCR_NART);
 
-    instance->can->IER = CAN_IER_TMEIE | CAN_IER_FMPIE0; // TODO: review reference manual for other interrupt flags needed
+    instance->can->IER = CAN_IER_TMEIE | CAN_IER_FMPIE0 | CAN_IER_FOVIE0 | CAN_IER_EWGIE | CAN_IER_EPVIE | CAN_IER_BOFIE | CAN_IER_LECIE | CAN_IER_ERRIE;
 }
 
 static void can_driver_stm32_stop(void* ctx) {
     struct can_driver_stm32_instance_s* instance = ctx;
 
+    // The frontend parks the frames in its mailboxes for the next start, so they must not stay loaded here as well. A frame
+    // that is already on the bus can't be aborted, and is reported once it has gone out so that it isn't sent twice.
+    const uint32_t tme_mask = CAN_TSR_TME0 | CAN_TSR_TME1 | CAN_TSR_TME2;
+    instance->can->TSR = CAN_TSR_ABRQ0 | CAN_TSR_ABRQ1 | CAN_TSR_ABRQ2;
+    while ((instance->can->TSR & tme_mask) != tme_mask) {
+        __asm__("nop");
+    }
+
+    const uint32_t rqcp[NUM_TX_MAILBOXES] = {CAN_TSR_RQCP0, CAN_TSR_RQCP1, CAN_TSR_RQCP2};
+    const uint32_t txok[NUM_TX_MAILBOXES] = {CAN_TSR_TXOK0, CAN_TSR_TXOK1, CAN_TSR_TXOK2};
+    systime_t t_now = chVTGetSystemTimeX();
+    uint64_t timestamp_us = can_get_timestamp_us_I(instance->frontend);
+    for (uint8_t i=0; i<NUM_TX_MAILBOXES; i++) {
+        uint32_t tsr = instance->can->TSR;
+        if ((tsr & rqcp[i]) != 0) {
+            if ((tsr & txok[i]) != 0) {
+                can_driver_tx_request_complete_I(instance->frontend, i, true, t_now, timestamp_us);
+            }
+            instance->can->TSR = rqcp[i];
+        }
+    }
+
     instance->can->MCR = 0x00010002;
     instance->can->IER = 0x00000000;
 
@@ -188,6 +261,15 @@ static void can_driver_stm32_retreive_rx_frame_I(struct can_frame_s* frame, CAN_
 
 static void stm32_can_rx_handler(struct can_driver_stm32_instance_s* instance) {
     systime_t rx_systime = chVTGetSystemTimeX();
+
+    chSysLockFromISR();
+    uint64_t rx_timestamp_us = can_get_timestamp_us_I(instance->frontend);
+    if ((instance->can->RF0R & CAN_RF0R_FOVR0) != 0) {
+        can_driver_rx_overrun_I(instance->frontend, 0);
+        instance->can->RF0R = CAN_RF0R_FOVR0;
+    }
+    chSysUnlockFromISR();
+
     while (true) {
         chSysLockFromISR();
         if ((instance->can->RF0R & CAN_RF0R_FMP0) == 0) {
@@ -196,7 +278,7 @@ static void stm32_can_rx_handler(struct can_driver_stm32_instance_s* instance) {
         }
         struct can_frame_s frame;
         can_driver_stm32_retreive_rx_frame_I(&frame, &instance->can->sFIFOMailBox[0]);
-        can_driver_rx_frame_received_I(instance->frontend, 0, rx_systime, &frame);
+        can_driver_rx_frame_received_I(instance->frontend, 0, rx_systime, rx_timestamp_us, &frame);
         instance->can->RF0R = CAN_RF0R_RFOM0;
         chSysUnlockFromISR();
     }
@@ -209,7 +291,7 @@ static void stm32_can_rx_handler(struct can_driver_stm32_instance_s* instance) {
         }
         struct can_frame_s frame;
         can_driver_stm32_retreive_rx_frame_I(&frame, &instance->can->sFIFOMailBox[1]);
-        can_driver_rx_frame_received_I(instance->frontend, 1, rx_systime, &frame);
+        can_driver_rx_frame_received_I(instance->frontend, 1, rx_systime, rx_timestamp_us, &frame);
         instance->can->RF1R = CAN_RF1R_RFOM1;
         chSysUnlockFromISR();
     }
@@ -219,23 +301,65 @@ static void stm32_can_tx_handler(struct can_driver_stm32_instance_s* instance) {
     systime_t t_now = chVTGetSystemTimeX();
 
     chSysLockFromISR();
+    uint64_t timestamp_us = can_get_timestamp_us_I(instance->frontend);
+
+    if ((instance->can->TSR & (CAN_TSR_RQCP0|CAN_TSR_ALST0)) == (CAN_TSR_RQCP0|CAN_TSR_ALST0)) {
+        can_driver_tx_arbitration_lost_I(instance->frontend, 0);
+    }
+    if ((instance->can->TSR & (CAN_TSR_RQCP1|CAN_TSR_ALST1)) == (CAN_TSR_RQCP1|CAN_TSR_ALST1)) {
+        can_driver_tx_arbitration_lost_I(instance->frontend, 1);
+    }
+    if ((instance->can->TSR & (CAN_TSR_RQCP2|CAN_TSR_ALST2)) == (CAN_TSR_RQCP2|CAN_TSR_ALST2)) {
+        can_driver_tx_arbitration_lost_I(instance->frontend, 2);
+    }
+
     if ((instance->can->TSR & CAN_TSR_RQCP0) != 0) {
-        can_driver_tx_request_complete_I(instance->frontend, 0, (instance->can->TSR & CAN_TSR_TXOK0) != 0, t_now);
+        can_driver_tx_request_complete_I(instance->frontend, 0, (instance->can->TSR & CAN_TSR_TXOK0) != 0, t_now, timestamp_us);
         instance->can->TSR = CAN_TSR_RQCP0;
     }
 
     if ((instance->can->TSR & CAN_TSR_RQCP1) != 0) {
-        can_driver_tx_request_complete_I(instance->frontend, 1, (instance->can->TSR & CAN_TSR_TXOK1) != 0, t_now);
+        can_driver_tx_request_complete_I(instance->frontend, 1, (instance->can->TSR & CAN_TSR_TXOK1) != 0, t_now, timestamp_us);
         instance->can->TSR = CAN_TSR_RQCP1;
     }
 
     if ((instance->can->TSR & CAN_TSR_RQCP2) != 0) {
-        can_driver_tx_request_complete_I(instance->frontend, 2, (instance->can->TSR & CAN_TSR_TXOK2) != 0, t_now);
+        can_driver_tx_request_complete_I(instance->frontend, 2, (instance->can->TSR & CAN_TSR_TXOK2) != 0, t_now, timestamp_us);
         instance->can->TSR = CAN_TSR_RQCP2;
     }
     chSysUnlockFromISR();
 }
 
+static void can_driver_stm32_report_error_status_I(struct can_driver_stm32_instance_s* instance, uint32_t esr, uint8_t last_error_code) {
+    uint8_t tec = (esr & CAN_ESR_TEC) >> 16;
+    uint8_t rec = (esr & CAN_ESR_REC) >> 24;
+
+    can_driver_error_status_update_I(instance->frontend, tec, rec, (esr & CAN_ESR_EPVF) != 0, (esr & CAN_ESR_BOFF) != 0, last_error_code);
+}
+
+// With automatic bus-off management, leaving bus-off raises no interrupt. LEC is left to the SCE handler so that protocol errors
+// are not counted twice.
+static void can_driver_stm32_poll_error_status_I(void* ctx) {
+    struct can_driver_stm32_instance_s* instance = ctx;
+
+    chDbgCheckClassI();
+
+    can_driver_stm32_report_error_status_I(instance, instance->can->ESR, CAN_ERROR_CODE_NONE);
+}
+
+static void stm32_can_sce_handler(struct can_driver_stm32_instance_s* instance) {
+    chSysLockFromISR();
+    uint32_t esr = instance->can->ESR;
+    uint8_t lec = (esr & CAN_ESR_LEC) >> 4;
+
+    // LEC value 7 is reserved for software use - set it so that the next update from hardware is detected
+    instance->can->ESR = CAN_ESR_LEC;
+    instance->can->MSR = CAN_MSR_ERRI;
+
+    can_driver_stm32_report_error_status_I(instance, esr, lec == 7 ? 0 : lec);
+    chSysUnlockFromISR();
+}
+
 OSAL_IRQ_HANDLER(STM32_CAN1_TX_HANDLER) {
     OSAL_IRQ_PROLOGUE();
 
@@ -251,3 +375,11 @@ OSAL_IRQ_HANDLER(STM32_CAN1_RX0_HANDLER) {
 
     OSAL_IRQ_EPILOGUE();
 }
+
+OSAL_IRQ_HANDLER(STM32_CAN1_SCE_HANDLER) {
+    OSAL_IRQ_PROLOGUE();
+
+    stm32_can_sce_handler(&can1_instance);
+
+    OSAL_IRQ_EPILOGUE();
+}
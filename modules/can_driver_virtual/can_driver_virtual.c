@@ -0,0 +1,474 @@
+#include "can_driver_virtual.h"
+#include <common/ctor.h>
+#include <common/helpers.h>
+#include <modules/can/can.h>
+#include <modules/can/can_helpers.h>
+#include <string.h>
+
+#ifndef CAN_DRIVER_VIRTUAL_NUM_NODES
+#define CAN_DRIVER_VIRTUAL_NUM_NODES 1
+#endif
+
+#ifndef CAN_DRIVER_VIRTUAL_BUS_BAUDRATE
+#define CAN_DRIVER_VIRTUAL_BUS_BAUDRATE 1000000
+#endif
+
+#define NUM_RX_MAILBOXES 1
+#define RX_FIFO_DEPTH 8
+
+// Bus-off recovery takes 128 occurrences of 11 recessive bits
+#define BUS_OFF_RECOVERY_BITS (128*11)
+
+static void can_driver_virtual_start(void* ctx, bool silent, bool auto_retransmit, uint32_t baudrate);
+static void can_driver_virtual_stop(void* ctx);
+static bool can_driver_virtual_abort_tx_mailbox_I(void* ctx, uint8_t mb_idx);
+static bool can_driver_virtual_load_tx_mailbox_I(void* ctx, uint8_t mb_idx, struct can_frame_s* frame);
+static void can_driver_virtual_poll_error_status_I(void* ctx);
+
+static void can_driver_virtual_bus_kick_I(struct can_driver_virtual_bus_s* bus);
+static void can_driver_virtual_frame_timer_cb(void* ctx);
+
+static const struct can_driver_iface_s can_driver_virtual_iface = {
+    can_driver_virtual_start,
+    can_driver_virtual_stop,
+    can_driver_virtual_abort_tx_mailbox_I,
+    can_driver_virtual_load_tx_mailbox_I,
+    NULL,
+    can_driver_virtual_poll_error_status_I,
+};
+
+static struct can_driver_virtual_bus_s default_bus;
+static struct can_driver_virtual_node_s default_nodes[CAN_DRIVER_VIRTUAL_NUM_NODES];
+
+RUN_ON(CAN_INIT) {
+    can_driver_virtual_bus_init(&default_bus, CAN_DRIVER_VIRTUAL_BUS_BAUDRATE);
+
+    for (uint8_t i=0; i<CAN_DRIVER_VIRTUAL_NUM_NODES; i++) {
+        can_driver_virtual_attach(&default_bus, &default_nodes[i], i);
+    }
+}
+
+struct can_driver_virtual_bus_s* can_driver_virtual_get_default_bus(void) {
+    return &default_bus;
+}
+
+void can_driver_virtual_bus_init(struct can_driver_virtual_bus_s* bus, uint32_t baudrate) {
+    if (!bus) {
+        return;
+    }
+
+    memset(bus, 0, sizeof(struct can_driver_virtual_bus_s));
+    bus->baudrate = baudrate;
+    chVTObjectInit(&bus->frame_timer);
+}
+
+void can_driver_virtual_bus_set_baudrate(struct can_driver_virtual_bus_s* bus, uint32_t baudrate) {
+    if (!bus) {
+        return;
+    }
+
+    chSysLock();
+    bus->baudrate = baudrate;
+    chSysUnlock();
+}
+
+void can_driver_virtual_bus_set_error_inject_cb(struct can_driver_virtual_bus_s* bus, can_driver_virtual_error_inject_func_ptr error_inject_cb, void* ctx) {
+    if (!bus) {
+        return;
+    }
+
+    chSysLock();
+    bus->error_inject_cb = error_inject_cb;
+    bus->error_inject_ctx = ctx;
+    chSysUnlock();
+}
+
+struct can_instance_s* can_driver_virtual_attach(struct can_driver_virtual_bus_s* bus, struct can_driver_virtual_node_s* node, uint8_t can_idx) {
+    if (!bus || !node) {
+        return NULL;
+    }
+
+    memset(node, 0, sizeof(struct can_driver_virtual_node_s));
+    node->bus = bus;
+
+    node->frontend = can_driver_register(can_idx, node, &can_driver_virtual_iface, CAN_DRIVER_VIRTUAL_NUM_TX_MAILBOXES, NUM_RX_MAILBOXES, RX_FIFO_DEPTH);
+    if (!node->frontend) {
+        return NULL;
+    }
+
+    chSysLock();
+    LINKED_LIST_APPEND(struct can_driver_virtual_node_s, bus->node_list_head, node);
+    chSysUnlock();
+
+    return node->frontend;
+}
+
+static void can_driver_virtual_start(void* ctx, bool silent, bool auto_retransmit, uint32_t baudrate) {
+    struct can_driver_virtual_node_s* node = ctx;
+
+    node->silent = silent;
+    node->auto_retransmit = auto_retransmit;
+    node->baudrate = baudrate;
+    node->tx_error_counter = 0;
+    node->rx_error_counter = 0;
+    node->bus_off = false;
+    node->started = true;
+}
+
+static void can_driver_virtual_stop(void* ctx) {
+    struct can_driver_virtual_node_s* node = ctx;
+
+    node->started = false;
+
+    // A frame that is on the bus is cut short; the bus stays busy until its scheduled end
+    if (node->bus->transmitting_node == node) {
+        node->bus->transmitting_node = NULL;
+    }
+
+    // Every frame still in a mailbox, including one cut short on the bus, is completed as failed
+    systime_t t_now = chVTGetSystemTimeX();
+    for (uint8_t i=0; i<CAN_DRIVER_VIRTUAL_NUM_TX_MAILBOXES; i++) {
+        node->tx_mailbox_abort_requested[i] = false;
+        if (node->tx_mailbox_pending[i]) {
+            node->tx_mailbox_pending[i] = false;
+            can_driver_tx_request_complete_I(node->frontend, i, false, t_now, can_systime_to_timestamp_us_I(t_now));
+        }
+    }
+}
+
+static bool can_driver_virtual_abort_tx_mailbox_I(void* ctx, uint8_t mb_idx) {
+    struct can_driver_virtual_node_s* node = ctx;
+
+    chDbgCheckClassI();
+
+    if (mb_idx >= CAN_DRIVER_VIRTUAL_NUM_TX_MAILBOXES || !node->tx_mailbox_pending[mb_idx]) {
+        return false;
+    }
+
+    // Like bxCAN, the abort completes asynchronously and a frame already on the bus is only aborted if it fails
+    node->tx_mailbox_abort_requested[mb_idx] = true;
+    can_driver_virtual_bus_kick_I(node->bus);
+    return true;
+}
+
+static bool can_driver_virtual_load_tx_mailbox_I(void* ctx, uint8_t mb_idx, struct can_frame_s* frame) {
+    struct can_driver_virtual_node_s* node = ctx;
+
+    chDbgCheckClassI();
+
+    if (mb_idx >= CAN_DRIVER_VIRTUAL_NUM_TX_MAILBOXES) {
+        return false;
+    }
+
+    node->tx_mailbox[mb_idx] = *frame;
+    node->tx_mailbox_abort_requested[mb_idx] = false;
+    node->tx_mailbox_pending[mb_idx] = true;
+
+    can_driver_virtual_bus_kick_I(node->bus);
+    return true;
+}
+
+static bool can_driver_virtual_node_on_bus(struct can_driver_virtual_node_s* node) {
+    return node->started && node->baudrate == node->bus->baudrate;
+}
+
+static bool can_driver_virtual_node_can_transmit(struct can_driver_virtual_node_s* node) {
+    return can_driver_virtual_node_on_bus(node) && !node->silent && !node->bus_off;
+}
+
+static void can_driver_virtual_node_report_error_status_I(struct can_driver_virtual_node_s* node, enum can_error_code_t error_code) {
+    chDbgCheckClassI();
+
+    bool error_passive = node->tx_error_counter > 127 || node->rx_error_counter > 127;
+    can_driver_error_status_update_I(node->frontend, MIN(node->tx_error_counter, 255), node->rx_error_counter, error_passive, node->bus_off, error_code);
+}
+
+// Error counter rules follow the CAN fault confinement rules, simplified to one event per frame
+static void can_driver_virtual_node_tx_error_I(struct can_driver_virtual_node_s* node, enum can_error_code_t error_code, systime_t t_now) {
+    chDbgCheckClassI();
+
+    // An error passive transmitter does not count acknowledgement errors, so a node alone on the bus never goes bus-off
+    if (error_code != CAN_ERROR_CODE_ACK || node->tx_error_counter <= 127) {
+        node->tx_error_counter += 8;
+    }
+
+    if (node->tx_error_counter > 255) {
+        node->bus_off = true;
+        node->bus_off_systime = t_now;
+    }
+
+    can_driver_virtual_node_report_error_status_I(node, error_code);
+}
+
+static void can_driver_virtual_node_tx_success_I(struct can_driver_virtual_node_s* node) {
+    chDbgCheckClassI();
+
+    if (node->tx_error_counter > 0) {
+        node->tx_error_counter--;
+        can_driver_virtual_node_report_error_status_I(node, CAN_ERROR_CODE_NONE);
+    }
+}
+
+static void can_driver_virtual_node_rx_error_I(struct can_driver_virtual_node_s* node, enum can_error_code_t error_code) {
+    chDbgCheckClassI();
+
+    if (node->rx_error_counter < 255) {
+        node->rx_error_counter++;
+    }
+
+    can_driver_virtual_node_report_error_status_I(node, error_code);
+}
+
+static void can_driver_virtual_node_rx_success_I(struct can_driver_virtual_node_s* node) {
+    chDbgCheckClassI();
+
+    if (node->rx_error_counter > 127) {
+        node->rx_error_counter = 127;
+    } else if (node->rx_error_counter > 0) {
+        node->rx_error_counter--;
+    } else {
+        return;
+    }
+
+    can_driver_virtual_node_report_error_status_I(node, CAN_ERROR_CODE_NONE);
+}
+
+// Mirrors the automatic bus-off management the STM32 driver enables
+static void can_driver_virtual_node_try_recover_I(struct can_driver_virtual_node_s* node, systime_t t_now) {
+    chDbgCheckClassI();
+
+    if (!node->bus_off || node->bus->baudrate == 0) {
+        return;
+    }
+
+    systime_t recovery_ticks = (systime_t)(((uint64_t)BUS_OFF_RECOVERY_BITS * CH_CFG_ST_FREQUENCY + node->bus->baudrate - 1) / node->bus->baudrate);
+    if ((systime_t)(t_now - node->bus_off_systime) >= recovery_ticks) {
+        node->bus_off = false;
+        node->tx_error_counter = 0;
+        node->rx_error_counter = 0;
+        can_driver_virtual_node_report_error_status_I(node, CAN_ERROR_CODE_NONE);
+    }
+}
+
+// Recovery is otherwise only evaluated when the bus is serviced, which does not happen while it is idle
+static void can_driver_virtual_poll_error_status_I(void* ctx) {
+    struct can_driver_virtual_node_s* node = ctx;
+
+    chDbgCheckClassI();
+
+    if (!node->started) {
+        return;
+    }
+
+    can_driver_virtual_node_try_recover_I(node, chVTGetSystemTimeX());
+    can_driver_virtual_node_report_error_status_I(node, CAN_ERROR_CODE_NONE);
+}
+
+static void can_driver_virtual_bus_arm_timer_I(struct can_driver_virtual_bus_s* bus, systime_t delay) {
+    chDbgCheckClassI();
+
+    if (chVTIsArmedI(&bus->frame_timer)) {
+        chVTResetI(&bus->frame_timer);
+    }
+    chVTSetI(&bus->frame_timer, MAX(delay, 1), can_driver_virtual_frame_timer_cb, bus);
+}
+
+static systime_t can_driver_virtual_bus_get_frame_end_systime(struct can_driver_virtual_bus_s* bus) {
+    return bus->frame_start_systime + (systime_t)((bus->frame_end_tick_frac + bus->baudrate - 1) / bus->baudrate);
+}
+
+// Arbitrates between all pending mailboxes of all nodes and puts the winner on the bus. If the bus was idle, the frame starts at
+// t_idle_start, otherwise it follows the previous frame back-to-back.
+static bool can_driver_virtual_bus_start_next_frame_I(struct can_driver_virtual_bus_s* bus, systime_t t_idle_start) {
+    chDbgCheckClassI();
+
+    struct can_driver_virtual_node_s* winner = NULL;
+    uint8_t winner_mb_idx = 0;
+    can_frame_priority_t winner_prio = 0;
+
+    for (struct can_driver_virtual_node_s* node = bus->node_list_head; node != NULL; node = node->next) {
+        if (!can_driver_virtual_node_can_transmit(node)) {
+            continue;
+        }
+
+        for (uint8_t i=0; i<CAN_DRIVER_VIRTUAL_NUM_TX_MAILBOXES; i++) {
+            if (!node->tx_mailbox_pending[i] || node->tx_mailbox_abort_requested[i]) {
+                continue;
+            }
+
+            can_frame_priority_t prio = can_get_frame_priority_X(&node->tx_mailbox[i]);
+            if (!winner || prio > winner_prio) {
+                winner = node;
+                winner_mb_idx = i;
+                winner_prio = prio;
+            }
+        }
+    }
+
+    if (!winner || bus->baudrate == 0) {
+        bus->frame_in_progress = false;
+        return false;
+    }
+
+    // Every other node that contended for the bus lost arbitration
+    for (struct can_driver_virtual_node_s* node = bus->node_list_head; node != NULL; node = node->next) {
+        if (node == winner || !can_driver_virtual_node_can_transmit(node)) {
+            continue;
+        }
+
+        for (uint8_t i=0; i<CAN_DRIVER_VIRTUAL_NUM_TX_MAILBOXES; i++) {
+            if (node->tx_mailbox_pending[i] && !node->tx_mailbox_abort_requested[i]) {
+                can_driver_tx_arbitration_lost_I(node->frontend, i);
+            }
+        }
+    }
+
+    if (!bus->frame_in_progress) {
+        bus->frame_start_systime = t_idle_start;
+        bus->frame_end_tick_frac = 0;
+    }
+
+    uint32_t frame_bits = can_get_frame_bit_length_X(&winner->tx_mailbox[winner_mb_idx]);
+    bus->frame_end_tick_frac += (uint64_t)frame_bits * CH_CFG_ST_FREQUENCY;
+    bus->bits_transmitted += frame_bits;
+    bus->transmitting_node = winner;
+    bus->transmitting_mb_idx = winner_mb_idx;
+    bus->frame_in_progress = true;
+
+    return true;
+}
+
+static void can_driver_virtual_bus_complete_frame_I(struct can_driver_virtual_bus_s* bus, systime_t t_end) {
+    chDbgCheckClassI();
+
+    struct can_driver_virtual_node_s* tx_node = bus->transmitting_node;
+    uint8_t mb_idx = bus->transmitting_mb_idx;
+    bus->transmitting_node = NULL;
+
+    if (!tx_node) {
+        return;
+    }
+
+    const struct can_frame_s* frame = &tx_node->tx_mailbox[mb_idx];
+
+    bool corrupted = bus->error_inject_cb && bus->error_inject_cb(frame, bus->error_inject_ctx);
+
+    // Silent nodes receive but do not acknowledge
+    bool acked = false;
+    for (struct can_driver_virtual_node_s* node = bus->node_list_head; node != NULL; node = node->next) {
+        if (node != tx_node && can_driver_virtual_node_can_transmit(node)) {
+            acked = true;
+        }
+    }
+
+    for (struct can_driver_virtual_node_s* node = bus->node_list_head; node != NULL; node = node->next) {
+        if (node == tx_node || !node->started) {
+            continue;
+        }
+
+        if (!can_driver_virtual_node_on_bus(node)) {
+            // Nodes sampling at the wrong bit rate see the frame as a stream of stuff and form errors
+            can_driver_virtual_node_rx_error_I(node, CAN_ERROR_CODE_STUFF);
+        } else if (corrupted) {
+            can_driver_virtual_node_rx_error_I(node, CAN_ERROR_CODE_CRC);
+        } else if (acked) {
+            struct can_frame_s rx_frame = *frame;
+            can_driver_rx_frame_received_I(node->frontend, 0, t_end, can_systime_to_timestamp_us_I(t_end), &rx_frame);
+            can_driver_virtual_node_rx_success_I(node);
+        }
+    }
+
+    if (corrupted) {
+        bus->frames_corrupted++;
+        can_driver_virtual_node_tx_error_I(tx_node, CAN_ERROR_CODE_FORM, t_end);
+    } else if (acked) {
+        bus->frames_completed++;
+        can_driver_virtual_node_tx_success_I(tx_node);
+    } else {
+        can_driver_virtual_node_tx_error_I(tx_node, CAN_ERROR_CODE_ACK, t_end);
+    }
+
+    if (!corrupted && acked) {
+        tx_node->tx_mailbox_pending[mb_idx] = false;
+        can_driver_tx_request_complete_I(tx_node->frontend, mb_idx, true, t_end, can_systime_to_timestamp_us_I(t_end));
+    } else if (!tx_node->auto_retransmit || tx_node->tx_mailbox_abort_requested[mb_idx] || tx_node->bus_off) {
+        tx_node->tx_mailbox_pending[mb_idx] = false;
+        can_driver_tx_request_complete_I(tx_node->frontend, mb_idx, false, t_end, can_systime_to_timestamp_us_I(t_end));
+    }
+}
+
+// Fails aborted mailboxes and mailboxes of nodes that cannot reach the bus (silent, bus-off or configured to another baudrate)
+static void can_driver_virtual_bus_fail_untransmittable_I(struct can_driver_virtual_bus_s* bus, systime_t t_now) {
+    chDbgCheckClassI();
+
+    for (struct can_driver_virtual_node_s* node = bus->node_list_head; node != NULL; node = node->next) {
+        can_driver_virtual_node_try_recover_I(node, t_now);
+
+        bool can_transmit = can_driver_virtual_node_can_transmit(node);
+
+        for (uint8_t i=0; i<CAN_DRIVER_VIRTUAL_NUM_TX_MAILBOXES; i++) {
+            if (!node->tx_mailbox_pending[i] || (node == bus->transmitting_node && i == bus->transmitting_mb_idx)) {
+                continue;
+            }
+
+            if (node->tx_mailbox_abort_requested[i] || !can_transmit) {
+                node->tx_mailbox_pending[i] = false;
+                can_driver_tx_request_complete_I(node->frontend, i, false, t_now, can_systime_to_timestamp_us_I(t_now));
+            }
+        }
+    }
+}
+
+static void can_driver_virtual_bus_service_I(struct can_driver_virtual_bus_s* bus) {
+    chDbgCheckClassI();
+
+    systime_t t_now = chVTGetSystemTimeX();
+
+    while (bus->frame_in_progress) {
+        systime_t t_end = can_driver_virtual_bus_get_frame_end_systime(bus);
+        if ((systime_t)(t_now - bus->frame_start_systime) < (systime_t)(t_end - bus->frame_start_systime)) {
+            can_driver_virtual_bus_arm_timer_I(bus, t_end - t_now);
+            return;
+        }
+
+        can_driver_virtual_bus_complete_frame_I(bus, t_end);
+
+        // Carry the sub-tick remainder into the next frame so that bus timing does not drift
+        uint64_t whole_ticks = bus->frame_end_tick_frac / bus->baudrate;
+        bus->frame_start_systime += (systime_t)whole_ticks;
+        bus->frame_end_tick_frac -= whole_ticks * bus->baudrate;
+
+        can_driver_virtual_bus_fail_untransmittable_I(bus, t_end);
+        can_driver_virtual_bus_start_next_frame_I(bus, t_end);
+    }
+
+    can_driver_virtual_bus_fail_untransmittable_I(bus, t_now);
+
+    if (!bus->frame_in_progress && can_driver_virtual_bus_start_next_frame_I(bus, t_now)) {
+        can_driver_virtual_bus_arm_timer_I(bus, can_driver_virtual_bus_get_frame_end_systime(bus) - t_now);
+    }
+}
+
+static void can_driver_virtual_bus_kick_I(struct can_driver_virtual_bus_s* bus) {
+    chDbgCheckClassI();
+
+    if (bus->frame_in_progress || chVTIsArmedI(&bus->frame_timer)) {
+        return;
+    }
+
+    systime_t t_now = chVTGetSystemTimeX();
+    if (can_driver_virtual_bus_start_next_frame_I(bus, t_now)) {
+        can_driver_virtual_bus_arm_timer_I(bus, can_driver_virtual_bus_get_frame_end_systime(bus) - t_now);
+    } else {
+        // Completions are only ever reported from the timer, never from within a driver call
+        can_driver_virtual_bus_arm_timer_I(bus, 1);
+    }
+}
+
+static void can_driver_virtual_frame_timer_cb(void* ctx) {
+    struct can_driver_virtual_bus_s* bus = ctx;
+
+    chSysLockFromISR();
+    can_driver_virtual_bus_service_I(bus);
+    chSysUnlockFromISR();
+}
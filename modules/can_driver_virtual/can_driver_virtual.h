@@ -0,0 +1,57 @@
+#pragma once
+
+#include <modules/can/can_driver.h>
+#include <ch.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#define CAN_DRIVER_VIRTUAL_NUM_TX_MAILBOXES 3
+
+struct can_driver_virtual_node_s;
+
+// - Called with the system locked for every frame that completes on the bus. Returning true corrupts the frame: no node
+//   receives it and the transmitter sees an error, which is retried if the transmitter has auto retransmit enabled.
+typedef bool (*can_driver_virtual_error_inject_func_ptr)(const struct can_frame_s* frame, void* ctx);
+
+struct can_driver_virtual_bus_s {
+    uint32_t baudrate;
+    virtual_timer_t frame_timer;
+    bool frame_in_progress;
+    struct can_driver_virtual_node_s* transmitting_node;
+    uint8_t transmitting_mb_idx;
+    systime_t frame_start_systime;
+    uint64_t frame_end_tick_frac; // end of the current frame relative to frame_start_systime, in units of 1/baudrate ticks
+    can_driver_virtual_error_inject_func_ptr error_inject_cb;
+    void* error_inject_ctx;
+    uint32_t frames_completed;
+    uint32_t frames_corrupted;
+    uint64_t bits_transmitted;
+    struct can_driver_virtual_node_s* node_list_head;
+};
+
+struct can_driver_virtual_node_s {
+    struct can_instance_s* frontend;
+    struct can_driver_virtual_bus_s* bus;
+    bool started;
+    bool silent;
+    bool auto_retransmit;
+    uint32_t baudrate;
+    uint16_t tx_error_counter;
+    uint8_t rx_error_counter;
+    bool bus_off;
+    systime_t bus_off_systime;
+    struct can_frame_s tx_mailbox[CAN_DRIVER_VIRTUAL_NUM_TX_MAILBOXES];
+    bool tx_mailbox_pending[CAN_DRIVER_VIRTUAL_NUM_TX_MAILBOXES];
+    bool tx_mailbox_abort_requested[CAN_DRIVER_VIRTUAL_NUM_TX_MAILBOXES];
+    struct can_driver_virtual_node_s* next;
+};
+
+// - Initializes an in-memory bus running at baudrate. Nodes only exchange frames with the bus while configured to the same baudrate.
+void can_driver_virtual_bus_init(struct can_driver_virtual_bus_s* bus, uint32_t baudrate);
+void can_driver_virtual_bus_set_baudrate(struct can_driver_virtual_bus_s* bus, uint32_t baudrate);
+void can_driver_virtual_bus_set_error_inject_cb(struct can_driver_virtual_bus_s* bus, can_driver_virtual_error_inject_func_ptr error_inject_cb, void* ctx);
+
+// - Attaches node to bus and registers it with the CAN frontend as can_idx. Returns the frontend instance, or NULL on failure.
+struct can_instance_s* can_driver_virtual_attach(struct can_driver_virtual_bus_s* bus, struct can_driver_virtual_node_s* node, uint8_t can_idx);
+
+struct can_driver_virtual_bus_s* can_driver_virtual_get_default_bus(void);
@@ -1,23 +1,89 @@
 #include "flash_journal.h"
 #include <modules/flash/flash.h>
 #include <common/helpers.h>
+#include <string.h>
 
 #define FLASH_JOURNAL_ALIGNMENT 2
 #define FLASH_JOURNAL_ENTRY_HEADER_SIZE sizeof(struct flash_journal_entry_s)
+#define FLASH_JOURNAL_SECTOR_MAGIC 0x4a46
+
+enum flash_journal_sector_state_t {
+    FLASH_JOURNAL_SECTOR_STATE_NEEDS_ERASE = 0,
+    FLASH_JOURNAL_SECTOR_STATE_ERASED,
+    FLASH_JOURNAL_SECTOR_STATE_OPEN
+};
+
+// First entry of every sector, written as soon as it has been erased
+struct __attribute__((packed)) flash_journal_sector_header_s {
+    uint16_t magic;
+    uint16_t format_version;
+    uint32_t erase_count;
+};
+
+// Second entry of a sector, written when it becomes the newest. Sectors are ordered by it.
+struct __attribute__((packed)) flash_journal_sector_seq_s {
+    uint32_t seq;
+};
 
 static uint16_t flash_journal_entry_compute_crc16(const struct flash_journal_entry_s* entry);
-static bool flash_journal_entry_valid(struct flash_journal_instance_s* instance, const struct flash_journal_entry_s* entry);
-static bool flash_journal_address_in_bounds(struct flash_journal_instance_s* instance, const void* address);
-static bool flash_journal_range_in_bounds(struct flash_journal_instance_s* instance, const void* address, uint32_t len);
+static bool flash_journal_page_entry_valid(const void* flash_page_ptr, size_t flash_page_size, const struct flash_journal_entry_s* entry);
+static bool flash_journal_page_range_in_bounds(const void* flash_page_ptr, size_t flash_page_size, const void* address, size_t len);
+static bool flash_journal_range_blank(const void* address, size_t len);
 static size_t flash_journal_entry_size(uint8_t len);
+static const struct flash_journal_entry_s* flash_journal_next_entry(const struct flash_journal_entry_s* entry);
+static struct flash_journal_entry_s* flash_journal_sector_first_entry(const struct flash_journal_sector_s* sector);
+static bool flash_journal_sector_contains(const struct flash_journal_sector_s* sector, const void* address);
+static bool flash_journal_sector_has_room(const struct flash_journal_sector_s* sector, size_t entry_size);
+static struct flash_journal_sector_s* flash_journal_get_head_sector(struct flash_journal_instance_s* instance);
+static uint8_t flash_journal_get_num_unopened_sectors(struct flash_journal_instance_s* instance);
+static void flash_journal_scan_sector(struct flash_journal_instance_s* instance, uint8_t sector_idx);
+static bool flash_journal_erase_sector(struct flash_journal_instance_s* instance, uint8_t sector_idx);
+static bool flash_journal_open_next_sector(struct flash_journal_instance_s* instance, bool use_reserve);
+static bool flash_journal_append(struct flash_journal_instance_s* instance, size_t entry_buf1_size, const void* entry_buf1, size_t entry_buf2_size, const void* entry_buf2, bool use_reserve);
+static bool flash_journal_write_entry(void* address, size_t entry_buf1_size, const void* entry_buf1, size_t entry_buf2_size, const void* entry_buf2);
 
-void flash_journal_init(struct flash_journal_instance_s* instance, void* flash_page_ptr, size_t flash_page_size) {
+void flash_journal_init(struct flash_journal_instance_s* instance, uint16_t format_version, uint8_t num_sectors, struct flash_journal_sector_s* sectors) {
     if (!instance) {
         return;
     }
 
-    instance->flash_page_ptr = flash_page_ptr;
-    instance->flash_page_size = flash_page_size;
+    memset(instance, 0, sizeof(*instance));
+
+    if (!sectors || num_sectors < 2 || num_sectors > FLASH_JOURNAL_MAX_SECTORS) {
+        return;
+    }
+
+    instance->sectors = sectors;
+    instance->num_sectors = num_sectors;
+    instance->format_version = format_version;
+
+    for (uint8_t i=0; i<num_sectors; i++) {
+        flash_journal_scan_sector(instance, i);
+
+        struct flash_journal_sector_s* sector = &sectors[i];
+        if (sector->state != FLASH_JOURNAL_SECTOR_STATE_OPEN) {
+            continue;
+        }
+
+        // Insert in order of sequence number
+        uint8_t insert_idx = instance->num_open_sectors;
+        while (insert_idx > 0 && sectors[instance->open_sectors[insert_idx-1]].seq > sector->seq) {
+            instance->open_sectors[insert_idx] = instance->open_sectors[insert_idx-1];
+            insert_idx--;
+        }
+        instance->open_sectors[insert_idx] = i;
+        instance->num_open_sectors++;
+        instance->entry_count += sector->entry_count;
+    }
+
+    // Only compaction opens the last erased sector, and it frees the oldest before returning. If every sector is open,
+    // power was lost part way through, and the newest sector holds nothing but copies of entries still in the oldest.
+    // It is dropped, as a torn write at its end would otherwise leave nowhere to compact into.
+    if (instance->num_open_sectors == num_sectors) {
+        uint8_t newest_sector_idx = instance->open_sectors[--instance->num_open_sectors];
+        instance->entry_count -= sectors[newest_sector_idx].entry_count;
+        flash_journal_erase_sector(instance, newest_sector_idx);
+    }
 }
 
 bool flash_journal_write_from_2_buffers(struct flash_journal_instance_s* instance, size_t entry_buf1_size, const void* entry_buf1, size_t entry_buf2_size, const void* entry_buf2) {
@@ -26,38 +92,80 @@ bool flash_journal_write_from_2_buffers(struct flash_journal_instance_s* instanc
         return false;
     }
 
-    struct flash_journal_entry_s* new_entry_ptr = NULL;
-    while (flash_journal_iterate(instance, (const struct flash_journal_entry_s**)&new_entry_ptr));
+    return flash_journal_append(instance, entry_buf1_size, entry_buf1, entry_buf2_size, entry_buf2, false);
+}
+
+bool flash_journal_write(struct flash_journal_instance_s* instance, size_t entry_buf1_size, const void* entry_buf1) {
+    return flash_journal_write_from_2_buffers(instance, entry_buf1_size, entry_buf1, 0, NULL);
+}
 
-    if (!flash_journal_range_in_bounds(instance, new_entry_ptr, flash_journal_entry_size(total_size))) {
+const struct flash_journal_entry_s* flash_journal_get_last_entry(struct flash_journal_instance_s* instance) {
+    if (!instance) {
+        return NULL;
+    }
+
+    return instance->last_entry_ptr;
+}
+
+bool flash_journal_compact_oldest_sector(struct flash_journal_instance_s* instance, flash_journal_entry_live_func_ptr_t live_cb, void* ctx) {
+    if (!instance || !live_cb) {
         return false;
     }
 
-    struct flash_journal_entry_s entry_header = {0};
-    entry_header.len = total_size;
+    if (instance->num_open_sectors == 0) {
+        return true;
+    }
 
-    // compute crc16
-    entry_header.crc16 = crc16_ccitt((uint8_t*)&entry_header+sizeof(entry_header.crc16), FLASH_JOURNAL_ENTRY_HEADER_SIZE-sizeof(entry_header.crc16), entry_header.crc16);
+    uint8_t oldest_sector_idx = instance->open_sectors[0];
+    struct flash_journal_sector_s* oldest_sector = &instance->sectors[oldest_sector_idx];
 
-    if (entry_buf1) {
-        entry_header.crc16 = crc16_ccitt(entry_buf1, entry_buf1_size, entry_header.crc16);
+    // Entries can't be copied into the sector they are being copied out of
+    if (instance->num_open_sectors == 1 && !flash_journal_open_next_sector(instance, true)) {
+        return false;
     }
 
-    if (entry_buf2) {
-        entry_header.crc16 = crc16_ccitt(entry_buf2, entry_buf2_size, entry_header.crc16);
+    // Sectors are equally sized, so whatever was in the oldest fits in the rest of the newest and the reserve sector
+    for (const struct flash_journal_entry_s* entry = flash_journal_sector_first_entry(oldest_sector); (size_t)entry < (size_t)oldest_sector->end_ptr; entry = flash_journal_next_entry(entry)) {
+        if (live_cb(entry, ctx) && !flash_journal_append(instance, entry->len, entry->data, 0, NULL, true)) {
+            return false;
+        }
     }
 
-    struct flash_write_buf_s write_bufs[] = {
-        {sizeof(entry_header), &entry_header},
-        {entry_buf1_size, entry_buf1},
-        {entry_buf2_size, entry_buf2}
-    };
+    // The oldest sector is dropped before it is erased, so it is never iterated over half erased
+    instance->entry_count -= oldest_sector->entry_count;
+    instance->num_open_sectors--;
+    memmove(&instance->open_sectors[0], &instance->open_sectors[1], instance->num_open_sectors);
+    if (flash_journal_sector_contains(oldest_sector, instance->last_entry_ptr)) {
+        instance->last_entry_ptr = NULL;
+    }
 
-    return flash_write(new_entry_ptr, 3, write_bufs);
+    return flash_journal_erase_sector(instance, oldest_sector_idx);
 }
 
-bool flash_journal_write(struct flash_journal_instance_s* instance, size_t entry_buf1_size, const void* entry_buf1) {
-    return flash_journal_write_from_2_buffers(instance, entry_buf1_size, entry_buf1, 0, NULL);
+bool flash_journal_compaction_due(struct flash_journal_instance_s* instance, flash_journal_entry_live_func_ptr_t live_cb, void* ctx) {
+    if (!instance || !live_cb) {
+        return false;
+    }
+
+    struct flash_journal_sector_s* head_sector = flash_journal_get_head_sector(instance);
+    if (!head_sector || flash_journal_get_num_unopened_sectors(instance) > 1) {
+        return false;
+    }
+
+    size_t used = (size_t)head_sector->end_ptr - (size_t)head_sector->flash_page_ptr;
+    if (used < head_sector->flash_page_size/4*3) {
+        return false;
+    }
+
+    // Compacting a sector whose entries are all live would copy every one of them and erase a sector to free nothing
+    const struct flash_journal_sector_s* oldest_sector = &instance->sectors[instance->open_sectors[0]];
+    for (const struct flash_journal_entry_s* entry = flash_journal_sector_first_entry(oldest_sector); (size_t)entry < (size_t)oldest_sector->end_ptr; entry = flash_journal_next_entry(entry)) {
+        if (!live_cb(entry, ctx)) {
+            return true;
+        }
+    }
+
+    return false;
 }
 
 uint32_t flash_journal_count_entries(struct flash_journal_instance_s* instance) {
@@ -65,13 +173,15 @@ uint32_t flash_journal_count_entries(struct flash_journal_instance_s* instance)
         return 0;
     }
 
-    uint32_t ret = 0;
-    const struct flash_journal_entry_s* entry = NULL;
-    while(flash_journal_iterate(instance, &entry)) {
-        ret++;
+    return instance->entry_count;
+}
+
+uint32_t flash_journal_get_sector_erase_count(struct flash_journal_instance_s* instance, uint8_t sector_idx) {
+    if (!instance || sector_idx >= instance->num_sectors) {
+        return FLASH_JOURNAL_ERASE_COUNT_UNKNOWN;
     }
 
-    return ret;
+    return instance->sectors[sector_idx].erase_count;
 }
 
 bool flash_journal_erase(struct flash_journal_instance_s* instance) {
@@ -79,7 +189,23 @@ bool flash_journal_erase(struct flash_journal_instance_s* instance) {
         return false;
     }
 
-    return flash_erase_page(instance->flash_page_ptr);
+    instance->num_open_sectors = 0;
+    instance->entry_count = 0;
+    instance->last_entry_ptr = NULL;
+
+    bool ret = true;
+    for (uint8_t i=0; i<instance->num_sectors; i++) {
+        struct flash_journal_sector_s* sector = &instance->sectors[i];
+        if (sector->locked || sector->state == FLASH_JOURNAL_SECTOR_STATE_ERASED) {
+            continue;
+        }
+
+        if (!flash_journal_erase_sector(instance, i)) {
+            ret = false;
+        }
+    }
+
+    return ret;
 }
 
 bool flash_journal_iterate(struct flash_journal_instance_s* instance, const struct flash_journal_entry_s** entry_ptr) {
@@ -87,38 +213,289 @@ bool flash_journal_iterate(struct flash_journal_instance_s* instance, const stru
         return false;
     }
 
+    uint8_t open_idx = 0;
+    const struct flash_journal_entry_s* entry = NULL;
+
+    if (*entry_ptr) {
+        while (open_idx < instance->num_open_sectors && !flash_journal_sector_contains(&instance->sectors[instance->open_sectors[open_idx]], *entry_ptr)) {
+            open_idx++;
+        }
+        entry = flash_journal_next_entry(*entry_ptr);
+    }
+
+    for (; open_idx < instance->num_open_sectors; open_idx++) {
+        const struct flash_journal_sector_s* sector = &instance->sectors[instance->open_sectors[open_idx]];
+        if (!entry) {
+            entry = flash_journal_sector_first_entry(sector);
+        }
+
+        // Entries before end_ptr had their CRC checked when the sector was scanned or written
+        if ((size_t)entry < (size_t)sector->end_ptr) {
+            *entry_ptr = entry;
+            return true;
+        }
+
+        entry = NULL;
+    }
+
+    return false;
+}
+
+bool flash_journal_iterate_page(const void* flash_page_ptr, size_t flash_page_size, const struct flash_journal_entry_s** entry_ptr) {
+    if (!flash_page_ptr || !entry_ptr) {
+        return false;
+    }
+
     if (!*entry_ptr) {
-        *entry_ptr = instance->flash_page_ptr;
-    } else if(flash_journal_entry_valid(instance, *entry_ptr)) {
-        size_t entry_size = flash_journal_entry_size((*entry_ptr)->len);
-        *entry_ptr = (const struct flash_journal_entry_s*)((uint8_t*)*entry_ptr + entry_size);
+        *entry_ptr = flash_page_ptr;
+    } else if(flash_journal_page_entry_valid(flash_page_ptr, flash_page_size, *entry_ptr)) {
+        *entry_ptr = flash_journal_next_entry(*entry_ptr);
+    }
+
+    return flash_journal_page_entry_valid(flash_page_ptr, flash_page_size, *entry_ptr);
+}
+
+static void flash_journal_scan_sector(struct flash_journal_instance_s* instance, uint8_t sector_idx) {
+    struct flash_journal_sector_s* sector = &instance->sectors[sector_idx];
+
+    sector->state = FLASH_JOURNAL_SECTOR_STATE_NEEDS_ERASE;
+    sector->seq = 0;
+    sector->erase_count = FLASH_JOURNAL_ERASE_COUNT_UNKNOWN;
+    sector->end_ptr = sector->flash_page_ptr;
+    sector->entry_count = 0;
+
+    const struct flash_journal_entry_s* entry = NULL;
+    if (!flash_journal_iterate_page(sector->flash_page_ptr, sector->flash_page_size, &entry) || entry->len != sizeof(struct flash_journal_sector_header_s)) {
+        return;
+    }
+
+    const struct flash_journal_sector_header_s* header = (const struct flash_journal_sector_header_s*)entry->data;
+    if (header->magic != FLASH_JOURNAL_SECTOR_MAGIC) {
+        return;
+    }
+
+    // The erase count carries over even if the sector's contents are of no use
+    sector->erase_count = header->erase_count;
+    if (header->format_version != instance->format_version) {
+        return;
+    }
+
+    if (!flash_journal_iterate_page(sector->flash_page_ptr, sector->flash_page_size, &entry)) {
+        // Erased but never used, unless something was left half written after the header
+        if (flash_journal_range_blank(entry, flash_journal_entry_size(sizeof(struct flash_journal_sector_seq_s)))) {
+            sector->state = FLASH_JOURNAL_SECTOR_STATE_ERASED;
+            sector->end_ptr = (struct flash_journal_entry_s*)entry;
+        }
+        return;
+    }
+
+    if (entry->len != sizeof(struct flash_journal_sector_seq_s)) {
+        return;
+    }
+
+    sector->seq = ((const struct flash_journal_sector_seq_s*)entry->data)->seq;
+    sector->state = FLASH_JOURNAL_SECTOR_STATE_OPEN;
+
+    while (flash_journal_iterate_page(sector->flash_page_ptr, sector->flash_page_size, &entry)) {
+        sector->entry_count++;
     }
 
-    return flash_journal_entry_valid(instance, *entry_ptr);
+    // Iterating stops at the first entry that isn't valid, which is where the next entry is written
+    sector->end_ptr = (struct flash_journal_entry_s*)entry;
 }
 
-static bool flash_journal_entry_valid(struct flash_journal_instance_s* instance, const struct flash_journal_entry_s* entry) {
-    if (!flash_journal_address_in_bounds(instance, entry) || entry->len == 0xff) {
+static bool flash_journal_erase_sector(struct flash_journal_instance_s* instance, uint8_t sector_idx) {
+    struct flash_journal_sector_s* sector = &instance->sectors[sector_idx];
+
+    uint32_t erase_count = sector->erase_count;
+    if (erase_count == FLASH_JOURNAL_ERASE_COUNT_UNKNOWN) {
+        // Lost to power failing between an erase and its header being written, so assume the sector is as worn as any
+        erase_count = 0;
+        for (uint8_t i=0; i<instance->num_sectors; i++) {
+            if (instance->sectors[i].erase_count != FLASH_JOURNAL_ERASE_COUNT_UNKNOWN && instance->sectors[i].erase_count > erase_count) {
+                erase_count = instance->sectors[i].erase_count;
+            }
+        }
+    }
+    erase_count++;
+
+    sector->state = FLASH_JOURNAL_SECTOR_STATE_NEEDS_ERASE;
+    sector->seq = 0;
+    sector->erase_count = erase_count;
+    sector->end_ptr = sector->flash_page_ptr;
+    sector->entry_count = 0;
+
+    struct flash_journal_sector_header_s header = {FLASH_JOURNAL_SECTOR_MAGIC, instance->format_version, erase_count};
+    if (!flash_erase_page(sector->flash_page_ptr) || !flash_journal_write_entry(sector->flash_page_ptr, sizeof(header), &header, 0, NULL)) {
         return false;
     }
 
-    size_t entry_size = flash_journal_entry_size(entry->len);
-    uint16_t crc16_computed = flash_journal_entry_compute_crc16(entry);
-    bool range_in_bounds = flash_journal_range_in_bounds(instance, entry, entry_size);
+    sector->state = FLASH_JOURNAL_SECTOR_STATE_ERASED;
+    sector->end_ptr = (struct flash_journal_entry_s*)((uint8_t*)sector->flash_page_ptr + flash_journal_entry_size(sizeof(header)));
+    return true;
+}
+
+static bool flash_journal_open_next_sector(struct flash_journal_instance_s* instance, bool use_reserve) {
+    // The reserve sector is only used by compaction, which frees up a sector in return
+    if (flash_journal_get_num_unopened_sectors(instance) < (use_reserve ? 1 : 2)) {
+        return false;
+    }
+
+    struct flash_journal_sector_s* head_sector = flash_journal_get_head_sector(instance);
+    struct flash_journal_sector_s* sector = NULL;
+    uint8_t sector_idx = 0;
+
+    for (uint8_t i=0; i<instance->num_sectors; i++) {
+        uint8_t candidate_idx = i;
+        if (head_sector) {
+            // Sectors are used in turn after the newest, so that erases are spread evenly over them
+            candidate_idx = (instance->open_sectors[instance->num_open_sectors-1]+1+i) % instance->num_sectors;
+        }
+
+        struct flash_journal_sector_s* candidate = &instance->sectors[candidate_idx];
+        if (candidate->locked || candidate->state == FLASH_JOURNAL_SECTOR_STATE_OPEN) {
+            continue;
+        }
+
+        // Starting afresh, so begin with the least worn sector. Unknown erase counts compare as the highest.
+        if (!sector || (!head_sector && candidate->erase_count < sector->erase_count)) {
+            sector = candidate;
+            sector_idx = candidate_idx;
+        }
+
+        if (head_sector) {
+            break;
+        }
+    }
+
+    if (!sector) {
+        return false;
+    }
+
+    if (sector->state != FLASH_JOURNAL_SECTOR_STATE_ERASED && !flash_journal_erase_sector(instance, sector_idx)) {
+        return false;
+    }
+
+    struct flash_journal_sector_seq_s seq = {head_sector ? head_sector->seq+1 : 1};
+    if (!flash_journal_write_entry(sector->end_ptr, sizeof(seq), &seq, 0, NULL)) {
+        return false;
+    }
+
+    sector->seq = seq.seq;
+    sector->state = FLASH_JOURNAL_SECTOR_STATE_OPEN;
+    sector->end_ptr = flash_journal_sector_first_entry(sector);
+    sector->entry_count = 0;
+    instance->open_sectors[instance->num_open_sectors++] = sector_idx;
+    return true;
+}
+
+static bool flash_journal_append(struct flash_journal_instance_s* instance, size_t entry_buf1_size, const void* entry_buf1, size_t entry_buf2_size, const void* entry_buf2, bool use_reserve) {
+    size_t entry_size = flash_journal_entry_size(entry_buf1_size+entry_buf2_size);
+    struct flash_journal_sector_s* head_sector = flash_journal_get_head_sector(instance);
+
+    // The newest sector is left behind once an entry doesn't fit, or if a failed write has left its tail programmed
+    if (!head_sector || !flash_journal_sector_has_room(head_sector, entry_size)) {
+        if (!flash_journal_open_next_sector(instance, use_reserve)) {
+            return false;
+        }
 
-    return range_in_bounds && crc16_computed == entry->crc16;
+        head_sector = flash_journal_get_head_sector(instance);
+        if (!flash_journal_sector_has_room(head_sector, entry_size)) {
+            return false;
+        }
+    }
+
+    struct flash_journal_entry_s* new_entry_ptr = head_sector->end_ptr;
+    if (!flash_journal_write_entry(new_entry_ptr, entry_buf1_size, entry_buf1, entry_buf2_size, entry_buf2)) {
+        return false;
+    }
+
+    head_sector->end_ptr = (struct flash_journal_entry_s*)((uint8_t*)new_entry_ptr + entry_size);
+    head_sector->entry_count++;
+    instance->entry_count++;
+    instance->last_entry_ptr = new_entry_ptr;
+    return true;
 }
 
-static bool flash_journal_range_in_bounds(struct flash_journal_instance_s* instance, const void* address, uint32_t len) {
-    return flash_journal_address_in_bounds(instance, address) && flash_journal_address_in_bounds(instance, (uint8_t*)address+len-1);
+static bool flash_journal_write_entry(void* address, size_t entry_buf1_size, const void* entry_buf1, size_t entry_buf2_size, const void* entry_buf2) {
+    struct flash_journal_entry_s entry_header = {0};
+    entry_header.len = entry_buf1_size+entry_buf2_size;
+
+    // compute crc16
+    entry_header.crc16 = crc16_ccitt((uint8_t*)&entry_header+sizeof(entry_header.crc16), FLASH_JOURNAL_ENTRY_HEADER_SIZE-sizeof(entry_header.crc16), entry_header.crc16);
+
+    // Empty buffers are left out, as flash_write expects every buffer it is given to have data
+    struct flash_write_buf_s write_bufs[3] = {{sizeof(entry_header), &entry_header}};
+    uint8_t num_write_bufs = 1;
+
+    if (entry_buf1 && entry_buf1_size > 0) {
+        entry_header.crc16 = crc16_ccitt(entry_buf1, entry_buf1_size, entry_header.crc16);
+        write_bufs[num_write_bufs].len = entry_buf1_size;
+        write_bufs[num_write_bufs].data = entry_buf1;
+        num_write_bufs++;
+    }
+
+    if (entry_buf2 && entry_buf2_size > 0) {
+        entry_header.crc16 = crc16_ccitt(entry_buf2, entry_buf2_size, entry_header.crc16);
+        write_bufs[num_write_bufs].len = entry_buf2_size;
+        write_bufs[num_write_bufs].data = entry_buf2;
+        num_write_bufs++;
+    }
+
+    return flash_write(address, num_write_bufs, write_bufs);
 }
 
-static bool flash_journal_address_in_bounds(struct flash_journal_instance_s* instance, const void* address) {
-    if (!instance) {
+static struct flash_journal_sector_s* flash_journal_get_head_sector(struct flash_journal_instance_s* instance) {
+    if (instance->num_open_sectors == 0) {
+        return NULL;
+    }
+
+    return &instance->sectors[instance->open_sectors[instance->num_open_sectors-1]];
+}
+
+static uint8_t flash_journal_get_num_unopened_sectors(struct flash_journal_instance_s* instance) {
+    return instance->num_sectors - instance->num_open_sectors;
+}
+
+static struct flash_journal_entry_s* flash_journal_sector_first_entry(const struct flash_journal_sector_s* sector) {
+    size_t ofs = flash_journal_entry_size(sizeof(struct flash_journal_sector_header_s)) + flash_journal_entry_size(sizeof(struct flash_journal_sector_seq_s));
+    return (struct flash_journal_entry_s*)((uint8_t*)sector->flash_page_ptr + ofs);
+}
+
+static bool flash_journal_sector_contains(const struct flash_journal_sector_s* sector, const void* address) {
+    return (size_t)address >= (size_t)sector->flash_page_ptr && (size_t)address < (size_t)sector->flash_page_ptr+sector->flash_page_size;
+}
+
+static bool flash_journal_sector_has_room(const struct flash_journal_sector_s* sector, size_t entry_size) {
+    return flash_journal_page_range_in_bounds(sector->flash_page_ptr, sector->flash_page_size, sector->end_ptr, entry_size) && flash_journal_range_blank(sector->end_ptr, entry_size);
+}
+
+static const struct flash_journal_entry_s* flash_journal_next_entry(const struct flash_journal_entry_s* entry) {
+    return (const struct flash_journal_entry_s*)((uint8_t*)entry + flash_journal_entry_size(entry->len));
+}
+
+static bool flash_journal_page_entry_valid(const void* flash_page_ptr, size_t flash_page_size, const struct flash_journal_entry_s* entry) {
+    if (!flash_journal_page_range_in_bounds(flash_page_ptr, flash_page_size, entry, FLASH_JOURNAL_ENTRY_HEADER_SIZE) || entry->len == 0xff) {
         return false;
     }
 
-    return (size_t)address >= (size_t)instance->flash_page_ptr && (size_t)address < ((size_t)instance->flash_page_ptr+instance->flash_page_size);
+    size_t entry_size = flash_journal_entry_size(entry->len);
+    bool range_in_bounds = flash_journal_page_range_in_bounds(flash_page_ptr, flash_page_size, entry, entry_size);
+
+    return range_in_bounds && flash_journal_entry_compute_crc16(entry) == entry->crc16;
+}
+
+static bool flash_journal_page_range_in_bounds(const void* flash_page_ptr, size_t flash_page_size, const void* address, size_t len) {
+    return (size_t)address >= (size_t)flash_page_ptr && (size_t)address+len <= (size_t)flash_page_ptr+flash_page_size;
+}
+
+static bool flash_journal_range_blank(const void* address, size_t len) {
+    for (size_t i=0; i<len; i++) {
+        if (((const uint8_t*)address)[i] != 0xff) {
+            return false;
+        }
+    }
+    return true;
 }
 
 static size_t flash_journal_entry_size(uint8_t len) {
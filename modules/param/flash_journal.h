@@ -2,20 +2,81 @@
 
 #include <ch.h>
 
+// Most sectors a journal can be spread over
+#ifndef FLASH_JOURNAL_MAX_SECTORS
+#define FLASH_JOURNAL_MAX_SECTORS 8
+#endif
+
+#define FLASH_JOURNAL_ERASE_COUNT_UNKNOWN UINT32_MAX
+
 struct __attribute__((packed)) flash_journal_entry_s {
     uint16_t crc16; // computed by xor-folding crc32
     uint8_t len; // valid range 0..254 - 0xff means entry is invalid
     uint8_t data[];
 };
 
-struct flash_journal_instance_s {
+// The journal is a ring of equally sized flash sectors. Entries are appended to the newest sector, and space is
+// reclaimed by copying the entries still wanted out of the oldest sector and erasing it. One sector is kept erased so
+// that there is always somewhere to copy them to.
+struct flash_journal_sector_s {
+    // Set by the caller before flash_journal_init
     struct flash_journal_entry_s* flash_page_ptr;
     size_t flash_page_size;
+    // While set, the sector is neither written nor erased, e.g. while the caller reads data in an older layout from it
+    bool locked;
+
+    // Set up by flash_journal_init
+    uint8_t state;
+    uint32_t seq;
+    uint32_t erase_count;
+    struct flash_journal_entry_s* end_ptr;
+    uint32_t entry_count;
 };
 
-void flash_journal_init(struct flash_journal_instance_s* instance, void* flash_page_ptr, size_t flash_page_size);
+struct flash_journal_instance_s {
+    struct flash_journal_sector_s* sectors;
+    uint8_t num_sectors;
+    uint16_t format_version;
+    // Indices of the sectors holding entries, oldest first. The last one is appended to.
+    uint8_t open_sectors[FLASH_JOURNAL_MAX_SECTORS];
+    uint8_t num_open_sectors;
+    const struct flash_journal_entry_s* last_entry_ptr;
+    uint32_t entry_count;
+};
+
+// - Returns true if entry should be kept when the sector holding it is reclaimed
+typedef bool (*flash_journal_entry_live_func_ptr_t)(const struct flash_journal_entry_s* entry, void* ctx);
+
+// - Scans num_sectors sectors, at least 2, whose flash_page_ptr and flash_page_size have been set. Sectors written with a
+//   different format_version are erased and reused as if they were blank.
+void flash_journal_init(struct flash_journal_instance_s* instance, uint16_t format_version, uint8_t num_sectors, struct flash_journal_sector_s* sectors);
+
+// - Iterates over the entries of every sector in the order they were written, starting from *entry_ptr == NULL
 bool flash_journal_iterate(struct flash_journal_instance_s* instance, const struct flash_journal_entry_s** entry_ptr);
+
+// - Appends an entry, moving on to the next erased sector when the newest is full. Returns false if that would leave no
+//   sector erased, in which case flash_journal_compact_oldest_sector has to make room first.
 bool flash_journal_write_from_2_buffers(struct flash_journal_instance_s* instance, size_t entry_buf1_size, const void* entry_buf1, size_t entry_buf2_size, const void* entry_buf2);
 bool flash_journal_write(struct flash_journal_instance_s* instance, size_t entry_buf1_size, const void* entry_buf1);
+
+// - Returns the entry most recently written by this instance, or NULL
+const struct flash_journal_entry_s* flash_journal_get_last_entry(struct flash_journal_instance_s* instance);
+
+// - Copies the entries of the oldest sector that live_cb accepts to the newest, then erases the oldest sector. If power is
+//   lost part way through, the copies are duplicates of entries that are still in the oldest sector, so nothing is lost.
+bool flash_journal_compact_oldest_sector(struct flash_journal_instance_s* instance, flash_journal_entry_live_func_ptr_t live_cb, void* ctx);
+
+// - Returns true once the erased sectors are down to the one kept in reserve, the newest sector is mostly full, and the
+//   oldest sector holds entries that live_cb rejects, so that compacting ahead of time avoids doing it when a write fails
+bool flash_journal_compaction_due(struct flash_journal_instance_s* instance, flash_journal_entry_live_func_ptr_t live_cb, void* ctx);
+
+// - Erases every sector that isn't locked
 bool flash_journal_erase(struct flash_journal_instance_s* instance);
 uint32_t flash_journal_count_entries(struct flash_journal_instance_s* instance);
+
+// - Returns the number of times sector_idx has been erased, or FLASH_JOURNAL_ERASE_COUNT_UNKNOWN
+uint32_t flash_journal_get_sector_erase_count(struct flash_journal_instance_s* instance, uint8_t sector_idx);
+
+// - Iterates over the CRC-checked entries of a single flash page that isn't part of a journal instance, for reading
+//   pages written in an older layout
+bool flash_journal_iterate_page(const void* flash_page_ptr, size_t flash_page_size, const struct flash_journal_entry_s** entry_ptr);
@@ -1,17 +1,42 @@
 #include "param.h"
 #include "flash_journal.h"
 #include <common/helpers.h>
+#include <modules/flash/flash.h>
 
 #include <ch.h>
 
 #include <string.h>
 #include <stdio.h>
 
+#ifdef PARAM_WORKER_THREAD
+#include <modules/worker_thread/worker_thread.h>
+#include <modules/pubsub/pubsub.h>
+
+// Should be a lower priority thread than the ones that set params, so that flash writes don't hold them up
+#define WT PARAM_WORKER_THREAD
+WORKER_THREAD_DECLARE_EXTERN(WT)
+#endif
+
 #ifndef PARAM_MAX_NUM_PARAMS
 #define PARAM_MAX_NUM_PARAMS 50
 #endif
 
-#define PARAM_FORMAT_VERSION 1
+// Number of distinct keys in the journal that can be looked up without scanning it. Keys of params that aren't
+// registered in this build count too, so the default leaves room for some.
+#ifndef PARAM_JOURNAL_INDEX_SIZE
+#define PARAM_JOURNAL_INDEX_SIZE (PARAM_MAX_NUM_PARAMS*3/2)
+#endif
+
+// The journal is spread over BOARD_PARAM_NUM_SECTORS equally sized flash sectors. Boards with more than the two param
+// sections define BOARD_PARAM_SECTOR_ADDR(n) and BOARD_PARAM_SECTOR_SIZE(n) for each of them.
+#ifndef BOARD_PARAM_NUM_SECTORS
+#define BOARD_PARAM_NUM_SECTORS 2
+#define BOARD_PARAM_SECTOR_ADDR(n) ((n) == 0 ? BOARD_PARAM1_ADDR : BOARD_PARAM2_ADDR)
+#define BOARD_PARAM_SECTOR_SIZE(n) ((n) == 0 ? BOARD_PARAM1_FLASH_SIZE : BOARD_PARAM2_FLASH_SIZE)
+#endif
+
+#define PARAM_FORMAT_VERSION 2
+#define PARAM_LEGACY_FORMAT_VERSION 1
 
 // NOTE: This parameter system uses a 40-bit hash as a key. The chance of a collision occurring
 // among N keys is roughly k^2/2199023255552 - approximately 1 in 10 million for 500 keys. A
@@ -20,7 +45,8 @@ struct __attribute__((packed)) param_key_s {
     uint8_t bytes[5];
 };
 
-struct __attribute__((packed)) param_journal_header_s {
+// Format version 1 kept params in one flash page at a time, starting with this header, and swapped pages on compression
+struct __attribute__((packed)) param_legacy_journal_header_s {
     uint8_t format_version;
     int8_t index;
     uint16_t initial_entry_count;
@@ -31,8 +57,21 @@ struct __attribute__((packed)) param_journal_key_value_s {
     uint8_t value[];
 };
 
-struct flash_journal_instance_s journals[2];
-static struct flash_journal_instance_s* active_journal;
+// Maps each key to its final entry in the journal, sorted by key
+struct __attribute__((packed)) param_journal_index_entry_s {
+    struct param_key_s key;
+    const struct flash_journal_entry_s* journal_entry;
+};
+
+static struct flash_journal_sector_s param_journal_sectors[BOARD_PARAM_NUM_SECTORS];
+static struct flash_journal_instance_s param_journal;
+
+// Format version 1 page that entries are read from while they are imported into the journal
+static struct flash_journal_sector_s* param_legacy_sector;
+
+static struct param_journal_index_entry_s param_journal_index[PARAM_JOURNAL_INDEX_SIZE];
+static uint16_t param_journal_index_len;
+static bool param_journal_index_overflowed;
 
 static const struct param_descriptor_header_s* param_descriptor_table[PARAM_MAX_NUM_PARAMS];
 static struct param_key_s param_keys[PARAM_MAX_NUM_PARAMS];
@@ -40,7 +79,15 @@ static struct param_key_s param_keys[PARAM_MAX_NUM_PARAMS];
 static uint16_t num_params_registered;
 MUTEX_DECL(param_mutex);
 
-static const struct param_journal_header_s* param_get_journal_header_ptr(struct flash_journal_instance_s* journal);
+#ifdef PARAM_WORKER_THREAD
+static struct worker_thread_timer_task_s param_store_task;
+static struct pubsub_topic_s param_store_complete_topic;
+static uint32_t param_store_request_seq;
+static void param_store_task_func(struct worker_thread_timer_task_s* task);
+#endif
+
+static void param_import_legacy_journal(void);
+static bool param_journal_iterate(const struct flash_journal_entry_s** iterator);
 static void param_load_cache_value_from_journal(uint16_t param_idx);
 static void param_load_cache_value_from_hard_coded_default(uint16_t param_idx);
 static void param_load_cache_value_from_all(uint16_t param_idx);
@@ -53,39 +100,36 @@ static bool param_type_get_size_fixed(enum param_type_t type);
 static int64_t param_uncompress_varint64(uint8_t len, const uint8_t* buf);
 static uint8_t param_compress_varint64(int64_t value, uint8_t* buf);
 static bool param_journal_iterate_final_values(const struct flash_journal_entry_s** iterator);
-static void param_compress_journal(void);
+static bool param_compact_journal(void);
+static bool param_journal_entry_live(const struct flash_journal_entry_s* journal_entry, void* ctx);
+static void param_journal_index_rebuild(void);
+static void param_journal_index_update(const struct flash_journal_entry_s* journal_entry);
+static uint16_t param_journal_index_search(const struct param_key_s* key, bool* found);
 
 RUN_ON(PARAM_INIT) {
     param_acquire();
 
-    flash_journal_init(&journals[0], BOARD_PARAM1_ADDR, BOARD_PARAM1_FLASH_SIZE);
-    flash_journal_init(&journals[1], BOARD_PARAM2_ADDR, BOARD_PARAM2_FLASH_SIZE);
-
-    for (uint8_t i=0; i<2; i++) {
-        const struct param_journal_header_s* header = param_get_journal_header_ptr(&journals[i]);
-
-        if (!header || flash_journal_count_entries(&journals[i]) < header->initial_entry_count || header->format_version != PARAM_FORMAT_VERSION) {
-            // journals[i] is invalid - continue
-            continue;
-        }
-
-        if (!active_journal || (header->index - param_get_journal_header_ptr(active_journal)->index) > 0) {
-            active_journal = &journals[i];
-        }
+    for (uint8_t i=0; i<BOARD_PARAM_NUM_SECTORS; i++) {
+        param_journal_sectors[i].flash_page_ptr = (struct flash_journal_entry_s*)BOARD_PARAM_SECTOR_ADDR(i);
+        param_journal_sectors[i].flash_page_size = BOARD_PARAM_SECTOR_SIZE(i);
     }
 
-    if (!active_journal) {
-        // no valid journal was found - initialize an empty one
-        struct param_journal_header_s header = {PARAM_FORMAT_VERSION, 0, 1};
+    flash_journal_init(&param_journal, PARAM_FORMAT_VERSION, BOARD_PARAM_NUM_SECTORS, param_journal_sectors);
 
-        flash_journal_erase(&journals[0]);
-        flash_journal_write(&journals[0], sizeof(header), &header);
+    param_import_legacy_journal();
 
-        active_journal = &journals[0];
+    // Every param registered from here on is loaded from the index, rather than by scanning the journal
+    param_journal_index_rebuild();
+
+    // Compact journal if needed
+    if (flash_journal_compaction_due(&param_journal, param_journal_entry_live, NULL)) {
+        param_compact_journal();
     }
 
-    // Compress journal if needed
-    param_compress_journal();
+#ifdef PARAM_WORKER_THREAD
+    pubsub_init_topic(&param_store_complete_topic, NULL);
+    worker_thread_add_timer_task(&WT, &param_store_task, param_store_task_func, NULL, TIME_INFINITE, false);
+#endif
 
     param_release();
 }
@@ -116,21 +160,17 @@ void param_register(const struct param_descriptor_header_s* param_descriptor_hea
 }
 
 bool param_erase(void) {
-    struct param_journal_header_s header = {PARAM_FORMAT_VERSION, 0, 1};
-
-    flash_journal_erase((active_journal == &journals[0]) ? &journals[1] : &journals[0]);
-    flash_journal_erase((active_journal == &journals[0]) ? &journals[0] : &journals[1]);
-
-    flash_journal_write(&journals[0], sizeof(header), &header);
-    active_journal = &journals[0];
-    return true;
+    bool ret = flash_journal_erase(&param_journal);
+    param_journal_index_rebuild();
+    return ret;
 }
 
 bool param_store_all(void) {
     for (uint16_t i=0; i<num_params_registered; i++) {
-        if (!param_store_by_idx(i)) {
-            param_compress_journal();
-            if (!param_store_by_idx(i)) {
+        // Each compaction frees the oldest sector, but only gains the space its stale entries took up
+        uint8_t compactions = 0;
+        while (!param_store_by_idx(i)) {
+            if (compactions++ == BOARD_PARAM_NUM_SECTORS || !param_compact_journal()) {
                 return false;
             }
         }
@@ -138,6 +178,51 @@ bool param_store_all(void) {
     return true;
 }
 
+uint8_t param_get_num_journal_sectors(void) {
+    return BOARD_PARAM_NUM_SECTORS;
+}
+
+uint32_t param_get_journal_sector_erase_count(uint8_t sector_idx) {
+    return flash_journal_get_sector_erase_count(&param_journal, sector_idx);
+}
+
+#ifdef PARAM_WORKER_THREAD
+uint32_t param_store_all_in_background(void) {
+    chSysLock();
+    uint32_t request_seq = ++param_store_request_seq;
+    chSysUnlock();
+
+    worker_thread_timer_task_reschedule(&WT, &param_store_task, TIME_IMMEDIATE);
+    return request_seq;
+}
+
+struct pubsub_topic_s* param_get_store_complete_topic(void) {
+    return &param_store_complete_topic;
+}
+
+static void param_store_task_func(struct worker_thread_timer_task_s* task) {
+    (void)task;
+    struct param_store_complete_msg_s msg;
+
+    // A request made after the sequence number is taken reschedules this task, so it gets a store of its own
+    param_acquire();
+    chSysLock();
+    msg.request_seq = param_store_request_seq;
+    chSysUnlock();
+    msg.success = param_store_all();
+    param_release();
+
+    pubsub_publish_message(&param_store_complete_topic, sizeof(msg), pubsub_copy_writer_func, &msg);
+
+    // Compacting now, while nothing is waiting on it, saves a later store from having to
+    param_acquire();
+    if (flash_journal_compaction_due(&param_journal, param_journal_entry_live, NULL)) {
+        param_compact_journal();
+    }
+    param_release();
+}
+#endif
+
 bool param_get_exists(uint16_t param_idx) {
     return param_idx < num_params_registered;
 }
@@ -520,10 +605,6 @@ static bool param_store_by_idx(uint16_t param_idx) {
 }
 
 static bool param_write_to_flash_journal(const struct param_key_s* key, size_t value_size, const void* value) {
-    if (!active_journal) {
-        return false;
-    }
-
     const void* existing_stored_param_value = NULL;
     size_t existing_stored_param_value_size;
 
@@ -533,7 +614,7 @@ static bool param_write_to_flash_journal(const struct param_key_s* key, size_t v
         if (existing_journal_entry) {
             const struct param_journal_key_value_s* stored_param_key_value = (const struct param_journal_key_value_s*)(existing_journal_entry->data);
             existing_stored_param_value = stored_param_key_value->value;
-            existing_stored_param_value_size = existing_journal_entry->len;
+            existing_stored_param_value_size = existing_journal_entry->len - sizeof(struct param_key_s);
         }
     }
 
@@ -541,49 +622,148 @@ static bool param_write_to_flash_journal(const struct param_key_s* key, size_t v
         return true;
     }
 
-    return flash_journal_write_from_2_buffers(active_journal, sizeof(struct param_key_s), key, value_size, value);
+    if (!flash_journal_write_from_2_buffers(&param_journal, sizeof(struct param_key_s), key, value_size, value)) {
+        return false;
+    }
+
+    param_journal_index_update(flash_journal_get_last_entry(&param_journal));
+    return true;
 }
 
-static void param_compress_journal(void) {
-    if (!active_journal) {
+static bool param_compact_journal(void) {
+    bool ret = flash_journal_compact_oldest_sector(&param_journal, param_journal_entry_live, NULL);
+
+    // Entries that were copied now live in a different sector
+    param_journal_index_rebuild();
+    return ret;
+}
+
+static bool param_journal_entry_live(const struct flash_journal_entry_s* journal_entry, void* ctx) {
+    (void)ctx;
+
+    if (journal_entry->len < sizeof(struct param_journal_key_value_s)) {
+        // journal_entry is too small to be a param entry
+        return false;
+    }
+
+    // Only the final entry for each key is kept, including keys of params that aren't registered in this build
+    const struct param_journal_key_value_s* param_key_value = (const struct param_journal_key_value_s*)(journal_entry->data);
+    return param_get_final_journal_entry_with_key(&param_key_value->key) == journal_entry;
+}
+
+static void param_import_legacy_journal(void) {
+    const struct param_legacy_journal_header_s* legacy_header = NULL;
+
+    for (uint8_t i=0; i<BOARD_PARAM_NUM_SECTORS; i++) {
+        struct flash_journal_sector_s* sector = &param_journal_sectors[i];
+        const struct flash_journal_entry_s* journal_entry = NULL;
+
+        if (!flash_journal_iterate_page(sector->flash_page_ptr, sector->flash_page_size, &journal_entry) || journal_entry->len != sizeof(struct param_legacy_journal_header_s)) {
+            continue;
+        }
+
+        const struct param_legacy_journal_header_s* header = (const struct param_legacy_journal_header_s*)(journal_entry->data);
+
+        uint32_t entry_count = 1;
+        while (flash_journal_iterate_page(sector->flash_page_ptr, sector->flash_page_size, &journal_entry)) {
+            entry_count++;
+        }
+
+        if (header->format_version != PARAM_LEGACY_FORMAT_VERSION || entry_count < header->initial_entry_count) {
+            // page is invalid - continue
+            continue;
+        }
+
+        if (!legacy_header || (header->index - legacy_header->index) > 0) {
+            legacy_header = header;
+            param_legacy_sector = sector;
+        }
+    }
+
+    if (!legacy_header) {
         return;
     }
 
-    // Count unique entries
-    uint32_t unique_param_entry_count = 0;
+    // The page is held onto until every entry is in the journal. If power is lost before then, the import starts over.
+    param_legacy_sector->locked = true;
+    flash_journal_erase(&param_journal);
+    param_journal_index_rebuild();
+
+    if (!param_journal_index_overflowed) {
+        for (uint16_t i=0; i<param_journal_index_len; i++) {
+            const struct flash_journal_entry_s* journal_entry = param_journal_index[i].journal_entry;
+            flash_journal_write(&param_journal, journal_entry->len, journal_entry->data);
+        }
+    } else {
+        const struct flash_journal_entry_s* journal_entry = NULL;
+        while(param_journal_iterate_final_values(&journal_entry)) {
+            flash_journal_write(&param_journal, journal_entry->len, journal_entry->data);
+        }
+    }
+
+    param_legacy_sector->locked = false;
+    flash_erase_page(param_legacy_sector->flash_page_ptr);
+    param_legacy_sector = NULL;
+}
+
+static void param_journal_index_rebuild(void) {
+    param_journal_index_len = 0;
+    param_journal_index_overflowed = false;
+
+    // One pass in journal order, so each key ends up with its final entry
     const struct flash_journal_entry_s* journal_entry = NULL;
-    while(param_journal_iterate_final_values(&journal_entry)) {
-        unique_param_entry_count++;
+    while (param_journal_iterate(&journal_entry)) {
+        param_journal_index_update(journal_entry);
     }
+}
 
-    if (unique_param_entry_count+1 == flash_journal_count_entries(active_journal)) {
-        // Compression not needed
+static void param_journal_index_update(const struct flash_journal_entry_s* journal_entry) {
+    if (journal_entry->len < sizeof(struct param_journal_key_value_s)) {
+        // journal_entry is too small to be a param entry
         return;
     }
 
-    struct flash_journal_instance_s* inactive_journal = (active_journal == &journals[0]) ? &journals[1] : &journals[0];
+    const struct param_journal_key_value_s* param_key_value = (const struct param_journal_key_value_s*)(journal_entry->data);
+    bool found;
+    uint16_t idx = param_journal_index_search(&param_key_value->key, &found);
 
-    // Write header
-    {
-        // NOTE: initial_entry_count includes the header
-        struct param_journal_header_s header = {
-            PARAM_FORMAT_VERSION,
-            param_get_journal_header_ptr(active_journal)->index + 1,
-            unique_param_entry_count + 1
-        };
+    if (found) {
+        param_journal_index[idx].journal_entry = journal_entry;
+        return;
+    }
 
-        flash_journal_erase(inactive_journal);
-        flash_journal_write(inactive_journal, sizeof(header), &header);
+    if (param_journal_index_len >= PARAM_JOURNAL_INDEX_SIZE) {
+        // Lookups fall back to scanning the journal until the index is rebuilt with fewer keys
+        param_journal_index_overflowed = true;
+        return;
     }
 
-    // Write entries
-    journal_entry = NULL;
-    while(param_journal_iterate_final_values(&journal_entry)) {
-        flash_journal_write(inactive_journal, journal_entry->len, journal_entry->data);
+    memmove(&param_journal_index[idx+1], &param_journal_index[idx], (param_journal_index_len-idx)*sizeof(struct param_journal_index_entry_s));
+    param_journal_index[idx].key = param_key_value->key;
+    param_journal_index[idx].journal_entry = journal_entry;
+    param_journal_index_len++;
+}
+
+// Returns the index of key, or of where it would be inserted if found is false
+static uint16_t param_journal_index_search(const struct param_key_s* key, bool* found) {
+    uint16_t lo = 0;
+    uint16_t hi = param_journal_index_len;
+
+    while (lo < hi) {
+        uint16_t mid = (lo+hi)/2;
+        int cmp = memcmp(key, &param_journal_index[mid].key, sizeof(struct param_key_s));
+        if (cmp == 0) {
+            *found = true;
+            return mid;
+        } else if (cmp < 0) {
+            hi = mid;
+        } else {
+            lo = mid+1;
+        }
     }
 
-    // Switch journals
-    active_journal = inactive_journal;
+    *found = false;
+    return lo;
 }
 
 static void param_load_cache_value_from_hard_coded_default(uint16_t param_idx) {
@@ -622,7 +802,7 @@ static void param_load_cache_value_from_hard_coded_default(uint16_t param_idx) {
 }
 
 static void param_load_cache_value_from_journal(uint16_t param_idx) {
-    if (!active_journal || param_idx >= num_params_registered) {
+    if (param_idx >= num_params_registered) {
         return;
     }
 
@@ -665,8 +845,10 @@ static void param_load_cache_value_from_journal(uint16_t param_idx) {
 }
 
 static const struct flash_journal_entry_s* param_get_final_journal_entry_with_key(const struct param_key_s* key) {
-    if (!active_journal) {
-        return NULL;
+    if (!param_journal_index_overflowed) {
+        bool found;
+        uint16_t idx = param_journal_index_search(key, &found);
+        return found ? param_journal_index[idx].journal_entry : NULL;
     }
 
     const struct flash_journal_entry_s* journal_entry = NULL;
@@ -739,22 +921,17 @@ static bool param_type_get_size_fixed(enum param_type_t type) {
     }
 }
 
-static const struct param_journal_header_s* param_get_journal_header_ptr(struct flash_journal_instance_s* journal) {
-    const struct flash_journal_entry_s* ret = NULL;
-
-    if (!journal || !flash_journal_iterate(journal, &ret) || ret->len != sizeof(struct param_journal_header_s)) {
-        return NULL;
+static bool param_journal_iterate(const struct flash_journal_entry_s** iterator) {
+    if (param_legacy_sector) {
+        // The page's header entry is skipped along with anything else too small to be a param entry
+        return flash_journal_iterate_page(param_legacy_sector->flash_page_ptr, param_legacy_sector->flash_page_size, iterator);
     }
 
-    return (const struct param_journal_header_s*)(ret->data);
+    return flash_journal_iterate(&param_journal, iterator);
 }
 
 static bool param_journal_iterate_final_values(const struct flash_journal_entry_s** iterator) {
-    if (*iterator == NULL) {
-        flash_journal_iterate(active_journal, iterator); // skip header
-    }
-
-    while (flash_journal_iterate(active_journal, iterator)) {
+    while (param_journal_iterate(iterator)) {
         const struct flash_journal_entry_s* journal_entry = *iterator;
 
         if (journal_entry->len < sizeof(struct param_journal_key_value_s)) {
@@ -765,7 +942,7 @@ static bool param_journal_iterate_final_values(const struct flash_journal_entry_
         // ensure this is the last occurrence of this key
         bool last_occurrence = true;
         const struct flash_journal_entry_s* later_journal_entry = journal_entry;
-        while (flash_journal_iterate(active_journal, &later_journal_entry)) {
+        while (param_journal_iterate(&later_journal_entry)) {
             if (later_journal_entry->len < sizeof(struct param_journal_key_value_s)) {
                 // later_journal_entry is too small to be a param entry
                 continue;
@@ -144,6 +144,15 @@ struct __attribute__((packed)) param_descriptor_bool_s {
     struct param_descriptor_header_s header;
 };
 
+// - Published on the store complete topic after a background store. Every request with a sequence number up to and
+//   including request_seq has been written to flash if success is set.
+struct param_store_complete_msg_s {
+    uint32_t request_seq;
+    bool success;
+};
+
+struct pubsub_topic_s;
+
 void param_acquire(void);
 void param_release(void);
 void param_register(const struct param_descriptor_header_s* param_descriptor_header);
@@ -175,4 +184,22 @@ bool param_get_min_value_by_index_integer(uint16_t param_idx, int64_t* value);
 bool param_get_min_value_by_index_float32(uint16_t param_idx, float* value);
 
 bool param_erase(void);
+
+// - Writes every param whose value differs from the one in flash. Params that haven't changed aren't written again, so
+//   repeated sets of a param between stores cost one journal entry.
 bool param_store_all(void);
+
+// - The journal is spread over this many flash sectors, which are erased in turn
+uint8_t param_get_num_journal_sectors(void);
+
+// - Returns the number of times sector_idx has been erased, or UINT32_MAX if that was lost to a power failure
+uint32_t param_get_journal_sector_erase_count(uint8_t sector_idx);
+
+#ifdef PARAM_WORKER_THREAD
+// - Runs param_store_all on PARAM_WORKER_THREAD, so that flash programming and journal compaction don't block the
+//   caller. Requests made before the store starts are coalesced into it. Returns the request's sequence number, which
+//   is covered by the first struct param_store_complete_msg_s published afterwards with a request_seq at least as large.
+//   The oldest journal sector is compacted after the store once the erased sectors run low.
+uint32_t param_store_all_in_background(void);
+struct pubsub_topic_s* param_get_store_complete_topic(void);
+#endif
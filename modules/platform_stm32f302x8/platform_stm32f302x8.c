@@ -1,6 +1,14 @@
 #include "platform_stm32f302x8.h"
 #include <hal.h>
 #include <string.h>
+#include <common/helpers.h>
+
+#ifndef PLATFORM_STM32F302X8_USE_HW_CRC
+#define PLATFORM_STM32F302X8_USE_HW_CRC FALSE
+#endif
+
+// Bytes fed to the CRC unit per critical section
+#define HW_CRC_CHUNK_LEN 64
 
 /**
  * @brief   Early initialization code.
@@ -24,3 +32,59 @@ void board_get_unique_id(uint8_t* buf, uint8_t len) {
         memcpy(buf, unique_id_uint32, len);
     }
 }
+
+#if PLATFORM_STM32F302X8_USE_HW_CRC
+// The F3 CRC unit has a programmable polynomial, so it replaces the weak software crc16_ccitt and crc32. The unit is shared,
+// so its state is reloaded from the running CRC for every chunk and the chunk is fed with interrupts locked.
+// tests/test_crc_stm32_hw.c checks these register sequences against an emulated unit, and must be kept in step.
+static void hw_crc_begin(uint32_t polynomial, uint32_t cr, uint32_t init) {
+    RCC->AHBENR |= RCC_AHBENR_CRCEN;
+    CRC->POL = polynomial;
+    CRC->CR = cr;
+    CRC->INIT = init;
+    CRC->CR = cr | CRC_CR_RESET;
+}
+
+static void hw_crc_feed(const uint8_t* buf, size_t len) {
+    for (size_t i=0; i<len; i++) {
+        *(__IO uint8_t*)&CRC->DR = buf[i];
+    }
+}
+
+uint16_t crc16_ccitt(const void *buf, size_t len, uint16_t crc) {
+    const uint8_t* data = buf;
+
+    while (len > 0) {
+        size_t chunk_len = MIN(len, HW_CRC_CHUNK_LEN);
+
+        syssts_t sts = chSysGetStatusAndLockX();
+        hw_crc_begin(0x1021, CRC_CR_POLYSIZE_0, crc);
+        hw_crc_feed(data, chunk_len);
+        crc = (uint16_t)CRC->DR;
+        chSysRestoreStatusX(sts);
+
+        data += chunk_len;
+        len -= chunk_len;
+    }
+
+    return crc;
+}
+
+uint32_t crc32(const uint8_t *buf, uint32_t len, uint32_t crc) {
+    while (len > 0) {
+        uint32_t chunk_len = MIN(len, HW_CRC_CHUNK_LEN);
+
+        // crc32 is bit-reflected: reflect input bytes and the output, and seed INIT with the unreflected running state
+        syssts_t sts = chSysGetStatusAndLockX();
+        hw_crc_begin(0x04C11DB7, CRC_CR_REV_IN_0 | CRC_CR_REV_OUT, __RBIT(~crc));
+        hw_crc_feed(buf, chunk_len);
+        crc = ~CRC->DR;
+        chSysRestoreStatusX(sts);
+
+        buf += chunk_len;
+        len -= chunk_len;
+    }
+
+    return crc;
+}
+#endif
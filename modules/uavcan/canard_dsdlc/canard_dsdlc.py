@@ -2,6 +2,7 @@ import uavcan.dsdl
 import argparse
 import os
 import em
+import canard_dsdlc_helpers
 from canard_dsdlc_helpers import *
 
 templates = [
@@ -25,8 +26,11 @@ parser = argparse.ArgumentParser()
 parser.add_argument('namespace_dir', nargs='+')
 parser.add_argument('build_dir', nargs=1)
 parser.add_argument('--build', action='append')
+parser.add_argument('--generic', action='store_true', help='generate only field by field code, as a reference for the fixed layout and bulk copy paths')
 args = parser.parse_args()
 
+canard_dsdlc_helpers.GENERIC_ONLY = args.generic
+
 buildlist = None
 
 if args.build:
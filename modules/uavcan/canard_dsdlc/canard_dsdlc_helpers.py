@@ -5,6 +5,13 @@ import em
 import math
 import copy
 
+# Types with no dynamic arrays or unions up to this size are packed by straight-line code into one buffer on the stack
+FIXED_LAYOUT_MAX_BITLEN = 64*8
+
+# Set by canard_dsdlc.py --generic, which leaves out the fixed layout and bulk copy paths so that they can be checked
+# against the field by field code
+GENERIC_ONLY = False
+
 def get_empy_env_request(msg):
     assert msg.kind == msg.KIND_SERVICE
     msg_underscored_name = msg.full_name.replace('.','_')+'_req'
@@ -16,7 +23,9 @@ def get_empy_env_request(msg):
         'msg_union': msg.request_union,
         'msg_fields': msg.request_fields,
         'msg_constants': msg.request_constants,
+        'msg_min_bitlen': msg_fields_min_bitlen(msg.request_fields, msg.request_union),
         'msg_max_bitlen': msg.get_max_bitlen_request(),
+        'msg_fixed_layout': msg_fields_are_fixed_layout(msg.request_fields, msg.request_union, msg.get_max_bitlen_request()),
         'msg_dt_sig': msg.get_data_type_signature(),
         'msg_default_dtid': msg.default_dtid,
         'msg_kind': 'request',
@@ -34,7 +43,9 @@ def get_empy_env_response(msg):
         'msg_union': msg.response_union,
         'msg_fields': msg.response_fields,
         'msg_constants': msg.response_constants,
+        'msg_min_bitlen': msg_fields_min_bitlen(msg.response_fields, msg.response_union),
         'msg_max_bitlen': msg.get_max_bitlen_response(),
+        'msg_fixed_layout': msg_fields_are_fixed_layout(msg.response_fields, msg.response_union, msg.get_max_bitlen_response()),
         'msg_dt_sig': msg.get_data_type_signature(),
         'msg_default_dtid': msg.default_dtid,
         'msg_kind': 'response'
@@ -50,7 +61,9 @@ def get_empy_env_broadcast(msg):
         'msg_union': msg.union,
         'msg_fields': msg.fields,
         'msg_constants': msg.constants,
+        'msg_min_bitlen': msg_fields_min_bitlen(msg.fields, msg.union),
         'msg_max_bitlen': msg.get_max_bitlen(),
+        'msg_fixed_layout': msg_fields_are_fixed_layout(msg.fields, msg.union, msg.get_max_bitlen()),
         'msg_dt_sig': msg.get_data_type_signature(),
         'msg_default_dtid': msg.default_dtid,
         'msg_kind': 'broadcast'
@@ -67,6 +80,44 @@ def uavcan_type_is_signed(uavcan_type):
     elif uavcan_type.kind == uavcan_type.KIND_FLOAT:
         return True
 
+def msg_fields_min_bitlen(fields, union):
+    if union:
+        return union_msg_tag_bitlen_from_num_fields(len(fields)) + min(field.type.get_min_bitlen() for field in fields)
+    return sum(field.type.get_min_bitlen() for field in fields)
+
+def msg_fields_are_fixed_layout(fields, union, max_bitlen):
+    if GENERIC_ONLY or union or max_bitlen == 0 or max_bitlen > FIXED_LAYOUT_MAX_BITLEN:
+        return False
+    return all(uavcan_type_is_fixed_layout(field.type) for field in fields)
+
+def uavcan_type_is_fixed_layout(uavcan_type):
+    if uavcan_type.category in (uavcan_type.CATEGORY_PRIMITIVE, uavcan_type.CATEGORY_VOID):
+        return True
+    elif uavcan_type.category == uavcan_type.CATEGORY_ARRAY:
+        return uavcan_type.mode == uavcan_type.MODE_STATIC and uavcan_type_is_fixed_layout(uavcan_type.value_type)
+    elif uavcan_type.category == uavcan_type.CATEGORY_COMPOUND:
+        return msg_fields_are_fixed_layout(uavcan_type.fields, uavcan_type.union, uavcan_type.get_max_bitlen())
+
+def fixed_layout_field_bit_ofs(fields, field):
+    bit_ofs = 0
+    for f in fields:
+        if f is field:
+            return bit_ofs
+        bit_ofs += f.type.get_max_bitlen()
+
+def uavcan_array_is_bulk_copyable(array_type):
+    # Arrays of 8-bit integers are laid out the same in memory as on the wire
+    assert array_type.category == array_type.CATEGORY_ARRAY
+    if GENERIC_ONLY:
+        return False
+    value_type = array_type.value_type
+    if value_type.category != value_type.CATEGORY_PRIMITIVE or value_type.bitlen != 8:
+        return False
+    return value_type.kind in (value_type.KIND_UNSIGNED_INT, value_type.KIND_SIGNED_INT)
+
+def uavcan_type_is_float16(uavcan_type):
+    return uavcan_type.category == uavcan_type.CATEGORY_PRIMITIVE and uavcan_type.kind == uavcan_type.KIND_FLOAT and uavcan_type.bitlen == 16
+
 def union_msg_tag_bitlen_from_num_fields(num_fields):
     return int(math.ceil(math.log(num_fields,2)))
 
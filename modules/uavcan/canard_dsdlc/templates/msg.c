@@ -27,6 +27,7 @@ const struct uavcan_message_descriptor_s @(msg_underscored_name)_descriptor = {
 @[    end if]@
     sizeof(@(msg_c_type)),
     @(msg_underscored_name.upper())_MAX_PACK_SIZE,
+    @(msg_underscored_name.upper())_MIN_PACK_SIZE,
     encode_func,
     decode_func,
 @[    if msg_kind == "request"]@
@@ -49,6 +50,16 @@ uint32_t decode_@(msg_underscored_name)(const CanardRxTransfer* transfer, @(msg_
 }
 
 void _encode_@(msg_underscored_name)(uint8_t* buffer, @(msg_c_type)* msg, uavcan_serializer_chunk_cb_ptr_t chunk_cb, void* ctx, bool tao) {
+@[  if msg_fixed_layout]@
+    uint8_t fixed_buffer[@(msg_underscored_name.upper())_MAX_PACK_SIZE];
+    (void)buffer;
+    (void)tao;
+
+    memset(fixed_buffer, 0, sizeof(fixed_buffer));
+    _pack_@(msg_underscored_name)(msg, fixed_buffer, 0);
+    chunk_cb(fixed_buffer, @(msg_max_bitlen), ctx);
+}
+@[  else]@
 @{indent += 1}@{ind = '    '*indent}@
 @(ind)(void)buffer;
 @(ind)(void)msg;
@@ -96,10 +107,12 @@ void _encode_@(msg_underscored_name)(uint8_t* buffer, @(msg_c_type)* msg, uavcan
 @{indent -= 1}@{ind = '    '*indent}@
 @(ind)}
 @[          end if]@
-@(ind)for (size_t i=0; i < msg->@(field.name)_len; i++) {
-@[        else]@
-@(ind)for (size_t i=0; i < @(field.type.max_size); i++) {
 @[        end if]@
+@{array_len = ('msg->%s_len' % (field.name,)) if field.type.mode == field.type.MODE_DYNAMIC else str(field.type.max_size)}@
+@[        if uavcan_array_is_bulk_copyable(field.type)]@
+@(ind)chunk_cb((uint8_t*)msg->@(field.name), @(array_len)*8, ctx);
+@[        else]@
+@(ind)for (size_t i=0; i < @(array_len); i++) {
 @{indent += 1}@{ind = '    '*indent}@
 @[        if field.type.value_type.category == field.type.value_type.CATEGORY_PRIMITIVE]@
 @(ind)    memset(buffer,0,8);
@@ -117,6 +130,7 @@ void _encode_@(msg_underscored_name)(uint8_t* buffer, @(msg_c_type)* msg, uavcan
 @[        end if]@
 @{indent -= 1}@{ind = '    '*indent}@
 @(ind)}
+@[        end if]@
 @[      elif field.type.category == field.type.CATEGORY_VOID]@
 @(ind)chunk_cb(NULL, @(field.type.bitlen), ctx);
 @[      end if]@
@@ -132,8 +146,15 @@ void _encode_@(msg_underscored_name)(uint8_t* buffer, @(msg_c_type)* msg, uavcan
 @[  end if]@
 @{indent -= 1}@{ind = '    '*indent}@
 @(ind)}
+@[  end if]@
 
 void _decode_@(msg_underscored_name)(const CanardRxTransfer* transfer, uint32_t* bit_ofs, @(msg_c_type)* msg, bool tao) {
+@[  if msg_fixed_layout]@
+    (void)tao;
+
+    _unpack_@(msg_underscored_name)(transfer, *bit_ofs, msg);
+    *bit_ofs += @(msg_max_bitlen);
+@[  else]@
 @{indent += 1}@{ind = '    '*indent}@
 @(ind)(void)transfer;
 @(ind)(void)bit_ofs;
@@ -201,10 +222,13 @@ msg->@(field.name)_len = 0;
 @(ind)} else {
 @{indent += 1}@{ind = '    '*indent}@
 @[              end if]@
-@(ind)for (size_t i=0; i < msg->@(field.name)_len; i++) {
-@[        else]@
-@(ind)for (size_t i=0; i < @(field.type.max_size); i++) {
 @[        end if]@
+@{array_len = ('msg->%s_len' % (field.name,)) if field.type.mode == field.type.MODE_DYNAMIC else str(field.type.max_size)}@
+@[        if uavcan_array_is_bulk_copyable(field.type)]@
+@(ind)uavcan_decode_byte_array(transfer, *bit_ofs, (uint8_t*)msg->@(field.name), @(array_len));
+@(ind)*bit_ofs += @(array_len)*8;
+@[        else]@
+@(ind)for (size_t i=0; i < @(array_len); i++) {
 @{indent += 1}@{ind = '    '*indent}@
 @[        if field.type.value_type.category == field.type.value_type.CATEGORY_PRIMITIVE]@
 @[          if field.type.value_type.kind == field.type.value_type.KIND_FLOAT and field.type.value_type.bitlen == 16]@
@@ -222,7 +246,8 @@ msg->@(field.name)_len = 0;
 @[        end if]@
 @{indent -= 1}@{ind = '    '*indent}@
 @(ind)}
-@[              if field.type.value_type.category == field.type.value_type.CATEGORY_COMPOUND]@
+@[        end if]@
+@[              if field.type.mode == field.type.MODE_DYNAMIC and field.type.value_type.category == field.type.value_type.CATEGORY_COMPOUND]@
 @{indent -= 1}@{ind = '    '*indent}@
 @(ind)}
 @[              end if]@
@@ -240,4 +265,79 @@ msg->@(field.name)_len = 0;
 @{indent -= 1}@{ind = '    '*indent}@
 @(ind)}
 @[  end if]@
+@[  end if]@
 }
+@[  if msg_fixed_layout]@
+
+void _pack_@(msg_underscored_name)(@(msg_c_type)* msg, uint8_t* buffer, uint32_t bit_ofs) {
+    (void)msg;
+    (void)buffer;
+    (void)bit_ofs;
+
+@[    for field in msg_fields]@
+@{field_bit_ofs = fixed_layout_field_bit_ofs(msg_fields, field)}@
+@[      if field.type.category == field.type.CATEGORY_COMPOUND]@
+    _pack_@(underscored_name(field.type))(&msg->@(field.name), buffer, bit_ofs+@(field_bit_ofs));
+@[      elif field.type.category == field.type.CATEGORY_PRIMITIVE]@
+@[        if uavcan_type_is_float16(field.type)]@
+    {
+        uint16_t float16_val = canardConvertNativeFloatToFloat16(msg->@(field.name));
+        canardEncodeScalar(buffer, bit_ofs+@(field_bit_ofs), 16, &float16_val);
+    }
+@[        else]@
+    canardEncodeScalar(buffer, bit_ofs+@(field_bit_ofs), @(field.type.bitlen), &msg->@(field.name));
+@[        end if]@
+@[      elif field.type.category == field.type.CATEGORY_ARRAY]@
+    for (size_t i=0; i < @(field.type.max_size); i++) {
+@[        if field.type.value_type.category == field.type.value_type.CATEGORY_COMPOUND]@
+        _pack_@(underscored_name(field.type.value_type))(&msg->@(field.name)[i], buffer, bit_ofs+@(field_bit_ofs)+i*@(field.type.value_type.get_max_bitlen()));
+@[        elif uavcan_type_is_float16(field.type.value_type)]@
+        uint16_t float16_val = canardConvertNativeFloatToFloat16(msg->@(field.name)[i]);
+        canardEncodeScalar(buffer, bit_ofs+@(field_bit_ofs)+i*16, 16, &float16_val);
+@[        else]@
+        canardEncodeScalar(buffer, bit_ofs+@(field_bit_ofs)+i*@(field.type.value_type.bitlen), @(field.type.value_type.bitlen), &msg->@(field.name)[i]);
+@[        end if]@
+    }
+@[      end if]@
+@[    end for]@
+}
+
+void _unpack_@(msg_underscored_name)(const CanardRxTransfer* transfer, uint32_t bit_ofs, @(msg_c_type)* msg) {
+    (void)transfer;
+    (void)bit_ofs;
+    (void)msg;
+
+@[    for field in msg_fields]@
+@{field_bit_ofs = fixed_layout_field_bit_ofs(msg_fields, field)}@
+@[      if field.type.category == field.type.CATEGORY_COMPOUND]@
+    _unpack_@(underscored_name(field.type))(transfer, bit_ofs+@(field_bit_ofs), &msg->@(field.name));
+@[      elif field.type.category == field.type.CATEGORY_PRIMITIVE]@
+@[        if uavcan_type_is_float16(field.type)]@
+    {
+        uint16_t float16_val;
+        canardDecodeScalar(transfer, bit_ofs+@(field_bit_ofs), 16, true, &float16_val);
+        msg->@(field.name) = canardConvertFloat16ToNativeFloat(float16_val);
+    }
+@[        else]@
+    canardDecodeScalar(transfer, bit_ofs+@(field_bit_ofs), @(field.type.bitlen), @('true' if uavcan_type_is_signed(field.type) else 'false'), &msg->@(field.name));
+@[        end if]@
+@[      elif field.type.category == field.type.CATEGORY_ARRAY]@
+@[        if uavcan_array_is_bulk_copyable(field.type)]@
+    uavcan_decode_byte_array(transfer, bit_ofs+@(field_bit_ofs), (uint8_t*)msg->@(field.name), @(field.type.max_size));
+@[        else]@
+    for (size_t i=0; i < @(field.type.max_size); i++) {
+@[          if field.type.value_type.category == field.type.value_type.CATEGORY_COMPOUND]@
+        _unpack_@(underscored_name(field.type.value_type))(transfer, bit_ofs+@(field_bit_ofs)+i*@(field.type.value_type.get_max_bitlen()), &msg->@(field.name)[i]);
+@[          elif uavcan_type_is_float16(field.type.value_type)]@
+        uint16_t float16_val;
+        canardDecodeScalar(transfer, bit_ofs+@(field_bit_ofs)+i*16, 16, true, &float16_val);
+        msg->@(field.name)[i] = canardConvertFloat16ToNativeFloat(float16_val);
+@[          else]@
+        canardDecodeScalar(transfer, bit_ofs+@(field_bit_ofs)+i*@(field.type.value_type.bitlen), @(field.type.value_type.bitlen), @('true' if uavcan_type_is_signed(field.type.value_type) else 'false'), &msg->@(field.name)[i]);
+@[          end if]@
+    }
+@[        end if]@
+@[      end if]@
+@[    end for]@
+}
+@[  end if]@
@@ -17,6 +17,7 @@ for field in msg_fields:
 @[  end for]@
 
 #define @(msg_underscored_name.upper())_MAX_PACK_SIZE @((msg_max_bitlen+7)/8)
+#define @(msg_underscored_name.upper())_MIN_PACK_SIZE @((msg_min_bitlen+7)/8)
 #define @(msg_underscored_name.upper())_DT_SIG @('0x%08X' % (msg_dt_sig,))
 @[  if msg_default_dtid is not None]@
 #define @(msg_underscored_name.upper())_DT_ID @(msg_default_dtid)
@@ -61,3 +62,7 @@ void encode_@(msg_underscored_name)(@(msg_c_type)* msg, uavcan_serializer_chunk_
 uint32_t decode_@(msg_underscored_name)(const CanardRxTransfer* transfer, @(msg_c_type)* msg);
 void _encode_@(msg_underscored_name)(uint8_t* buffer, @(msg_c_type)* msg, uavcan_serializer_chunk_cb_ptr_t chunk_cb, void* ctx, bool tao);
 void _decode_@(msg_underscored_name)(const CanardRxTransfer* transfer, uint32_t* bit_ofs, @(msg_c_type)* msg, bool tao);
+@[  if msg_fixed_layout]@
+void _pack_@(msg_underscored_name)(@(msg_c_type)* msg, uint8_t* buffer, uint32_t bit_ofs);
+void _unpack_@(msg_underscored_name)(const CanardRxTransfer* transfer, uint32_t bit_ofs, @(msg_c_type)* msg);
+@[  end if]@
@@ -1,7 +1,10 @@
 #include <modules/uavcan/uavcan.h>
+#include <modules/uavcan/uavcan_service_client.h>
+#include <modules/uavcan/uavcan_rx_dispatch.h>
+#include <modules/uavcan/uavcan_transfer_id_map.h>
 #include <common/ctor.h>
-#include <modules/timing/timing.h>
 #include <common/helpers.h>
+#include <common/bit_array.h>
 #include <string.h>
 #include <modules/can/can.h>
 #include <modules/worker_thread/worker_thread.h>
@@ -27,10 +30,21 @@
 #define UAVCAN_CANARD_MEMORY_POOL_SIZE 768
 #endif
 
+// 25 entries of 5 bytes
 #ifndef UAVCAN_TRANSFER_ID_MAP_WORKING_AREA_SIZE
 #define UAVCAN_TRANSFER_ID_MAP_WORKING_AREA_SIZE 128
 #endif
 
+// Maximum CAN tx frames held by each priority class, indexed by priority/8. The defaults keep low priority traffic such as
+// debug messages from exhausting the frame pool and starving higher priority broadcasts: the two low priority classes
+// together hold at most 40 of the CAN_TX_QUEUE_LEN (default 64) frames, which leaves at least 24 for the high priority
+// classes. Keep the sum of the limited classes well below CAN_TX_QUEUE_LEN when changing either.
+// A transfer larger than its class quota, such as a lowest priority LogMessage or a file.Read response, is still sent
+// when the class has nothing else in flight, and may then take more frames than the quota until it is transmitted.
+#ifndef UAVCAN_TX_PRIORITY_CLASS_MAX_FRAMES
+#define UAVCAN_TX_PRIORITY_CLASS_MAX_FRAMES {UINT16_MAX, UINT16_MAX, 24, 16}
+#endif
+
 #ifndef UAVCAN_RX_WORKER_THREAD
 #error Please define UAVCAN_RX_WORKER_THREAD in framework_conf.h.
 #endif
@@ -39,34 +53,20 @@
 
 WORKER_THREAD_DECLARE_EXTERN(WT_RX)
 
-struct __attribute__((packed)) map_entry_s {
-    uint32_t key : 17;
-    uint32_t next : 7; // NOTE: can be increased to 15 bits to allow larger transfer ID map sizes
-    uint8_t transfer_id;
-};
-
-struct transfer_id_map_s {
-    struct map_entry_s* entries;
-    uint16_t size;
-    uint16_t head;
-};
-
-struct uavcan_rx_list_item_s {
-    const struct uavcan_message_descriptor_s* msg_descriptor;
-    struct pubsub_topic_s topic;
-    struct uavcan_rx_list_item_s* next;
-};
-
 struct uavcan_instance_s {
     uint8_t idx;
     struct can_instance_s* can_instance;
     CanardInstance canard;
     void* canard_memory_pool;
-    struct transfer_id_map_s transfer_id_map;
+    struct uavcan_transfer_id_map_s transfer_id_map;
+
+    struct can_tx_quota_s tx_quota[UAVCAN_TX_NUM_PRIORITY_CLASSES];
+    uint32_t tx_transfers_dropped[UAVCAN_TX_NUM_PRIORITY_CLASSES];
 
     struct worker_thread_listener_task_s rx_listener_task;
 
-    struct uavcan_rx_list_item_s* rx_list_head;
+    struct uavcan_rx_list_item_s* rx_dispatch_table[UAVCAN_RX_DISPATCH_TABLE_SIZE];
+    uint16_t rx_dispatch_table_count;
 
     struct uavcan_instance_s* next;
 };
@@ -83,8 +83,8 @@ static void uavcan_on_transfer_rx(CanardInstance* canard, CanardRxTransfer* tran
 
 static CanardCANFrame convert_can_frame_to_CanardCANFrame(const struct can_frame_s* frame);
 
-static void uavcan_transfer_id_map_init(struct transfer_id_map_s* map, size_t map_mem_size, void* map_mem);
-static uint8_t* uavcan_transfer_id_map_retrieve(struct transfer_id_map_s* map, bool service_not_message, uint16_t transfer_id, uint8_t dest_node_id);
+static uint16_t _uavcan_get_message_data_type_id(struct uavcan_instance_s* instance, const struct uavcan_message_descriptor_s* msg_descriptor);
+
 
 MEMORYPOOL_DECL(rx_list_pool, sizeof(struct uavcan_rx_list_item_s), chCoreAllocAlignedI);
 
@@ -119,6 +119,12 @@ static void uavcan_init(uint8_t can_dev_idx) {
     if (!(transfer_id_map_working_area = chCoreAlloc(UAVCAN_TRANSFER_ID_MAP_WORKING_AREA_SIZE))) { goto fail; }
     uavcan_transfer_id_map_init(&instance->transfer_id_map, UAVCAN_TRANSFER_ID_MAP_WORKING_AREA_SIZE, transfer_id_map_working_area);
     if(!(instance->canard_memory_pool = chCoreAlloc(UAVCAN_CANARD_MEMORY_POOL_SIZE))) { goto fail; }
+    {
+        const uint16_t tx_quota_max_frames[UAVCAN_TX_NUM_PRIORITY_CLASSES] = UAVCAN_TX_PRIORITY_CLASS_MAX_FRAMES;
+        for (uint8_t i=0; i<UAVCAN_TX_NUM_PRIORITY_CLASSES; i++) {
+            can_tx_quota_init(&instance->tx_quota[i], tx_quota_max_frames[i]);
+        }
+    }
     canardInit(&instance->canard, instance->canard_memory_pool, UAVCAN_CANARD_MEMORY_POOL_SIZE, uavcan_on_transfer_rx, uavcan_should_accept_transfer, instance);
     struct pubsub_topic_s* can_rx_topic = can_get_rx_topic(instance->can_instance);
     if (!can_rx_topic) { goto fail; }
@@ -176,14 +182,22 @@ static bool uavcan_iterate_instances(struct uavcan_instance_s** instance_ptr) {
 }
 
 static struct pubsub_topic_s* _uavcan_get_message_topic(struct uavcan_instance_s* instance, const struct uavcan_message_descriptor_s* msg_descriptor) {
-    if (!instance) {
+    if (!instance || !msg_descriptor) {
         return NULL;
     }
 
+    uint32_t dispatch_key = uavcan_rx_dispatch_key(msg_descriptor->transfer_type, _uavcan_get_message_data_type_id(instance, msg_descriptor));
+
     chSysLock();
 
-    // attempt to find existing item in receive list
-    struct uavcan_rx_list_item_s* rx_list_item = instance->rx_list_head;
+    // attempt to find existing item in the dispatch table
+    struct uavcan_rx_list_item_s** slot = uavcan_rx_dispatch_find_slot(instance->rx_dispatch_table, dispatch_key);
+    if (!slot) {
+        chSysUnlock();
+        return NULL;
+    }
+
+    struct uavcan_rx_list_item_s* rx_list_item = *slot;
     while (rx_list_item && rx_list_item->msg_descriptor != msg_descriptor) {
         rx_list_item = rx_list_item->next;
     }
@@ -193,7 +207,13 @@ static struct pubsub_topic_s* _uavcan_get_message_topic(struct uavcan_instance_s
         return &rx_list_item->topic;
     }
 
-    // create new item in receive list
+    // keep the table at most 3/4 full so that probe sequences for unsubscribed keys stay short
+    if (!*slot && (instance->rx_dispatch_table_count+1)*4 > UAVCAN_RX_DISPATCH_TABLE_SIZE*3) {
+        chSysUnlock();
+        return NULL;
+    }
+
+    // create new item
     rx_list_item = chPoolAllocI(&rx_list_pool);
     if (!rx_list_item) {
         chSysUnlock();
@@ -202,10 +222,14 @@ static struct pubsub_topic_s* _uavcan_get_message_topic(struct uavcan_instance_s
 
     // populate it
     rx_list_item->msg_descriptor = msg_descriptor;
+    rx_list_item->dispatch_key = dispatch_key;
     pubsub_init_topic(&rx_list_item->topic, NULL);
 
-    // append it
-    LINKED_LIST_APPEND(struct uavcan_rx_list_item_s, instance->rx_list_head, rx_list_item);
+    // append it to the slot, which is read by the rx thread without locking
+    if (!*slot) {
+        instance->rx_dispatch_table_count++;
+    }
+    LINKED_LIST_APPEND(struct uavcan_rx_list_item_s, *slot, rx_list_item);
 
     chSysUnlock();
 
@@ -260,90 +284,144 @@ void uavcan_set_node_id(uint8_t uavcan_idx, uint8_t node_id) {
     return _uavcan_set_node_id(uavcan_get_instance(uavcan_idx), node_id);
 }
 
+static uint8_t uavcan_get_tx_priority_class(uint8_t priority) {
+    return (priority & 0x1f) / (32/UAVCAN_TX_NUM_PRIORITY_CLASSES);
+}
+
+uint32_t uavcan_get_tx_transfers_dropped(uint8_t uavcan_idx, uint8_t priority) {
+    struct uavcan_instance_s* instance = uavcan_get_instance(uavcan_idx);
+    if (!instance) {
+        return 0;
+    }
+
+    return instance->tx_transfers_dropped[uavcan_get_tx_priority_class(priority)];
+}
+
 struct uavcan_transmit_state_s {
     bool failed;
     struct uavcan_instance_s* instance;
+    struct can_tx_quota_s* quota;
+    bool over_quota;
     struct can_tx_frame_s* frame_list_head;
     struct can_tx_frame_s* frame_list_tail;
     size_t frame_bit_ofs;
+    bool multi_frame;
+    uint16_t crc16;
 };
 
-/**
- * Bit array copy routine, originally developed by Ben Dyer for Libuavcan. Thanks Ben.
- */
-
-static void __attribute__((optimize("O3"))) copy_bit_array(const uint8_t* src, uint32_t src_offset, uint32_t src_len, uint8_t* dst, uint32_t dst_offset) {
-    // Normalizing inputs
-    src += src_offset / 8;
-    dst += dst_offset / 8;
+static void uavcan_transmit_init_frames(struct can_tx_frame_s* frame_list) {
+    for (struct can_tx_frame_s* frame = frame_list; frame != NULL; frame = frame->next) {
+        memset(frame->content.data, 0, 8);
+        frame->content.DLC = 1;
+    }
+}
 
-    src_offset %= 8;
-    dst_offset %= 8;
+static size_t uavcan_transmit_num_frames(size_t payload_len, bool multi_frame) {
+    if (!multi_frame) {
+        return 1;
+    }
 
-    const size_t last_bit = src_offset + src_len;
-    while (last_bit - src_offset)
-    {
-        const uint8_t src_bit_offset = (uint8_t)(src_offset % 8U);
-        const uint8_t dst_bit_offset = (uint8_t)(dst_offset % 8U);
+    // The first frame of a multi-frame transfer carries the 2 byte transfer CRC
+    return (payload_len+2+6)/7;
+}
 
-        const uint8_t max_offset = MAX(src_bit_offset, dst_bit_offset);
-        const uint32_t copy_bits = MIN(last_bit - src_offset, 8U - max_offset);
+static bool uavcan_transmit_advance_frame(struct uavcan_transmit_state_s* tx_state) {
+    struct can_tx_frame_s* frame = tx_state->frame_list_tail;
 
-        const uint8_t write_mask = (uint8_t)((uint8_t)(0xFF00U >> copy_bits) >> dst_bit_offset);
-        const uint8_t src_data = (uint8_t)((src[src_offset / 8U] << src_bit_offset) >> dst_bit_offset);
+    if (!tx_state->multi_frame) {
+        return false;
+    }
 
-        dst[dst_offset / 8U] = (uint8_t)((dst[dst_offset / 8U] & ~write_mask) | (src_data & write_mask));
+    // Each frame is only written once, so its bytes can go into the transfer CRC as soon as it is full
+    if (frame == tx_state->frame_list_head) {
+        tx_state->crc16 = crc16_ccitt(&frame->content.data[2], 5, tx_state->crc16);
+    } else {
+        tx_state->crc16 = crc16_ccitt(frame->content.data, 7, tx_state->crc16);
+    }
 
-        src_offset += copy_bits;
-        dst_offset += copy_bits;
+    if (!frame->next) {
+        if (tx_state->over_quota) {
+            frame->next = can_allocate_tx_frames_over_quota(tx_state->instance->can_instance, tx_state->quota, 1);
+        } else {
+            frame->next = can_allocate_tx_frames(tx_state->instance->can_instance, tx_state->quota, 1);
+        }
+        if (!frame->next) {
+            return false;
+        }
+        uavcan_transmit_init_frames(frame->next);
     }
+
+    tx_state->frame_list_tail = frame->next;
+    tx_state->frame_bit_ofs = 0;
+    return true;
 }
 
 static void __attribute__((optimize("O3"))) uavcan_transmit_chunk_handler(uint8_t* chunk, size_t bitlen, void* ctx) {
     struct uavcan_transmit_state_s* tx_state = ctx;
 
-    if (tx_state->failed || bitlen == 0) {
+    if (tx_state->failed) {
         return;
     }
 
-    if (!tx_state->frame_list_tail) {
-        tx_state->frame_list_tail = can_allocate_tx_frame_and_append(tx_state->instance->can_instance, &tx_state->frame_list_head);
-        if (!tx_state->frame_list_tail) {
-            tx_state->failed = true;
-            return;
-        }
-        memset(tx_state->frame_list_tail->content.data, 0, 8);
-    }
-
     size_t chunk_bit_ofs = 0;
 
     while (chunk_bit_ofs < bitlen) {
         size_t frame_copy_bits = MIN(bitlen-chunk_bit_ofs, 7*8-tx_state->frame_bit_ofs);
         if (frame_copy_bits == 0) {
-            bool make_room_for_crc = tx_state->frame_list_head->next == NULL;
-            tx_state->frame_list_tail = can_allocate_tx_frame_and_append(tx_state->instance->can_instance, &tx_state->frame_list_head);
-            if (!tx_state->frame_list_tail) {
+            if (!uavcan_transmit_advance_frame(tx_state)) {
                 tx_state->failed = true;
                 return;
             }
-            memset(tx_state->frame_list_tail->content.data, 0, 8);
-            if (make_room_for_crc) {
-                memcpy(tx_state->frame_list_tail->content.data, &tx_state->frame_list_head->content.data[5], 2);
-                memmove(&tx_state->frame_list_head->content.data[2], tx_state->frame_list_head->content.data, 5);
-                tx_state->frame_bit_ofs = 16;
-            } else {
-                tx_state->frame_bit_ofs = 0;
-            }
             continue;
         }
 
-        copy_bit_array(chunk, chunk_bit_ofs, frame_copy_bits, tx_state->frame_list_tail->content.data, tx_state->frame_bit_ofs);
+        // Void fields come in as a NULL chunk and stay as the zeroes the frame was initialized with
+        if (chunk) {
+            copy_bit_array(chunk, chunk_bit_ofs, frame_copy_bits, tx_state->frame_list_tail->content.data, tx_state->frame_bit_ofs);
+        }
         chunk_bit_ofs += frame_copy_bits;
         tx_state->frame_bit_ofs += frame_copy_bits;
         tx_state->frame_list_tail->content.DLC = (tx_state->frame_bit_ofs+7)/8 + 1;
     }
 }
 
+static void uavcan_transmit_finish(struct uavcan_transmit_state_s* tx_state) {
+    struct can_tx_frame_s* head = tx_state->frame_list_head;
+    struct can_tx_frame_s* tail = tx_state->frame_list_tail;
+
+    if (tail->next) {
+        can_free_tx_frames(tx_state->instance->can_instance, &tail->next);
+    }
+
+    if (!tx_state->multi_frame) {
+        return;
+    }
+
+    size_t tail_len = (tx_state->frame_bit_ofs+7)/8;
+
+    // A variable length payload that came out at 7 bytes or less goes out as a single frame without a CRC
+    if (head == tail) {
+        size_t payload_len = tail_len - 2;
+        memmove(head->content.data, &head->content.data[2], payload_len);
+        memset(&head->content.data[payload_len], 0, 8-payload_len);
+        head->content.DLC = payload_len + 1;
+        return;
+    }
+
+    if (head->next == tail && tail_len <= 2) {
+        memmove(head->content.data, &head->content.data[2], 5);
+        memcpy(&head->content.data[5], tail->content.data, tail_len);
+        memset(&head->content.data[5+tail_len], 0, 3-tail_len);
+        head->content.DLC = 5 + tail_len + 1;
+        can_free_tx_frames(tx_state->instance->can_instance, &head->next);
+        tx_state->frame_list_tail = head;
+        return;
+    }
+
+    tx_state->crc16 = crc16_ccitt(tail->content.data, tail_len, tx_state->crc16);
+    memcpy(head->content.data, &tx_state->crc16, 2);
+}
+
 static bool _uavcan_send(struct uavcan_instance_s* instance, const struct uavcan_message_descriptor_s* const msg_descriptor, uint16_t data_type_id, uint8_t priority, uint8_t transfer_id, uint8_t dest_node_id, void* msg_data) {
     if (!instance || !msg_descriptor || !msg_descriptor->serializer_func || !msg_data) {
         return false;
@@ -361,16 +439,48 @@ static bool _uavcan_send(struct uavcan_instance_s* instance, const struct uavcan
         return false;
     }
 
+    uint8_t priority_class = uavcan_get_tx_priority_class(priority);
     struct uavcan_transmit_state_s tx_state = {
-        false, instance, NULL, NULL, 0
+        false, instance, &instance->tx_quota[priority_class], false, NULL, NULL, 0, msg_descriptor->max_serialized_size > 7, 0xffff
     };
 
+    // Frames for the smallest possible payload are allocated up front, which covers fixed size types entirely. The
+    // frame layout is settled before serialization, so bits are written straight to their final place in the frames.
+    // A transfer that starts while its class has nothing in flight is not held to the class quota, as otherwise one larger
+    // than the quota could never be sent
+    size_t num_frames = uavcan_transmit_num_frames(msg_descriptor->min_serialized_size, tx_state.multi_frame);
+    chSysLock();
+    tx_state.over_quota = tx_state.quota->frames_in_use == 0;
+    if (tx_state.over_quota) {
+        tx_state.frame_list_head = can_allocate_tx_frames_over_quota_I(instance->can_instance, tx_state.quota, num_frames);
+    } else {
+        tx_state.frame_list_head = can_allocate_tx_frames_I(instance->can_instance, tx_state.quota, num_frames);
+    }
+    chSysUnlock();
+    if (!tx_state.frame_list_head) {
+        chSysLock();
+        instance->tx_transfers_dropped[priority_class]++;
+        chSysUnlock();
+        return false;
+    }
+    uavcan_transmit_init_frames(tx_state.frame_list_head);
+    tx_state.frame_list_tail = tx_state.frame_list_head;
+
+    if (tx_state.multi_frame) {
+        tx_state.frame_bit_ofs = 16;
+        tx_state.crc16 = crc16_ccitt((void*)&msg_descriptor->data_type_signature, 8, 0xffff);
+    }
+
     msg_descriptor->serializer_func(msg_data, uavcan_transmit_chunk_handler, &tx_state);
-    if (tx_state.failed || !tx_state.frame_list_head) {
+    if (tx_state.failed) {
         can_free_tx_frames(instance->can_instance, &tx_state.frame_list_head);
+        chSysLock();
+        instance->tx_transfers_dropped[priority_class]++;
+        chSysUnlock();
         return false;
     }
 
+    uavcan_transmit_finish(&tx_state);
 
     uint32_t can_id = 0;
     can_id |= (uint32_t)(priority&0x1f) << 24;
@@ -411,21 +521,6 @@ static bool _uavcan_send(struct uavcan_instance_s* instance, const struct uavcan
         frame = frame->next;
     }
 
-    if (tx_state.frame_list_head != tx_state.frame_list_tail) {
-        uint16_t crc16 = crc16_ccitt((void*)&msg_descriptor->data_type_signature, 8, 0xffff);
-
-        frame = tx_state.frame_list_head;
-        crc16 = crc16_ccitt(&frame->content.data[2], 5, crc16);
-        frame = frame->next;
-
-        while (frame->next != NULL) {
-            crc16 = crc16_ccitt(&frame->content.data[0], 7, crc16);
-            frame = frame->next;
-        }
-        crc16 = crc16_ccitt(&frame->content.data[0], frame->content.DLC-1, crc16);
-        memcpy(tx_state.frame_list_head->content.data, &crc16, 2);
-    }
-
     can_enqueue_tx_frames(instance->can_instance, &tx_state.frame_list_head, TIME_INFINITE, NULL);
 
     return true;
@@ -449,22 +544,39 @@ bool uavcan_broadcast(uint8_t uavcan_idx, const struct uavcan_message_descriptor
     }
 }
 
-bool uavcan_request(uint8_t uavcan_idx, const struct uavcan_message_descriptor_s* const msg_descriptor, uint8_t priority, uint8_t dest_node_id, void* msg_data) {
+bool uavcan_request_reserve_transfer_id(uint8_t uavcan_idx, const struct uavcan_message_descriptor_s* const msg_descriptor, uint8_t dest_node_id, uint8_t* transfer_id) {
     struct uavcan_instance_s* instance = uavcan_get_instance(uavcan_idx);
-    if (!instance) {
+    if (!instance || !msg_descriptor || !transfer_id) {
         return false;
     }
 
-    uint16_t data_type_id = msg_descriptor->default_data_type_id;
+    // Service transfer IDs are kept per (data type, server node) pair
     chSysLock();
-    uint8_t* transfer_id = uavcan_transfer_id_map_retrieve(&instance->transfer_id_map, false, data_type_id, 0);
+    uint8_t* map_transfer_id = uavcan_transfer_id_map_retrieve(&instance->transfer_id_map, true, msg_descriptor->default_data_type_id, dest_node_id);
+    if (map_transfer_id) {
+        *transfer_id = (*map_transfer_id)++;
+    }
     chSysUnlock();
-    if(_uavcan_send(instance, msg_descriptor, data_type_id, priority, *transfer_id, dest_node_id, msg_data)) {
-        (*transfer_id)++;
-        return true;
-    } else {
+
+    return map_transfer_id != NULL;
+}
+
+bool uavcan_request_with_transfer_id(uint8_t uavcan_idx, const struct uavcan_message_descriptor_s* const msg_descriptor, uint8_t priority, uint8_t dest_node_id, uint8_t transfer_id, void* msg_data) {
+    struct uavcan_instance_s* instance = uavcan_get_instance(uavcan_idx);
+    if (!instance || !msg_descriptor) {
+        return false;
+    }
+
+    return _uavcan_send(instance, msg_descriptor, msg_descriptor->default_data_type_id, priority, transfer_id, dest_node_id, msg_data);
+}
+
+bool uavcan_request(uint8_t uavcan_idx, const struct uavcan_message_descriptor_s* const msg_descriptor, uint8_t priority, uint8_t dest_node_id, void* msg_data) {
+    uint8_t transfer_id;
+    if (!uavcan_request_reserve_transfer_id(uavcan_idx, msg_descriptor, dest_node_id, &transfer_id)) {
         return false;
     }
+
+    return uavcan_request_with_transfer_id(uavcan_idx, msg_descriptor, priority, dest_node_id, transfer_id, msg_data);
 }
 
 bool uavcan_respond(uint8_t uavcan_idx, const struct uavcan_deserialized_message_s* const req_msg, void* msg_data) {
@@ -489,8 +601,7 @@ static void uavcan_can_rx_handler(size_t msg_size, const void* msg, void* ctx) {
 
     CanardCANFrame canard_frame = convert_can_frame_to_CanardCANFrame(&frame->content);
 
-    uint64_t timestamp = micros64();
-    canardHandleRxFrame(&instance->canard, &canard_frame, timestamp);
+    canardHandleRxFrame(&instance->canard, &canard_frame, frame->rx_timestamp_us);
 }
 
 static void stale_transfer_cleanup_task_func(struct worker_thread_timer_task_s* task) {
@@ -498,7 +609,7 @@ static void stale_transfer_cleanup_task_func(struct worker_thread_timer_task_s*
     struct uavcan_instance_s* instance = NULL;
 
     while (uavcan_iterate_instances(&instance)) {
-        canardCleanupStaleTransfers(&instance->canard, micros64());
+        canardCleanupStaleTransfers(&instance->canard, can_get_timestamp_us(instance->can_instance));
     }
 }
 
@@ -582,19 +693,32 @@ static void uavcan_on_transfer_rx(CanardInstance* canard, CanardRxTransfer* tran
         return;
     }
 
-    struct uavcan_rx_list_item_s* rx_list_item = instance->rx_list_head;
-    while (rx_list_item) {
-        if (rx_list_item->msg_descriptor->transfer_type == transfer->transfer_type && _uavcan_get_message_data_type_id(instance, rx_list_item->msg_descriptor) == transfer->data_type_id) {
-            struct uavcan_message_writer_func_args writer_args = { instance->idx, transfer, rx_list_item->msg_descriptor };
-            pubsub_publish_message(&rx_list_item->topic, rx_list_item->msg_descriptor->deserialized_size+sizeof(struct uavcan_deserialized_message_s), uavcan_message_writer_func, &writer_args);
+    // A response that a service client is waiting for goes only to that client
+    if (transfer->transfer_type == CanardTransferTypeResponse) {
+        const struct uavcan_message_descriptor_s* resp_descriptor;
+        struct pubsub_topic_s* client_topic = uavcan_service_client_find_response_topic(instance->idx, transfer, &resp_descriptor);
+        if (client_topic) {
+            struct uavcan_message_writer_func_args writer_args = { instance->idx, transfer, resp_descriptor };
+            pubsub_publish_message(client_topic, resp_descriptor->deserialized_size+sizeof(struct uavcan_deserialized_message_s), uavcan_message_writer_func, &writer_args);
+            return;
         }
+    }
+
+    struct uavcan_rx_list_item_s** slot = uavcan_rx_dispatch_find_slot(instance->rx_dispatch_table, uavcan_rx_dispatch_key(transfer->transfer_type, transfer->data_type_id));
+    if (!slot) {
+        return;
+    }
+
+    struct uavcan_rx_list_item_s* rx_list_item = *slot;
+    while (rx_list_item) {
+        struct uavcan_message_writer_func_args writer_args = { instance->idx, transfer, rx_list_item->msg_descriptor };
+        pubsub_publish_message(&rx_list_item->topic, rx_list_item->msg_descriptor->deserialized_size+sizeof(struct uavcan_deserialized_message_s), uavcan_message_writer_func, &writer_args);
 
         rx_list_item = rx_list_item->next;
     }
 }
 
 static bool uavcan_should_accept_transfer(const CanardInstance* canard, uint64_t* out_data_type_signature, uint16_t data_type_id, CanardTransferType transfer_type, uint8_t source_node_id) {
-    (void)source_node_id;
     if (!canard || !out_data_type_signature) {
         return false;
     }
@@ -604,80 +728,15 @@ static bool uavcan_should_accept_transfer(const CanardInstance* canard, uint64_t
         return false;
     }
 
-    struct uavcan_rx_list_item_s* rx_list_item = instance->rx_list_head;
-    while (rx_list_item) {
-        if (transfer_type == rx_list_item->msg_descriptor->transfer_type && data_type_id == _uavcan_get_message_data_type_id(instance, rx_list_item->msg_descriptor)) {
-            *out_data_type_signature = rx_list_item->msg_descriptor->data_type_signature;
-            return true;
-        }
-
-        rx_list_item = rx_list_item->next;
-    }
-
-    return false;
-}
-
-#define UAVCAN_TRANSFER_ID_MAP_MAX_LEN ((1<<7)-1)
-
-static void uavcan_transfer_id_map_init(struct transfer_id_map_s* map, size_t map_mem_size, void* map_mem) {
-    if (!map) {
-        return;
-    }
-    map->entries = map_mem;
-    map->size = map_mem_size/sizeof(struct map_entry_s);
-    if (map->size > UAVCAN_TRANSFER_ID_MAP_MAX_LEN) {
-        map->size = UAVCAN_TRANSFER_ID_MAP_MAX_LEN;
-    }
-    map->head = UAVCAN_TRANSFER_ID_MAP_MAX_LEN;
-}
-
-static uint8_t* uavcan_transfer_id_map_retrieve(struct transfer_id_map_s* map, bool service_not_message, uint16_t data_type_id, uint8_t dest_node_id) {
-    if (!map || !map->entries) {
-        return 0;
-    }
-
-    uint32_t key;
-    if (service_not_message) {
-        key = (1<<16) | ((data_type_id << 8) & 0xFF00) | ((dest_node_id << 0) & 0x00FF);
-    } else {
-        key = data_type_id;
-    }
-
-    uint16_t count = 0;
-    uint16_t entry = map->head;
-    uint16_t entry_prev = UAVCAN_TRANSFER_ID_MAP_MAX_LEN;
-    uint16_t entry_prev_prev = UAVCAN_TRANSFER_ID_MAP_MAX_LEN;
-
-    while (entry != UAVCAN_TRANSFER_ID_MAP_MAX_LEN && map->entries[entry].key != key) {
-        count++;
-        entry_prev_prev = entry_prev;
-        entry_prev = entry;
-        entry = map->entries[entry].next;
-    }
-
-    if (entry == UAVCAN_TRANSFER_ID_MAP_MAX_LEN) {
-        // Not found. Allocate an entry.
-        if (count >= map->size) {
-            // list is full - entry_prev is the LRU entry
-            entry = entry_prev;
-            entry_prev = entry_prev_prev;
-        } else {
-            // list is not full - allocate next available element
-            entry = count;
-        }
-
-        // Populate the allocated entry
-        map->entries[entry].key = key;
-        map->entries[entry].transfer_id = 0;
-        map->entries[entry].next = UAVCAN_TRANSFER_ID_MAP_MAX_LEN;
+    if (transfer_type == CanardTransferTypeResponse && uavcan_service_client_accept_response(instance->idx, data_type_id, source_node_id, out_data_type_signature)) {
+        return true;
     }
 
-    // Move to front
-    if (entry_prev != UAVCAN_TRANSFER_ID_MAP_MAX_LEN) {
-        map->entries[entry_prev].next = map->entries[entry].next;
-        map->entries[entry].next = map->head;
+    struct uavcan_rx_list_item_s** slot = uavcan_rx_dispatch_find_slot(instance->rx_dispatch_table, uavcan_rx_dispatch_key(transfer_type, data_type_id));
+    if (!slot || !*slot) {
+        return false;
     }
-    map->head = entry;
 
-    return &map->entries[entry].transfer_id;
+    *out_data_type_signature = (*slot)->msg_descriptor->data_type_signature;
+    return true;
 }
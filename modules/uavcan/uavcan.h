@@ -5,6 +5,8 @@
 #include <hal.h>
 #include <modules/pubsub/pubsub.h>
 
+#define UAVCAN_TX_NUM_PRIORITY_CLASSES 4
+
 typedef void (*uavcan_serializer_chunk_cb_ptr_t)(uint8_t* chunk, size_t bitlen, void* ctx);
 typedef void (*uavcan_serializer_func_ptr_t)(void* msg_struct, uavcan_serializer_chunk_cb_ptr_t chunk_cb, void* ctx);
 
@@ -16,6 +18,7 @@ struct uavcan_message_descriptor_s {
     CanardTransferType transfer_type;
     size_t deserialized_size;
     size_t max_serialized_size;
+    size_t min_serialized_size;
     uavcan_serializer_func_ptr_t serializer_func;
     uavcan_deserializer_func_ptr_t deserializer_func;
     const struct uavcan_message_descriptor_s* resp_descriptor;
@@ -44,4 +47,16 @@ struct pubsub_topic_s* uavcan_get_message_topic(uint8_t uavcan_idx, const struct
 
 bool uavcan_broadcast(uint8_t uavcan_idx, const struct uavcan_message_descriptor_s* const msg_descriptor, uint8_t priority, void* msg_data);
 bool uavcan_request(uint8_t uavcan_idx, const struct uavcan_message_descriptor_s* const msg_descriptor, uint8_t priority, uint8_t dest_node_id, void* msg_data);
+
+// - Takes the next transfer ID for requests of msg_descriptor to dest_node_id, for callers that need to know it before
+//   the request goes out. uavcan_request does this itself.
+bool uavcan_request_reserve_transfer_id(uint8_t uavcan_idx, const struct uavcan_message_descriptor_s* const msg_descriptor, uint8_t dest_node_id, uint8_t* transfer_id);
+bool uavcan_request_with_transfer_id(uint8_t uavcan_idx, const struct uavcan_message_descriptor_s* const msg_descriptor, uint8_t priority, uint8_t dest_node_id, uint8_t transfer_id, void* msg_data);
+
 bool uavcan_respond(uint8_t uavcan_idx, const struct uavcan_deserialized_message_s* const req_msg, void* msg_data);
+
+// - Returns the number of transfers dropped for lack of tx frames in the priority class that priority belongs to.
+uint32_t uavcan_get_tx_transfers_dropped(uint8_t uavcan_idx, uint8_t priority);
+
+// - Used by generated deserializers to decode len bytes starting at bit_ofs into dst, several bytes per libcanard call.
+void uavcan_decode_byte_array(const CanardRxTransfer* transfer, uint32_t bit_ofs, uint8_t* dst, size_t len);
@@ -0,0 +1,27 @@
+// Helpers called by generated deserializers. Kept apart from uavcan.c so that generated code can be built without the
+// rest of the module.
+
+#include <modules/uavcan/uavcan.h>
+
+void uavcan_decode_byte_array(const CanardRxTransfer* transfer, uint32_t bit_ofs, uint8_t* dst, size_t len) {
+    // Bytes are taken out of the decoded value by shifting, so this doesn't depend on host byte order
+    while (len >= 8) {
+        uint64_t val;
+        if (canardDecodeScalar(transfer, bit_ofs, 64, false, &val) != 64) {
+            break;
+        }
+        for (uint8_t i=0; i<8; i++) {
+            dst[i] = (uint8_t)(val >> (8*i));
+        }
+        bit_ofs += 64;
+        dst += 8;
+        len -= 8;
+    }
+
+    while (len > 0) {
+        canardDecodeScalar(transfer, bit_ofs, 8, false, dst);
+        bit_ofs += 8;
+        dst++;
+        len--;
+    }
+}
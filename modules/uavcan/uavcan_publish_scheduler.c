@@ -0,0 +1,288 @@
+#include "uavcan_publish_scheduler.h"
+#include <common/helpers.h>
+#include <modules/worker_thread/worker_thread.h>
+
+#ifndef UAVCAN_PUBLISH_SCHEDULER_WORKER_THREAD
+#define UAVCAN_PUBLISH_SCHEDULER_WORKER_THREAD UAVCAN_RX_WORKER_THREAD
+#endif
+
+// Number of evenly spaced phases within its period that a new stream's first publication is chosen from
+#ifndef UAVCAN_PUBLISH_SCHEDULER_PHASE_CANDIDATES
+#define UAVCAN_PUBLISH_SCHEDULER_PHASE_CANDIDATES 16
+#endif
+
+// Publications of other streams closer than this to a candidate phase count against it, weighted by their frame count
+// and by how close they are
+#ifndef UAVCAN_PUBLISH_SCHEDULER_SPREAD_WINDOW_US
+#define UAVCAN_PUBLISH_SCHEDULER_SPREAD_WINDOW_US 5000
+#endif
+
+// Unused bandwidth budget is saved up for at most this long, which bounds the burst after an idle period
+#ifndef UAVCAN_PUBLISH_SCHEDULER_BUDGET_BURST_MS
+#define UAVCAN_PUBLISH_SCHEDULER_BUDGET_BURST_MS 50
+#endif
+
+#ifndef UAVCAN_PUBLISH_SCHEDULER_MAX_INSTANCES
+#define UAVCAN_PUBLISH_SCHEDULER_MAX_INSTANCES 1
+#endif
+
+#define WT UAVCAN_PUBLISH_SCHEDULER_WORKER_THREAD
+WORKER_THREAD_DECLARE_EXTERN(WT)
+
+struct bandwidth_budget_s {
+    uint32_t frames_per_sec;
+    uint64_t credit; // frames scaled by CH_CFG_ST_FREQUENCY, so that it accrues by frames_per_sec every tick
+    systime_t last_refill_systime;
+};
+
+static struct bandwidth_budget_s bandwidth_budgets[UAVCAN_PUBLISH_SCHEDULER_MAX_INSTANCES];
+static struct uavcan_publish_stream_s* stream_list_head;
+static struct worker_thread_timer_task_s publish_task;
+static bool publish_task_added;
+static bool rescan_requested;
+
+static void publish_task_func(struct worker_thread_timer_task_s* task);
+static systime_t uavcan_publish_scheduler_service_stream(struct uavcan_publish_stream_s* stream, systime_t t_now);
+static systime_t uavcan_publish_scheduler_choose_first_publish_systime_I(systime_t period, systime_t t_now);
+static bool bandwidth_budget_available_I(struct bandwidth_budget_s* budget, uint16_t num_frames, systime_t t_now, systime_t* ticks_until_available);
+static uint32_t ticks_to_us(uint64_t ticks);
+
+bool uavcan_publish_scheduler_add_stream(struct uavcan_publish_stream_s* stream, uint8_t uavcan_idx, const struct uavcan_message_descriptor_s* msg_descriptor, uint8_t priority, systime_t period, void* msg, uavcan_publish_source_func_ptr_t source_cb, void* source_ctx) {
+    if (!stream || !msg_descriptor || !msg || !source_cb || period == 0 || period == TIME_INFINITE || uavcan_idx >= UAVCAN_PUBLISH_SCHEDULER_MAX_INSTANCES) {
+        return false;
+    }
+
+    stream->uavcan_idx = uavcan_idx;
+    stream->priority = priority;
+    // Sized for the largest serialization, with the transfer CRC in the first frame of multi-frame transfers
+    stream->frames_per_publication = msg_descriptor->max_serialized_size <= 7 ? 1 : (msg_descriptor->max_serialized_size+2+6)/7;
+    stream->deferred = false;
+    stream->msg_descriptor = msg_descriptor;
+    stream->period = period;
+    stream->msg = msg;
+    stream->source_cb = source_cb;
+    stream->source_ctx = source_ctx;
+    stream->num_published = 0;
+    stream->num_skipped = 0;
+    stream->num_deferred = 0;
+    stream->num_missed = 0;
+    stream->num_send_failures = 0;
+    stream->lateness_sum_ticks = 0;
+    stream->lateness_max_ticks = 0;
+
+    chSysLock();
+    systime_t t_now = chVTGetSystemTimeX();
+    stream->stats_window_begin_systime = t_now;
+    stream->next_publish_systime = uavcan_publish_scheduler_choose_first_publish_systime_I(period, t_now);
+
+    // The list is kept in priority order, so that streams that are due at the same time are served highest priority first
+    struct uavcan_publish_stream_s** insert_ptr = &stream_list_head;
+    while (*insert_ptr && (*insert_ptr)->priority <= priority) {
+        insert_ptr = &(*insert_ptr)->next;
+    }
+    stream->next = *insert_ptr;
+    *insert_ptr = stream;
+
+    rescan_requested = true;
+    if (!publish_task_added) {
+        worker_thread_add_timer_task_I(&WT, &publish_task, publish_task_func, NULL, TIME_IMMEDIATE, false);
+        publish_task_added = true;
+    } else {
+        worker_thread_timer_task_reschedule_I(&WT, &publish_task, TIME_IMMEDIATE);
+    }
+    chSchRescheduleS();
+    chSysUnlock();
+
+    return true;
+}
+
+void uavcan_publish_scheduler_set_bandwidth_budget(uint8_t uavcan_idx, uint32_t frames_per_sec) {
+    if (uavcan_idx >= UAVCAN_PUBLISH_SCHEDULER_MAX_INSTANCES) {
+        return;
+    }
+
+    chSysLock();
+    bandwidth_budgets[uavcan_idx].frames_per_sec = frames_per_sec;
+    bandwidth_budgets[uavcan_idx].credit = 0;
+    bandwidth_budgets[uavcan_idx].last_refill_systime = chVTGetSystemTimeX();
+    chSysUnlock();
+}
+
+void uavcan_publish_scheduler_get_stream_stats(struct uavcan_publish_stream_s* stream, struct uavcan_publish_stream_stats_s* stats, bool reset) {
+    if (!stream || !stats) {
+        return;
+    }
+
+    chSysLock();
+    systime_t t_now = chVTGetSystemTimeX();
+    systime_t window_ticks = t_now - stream->stats_window_begin_systime;
+    stats->num_published = stream->num_published;
+    stats->num_skipped = stream->num_skipped;
+    stats->num_deferred = stream->num_deferred;
+    stats->num_missed = stream->num_missed;
+    stats->num_send_failures = stream->num_send_failures;
+    uint32_t lateness_sum_ticks = stream->lateness_sum_ticks;
+    systime_t lateness_max_ticks = stream->lateness_max_ticks;
+    if (reset) {
+        stream->stats_window_begin_systime = t_now;
+        stream->num_published = 0;
+        stream->num_skipped = 0;
+        stream->num_deferred = 0;
+        stream->num_missed = 0;
+        stream->num_send_failures = 0;
+        stream->lateness_sum_ticks = 0;
+        stream->lateness_max_ticks = 0;
+    }
+    chSysUnlock();
+
+    stats->window_us = ticks_to_us(window_ticks);
+    stats->achieved_rate_hz = window_ticks > 0 ? (float)stats->num_published * CH_CFG_ST_FREQUENCY / window_ticks : 0.0f;
+    stats->mean_lateness_us = stats->num_published > 0 ? ticks_to_us(lateness_sum_ticks) / stats->num_published : 0;
+    stats->max_lateness_us = ticks_to_us(lateness_max_ticks);
+}
+
+static void publish_task_func(struct worker_thread_timer_task_s* task) {
+    systime_t t_now = chVTGetSystemTimeX();
+    systime_t min_ticks_to_next = TIME_INFINITE;
+
+    chSysLock();
+    rescan_requested = false;
+    struct uavcan_publish_stream_s* stream = stream_list_head;
+    chSysUnlock();
+
+    while (stream) {
+        systime_t ticks_to_next = uavcan_publish_scheduler_service_stream(stream, t_now);
+        if (ticks_to_next < min_ticks_to_next) {
+            min_ticks_to_next = ticks_to_next;
+        }
+
+        chSysLock();
+        stream = stream->next;
+        chSysUnlock();
+    }
+
+    // A stream added while the list was being walked may be due before anything seen here
+    chSysLock();
+    worker_thread_timer_task_reschedule_I(&WT, task, rescan_requested ? TIME_IMMEDIATE : min_ticks_to_next);
+    chSysUnlock();
+}
+
+// Publishes stream if it is due. Returns the ticks until it next needs to be serviced.
+static systime_t uavcan_publish_scheduler_service_stream(struct uavcan_publish_stream_s* stream, systime_t t_now) {
+    // next_publish_systime is at most one period ahead, so anything further ahead is a wrapped time in the past
+    systime_t ticks_to_publish = stream->next_publish_systime - t_now;
+    if (ticks_to_publish != 0 && ticks_to_publish <= stream->period) {
+        return ticks_to_publish;
+    }
+
+    // Periods that were missed entirely are dropped rather than published back to back to catch up
+    systime_t lateness = t_now - stream->next_publish_systime;
+    if (lateness >= stream->period) {
+        uint32_t num_missed = lateness / stream->period;
+        stream->next_publish_systime += num_missed * stream->period;
+        lateness -= num_missed * stream->period;
+
+        chSysLock();
+        stream->num_missed += num_missed;
+        chSysUnlock();
+    }
+
+    chSysLock();
+    systime_t ticks_until_available;
+    struct bandwidth_budget_s* budget = &bandwidth_budgets[stream->uavcan_idx];
+    if (!bandwidth_budget_available_I(budget, stream->frames_per_publication, t_now, &ticks_until_available)) {
+        if (!stream->deferred) {
+            stream->deferred = true;
+            stream->num_deferred++;
+        }
+        chSysUnlock();
+        return ticks_until_available;
+    }
+    chSysUnlock();
+
+    stream->deferred = false;
+    stream->next_publish_systime += stream->period;
+
+    if (!stream->source_cb(stream->msg, stream->source_ctx)) {
+        chSysLock();
+        stream->num_skipped++;
+        chSysUnlock();
+        return stream->next_publish_systime - t_now;
+    }
+
+    bool sent = uavcan_broadcast(stream->uavcan_idx, stream->msg_descriptor, stream->priority, stream->msg);
+
+    chSysLock();
+    if (sent) {
+        if (budget->frames_per_sec != 0) {
+            budget->credit -= MIN(budget->credit, (uint64_t)stream->frames_per_publication * CH_CFG_ST_FREQUENCY);
+        }
+        stream->num_published++;
+        stream->lateness_sum_ticks += lateness;
+        stream->lateness_max_ticks = MAX(stream->lateness_max_ticks, lateness);
+    } else {
+        stream->num_send_failures++;
+    }
+    chSysUnlock();
+
+    return stream->next_publish_systime - t_now;
+}
+
+static systime_t uavcan_publish_scheduler_choose_first_publish_systime_I(systime_t period, systime_t t_now) {
+    chDbgCheckClassI();
+
+    const systime_t window = MAX(LL_US2ST(UAVCAN_PUBLISH_SCHEDULER_SPREAD_WINDOW_US), 1);
+    systime_t best_ofs = 0;
+    uint64_t best_cost = UINT64_MAX;
+
+    for (uint32_t i=0; i<UAVCAN_PUBLISH_SCHEDULER_PHASE_CANDIDATES; i++) {
+        systime_t ofs = (systime_t)(((uint64_t)period * i) / UAVCAN_PUBLISH_SCHEDULER_PHASE_CANDIDATES);
+        uint64_t cost = 0;
+
+        for (struct uavcan_publish_stream_s* other = stream_list_head; other != NULL; other = other->next) {
+            // Distance from the candidate to the nearest publication of the other stream, assuming it keeps its phase
+            systime_t other_ticks_to_publish = other->next_publish_systime - t_now;
+            if (other_ticks_to_publish > other->period) {
+                other_ticks_to_publish = 0;
+            }
+            systime_t rem = (systime_t)(((uint64_t)ofs + other->period - other_ticks_to_publish % other->period) % other->period);
+            systime_t dist = MIN(rem, other->period - rem);
+            if (dist < window) {
+                cost += (uint64_t)other->frames_per_publication * (window - dist);
+            }
+        }
+
+        if (cost < best_cost) {
+            best_cost = cost;
+            best_ofs = ofs;
+        }
+    }
+
+    return t_now + best_ofs;
+}
+
+static bool bandwidth_budget_available_I(struct bandwidth_budget_s* budget, uint16_t num_frames, systime_t t_now, systime_t* ticks_until_available) {
+    chDbgCheckClassI();
+
+    if (budget->frames_per_sec == 0) {
+        return true;
+    }
+
+    uint64_t required_credit = (uint64_t)num_frames * CH_CFG_ST_FREQUENCY;
+    uint64_t max_credit = MAX((uint64_t)budget->frames_per_sec * CH_CFG_ST_FREQUENCY * UAVCAN_PUBLISH_SCHEDULER_BUDGET_BURST_MS / 1000, required_credit);
+
+    budget->credit += (uint64_t)(systime_t)(t_now - budget->last_refill_systime) * budget->frames_per_sec;
+    budget->credit = MIN(budget->credit, max_credit);
+    budget->last_refill_systime = t_now;
+
+    if (budget->credit >= required_credit) {
+        return true;
+    }
+
+    *ticks_until_available = (systime_t)((required_credit - budget->credit + budget->frames_per_sec - 1) / budget->frames_per_sec);
+    return false;
+}
+
+static uint32_t ticks_to_us(uint64_t ticks) {
+    return ticks * 1000000 / CH_CFG_ST_FREQUENCY;
+}
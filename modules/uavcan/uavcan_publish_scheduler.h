@@ -0,0 +1,60 @@
+#pragma once
+
+#include <modules/uavcan/uavcan.h>
+#include <ch.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// - Fills msg with the stream's next message just before it is broadcast. Returning false skips this publication, for
+//   example when there is no new data.
+typedef bool (*uavcan_publish_source_func_ptr_t)(void* msg, void* ctx);
+
+struct uavcan_publish_stream_stats_s {
+    uint32_t window_us;
+    uint32_t num_published;
+    uint32_t num_skipped;
+    uint32_t num_deferred;
+    uint32_t num_missed;
+    uint32_t num_send_failures;
+    float achieved_rate_hz;
+    uint32_t mean_lateness_us;
+    uint32_t max_lateness_us;
+};
+
+struct uavcan_publish_stream_s {
+    uint8_t uavcan_idx;
+    uint8_t priority;
+    uint16_t frames_per_publication;
+    bool deferred;
+    const struct uavcan_message_descriptor_s* msg_descriptor;
+    systime_t period;
+    void* msg;
+    uavcan_publish_source_func_ptr_t source_cb;
+    void* source_ctx;
+    systime_t next_publish_systime;
+
+    systime_t stats_window_begin_systime;
+    uint32_t num_published;
+    uint32_t num_skipped;
+    uint32_t num_deferred;
+    uint32_t num_missed;
+    uint32_t num_send_failures;
+    uint32_t lateness_sum_ticks;
+    systime_t lateness_max_ticks;
+
+    struct uavcan_publish_stream_s* next;
+};
+
+// - Registers stream to broadcast msg_descriptor on uavcan_idx every period ticks. msg must point to deserialized_size
+//   bytes, which source_cb fills in before each publication. The first publication is placed at the phase within period
+//   that overlaps least with the streams already registered, so that streams of similar rates don't go out in bursts.
+//   Due streams are served in priority order.
+bool uavcan_publish_scheduler_add_stream(struct uavcan_publish_stream_s* stream, uint8_t uavcan_idx, const struct uavcan_message_descriptor_s* msg_descriptor, uint8_t priority, systime_t period, void* msg, uavcan_publish_source_func_ptr_t source_cb, void* source_ctx);
+
+// - Limits the frames per second that scheduled streams may send on uavcan_idx. A stream that would exceed the budget is
+//   held back until enough budget has accumulated and counted as deferred. 0 removes the limit.
+void uavcan_publish_scheduler_set_bandwidth_budget(uint8_t uavcan_idx, uint32_t frames_per_sec);
+
+// - Reports the stream's counters since they were last reset. Lateness is measured from the scheduled publication time.
+//   A stream that falls more than a full period behind drops the periods it missed rather than catching up in a burst.
+void uavcan_publish_scheduler_get_stream_stats(struct uavcan_publish_stream_s* stream, struct uavcan_publish_stream_stats_s* stats, bool reset);
@@ -0,0 +1,23 @@
+#include "uavcan_rx_dispatch.h"
+
+#include <stddef.h>
+
+uint32_t uavcan_rx_dispatch_key(uint8_t transfer_type, uint16_t data_type_id) {
+    return ((uint32_t)transfer_type << 16) | data_type_id;
+}
+
+struct uavcan_rx_list_item_s** uavcan_rx_dispatch_find_slot(struct uavcan_rx_list_item_s** table, uint32_t dispatch_key) {
+    const uint32_t mask = UAVCAN_RX_DISPATCH_TABLE_SIZE-1;
+
+    // Multiplicative hashing spreads the clustered data type ids across the table
+    uint32_t idx = (dispatch_key * 2654435769UL) >> 16;
+
+    for (uint32_t probe=0; probe<UAVCAN_RX_DISPATCH_TABLE_SIZE; probe++) {
+        struct uavcan_rx_list_item_s** slot = &table[(idx+probe) & mask];
+        if (!*slot || (*slot)->dispatch_key == dispatch_key) {
+            return slot;
+        }
+    }
+
+    return NULL;
+}
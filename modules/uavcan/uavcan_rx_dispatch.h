@@ -0,0 +1,29 @@
+#pragma once
+
+#include <stdint.h>
+#include <modules/pubsub/pubsub.h>
+
+// Open-addressed table of subscribed (transfer type, data type id) keys. Must be a power of two.
+#ifndef UAVCAN_RX_DISPATCH_TABLE_SIZE
+#define UAVCAN_RX_DISPATCH_TABLE_SIZE 64
+#endif
+
+#if (UAVCAN_RX_DISPATCH_TABLE_SIZE & (UAVCAN_RX_DISPATCH_TABLE_SIZE-1)) != 0
+#error UAVCAN_RX_DISPATCH_TABLE_SIZE must be a power of two
+#endif
+
+struct uavcan_message_descriptor_s;
+
+struct uavcan_rx_list_item_s {
+    const struct uavcan_message_descriptor_s* msg_descriptor;
+    uint32_t dispatch_key;
+    struct pubsub_topic_s topic;
+    struct uavcan_rx_list_item_s* next; // next item with the same dispatch key
+};
+
+// - Returns the dispatch key of a transfer type (a CanardTransferType) and data type id
+uint32_t uavcan_rx_dispatch_key(uint8_t transfer_type, uint16_t data_type_id);
+
+// - Returns the slot of table holding dispatch_key, or the empty slot where it would be inserted. Returns NULL if the
+//   table is full.
+struct uavcan_rx_list_item_s** uavcan_rx_dispatch_find_slot(struct uavcan_rx_list_item_s** table, uint32_t dispatch_key);
@@ -0,0 +1,220 @@
+#include "uavcan_service_client.h"
+#include <common/helpers.h>
+
+// Matches no received transfer ID, which are only 5 bits
+#define UAVCAN_SERVICE_CLIENT_TRANSFER_ID_NONE 0xff
+
+static struct uavcan_service_client_s* client_list_head;
+
+static void uavcan_service_client_response_handler(size_t msg_size, const void* buf, void* ctx);
+static void uavcan_service_client_timeout_task_func(struct worker_thread_timer_task_s* task);
+static bool uavcan_service_client_send(struct uavcan_service_client_request_s* request);
+static void uavcan_service_client_unlink_request(struct uavcan_service_client_request_s* request);
+static void uavcan_service_client_update_timeout_task(struct uavcan_service_client_s* client);
+static bool uavcan_service_client_request_matches(const struct uavcan_service_client_request_s* request, uint8_t uavcan_idx, uint16_t data_type_id, uint8_t source_node_id);
+
+void uavcan_service_client_init(struct uavcan_service_client_s* client, struct worker_thread_s* worker_thread) {
+    if (!client || !worker_thread) {
+        return;
+    }
+
+    client->worker_thread = worker_thread;
+    client->pending_list_head = NULL;
+    pubsub_init_topic(&client->response_topic, NULL);
+    worker_thread_add_listener_task(worker_thread, &client->response_listener_task, &client->response_topic, uavcan_service_client_response_handler, client);
+    worker_thread_add_timer_task(worker_thread, &client->timeout_task, uavcan_service_client_timeout_task_func, client, TIME_INFINITE, false);
+
+    chSysLock();
+    client->next = client_list_head;
+    client_list_head = client;
+    chSysUnlock();
+}
+
+bool uavcan_service_client_request(struct uavcan_service_client_s* client, struct uavcan_service_client_request_s* request, uint8_t uavcan_idx, const struct uavcan_message_descriptor_s* req_descriptor, uint8_t priority, uint8_t server_node_id, void* req_msg, systime_t timeout, uint8_t max_retries, uavcan_service_client_response_cb_ptr_t response_cb, void* ctx) {
+    if (!client || !request || !req_descriptor || !req_descriptor->resp_descriptor || !req_msg || !response_cb || timeout == TIME_IMMEDIATE || timeout == TIME_INFINITE) {
+        return false;
+    }
+
+    request->client = client;
+    request->uavcan_idx = uavcan_idx;
+    request->priority = priority;
+    request->server_node_id = server_node_id;
+    request->retries_remaining = max_retries;
+    request->data_type_id = req_descriptor->default_data_type_id;
+    request->req_descriptor = req_descriptor;
+    request->req_msg = req_msg;
+    request->timeout = timeout;
+    request->response_cb = response_cb;
+    request->ctx = ctx;
+
+    // The request is pending before it is sent, so that a quick response finds it. A reused request still holds the
+    // transfer ID it was last sent with, which is cleared so that a late response to that transfer can't match it.
+    chSysLock();
+    request->transfer_id = UAVCAN_SERVICE_CLIENT_TRANSFER_ID_NONE;
+    request->next = client->pending_list_head;
+    client->pending_list_head = request;
+    chSysUnlock();
+
+    if (!uavcan_service_client_send(request)) {
+        uavcan_service_client_unlink_request(request);
+        return false;
+    }
+
+    uavcan_service_client_update_timeout_task(client);
+    return true;
+}
+
+void uavcan_service_client_cancel(struct uavcan_service_client_request_s* request) {
+    if (!uavcan_service_client_request_pending(request)) {
+        return;
+    }
+
+    struct uavcan_service_client_s* client = request->client;
+    uavcan_service_client_unlink_request(request);
+    uavcan_service_client_update_timeout_task(client);
+}
+
+bool uavcan_service_client_request_pending(struct uavcan_service_client_request_s* request) {
+    if (!request || !request->client) {
+        return false;
+    }
+
+    chSysLock();
+    struct uavcan_service_client_request_s* pending = request->client->pending_list_head;
+    while (pending && pending != request) {
+        pending = pending->next;
+    }
+    chSysUnlock();
+
+    return pending != NULL;
+}
+
+bool uavcan_service_client_accept_response(uint8_t uavcan_idx, uint16_t data_type_id, uint8_t source_node_id, uint64_t* out_data_type_signature) {
+    // Only the first frame of a transfer is seen here, so the transfer ID can't be checked yet
+    bool ret = false;
+    chSysLock();
+    for (struct uavcan_service_client_s* client = client_list_head; client && !ret; client = client->next) {
+        for (struct uavcan_service_client_request_s* request = client->pending_list_head; request; request = request->next) {
+            if (uavcan_service_client_request_matches(request, uavcan_idx, data_type_id, source_node_id)) {
+                *out_data_type_signature = request->req_descriptor->resp_descriptor->data_type_signature;
+                ret = true;
+                break;
+            }
+        }
+    }
+    chSysUnlock();
+
+    return ret;
+}
+
+struct pubsub_topic_s* uavcan_service_client_find_response_topic(uint8_t uavcan_idx, const CanardRxTransfer* transfer, const struct uavcan_message_descriptor_s** resp_descriptor) {
+    if (!transfer || !resp_descriptor) {
+        return NULL;
+    }
+
+    struct pubsub_topic_s* ret = NULL;
+    chSysLock();
+    for (struct uavcan_service_client_s* client = client_list_head; client && !ret; client = client->next) {
+        for (struct uavcan_service_client_request_s* request = client->pending_list_head; request; request = request->next) {
+            if (uavcan_service_client_request_matches(request, uavcan_idx, transfer->data_type_id, transfer->source_node_id) && request->transfer_id == transfer->transfer_id) {
+                *resp_descriptor = request->req_descriptor->resp_descriptor;
+                ret = &client->response_topic;
+                break;
+            }
+        }
+    }
+    chSysUnlock();
+
+    return ret;
+}
+
+static void uavcan_service_client_response_handler(size_t msg_size, const void* buf, void* ctx) {
+    (void)msg_size;
+    struct uavcan_service_client_s* client = ctx;
+    const struct uavcan_deserialized_message_s* msg_wrapper = buf;
+
+    // The request may have timed out or been cancelled since the response was queued, so it is looked up again here
+    chSysLock();
+    struct uavcan_service_client_request_s* request = client->pending_list_head;
+    while (request && !(uavcan_service_client_request_matches(request, msg_wrapper->uavcan_idx, msg_wrapper->data_type_id, msg_wrapper->source_node_id) && request->transfer_id == msg_wrapper->transfer_id)) {
+        request = request->next;
+    }
+    chSysUnlock();
+
+    if (!request) {
+        return;
+    }
+
+    uavcan_service_client_unlink_request(request);
+    request->response_cb(request, msg_wrapper, request->ctx);
+    uavcan_service_client_update_timeout_task(client);
+}
+
+static void uavcan_service_client_timeout_task_func(struct worker_thread_timer_task_s* task) {
+    struct uavcan_service_client_s* client = worker_thread_task_get_user_context(task);
+
+    // Callbacks may issue or cancel requests, so the list is searched again after each expired request is dealt with
+    while (true) {
+        systime_t t_now = chVTGetSystemTimeX();
+        struct uavcan_service_client_request_s* request = client->pending_list_head;
+        while (request && t_now - request->send_systime < request->timeout) {
+            request = request->next;
+        }
+
+        if (!request) {
+            break;
+        }
+
+        if (request->retries_remaining > 0) {
+            request->retries_remaining--;
+            uavcan_service_client_send(request);
+            continue;
+        }
+
+        uavcan_service_client_unlink_request(request);
+        request->response_cb(request, NULL, request->ctx);
+    }
+
+    uavcan_service_client_update_timeout_task(client);
+}
+
+static bool uavcan_service_client_send(struct uavcan_service_client_request_s* request) {
+    uint8_t transfer_id;
+    if (!uavcan_request_reserve_transfer_id(request->uavcan_idx, request->req_descriptor, request->server_node_id, &transfer_id)) {
+        return false;
+    }
+
+    // The transfer ID is set before sending so that a quick response can't arrive ahead of it. A request that can't be
+    // sent, for example for lack of tx frames or before a node ID is set, is left to its timeout and retries. Only the
+    // 5 bits that go on the wire are kept, as received transfers carry no more than that to compare against.
+    chSysLock();
+    request->transfer_id = transfer_id & 0x1f;
+    request->send_systime = chVTGetSystemTimeX();
+    chSysUnlock();
+
+    uavcan_request_with_transfer_id(request->uavcan_idx, request->req_descriptor, request->priority, request->server_node_id, transfer_id, request->req_msg);
+    return true;
+}
+
+static void uavcan_service_client_unlink_request(struct uavcan_service_client_request_s* request) {
+    chSysLock();
+    LINKED_LIST_REMOVE(struct uavcan_service_client_request_s, request->client->pending_list_head, request);
+    chSysUnlock();
+}
+
+static void uavcan_service_client_update_timeout_task(struct uavcan_service_client_s* client) {
+    systime_t t_now = chVTGetSystemTimeX();
+    systime_t min_ticks_to_timeout = TIME_INFINITE;
+
+    for (struct uavcan_service_client_request_s* request = client->pending_list_head; request; request = request->next) {
+        systime_t elapsed = t_now - request->send_systime;
+        systime_t ticks_to_timeout = elapsed < request->timeout ? request->timeout - elapsed : TIME_IMMEDIATE;
+        min_ticks_to_timeout = MIN(min_ticks_to_timeout, ticks_to_timeout);
+    }
+
+    worker_thread_timer_task_reschedule(client->worker_thread, &client->timeout_task, min_ticks_to_timeout);
+}
+
+static bool uavcan_service_client_request_matches(const struct uavcan_service_client_request_s* request, uint8_t uavcan_idx, uint16_t data_type_id, uint8_t source_node_id) {
+    return request->uavcan_idx == uavcan_idx && request->data_type_id == data_type_id && request->server_node_id == source_node_id;
+}
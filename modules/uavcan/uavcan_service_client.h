@@ -0,0 +1,65 @@
+#pragma once
+
+#include <modules/uavcan/uavcan.h>
+#include <modules/worker_thread/worker_thread.h>
+#include <ch.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+struct uavcan_service_client_request_s;
+
+// - Called on the client's worker thread with the matching response, or with res NULL once the request has timed out
+//   after its last retry. The request is no longer pending when this is called, so it may be reused from here.
+typedef void (*uavcan_service_client_response_cb_ptr_t)(struct uavcan_service_client_request_s* request, const struct uavcan_deserialized_message_s* res, void* ctx);
+
+struct uavcan_service_client_s;
+
+struct uavcan_service_client_request_s {
+    struct uavcan_service_client_s* client;
+    uint8_t uavcan_idx;
+    uint8_t priority;
+    uint8_t server_node_id;
+    uint8_t transfer_id;
+    uint8_t retries_remaining;
+    uint16_t data_type_id;
+    const struct uavcan_message_descriptor_s* req_descriptor;
+    void* req_msg;
+    systime_t timeout;
+    systime_t send_systime;
+    uavcan_service_client_response_cb_ptr_t response_cb;
+    void* ctx;
+    struct uavcan_service_client_request_s* next;
+};
+
+struct uavcan_service_client_s {
+    struct worker_thread_s* worker_thread;
+    struct pubsub_topic_s response_topic;
+    struct worker_thread_listener_task_s response_listener_task;
+    struct worker_thread_timer_task_s timeout_task;
+    struct uavcan_service_client_request_s* pending_list_head;
+    struct uavcan_service_client_s* next;
+};
+
+// - Sets up client to run its response callbacks, timeouts and retries on worker_thread. Requests are issued and
+//   cancelled from that thread too.
+void uavcan_service_client_init(struct uavcan_service_client_s* client, struct worker_thread_s* worker_thread);
+
+// - Sends req_msg to server_node_id and keeps request pending until the response with the same transfer ID arrives from
+//   that node. If none arrives within timeout, the request is sent again with a new transfer ID, up to max_retries times.
+//   A request that can't be sent is left to its retries, so this only fails for bad arguments or an unknown uavcan_idx.
+//   request must not already be pending, and req_msg must stay valid while it is. Any number of requests may be pending
+//   on one client.
+bool uavcan_service_client_request(struct uavcan_service_client_s* client, struct uavcan_service_client_request_s* request, uint8_t uavcan_idx, const struct uavcan_message_descriptor_s* req_descriptor, uint8_t priority, uint8_t server_node_id, void* req_msg, systime_t timeout, uint8_t max_retries, uavcan_service_client_response_cb_ptr_t response_cb, void* ctx);
+
+// - Drops request without calling its callback. A response that arrives for it later is ignored.
+void uavcan_service_client_cancel(struct uavcan_service_client_request_s* request);
+
+bool uavcan_service_client_request_pending(struct uavcan_service_client_request_s* request);
+
+// - Used by the uavcan module to accept response transfers that a client is waiting for, whether or not anything else
+//   subscribes to the response type.
+bool uavcan_service_client_accept_response(uint8_t uavcan_idx, uint16_t data_type_id, uint8_t source_node_id, uint64_t* out_data_type_signature);
+
+// - Used by the uavcan module to find the client topic that transfer should be delivered to. Returns NULL if no pending
+//   request matches its source node, data type ID and transfer ID.
+struct pubsub_topic_s* uavcan_service_client_find_response_topic(uint8_t uavcan_idx, const CanardRxTransfer* transfer, const struct uavcan_message_descriptor_s** resp_descriptor);
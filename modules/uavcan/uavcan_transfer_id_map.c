@@ -0,0 +1,73 @@
+#include "uavcan_transfer_id_map.h"
+
+#include <common/helpers.h>
+
+// Service keys have node ids of at most 127, so this key is never used
+#define UAVCAN_TRANSFER_ID_MAP_EMPTY_KEY ((1UL<<17)-1)
+#define UAVCAN_TRANSFER_ID_MAP_LAST_USE_MASK ((1U<<15)-1)
+
+void uavcan_transfer_id_map_init(struct uavcan_transfer_id_map_s* map, size_t map_mem_size, void* map_mem) {
+    if (!map) {
+        return;
+    }
+
+    size_t size = MIN(map_mem_size/sizeof(struct uavcan_transfer_id_map_entry_s), UINT16_MAX);
+
+    map->entries = map_mem;
+    map->num_entries = size;
+    map->num_ways = MIN(size, UAVCAN_TRANSFER_ID_MAP_WAYS);
+    map->use_counter = 0;
+
+    for (size_t i=0; i<size; i++) {
+        map->entries[i].key = UAVCAN_TRANSFER_ID_MAP_EMPTY_KEY;
+        map->entries[i].last_use = 0;
+        map->entries[i].transfer_id = 0;
+    }
+}
+
+uint8_t* uavcan_transfer_id_map_retrieve(struct uavcan_transfer_id_map_s* map, bool service_not_message, uint16_t data_type_id, uint8_t dest_node_id) {
+    if (!map || !map->entries || map->num_entries == 0) {
+        return 0;
+    }
+
+    uint32_t key;
+    if (service_not_message) {
+        key = (1<<16) | ((data_type_id << 8) & 0xFF00) | ((dest_node_id << 0) & 0x00FF);
+    } else {
+        key = data_type_id;
+    }
+
+    map->use_counter = (map->use_counter+1) & UAVCAN_TRANSFER_ID_MAP_LAST_USE_MASK;
+
+    // The product is truncated to 32 bits as on the target, so that hosts with a 64 bit long hash keys the same way
+    uint32_t idx = ((uint32_t)(key * 2654435769UL) >> 16) % map->num_entries;
+
+    struct uavcan_transfer_id_map_entry_s* entry = NULL;
+    uint16_t lru_age = 0;
+    for (uint16_t i=0; i<map->num_ways; i++) {
+        struct uavcan_transfer_id_map_entry_s* candidate = &map->entries[idx];
+        if (candidate->key == key) {
+            entry = candidate;
+            break;
+        }
+
+        // Empty entries are preferred over any used entry
+        uint16_t age = candidate->key == UAVCAN_TRANSFER_ID_MAP_EMPTY_KEY ? UAVCAN_TRANSFER_ID_MAP_LAST_USE_MASK+1 : (map->use_counter - candidate->last_use) & UAVCAN_TRANSFER_ID_MAP_LAST_USE_MASK;
+        if (i == 0 || age > lru_age) {
+            lru_age = age;
+            entry = candidate;
+        }
+
+        idx = idx+1 < map->num_entries ? idx+1 : 0;
+    }
+
+    if (entry->key != key) {
+        // Not found. Evict the least recently used entry in the window.
+        entry->key = key;
+        entry->transfer_id = 0;
+    }
+
+    entry->last_use = map->use_counter;
+
+    return &entry->transfer_id;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// A key hashes to an entry, and is searched for in a window of UAVCAN_TRANSFER_ID_MAP_WAYS entries from there, wrapping
+// at the end of the working area. This bounds the search, and the least recently used entry within the window is
+// evicted. Windows overlap rather than being fixed sets, so every entry of any size of working area is used.
+#ifndef UAVCAN_TRANSFER_ID_MAP_WAYS
+#define UAVCAN_TRANSFER_ID_MAP_WAYS 4
+#endif
+
+struct __attribute__((packed)) uavcan_transfer_id_map_entry_s {
+    uint32_t key : 17;
+    uint32_t last_use : 15;
+    uint8_t transfer_id;
+};
+
+struct uavcan_transfer_id_map_s {
+    struct uavcan_transfer_id_map_entry_s* entries;
+    uint16_t num_entries;
+    uint16_t num_ways;
+    uint16_t use_counter;
+};
+
+// - Sets up map in map_mem, which holds map_mem_size/sizeof(struct uavcan_transfer_id_map_entry_s) entries
+void uavcan_transfer_id_map_init(struct uavcan_transfer_id_map_s* map, size_t map_mem_size, void* map_mem);
+
+// - Returns the transfer id of a message data type, or of a service data type and destination node. A key that isn't in
+//   the map takes the place of the least recently used entry of its window, with a transfer id of 0.
+uint8_t* uavcan_transfer_id_map_retrieve(struct uavcan_transfer_id_map_s* map, bool service_not_message, uint16_t data_type_id, uint8_t dest_node_id);
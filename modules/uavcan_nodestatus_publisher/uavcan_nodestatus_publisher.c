@@ -1,19 +1,14 @@
 #include "uavcan_nodestatus_publisher.h"
 #include <modules/uavcan/uavcan.h>
+#include <modules/uavcan/uavcan_publish_scheduler.h>
 #include <common/ctor.h>
-#include <modules/worker_thread/worker_thread.h>
-
-#ifndef UAVCAN_NODESTATUS_PUBLISHER_WORKER_THREAD
-#error Please define UAVCAN_NODESTATUS_PUBLISHER_WORKER_THREAD in framework_conf.h.
-#endif
-
-#define WT UAVCAN_NODESTATUS_PUBLISHER_WORKER_THREAD
-WORKER_THREAD_DECLARE_EXTERN(WT)
 
 static struct uavcan_protocol_NodeStatus_s node_status;
-static struct worker_thread_timer_task_s node_status_publisher_task;
+static struct uavcan_publish_stream_s node_status_stream;
+static uint64_t uptime_ticks;
+static systime_t uptime_last_systime;
 
-static void node_status_publisher_task_func(struct worker_thread_timer_task_s* task);
+static bool node_status_source_func(void* msg, void* ctx);
 
 // TODO mechanism to change node status
 
@@ -28,7 +23,7 @@ RUN_AFTER(UAVCAN_INIT) {
     node_status.sub_mode = 0;
     node_status.vendor_specific_status_code = 0;
 
-    worker_thread_add_timer_task(&WT, &node_status_publisher_task, node_status_publisher_task_func, NULL, S2ST(1), true);
+    uavcan_publish_scheduler_add_stream(&node_status_stream, 0, &uavcan_protocol_NodeStatus_descriptor, CANARD_TRANSFER_PRIORITY_LOW, S2ST(1), &node_status, node_status_source_func, NULL);
 }
 
 void set_node_health(uint8_t health) {
@@ -39,10 +34,20 @@ void set_node_mode(uint8_t mode) {
     node_status.mode = mode;
 }
 
+void set_node_vendor_specific_status_code(uint16_t vendor_specific_status_code) {
+    node_status.vendor_specific_status_code = vendor_specific_status_code;
+}
+
+
+static bool node_status_source_func(void* msg, void* ctx) {
+    (void)msg;
+    (void)ctx;
 
-static void node_status_publisher_task_func(struct worker_thread_timer_task_s* task) {
-    (void)task;
+    // Uptime is kept from system time, so that it stays right if the scheduler drops a period
+    systime_t t_now = chVTGetSystemTimeX();
+    uptime_ticks += (systime_t)(t_now - uptime_last_systime);
+    uptime_last_systime = t_now;
+    node_status.uptime_sec = uptime_ticks / CH_CFG_ST_FREQUENCY;
 
-    node_status.uptime_sec++;
-    uavcan_broadcast(0, &uavcan_protocol_NodeStatus_descriptor, CANARD_TRANSFER_PRIORITY_LOW, &node_status);
+    return true;
 }
@@ -4,4 +4,5 @@
 
 const struct uavcan_protocol_NodeStatus_s* uavcan_nodestatus_publisher_get_nodestatus_message(void);
 void set_node_health(uint8_t health);
-void set_node_mode(uint8_t mode);
\ No newline at end of file
+void set_node_mode(uint8_t mode);
+void set_node_vendor_specific_status_code(uint16_t vendor_specific_status_code);
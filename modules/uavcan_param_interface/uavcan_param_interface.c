@@ -21,12 +21,35 @@ static void getset_req_handler(size_t msg_size, const void* buf, void* ctx);
 static struct worker_thread_listener_task_s opcode_req_listener_task;
 static void opcode_req_handler(size_t msg_size, const void* buf, void* ctx);
 
+#ifdef PARAM_WORKER_THREAD
+#ifndef UAVCAN_PARAM_INTERFACE_MAX_PENDING_SAVES
+#define UAVCAN_PARAM_INTERFACE_MAX_PENDING_SAVES 4
+#endif
+
+// A save is answered once the param module reports that it is in flash. Saves requested while one is in progress are
+// held in request order, and are all answered by the store that covers them.
+struct pending_save_s {
+    uint32_t request_seq;
+    struct uavcan_deserialized_message_s req_msg;
+};
+
+static struct pending_save_s pending_saves[UAVCAN_PARAM_INTERFACE_MAX_PENDING_SAVES];
+static uint8_t num_pending_saves;
+
+static struct worker_thread_listener_task_s store_complete_listener_task;
+static void store_complete_handler(size_t msg_size, const void* buf, void* ctx);
+#endif
+
 RUN_AFTER(UAVCAN_INIT) {
     struct pubsub_topic_s* getset_req_topic = uavcan_get_message_topic(0, &uavcan_protocol_param_GetSet_req_descriptor);
     worker_thread_add_listener_task(&WT, &getset_req_listener_task, getset_req_topic, getset_req_handler, NULL);
 
     struct pubsub_topic_s* opcode_req_topic = uavcan_get_message_topic(0, &uavcan_protocol_param_ExecuteOpcode_req_descriptor);
     worker_thread_add_listener_task(&WT, &opcode_req_listener_task, opcode_req_topic, opcode_req_handler, NULL);
+
+#ifdef PARAM_WORKER_THREAD
+    worker_thread_add_listener_task(&WT, &store_complete_listener_task, param_get_store_complete_topic(), store_complete_handler, NULL);
+#endif
 }
 
 static void getset_req_handler(size_t msg_size, const void* buf, void* ctx) {
@@ -153,10 +176,22 @@ static void opcode_req_handler(size_t msg_size, const void* buf, void* ctx) {
 
     switch(req->opcode) {
         case UAVCAN_PROTOCOL_PARAM_EXECUTEOPCODE_REQ_OPCODE_SAVE:
+#ifdef PARAM_WORKER_THREAD
+            // With every slot taken, the request is refused rather than left unanswered
+            if (num_pending_saves < UAVCAN_PARAM_INTERFACE_MAX_PENDING_SAVES) {
+                pending_saves[num_pending_saves].req_msg = *msg_wrapper;
+                pending_saves[num_pending_saves].request_seq = param_store_all_in_background();
+                num_pending_saves++;
+                return;
+            }
+            res.ok = false;
+            break;
+#else
             param_acquire();
             res.ok = param_store_all();
             param_release();
             break;
+#endif
         case UAVCAN_PROTOCOL_PARAM_EXECUTEOPCODE_REQ_OPCODE_ERASE:
             param_acquire();
             res.ok = param_erase();
@@ -166,3 +201,29 @@ static void opcode_req_handler(size_t msg_size, const void* buf, void* ctx) {
 
     uavcan_respond(msg_wrapper->uavcan_idx, msg_wrapper, &res);
 }
+
+#ifdef PARAM_WORKER_THREAD
+static void store_complete_handler(size_t msg_size, const void* buf, void* ctx) {
+    (void)msg_size;
+    (void)ctx;
+
+    const struct param_store_complete_msg_s* msg = buf;
+
+    struct uavcan_protocol_param_ExecuteOpcode_res_s res;
+    memset(&res, 0, sizeof(struct uavcan_protocol_param_ExecuteOpcode_res_s));
+    res.ok = msg->success;
+
+    // Sequence numbers wrap, so the difference is compared rather than the numbers themselves. Saves that the store
+    // doesn't cover yet are kept, in order.
+    uint8_t num_remaining = 0;
+    for (uint8_t i=0; i<num_pending_saves; i++) {
+        struct pending_save_s* pending_save = &pending_saves[i];
+        if ((int32_t)(msg->request_seq - pending_save->request_seq) >= 0) {
+            uavcan_respond(pending_save->req_msg.uavcan_idx, &pending_save->req_msg, &res);
+        } else {
+            pending_saves[num_remaining++] = *pending_save;
+        }
+    }
+    num_pending_saves = num_remaining;
+}
+#endif
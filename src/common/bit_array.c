@@ -0,0 +1,90 @@
+#include <common/bit_array.h>
+#include <common/helpers.h>
+#include <string.h>
+
+// Copies shorter than this many bits are made bitwise, see tests/bench_bit_array.c
+#define COPY_BIT_ARRAY_BYTEWISE_MIN_LEN 12
+
+/**
+ * Bit array copy routine, originally developed by Ben Dyer for Libuavcan. Thanks Ben.
+ */
+
+void __attribute__((optimize("O3"))) copy_bit_array_bitwise(const uint8_t* src, uint32_t src_offset, uint32_t src_len, uint8_t* dst, uint32_t dst_offset) {
+    // Normalizing inputs
+    src += src_offset / 8;
+    dst += dst_offset / 8;
+
+    src_offset %= 8;
+    dst_offset %= 8;
+
+    const size_t last_bit = src_offset + src_len;
+    while (last_bit - src_offset)
+    {
+        const uint8_t src_bit_offset = (uint8_t)(src_offset % 8U);
+        const uint8_t dst_bit_offset = (uint8_t)(dst_offset % 8U);
+
+        const uint8_t max_offset = MAX(src_bit_offset, dst_bit_offset);
+        const uint32_t copy_bits = MIN(last_bit - src_offset, 8U - max_offset);
+
+        const uint8_t write_mask = (uint8_t)((uint8_t)(0xFF00U >> copy_bits) >> dst_bit_offset);
+        const uint8_t src_data = (uint8_t)((src[src_offset / 8U] << src_bit_offset) >> dst_bit_offset);
+
+        dst[dst_offset / 8U] = (uint8_t)((dst[dst_offset / 8U] & ~write_mask) | (src_data & write_mask));
+
+        src_offset += copy_bits;
+        dst_offset += copy_bits;
+    }
+}
+
+void __attribute__((optimize("O3"))) copy_bit_array(const uint8_t* src, uint32_t src_offset, uint32_t src_len, uint8_t* dst, uint32_t dst_offset) {
+    // Short fields take only a few passes of the bitwise loop, which costs less than setting up the bytewise copy
+    if (src_len < COPY_BIT_ARRAY_BYTEWISE_MIN_LEN) {
+        copy_bit_array_bitwise(src, src_offset, src_len, dst, dst_offset);
+        return;
+    }
+
+    src += src_offset / 8;
+    dst += dst_offset / 8;
+
+    src_offset %= 8;
+    dst_offset %= 8;
+
+    // Copy bitwise up to the next destination byte boundary
+    if (dst_offset != 0) {
+        const uint32_t head_bits = MIN(src_len, 8U - dst_offset);
+        copy_bit_array_bitwise(src, src_offset, head_bits, dst, dst_offset);
+
+        src_offset += head_bits;
+        src_len -= head_bits;
+        src += src_offset / 8;
+        src_offset %= 8;
+        dst++;
+    }
+
+    const uint32_t num_bytes = src_len / 8;
+
+    if (src_offset == 0) {
+        memcpy(dst, src, num_bytes);
+    } else {
+        // Every whole destination byte spans two source bytes that are both within the source bit range
+        const uint8_t src_rshift = 8U - src_offset;
+        uint32_t i = 0;
+
+        for (; i+4 <= num_bytes; i += 4) {
+            uint32_t word = ((uint32_t)src[i] << 24) | ((uint32_t)src[i+1] << 16) | ((uint32_t)src[i+2] << 8) | src[i+3];
+            word = (word << src_offset) | (src[i+4] >> src_rshift);
+            dst[i] = (uint8_t)(word >> 24);
+            dst[i+1] = (uint8_t)(word >> 16);
+            dst[i+2] = (uint8_t)(word >> 8);
+            dst[i+3] = (uint8_t)word;
+        }
+
+        for (; i < num_bytes; i++) {
+            dst[i] = (uint8_t)((src[i] << src_offset) | (src[i+1] >> src_rshift));
+        }
+    }
+
+    if (src_len % 8 != 0) {
+        copy_bit_array_bitwise(&src[num_bytes], src_offset, src_len % 8, &dst[num_bytes], 0);
+    }
+}
@@ -108,33 +108,3 @@ void hash_fnv_1a(uint32_t len, const uint8_t* buf, uint64_t* hash)
         *hash *= FNV_1_PRIME_64;
     }
 }
-
-uint16_t crc16_ccitt(const void *buf, size_t len, uint16_t crc) {
-    for (size_t i = 0; i < len; i++) {
-        crc = crc ^ (((uint8_t*)buf)[i] << 8);
-        for (int j = 0; j < 8; j++) {
-            if (crc & 0x8000) {
-                crc = (crc << 1) ^ 0x1021;
-            } else {
-                crc = (crc << 1);
-            }
-        }
-    }
-
-    return crc;
-}
-
-uint32_t crc32(const uint8_t *buf, uint32_t len, uint32_t crc)
-{
-    uint32_t i;
-    uint8_t j;
-
-    crc = ~crc;
-    for (i = 0; i < len; i++) {
-        crc = crc ^ buf[i];
-        for (j = 0; j < 8; j++) {
-            crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
-        }
-    }
-    return ~crc;
-}
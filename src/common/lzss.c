@@ -0,0 +1,137 @@
+#include <common/lzss.h>
+#include <string.h>
+
+enum lzss_decoder_state_t {
+    LZSS_STATE_HEADER = 0,
+    LZSS_STATE_FLAGS,
+    LZSS_STATE_ITEM,
+    LZSS_STATE_MATCH_BYTE1,
+    LZSS_STATE_ERROR
+};
+
+static bool lzss_decoder_parse_header(struct lzss_decoder_s* decoder);
+static bool lzss_decoder_output_match(struct lzss_decoder_s* decoder, uint8_t byte1);
+
+void lzss_decoder_init(struct lzss_decoder_s* decoder, lzss_output_func_ptr_t output_cb, lzss_history_func_ptr_t history_cb, void* ctx) {
+    if (!decoder) {
+        return;
+    }
+
+    memset(decoder, 0, sizeof(*decoder));
+    decoder->state = LZSS_STATE_HEADER;
+    decoder->output_cb = output_cb;
+    decoder->history_cb = history_cb;
+    decoder->ctx = ctx;
+}
+
+bool lzss_decoder_feed(struct lzss_decoder_s* decoder, const uint8_t* buf, size_t len) {
+    if (!decoder || (!buf && len > 0)) {
+        return false;
+    }
+
+    for (size_t i=0; i<len; i++) {
+        uint8_t byte = buf[i];
+
+        switch (decoder->state) {
+            case LZSS_STATE_HEADER:
+                decoder->header[decoder->header_len++] = byte;
+                if (decoder->header_len == LZSS_HEADER_SIZE) {
+                    decoder->state = lzss_decoder_parse_header(decoder) ? LZSS_STATE_FLAGS : LZSS_STATE_ERROR;
+                }
+                break;
+
+            case LZSS_STATE_FLAGS:
+                // The compressor never emits a flag byte after the last item, so this is trailing garbage
+                if (decoder->out_len == decoder->out_size) {
+                    decoder->state = LZSS_STATE_ERROR;
+                    break;
+                }
+                decoder->flags = byte;
+                decoder->flags_left = 8;
+                decoder->state = LZSS_STATE_ITEM;
+                break;
+
+            case LZSS_STATE_ITEM:
+                if (decoder->out_len == decoder->out_size) {
+                    decoder->state = LZSS_STATE_ERROR;
+                    break;
+                }
+
+                if (decoder->flags & 1) {
+                    decoder->output_cb(byte, decoder->ctx);
+                    decoder->out_len++;
+                    decoder->flags >>= 1;
+                    decoder->flags_left--;
+                    if (decoder->flags_left == 0) {
+                        decoder->state = LZSS_STATE_FLAGS;
+                    }
+                } else {
+                    decoder->match_byte0 = byte;
+                    decoder->state = LZSS_STATE_MATCH_BYTE1;
+                }
+                break;
+
+            case LZSS_STATE_MATCH_BYTE1:
+                if (!lzss_decoder_output_match(decoder, byte)) {
+                    decoder->state = LZSS_STATE_ERROR;
+                    break;
+                }
+                decoder->flags >>= 1;
+                decoder->flags_left--;
+                decoder->state = decoder->flags_left == 0 ? LZSS_STATE_FLAGS : LZSS_STATE_ITEM;
+                break;
+
+            default:
+                break;
+        }
+
+        if (decoder->state == LZSS_STATE_ERROR) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool lzss_decoder_header_complete(const struct lzss_decoder_s* decoder) {
+    return decoder && decoder->state != LZSS_STATE_HEADER && decoder->state != LZSS_STATE_ERROR;
+}
+
+uint32_t lzss_decoder_get_output_size(const struct lzss_decoder_s* decoder) {
+    if (!lzss_decoder_header_complete(decoder)) {
+        return 0;
+    }
+
+    return decoder->out_size;
+}
+
+bool lzss_decoder_finished(const struct lzss_decoder_s* decoder) {
+    // A match can't be left half read at the end of the output, since it is only counted once both bytes are in
+    return lzss_decoder_header_complete(decoder) && decoder->state != LZSS_STATE_MATCH_BYTE1 && decoder->out_len == decoder->out_size;
+}
+
+static bool lzss_decoder_parse_header(struct lzss_decoder_s* decoder) {
+    if (memcmp(decoder->header, LZSS_MAGIC, LZSS_MAGIC_SIZE) != 0) {
+        return false;
+    }
+
+    decoder->out_size = (uint32_t)decoder->header[4] | ((uint32_t)decoder->header[5] << 8) | ((uint32_t)decoder->header[6] << 16) | ((uint32_t)decoder->header[7] << 24);
+    return true;
+}
+
+static bool lzss_decoder_output_match(struct lzss_decoder_s* decoder, uint8_t byte1) {
+    uint32_t distance = ((uint32_t)decoder->match_byte0 | ((uint32_t)(byte1 >> 4) << 8)) + 1;
+    uint32_t length = (byte1 & 0x0f) + LZSS_MIN_MATCH;
+
+    if (distance > decoder->out_len || length > decoder->out_size - decoder->out_len) {
+        return false;
+    }
+
+    // Matches may overlap the bytes they produce, so each byte is read back only after the one before it is output
+    for (uint32_t i=0; i<length; i++) {
+        decoder->output_cb(decoder->history_cb(decoder->out_len - distance, decoder->ctx), decoder->ctx);
+        decoder->out_len++;
+    }
+
+    return true;
+}
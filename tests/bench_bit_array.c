@@ -0,0 +1,46 @@
+// Times copy_bit_array against copy_bit_array_bitwise for the copies the UAVCAN serializer makes: chunks of up to 7
+// bytes into a CAN frame, at every combination of sub-byte source and destination offsets.
+
+#include <common/bit_array.h>
+#include <stdio.h>
+#include <time.h>
+
+#define NUM_ROUNDS 200000
+
+typedef void (*copy_func_ptr_t)(const uint8_t* src, uint32_t src_offset, uint32_t src_len, uint8_t* dst, uint32_t dst_offset);
+
+static double get_time_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static double bench(copy_func_ptr_t copy_func, uint32_t src_len) {
+    static uint8_t src[16];
+    static volatile uint8_t sink;
+    uint8_t dst[16] = {0};
+
+    for (uint32_t i=0; i<sizeof(src); i++) {
+        src[i] = (uint8_t)(i*37+11);
+    }
+
+    double t_start = get_time_s();
+    for (uint32_t round=0; round<NUM_ROUNDS; round++) {
+        for (uint32_t ofs=0; ofs<64; ofs++) {
+            copy_func(src, ofs%8, src_len, dst, ofs/8);
+        }
+        sink = dst[round % sizeof(dst)];
+    }
+    (void)sink;
+
+    return (get_time_s() - t_start) * 1e9 / (NUM_ROUNDS*64.0);
+}
+
+int main(void) {
+    printf("%8s %16s %16s\n", "bits", "bitwise ns/copy", "copy ns/copy");
+    const uint32_t lengths[] = {3, 7, 8, 12, 16, 32, 56};
+    for (uint32_t i=0; i<sizeof(lengths)/sizeof(lengths[0]); i++) {
+        printf("%8u %16.2f %16.2f\n", lengths[i], bench(copy_bit_array_bitwise, lengths[i]), bench(copy_bit_array, lengths[i]));
+    }
+    return 0;
+}
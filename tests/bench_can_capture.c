@@ -0,0 +1,83 @@
+// Times can_capture_frame_I per frame, as the can module calls it with the system locked for every frame received and
+// transmitted: while the ring is being drained, while capture is disabled, and while the ring is full and frames are
+// dropped. The cost of taking and releasing the simulated system lock is timed on its own and subtracted. Reading out
+// with can_capture_read is timed per record.
+
+#include <modules/can_capture/can_capture.h>
+#include <ch.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define NUM_FRAMES 10000000
+#define DRAIN_INTERVAL 64
+
+static double get_time_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static struct can_frame_s frame;
+
+static double bench_lock_only(void) {
+    double t_start = get_time_s();
+    for (uint32_t i=0; i<NUM_FRAMES; i++) {
+        chSysLock();
+        __asm__ volatile("" : : "r"(&frame) : "memory");
+        chSysUnlock();
+    }
+    return (get_time_s() - t_start) * 1e9 / NUM_FRAMES;
+}
+
+// - Returns the time per captured frame, and the time per record read out if drain is set
+static double bench_capture(bool drain, double* read_ns) {
+    static struct can_capture_record_s records[DRAIN_INTERVAL];
+    double total_read_s = 0;
+    uint32_t num_read = 0;
+
+    double t_start = get_time_s();
+    for (uint32_t i=0; i<NUM_FRAMES; i++) {
+        frame.EID = i & 0x1FFFFFFF;
+        chSysLock();
+        can_capture_frame_I(0, &frame, i, i & 1);
+        chSysUnlock();
+
+        if (drain && i % DRAIN_INTERVAL == DRAIN_INTERVAL-1) {
+            double t_read_start = get_time_s();
+            num_read += can_capture_read(records, DRAIN_INTERVAL);
+            total_read_s += get_time_s() - t_read_start;
+        }
+    }
+    double ns = (get_time_s() - t_start - total_read_s) * 1e9 / NUM_FRAMES;
+
+    if (read_ns) {
+        *read_ns = num_read ? total_read_s * 1e9 / num_read : 0;
+    }
+    return ns;
+}
+
+int main(void) {
+    frame.IDE = 1;
+    frame.DLC = 8;
+    memset(frame.data, 0x55, sizeof(frame.data));
+
+    double lock_ns = bench_lock_only();
+
+    double read_ns;
+    double drained_ns = bench_capture(true, &read_ns);
+
+    can_capture_set_enabled(false);
+    double disabled_ns = bench_capture(false, NULL);
+
+    can_capture_set_enabled(true);
+    double full_ns = bench_capture(false, NULL);
+
+    printf("%28s %10s\n", "", "ns/frame");
+    printf("%28s %10.2f\n", "capture, ring drained", drained_ns - lock_ns);
+    printf("%28s %10.2f\n", "capture disabled", disabled_ns - lock_ns);
+    printf("%28s %10.2f\n", "ring full, frame dropped", full_ns - lock_ns);
+    printf("%28s %10.2f\n", "can_capture_read per record", read_ns);
+    printf("%u frames dropped\n", can_capture_get_dropped_count());
+    return 0;
+}
@@ -0,0 +1,175 @@
+// Runs CAN traffic between several nodes on the virtual bus at 1 Mbit/s and reports, against the offered load, the
+// transfers and frames per second that got through, the bus utilisation, and how long transfers waited from being
+// enqueued to their last frame completing. Each sender has its own priority and enqueues multi-frame transfers at random
+// intervals that average out to its share of the offered load, so that senders contend for the bus at any load. The
+// host time spent per simulated frame is the cost of the simulator itself. Queue waits are in system ticks of the
+// simulated ChibiOS, so they are only resolved to 0.1 ms.
+
+#include <sim.h>
+#include <modules/can/can.h>
+#include <modules/can/can_helpers.h>
+#include <modules/can_driver_virtual/can_driver_virtual.h>
+#include <modules/pubsub/pubsub.h>
+#include <modules/worker_thread/worker_thread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+WORKER_THREAD_SPAWN(lpwork_thread, LOWPRIO, 1024)
+WORKER_THREAD_SPAWN(can_thread, LOWPRIO, 1024)
+
+PUBSUB_TOPIC_GROUP_CREATE(default_topic_group, 16384)
+
+#define NUM_SENDERS 4
+#define FRAMES_PER_TRANSFER 3
+#define TX_TIMEOUT_MS 100
+#define RUN_TIME_MS 2000
+#define DRAIN_TIME_MS 200
+
+struct sender_s {
+    struct can_driver_virtual_node_s node;
+    struct can_instance_s* instance;
+    uint8_t priority;
+    systime_t mean_interval_ticks;
+    struct worker_thread_timer_task_s traffic_task;
+    struct pubsub_topic_s completion_topic;
+    struct worker_thread_listener_task_s completion_listener_task;
+};
+
+struct results_s {
+    uint32_t transfers_enqueued;
+    uint32_t transfers_not_enqueued;
+    uint32_t transfers_completed;
+    uint32_t transfers_failed;
+    uint64_t wait_ticks_sum;
+    systime_t wait_ticks_max;
+};
+
+static struct sender_s senders[NUM_SENDERS];
+static struct results_s results;
+
+static double get_time_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void fill_frame(struct can_frame_s* frame, uint8_t priority, uint8_t node_id) {
+    memset(frame, 0, sizeof(struct can_frame_s));
+    frame->IDE = 1;
+    frame->EID = ((uint32_t)priority << 24) | node_id;
+    frame->DLC = 8;
+}
+
+static void traffic_task_func(struct worker_thread_timer_task_s* task);
+
+// - Schedules the next transfer after a uniformly distributed interval of 1 to 2*mean_interval_ticks-1 ticks
+static void schedule_next_transfer(struct sender_s* sender) {
+    systime_t interval_ticks = 1 + rand() % (2*sender->mean_interval_ticks - 1);
+    worker_thread_add_timer_task(&lpwork_thread, &sender->traffic_task, traffic_task_func, sender, interval_ticks, false);
+}
+
+static void traffic_task_func(struct worker_thread_timer_task_s* task) {
+    struct sender_s* sender = worker_thread_task_get_user_context(task);
+
+    schedule_next_transfer(sender);
+
+    struct can_tx_frame_s* frame_list = can_allocate_tx_frames(sender->instance, NULL, FRAMES_PER_TRANSFER);
+    if (!frame_list) {
+        results.transfers_not_enqueued++;
+        return;
+    }
+
+    for (struct can_tx_frame_s* frame = frame_list; frame != NULL; frame = frame->next) {
+        fill_frame(&frame->content, sender->priority, sender - senders + 1);
+    }
+
+    can_enqueue_tx_frames(sender->instance, &frame_list, MS2ST(TX_TIMEOUT_MS), &sender->completion_topic);
+    results.transfers_enqueued++;
+}
+
+static void completion_handler(size_t msg_size, const void* buf, void* ctx) {
+    (void)msg_size;
+    (void)ctx;
+    const struct can_transmit_completion_msg_s* msg = buf;
+
+    if (!msg->transmit_success) {
+        results.transfers_failed++;
+        return;
+    }
+
+    systime_t wait_ticks = msg->completion_systime - msg->creation_systime;
+    results.transfers_completed++;
+    results.wait_ticks_sum += wait_ticks;
+    if (wait_ticks > results.wait_ticks_max) {
+        results.wait_ticks_max = wait_ticks;
+    }
+}
+
+static void bench(uint32_t offered_load_percent, uint32_t bits_per_transfer) {
+    struct can_driver_virtual_bus_s* bus = can_driver_virtual_get_default_bus();
+
+    // Each sender offers an equal share of the load, at a mean interval rounded to whole system ticks
+    systime_t mean_interval_ticks = ((uint64_t)NUM_SENDERS * bits_per_transfer * CH_CFG_ST_FREQUENCY * 100 + (uint64_t)bus->baudrate * offered_load_percent / 2) / ((uint64_t)bus->baudrate * offered_load_percent);
+    double offered_load = (double)NUM_SENDERS * bits_per_transfer * CH_CFG_ST_FREQUENCY / mean_interval_ticks / bus->baudrate;
+
+    memset(&results, 0, sizeof(results));
+    uint32_t frames_completed_start = bus->frames_completed;
+    uint64_t bits_transmitted_start = bus->bits_transmitted;
+
+    for (uint8_t i=0; i<NUM_SENDERS; i++) {
+        senders[i].mean_interval_ticks = mean_interval_ticks;
+        schedule_next_transfer(&senders[i]);
+    }
+
+    double t_start = get_time_s();
+    sim_run_for(MS2ST(RUN_TIME_MS));
+    double host_s = get_time_s() - t_start;
+
+    uint32_t frames_completed = bus->frames_completed - frames_completed_start;
+    double bus_utilisation = (double)(bus->bits_transmitted - bits_transmitted_start) / ((double)bus->baudrate * RUN_TIME_MS / 1000);
+
+    // Transfers still queued are left to complete or expire, so that they count towards the wait and are not carried over
+    for (uint8_t i=0; i<NUM_SENDERS; i++) {
+        worker_thread_remove_timer_task(&lpwork_thread, &senders[i].traffic_task);
+    }
+    sim_run_for(MS2ST(DRAIN_TIME_MS));
+
+    double mean_wait_ms = results.transfers_completed ? (double)results.wait_ticks_sum * 1000 / CH_CFG_ST_FREQUENCY / results.transfers_completed : 0;
+    double max_wait_ms = (double)results.wait_ticks_max * 1000 / CH_CFG_ST_FREQUENCY;
+    uint32_t transfers_lost = results.transfers_failed + results.transfers_not_enqueued;
+
+    printf("%8.1f %10.1f %14.0f %12.0f %14.2f %13.2f %8u %12.0f\n", offered_load*100, bus_utilisation*100,
+           results.transfers_completed * 1000.0 / RUN_TIME_MS, frames_completed * 1000.0 / RUN_TIME_MS, mean_wait_ms,
+           max_wait_ms, transfers_lost, frames_completed ? host_s * 1e9 / frames_completed : 0);
+}
+
+int main(void) {
+    struct can_driver_virtual_bus_s* bus = can_driver_virtual_get_default_bus();
+
+    srand(1);
+
+    // The default node only receives and acknowledges
+    can_start(can_get_instance(0), false, true, bus->baudrate);
+
+    for (uint8_t i=0; i<NUM_SENDERS; i++) {
+        senders[i].instance = can_driver_virtual_attach(bus, &senders[i].node, i+1);
+        senders[i].priority = 8 + i*4;
+        can_start(senders[i].instance, false, true, bus->baudrate);
+        pubsub_init_topic(&senders[i].completion_topic, NULL);
+        worker_thread_add_listener_task(&lpwork_thread, &senders[i].completion_listener_task, &senders[i].completion_topic, completion_handler, NULL);
+    }
+
+    struct can_frame_s frame;
+    fill_frame(&frame, 0, 0);
+    uint32_t bits_per_transfer = FRAMES_PER_TRANSFER * can_get_frame_bit_length_X(&frame);
+
+    printf("%u senders, %u frame transfers, %u bits per transfer at %u bit/s\n", NUM_SENDERS, FRAMES_PER_TRANSFER, bits_per_transfer, bus->baudrate);
+    printf("%8s %10s %14s %12s %14s %13s %8s %12s\n", "offered%", "bus util%", "transfers/s", "frames/s", "mean wait ms", "max wait ms", "lost", "host ns/frame");
+    const uint32_t offered_load_percents[] = {10, 30, 50, 70, 90, 100, 120};
+    for (uint32_t i=0; i<sizeof(offered_load_percents)/sizeof(offered_load_percents[0]); i++) {
+        bench(offered_load_percents[i], bits_per_transfer);
+    }
+    return 0;
+}
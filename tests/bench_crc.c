@@ -0,0 +1,79 @@
+// Times the CRC kernels selected by CRC_TABLE_BITS and CRC32_SLICE_BY_4. The Makefile builds this file once per
+// configuration, as it does test_crc.c. The lengths are a UAVCAN transfer signature, a CAN frame's worth of payload, a
+// file.Read response and a flash page.
+
+#include <common/crc64_we.h>
+#include <common/helpers.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define BYTES_PER_LENGTH 20000000
+
+static double get_time_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static uint8_t buf[2048];
+
+static double bench_crc16_ccitt(size_t len) {
+    static volatile uint16_t sink;
+    uint32_t rounds = BYTES_PER_LENGTH/len;
+    uint16_t crc = 0xFFFF;
+
+    double t_start = get_time_s();
+    for (uint32_t round=0; round<rounds; round++) {
+        crc = crc16_ccitt(buf, len, crc);
+    }
+    sink = crc;
+    (void)sink;
+
+    return (get_time_s() - t_start) * 1e9 / ((double)rounds*len);
+}
+
+static double bench_crc32(size_t len) {
+    static volatile uint32_t sink;
+    uint32_t rounds = BYTES_PER_LENGTH/len;
+    uint32_t crc = 0;
+
+    double t_start = get_time_s();
+    for (uint32_t round=0; round<rounds; round++) {
+        crc = crc32(buf, len, crc);
+    }
+    sink = crc;
+    (void)sink;
+
+    return (get_time_s() - t_start) * 1e9 / ((double)rounds*len);
+}
+
+static double bench_crc64_we(size_t len) {
+    static volatile uint64_t sink;
+    uint32_t rounds = BYTES_PER_LENGTH/len;
+    uint64_t crc = 0;
+
+    double t_start = get_time_s();
+    for (uint32_t round=0; round<rounds; round++) {
+        crc = crc64_we(buf, len, crc);
+    }
+    sink = crc;
+    (void)sink;
+
+    return (get_time_s() - t_start) * 1e9 / ((double)rounds*len);
+}
+
+int main(void) {
+    srand(1);
+    for (size_t i=0; i<sizeof(buf); i++) {
+        buf[i] = rand();
+    }
+
+    printf("CRC_TABLE_BITS=%d, CRC32_SLICE_BY_4=%d\n", CRC_TABLE_BITS, CRC32_SLICE_BY_4);
+    printf("%8s %20s %14s %16s\n", "bytes", "crc16_ccitt ns/byte", "crc32 ns/byte", "crc64_we ns/byte");
+    const size_t lengths[] = {8, 64, 256, 2048};
+    for (uint32_t i=0; i<sizeof(lengths)/sizeof(lengths[0]); i++) {
+        printf("%8u %20.3f %14.3f %16.3f\n", (unsigned)lengths[i], bench_crc16_ccitt(lengths[i]), bench_crc32(lengths[i]), bench_crc64_we(lengths[i]));
+    }
+    return 0;
+}
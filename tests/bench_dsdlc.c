@@ -0,0 +1,152 @@
+// Times encoding and decoding of code generated by canard_dsdlc. It is built twice, like test_dsdlc.c, so the fixed
+// layout and bulk copy paths can be compared against the field by field code generated with canard_dsdlc.py --generic.
+//
+// Decoding is timed from the transfer libcanard reassembles, so multi-frame payloads are read across its buffer blocks.
+
+#include <check.h>
+#include <common/bit_array.h>
+#include <common/helpers.h>
+#include <modules/uavcan/uavcan.h>
+#include <uavcan.protocol.NodeStatus.h>
+#include <uavcan.protocol.debug.KeyValue.h>
+#include <dsdlc_test.Float16Array.h>
+#include <dsdlc_test.Nested.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define NUM_ROUNDS 200000
+
+struct payload_s {
+    uint8_t data[128];
+    size_t bitlen;
+};
+
+static CanardInstance canard;
+static uint8_t canard_memory_pool[2048];
+static const struct uavcan_message_descriptor_s* rx_descriptor;
+static double rx_decode_ns;
+static uint8_t next_transfer_id;
+
+static double get_time_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void encode_chunk_cb(uint8_t* chunk, size_t bitlen, void* ctx) {
+    struct payload_s* payload = ctx;
+
+    if (chunk) {
+        copy_bit_array(chunk, 0, bitlen, payload->data, payload->bitlen);
+    }
+    payload->bitlen += bitlen;
+}
+
+static bool should_accept_transfer(const CanardInstance* ins, uint64_t* out_data_type_signature, uint16_t data_type_id, CanardTransferType transfer_type, uint8_t source_node_id) {
+    (void)ins;
+    (void)data_type_id;
+    (void)transfer_type;
+    (void)source_node_id;
+
+    *out_data_type_signature = rx_descriptor->data_type_signature;
+    return true;
+}
+
+static void on_transfer_rx(CanardInstance* ins, CanardRxTransfer* transfer) {
+    static uint8_t msg[512] __attribute__((aligned));
+    (void)ins;
+
+    double t_start = get_time_s();
+    for (uint32_t round=0; round<NUM_ROUNDS; round++) {
+        rx_descriptor->deserializer_func(transfer, msg);
+        __asm__ volatile("" : : "r"(msg) : "memory");
+    }
+    rx_decode_ns = (get_time_s() - t_start) * 1e9 / NUM_ROUNDS;
+}
+
+// - Returns the time to encode msg, and leaves the encoded payload in payload
+static double bench_encode(const struct uavcan_message_descriptor_s* descriptor, void* msg, struct payload_s* payload) {
+    double t_start = get_time_s();
+    for (uint32_t round=0; round<NUM_ROUNDS; round++) {
+        payload->bitlen = 0;
+        descriptor->serializer_func(msg, encode_chunk_cb, payload);
+        __asm__ volatile("" : : "r"(payload) : "memory");
+    }
+    return (get_time_s() - t_start) * 1e9 / NUM_ROUNDS;
+}
+
+// - Broadcasts the payload in CAN frames as uavcan.c does, and returns the time to decode the reassembled transfer
+static double bench_decode(const struct uavcan_message_descriptor_s* descriptor, const struct payload_s* payload) {
+    uint8_t transfer_id = next_transfer_id++ & 0x1f;
+    size_t len = (payload->bitlen+7)/8;
+
+    uint8_t buf[2+sizeof(payload->data)];
+    size_t buf_len = 0;
+    if (len > 7) {
+        uint16_t crc16 = crc16_ccitt(&descriptor->data_type_signature, 8, 0xffff);
+        crc16 = crc16_ccitt(payload->data, len, crc16);
+        buf[buf_len++] = crc16 & 0xff;
+        buf[buf_len++] = crc16 >> 8;
+    }
+    memcpy(&buf[buf_len], payload->data, len);
+    buf_len += len;
+
+    rx_descriptor = descriptor;
+    rx_decode_ns = 0;
+
+    uint8_t toggle = 0;
+    for (size_t ofs=0; ofs == 0 || ofs < buf_len; ofs += 7) {
+        CanardCANFrame frame;
+        memset(&frame, 0, sizeof(frame));
+        frame.id = CANARD_CAN_FRAME_EFF | (16UL << 24) | ((uint32_t)descriptor->default_data_type_id << 8) | 20;
+        size_t frame_len = MIN(buf_len-ofs, 7);
+        memcpy(frame.data, &buf[ofs], frame_len);
+        frame.data[frame_len] = (ofs == 0 ? 1<<7 : 0) | (ofs+7 >= buf_len ? 1<<6 : 0) | (toggle << 5) | transfer_id;
+        frame.data_len = frame_len+1;
+        toggle ^= 1;
+
+        canardHandleRxFrame(&canard, &frame, 0);
+    }
+
+    CHECK(rx_decode_ns > 0);
+    return rx_decode_ns;
+}
+
+static void bench_message(const char* name, const struct uavcan_message_descriptor_s* descriptor, void* msg) {
+    struct payload_s payload;
+    memset(&payload, 0, sizeof(payload));
+    double encode_ns = bench_encode(descriptor, msg, &payload);
+    double decode_ns = bench_decode(descriptor, &payload);
+    printf("%-14s %8u %12.1f %12.1f\n", name, (unsigned)((payload.bitlen+7)/8), encode_ns, decode_ns);
+}
+
+int main(void) {
+    canardInit(&canard, canard_memory_pool, sizeof(canard_memory_pool), on_transfer_rx, should_accept_transfer, NULL);
+    canardSetLocalNodeID(&canard, 10);
+
+    struct uavcan_protocol_NodeStatus_s node_status = {0x12345678, 2, 3, 6, 0xBEEF};
+
+    struct uavcan_protocol_debug_KeyValue_s key_value;
+    memset(&key_value, 0, sizeof(key_value));
+    key_value.value = -1.5f;
+    key_value.key_len = sizeof(key_value.key);
+    memset(key_value.key, 'k', key_value.key_len);
+
+    struct dsdlc_test_Float16Array_s float16_array = {5, {1.0f, -2.5f, 65504.0f}, {-1, 127, -128, 3}};
+
+    struct dsdlc_test_Nested_s nested = {
+        {1, 1, 2, 7, 0x1234},
+        true,
+        {{2, {0.5f, -0.25f, 3.0f}, {1, 2, 3, 4}}, {7, {-1.0f, 2.0f, 0.0f}, {-2, -3, 100, -100}}},
+        -1234
+    };
+
+    printf("%s\n", BENCH_DSDLC_VARIANT);
+    printf("%-14s %8s %12s %12s\n", "type", "bytes", "encode ns", "decode ns");
+    bench_message("NodeStatus", &uavcan_protocol_NodeStatus_descriptor, &node_status);
+    bench_message("KeyValue", &uavcan_protocol_debug_KeyValue_descriptor, &key_value);
+    bench_message("Float16Array", &dsdlc_test_Float16Array_descriptor, &float16_array);
+    bench_message("Nested", &dsdlc_test_Nested_descriptor, &nested);
+    return 0;
+}
@@ -0,0 +1,138 @@
+// Times stores to a flash journal on the RAM flash emulator, grouped by how full the journal was when each store began.
+// A store is what param_store_all does for one changed param: write an entry with a 5 byte key and 4 byte value, and
+// if the journal is full, compact the oldest sector and try again.
+//
+// The emulator runs at RAM speed, so the CPU time mostly shows the cost of compaction and of rebuilding the index after
+// it. On the device the flash operations dominate, and are estimated from the STM32F3 datasheet maximums.
+
+#include <common/helpers.h>
+#include <flash_sim.h>
+#include <modules/flash/flash.h>
+#include <modules/param/flash_journal.h>
+#include <check.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define NUM_KEYS 64
+#define NUM_PASSES 50
+#define STORES_PER_PASS 4000
+#define NUM_FILL_BUCKETS 10
+
+#define HALFWORD_PROGRAM_US 70
+#define PAGE_ERASE_US 40000
+
+struct __attribute__((packed)) key_value_s {
+    uint8_t key[5];
+    uint32_t value;
+};
+
+struct fill_bucket_s {
+    uint32_t num_stores;
+    uint32_t num_compactions;
+    double total_ns;
+    double max_ns;
+    double total_device_us;
+    double max_device_us;
+};
+
+static struct flash_journal_sector_s sectors[FLASH_SIM_NUM_PAGES];
+static struct flash_journal_instance_s journal;
+static const struct flash_journal_entry_s* index_entries[NUM_KEYS];
+
+static double get_time_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static uint8_t get_key_idx(const struct flash_journal_entry_s* entry) {
+    return ((const struct key_value_s*)entry->data)->key[0];
+}
+
+static void rebuild_index(void) {
+    memset(index_entries, 0, sizeof(index_entries));
+    const struct flash_journal_entry_s* entry = NULL;
+    while (flash_journal_iterate(&journal, &entry)) {
+        if (entry->len == sizeof(struct key_value_s)) {
+            index_entries[get_key_idx(entry)] = entry;
+        }
+    }
+}
+
+static bool entry_live(const struct flash_journal_entry_s* entry, void* ctx) {
+    (void)ctx;
+    return entry->len == sizeof(struct key_value_s) && index_entries[get_key_idx(entry)] == entry;
+}
+
+// - Returns the fraction of the journal's space taken up by its open sectors
+static double get_fill_level(void) {
+    size_t used = 0;
+    for (uint8_t i=0; i<journal.num_open_sectors; i++) {
+        const struct flash_journal_sector_s* sector = &sectors[journal.open_sectors[i]];
+        used += (size_t)sector->end_ptr - (size_t)sector->flash_page_ptr;
+    }
+    return (double)used / (FLASH_SIM_NUM_PAGES*FLASH_SIM_PAGE_SIZE);
+}
+
+static void store(uint8_t key_idx, uint32_t value, struct fill_bucket_s* bucket) {
+    struct key_value_s key_value;
+    memset(key_value.key, key_idx, sizeof(key_value.key));
+    key_value.value = value;
+
+    uint32_t flash_ops = flash_sim_get_op_count();
+    uint32_t erases = flash_sim_get_erase_count();
+    double t_start = get_time_s();
+
+    while (!flash_journal_write(&journal, sizeof(key_value), &key_value)) {
+        CHECK(flash_journal_compact_oldest_sector(&journal, entry_live, NULL));
+        rebuild_index();
+        bucket->num_compactions++;
+    }
+    index_entries[key_idx] = flash_journal_get_last_entry(&journal);
+
+    double ns = (get_time_s() - t_start) * 1e9;
+    bucket->num_stores++;
+    bucket->total_ns += ns;
+    bucket->max_ns = MAX(bucket->max_ns, ns);
+    erases = flash_sim_get_erase_count() - erases;
+    uint32_t halfwords = flash_sim_get_op_count() - flash_ops - erases;
+    double device_us = halfwords*HALFWORD_PROGRAM_US + erases*PAGE_ERASE_US;
+    bucket->total_device_us += device_us;
+    bucket->max_device_us = MAX(bucket->max_device_us, device_us);
+}
+
+int main(void) {
+    static struct fill_bucket_s buckets[NUM_FILL_BUCKETS];
+
+    for (uint8_t i=0; i<FLASH_SIM_NUM_PAGES; i++) {
+        sectors[i].flash_page_ptr = flash_get_page_addr(i);
+        sectors[i].flash_page_size = FLASH_SIM_PAGE_SIZE;
+    }
+
+    // Each pass starts from an erased journal, so that the low fill levels are seen as often as the steady state
+    srand(1);
+    for (uint32_t pass=0; pass<NUM_PASSES; pass++) {
+        flash_journal_init(&journal, 1, FLASH_SIM_NUM_PAGES, sectors);
+        CHECK(flash_journal_erase(&journal));
+        flash_journal_init(&journal, 1, FLASH_SIM_NUM_PAGES, sectors);
+        rebuild_index();
+
+        for (uint32_t i=0; i<STORES_PER_PASS; i++) {
+            uint32_t bucket_idx = MIN((uint32_t)(get_fill_level()*NUM_FILL_BUCKETS), NUM_FILL_BUCKETS-1);
+            store(rand() % NUM_KEYS, (uint32_t)rand(), &buckets[bucket_idx]);
+        }
+    }
+
+    printf("%u sectors of %u bytes, %u keys\n", FLASH_SIM_NUM_PAGES, FLASH_SIM_PAGE_SIZE, NUM_KEYS);
+    printf("%8s %10s %12s %12s %12s %16s %14s\n", "fill %", "stores", "compactions", "ns/store", "max ns", "device ms/store", "max device ms");
+    for (uint32_t i=0; i<NUM_FILL_BUCKETS; i++) {
+        const struct fill_bucket_s* bucket = &buckets[i];
+        if (bucket->num_stores == 0) {
+            continue;
+        }
+        printf("%3u-%-4u %10u %12u %12.0f %12.0f %16.3f %14.3f\n", i*100/NUM_FILL_BUCKETS, (i+1)*100/NUM_FILL_BUCKETS, bucket->num_stores, bucket->num_compactions, bucket->total_ns/bucket->num_stores, bucket->max_ns, bucket->total_device_us/bucket->num_stores/1000, bucket->max_device_us/1000);
+    }
+    return 0;
+}
@@ -0,0 +1,91 @@
+// Times transfer ID map retrievals against the number of active keys, for the default working area and for larger ones.
+// Each retrieval picks one of the active keys at random. A quarter are message data types, and the rest service data
+// types to one of many destination nodes, as on a node that talks to many peers. A retrieval that finds its key evicted
+// restarts that key's transfer ids at 0, and is counted as a miss.
+
+#include <modules/uavcan/uavcan_transfer_id_map.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define MAX_KEYS 500
+#define NUM_RETRIEVALS 2000000
+
+struct key_s {
+    bool service_not_message;
+    uint16_t data_type_id;
+    uint8_t dest_node_id;
+    uint8_t transfer_id;
+};
+
+static struct key_s keys[MAX_KEYS];
+static uint16_t key_sequence[NUM_RETRIEVALS];
+
+static double get_time_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void make_keys(void) {
+    for (uint32_t i=0; i<MAX_KEYS; i++) {
+        bool duplicate;
+        do {
+            keys[i].service_not_message = rand() % 4 != 0;
+            keys[i].data_type_id = keys[i].service_not_message ? rand() % 256 : rand() % 2048;
+            keys[i].dest_node_id = keys[i].service_not_message ? 1 + rand() % 125 : 0;
+
+            duplicate = false;
+            for (uint32_t j=0; j<i; j++) {
+                duplicate |= keys[j].service_not_message == keys[i].service_not_message && keys[j].data_type_id == keys[i].data_type_id && keys[j].dest_node_id == keys[i].dest_node_id;
+            }
+        } while (duplicate);
+    }
+}
+
+static void bench(size_t working_area_size, uint32_t num_keys, double* ns, double* miss_rate) {
+    static struct uavcan_transfer_id_map_entry_s map_mem[1024];
+    struct uavcan_transfer_id_map_s map;
+    uint32_t num_misses = 0;
+
+    uavcan_transfer_id_map_init(&map, working_area_size, map_mem);
+    for (uint32_t i=0; i<num_keys; i++) {
+        keys[i].transfer_id = 0;
+    }
+    for (uint32_t i=0; i<NUM_RETRIEVALS; i++) {
+        key_sequence[i] = rand() % num_keys;
+    }
+
+    double t_start = get_time_s();
+    for (uint32_t i=0; i<NUM_RETRIEVALS; i++) {
+        struct key_s* key = &keys[key_sequence[i]];
+        uint8_t* transfer_id = uavcan_transfer_id_map_retrieve(&map, key->service_not_message, key->data_type_id, key->dest_node_id);
+        if (*transfer_id != key->transfer_id) {
+            num_misses++;
+        }
+        // Transfer ids never go back to 0, so that an evicted key always shows as a miss
+        *transfer_id = *transfer_id % 255 + 1;
+        key->transfer_id = *transfer_id;
+    }
+    *ns = (get_time_s() - t_start) * 1e9 / NUM_RETRIEVALS;
+    *miss_rate = (double)num_misses / NUM_RETRIEVALS;
+}
+
+int main(void) {
+    srand(1);
+    make_keys();
+
+    // 128 bytes is the default UAVCAN_TRANSFER_ID_MAP_WORKING_AREA_SIZE
+    const size_t working_area_sizes[] = {128, 640, 2560};
+    const uint32_t key_counts[] = {10, 25, 50, 100, 200, 500};
+
+    printf("%12s %8s %6s %14s %8s\n", "area bytes", "entries", "keys", "ns/retrieval", "miss %");
+    for (uint32_t i=0; i<sizeof(working_area_sizes)/sizeof(working_area_sizes[0]); i++) {
+        for (uint32_t j=0; j<sizeof(key_counts)/sizeof(key_counts[0]); j++) {
+            double ns, miss_rate;
+            bench(working_area_sizes[i], key_counts[j], &ns, &miss_rate);
+            printf("%12u %8u %6u %14.2f %8.2f\n", (unsigned)working_area_sizes[i], (unsigned)(working_area_sizes[i]/sizeof(struct uavcan_transfer_id_map_entry_s)), key_counts[j], ns, miss_rate*100);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,529 @@
+// A small STM32F302x8 application: it brings the clocks up to 72 MHz from an 8 MHz HSE, blinks an LED on PB13 from
+// SysTick, and prints its uptime and the CRC of its own image on USART2. It is linked to the app region of
+// platforms/ARMCMx/ld/stm32f302x8/memory.ld, behind the bootloader.
+//
+// It is a fixture for test_lzss, which round-trips blinky_stm32f302x8.bin through the compressor in
+// tools/uavcan_upload.py. The image was built with:
+//
+//   llvm-mc -triple=thumbv7em-none-eabi -mcpu=cortex-m4 -filetype=obj blinky_stm32f302x8.s -o blinky_stm32f302x8.o
+//   llvm-objcopy -O binary --only-section=.text blinky_stm32f302x8.o blinky_stm32f302x8.bin
+//
+// Everything is in one section, so addresses in flash are computed from the offset to the vector table and need no
+// linker.
+
+    .syntax unified
+    .cpu cortex-m4
+    .fpu fpv4-sp-d16
+    .thumb
+
+    .equ APP_FLASH_ADDR,    0x08003000
+    .equ RAM_ADDR,          0x20000000
+    .equ STACK_TOP,         0x20003F00          // below the app_bl_shared region
+
+    .equ RCC_BASE,          0x40021000
+    .equ RCC_CR,            0x00
+    .equ RCC_CFGR,          0x04
+    .equ RCC_AHBENR,        0x14
+    .equ RCC_APB1ENR,       0x1C
+    .equ FLASH_ACR,         0x40022000
+    .equ GPIOA_BASE,        0x48000000
+    .equ GPIOB_BASE,        0x48000400
+    .equ GPIO_MODER,        0x00
+    .equ GPIO_OSPEEDR,      0x08
+    .equ GPIO_BSRR,         0x18
+    .equ GPIO_ODR,          0x14
+    .equ GPIO_AFRL,         0x20
+    .equ USART2_BASE,       0x40004400
+    .equ USART_CR1,         0x00
+    .equ USART_BRR,         0x0C
+    .equ USART_ISR,         0x1C
+    .equ USART_TDR,         0x28
+    .equ SYST_CSR,          0xE000E010
+    .equ SCB_CPACR,         0xE000ED88
+    .equ SCB_SHPR3,         0xE000ED20
+
+    .equ LED_PIN,           13
+    .equ SYSCLK_HZ,         72000000
+    .equ USART2_BAUD,       115200
+
+// Variables in RAM, the first ones initialized from data_load
+    .equ blink_period_ms,   RAM_ADDR + 0x00
+    .equ report_period_ms,  RAM_ADDR + 0x04
+    .equ DATA_SIZE,         0x08
+    .equ tick_count,        RAM_ADDR + 0x08
+    .equ next_blink_ms,     RAM_ADDR + 0x0C
+    .equ next_report_ms,    RAM_ADDR + 0x10
+    .equ image_crc,         RAM_ADDR + 0x14
+    .equ fmt_buf,           RAM_ADDR + 0x18     // 12 bytes
+    .equ BSS_SIZE,          0x24
+
+    .text
+vectors:
+    .word STACK_TOP
+    .word reset_handler - vectors + APP_FLASH_ADDR
+    .word nmi_handler - vectors + APP_FLASH_ADDR
+    .word hardfault_handler - vectors + APP_FLASH_ADDR
+    .word hardfault_handler - vectors + APP_FLASH_ADDR   // MemManage
+    .word hardfault_handler - vectors + APP_FLASH_ADDR   // BusFault
+    .word hardfault_handler - vectors + APP_FLASH_ADDR   // UsageFault
+    .word 0
+    .word 0
+    .word 0
+    .word 0
+    .word default_handler - vectors + APP_FLASH_ADDR     // SVCall
+    .word default_handler - vectors + APP_FLASH_ADDR     // DebugMonitor
+    .word 0
+    .word default_handler - vectors + APP_FLASH_ADDR     // PendSV
+    .word systick_handler - vectors + APP_FLASH_ADDR
+    .word default_handler - vectors + APP_FLASH_ADDR
+    .word default_handler - vectors + APP_FLASH_ADDR
+    .word default_handler - vectors + APP_FLASH_ADDR
+    .word default_handler - vectors + APP_FLASH_ADDR
+    .word default_handler - vectors + APP_FLASH_ADDR
+    .word default_handler - vectors + APP_FLASH_ADDR
+    .word default_handler - vectors + APP_FLASH_ADDR
+    .word default_handler - vectors + APP_FLASH_ADDR
+    .word default_handler - vectors + APP_FLASH_ADDR
+    .word default_handler - vectors + APP_FLASH_ADDR
+    .word default_handler - vectors + APP_FLASH_ADDR
+    .word default_handler - vectors + APP_FLASH_ADDR
+    .word default_handler - vectors + APP_FLASH_ADDR
+    .word default_handler - vectors + APP_FLASH_ADDR
+    .word default_handler - vectors + APP_FLASH_ADDR
+    .word default_handler - vectors + APP_FLASH_ADDR
+    .word default_handler - vectors + APP_FLASH_ADDR
+    .word default_handler - vectors + APP_FLASH_ADDR
+    .word default_handler - vectors + APP_FLASH_ADDR
+    .word default_handler - vectors + APP_FLASH_ADDR
+    .word default_handler - vectors + APP_FLASH_ADDR
+    .word default_handler - vectors + APP_FLASH_ADDR
+    .word default_handler - vectors + APP_FLASH_ADDR
+    .word default_handler - vectors + APP_FLASH_ADDR
+    .word default_handler - vectors + APP_FLASH_ADDR
+    .word default_handler - vectors + APP_FLASH_ADDR
+    .word default_handler - vectors + APP_FLASH_ADDR
+    .word default_handler - vectors + APP_FLASH_ADDR
+    .word default_handler - vectors + APP_FLASH_ADDR
+    .word default_handler - vectors + APP_FLASH_ADDR
+    .word default_handler - vectors + APP_FLASH_ADDR
+    .word default_handler - vectors + APP_FLASH_ADDR
+    .word default_handler - vectors + APP_FLASH_ADDR
+    .word default_handler - vectors + APP_FLASH_ADDR
+    .word default_handler - vectors + APP_FLASH_ADDR
+    .word default_handler - vectors + APP_FLASH_ADDR
+    .word default_handler - vectors + APP_FLASH_ADDR
+    .word default_handler - vectors + APP_FLASH_ADDR
+    .word default_handler - vectors + APP_FLASH_ADDR
+    .word default_handler - vectors + APP_FLASH_ADDR
+    .word default_handler - vectors + APP_FLASH_ADDR
+    .word default_handler - vectors + APP_FLASH_ADDR
+    .word default_handler - vectors + APP_FLASH_ADDR
+    .word default_handler - vectors + APP_FLASH_ADDR
+    .word default_handler - vectors + APP_FLASH_ADDR
+    .word default_handler - vectors + APP_FLASH_ADDR
+    .word default_handler - vectors + APP_FLASH_ADDR
+    .word default_handler - vectors + APP_FLASH_ADDR
+    .word default_handler - vectors + APP_FLASH_ADDR
+    .word default_handler - vectors + APP_FLASH_ADDR
+    .word default_handler - vectors + APP_FLASH_ADDR
+    .word default_handler - vectors + APP_FLASH_ADDR
+    .word default_handler - vectors + APP_FLASH_ADDR
+    .word default_handler - vectors + APP_FLASH_ADDR
+    .word default_handler - vectors + APP_FLASH_ADDR
+    .word default_handler - vectors + APP_FLASH_ADDR
+    .word default_handler - vectors + APP_FLASH_ADDR
+    .word default_handler - vectors + APP_FLASH_ADDR
+    .word default_handler - vectors + APP_FLASH_ADDR
+    .word default_handler - vectors + APP_FLASH_ADDR
+    .word default_handler - vectors + APP_FLASH_ADDR
+    .word default_handler - vectors + APP_FLASH_ADDR
+    .word default_handler - vectors + APP_FLASH_ADDR
+    .word default_handler - vectors + APP_FLASH_ADDR
+    .word default_handler - vectors + APP_FLASH_ADDR
+    .word default_handler - vectors + APP_FLASH_ADDR
+    .word default_handler - vectors + APP_FLASH_ADDR
+    .word default_handler - vectors + APP_FLASH_ADDR
+    .word default_handler - vectors + APP_FLASH_ADDR
+    .word default_handler - vectors + APP_FLASH_ADDR
+    .word default_handler - vectors + APP_FLASH_ADDR
+    .word default_handler - vectors + APP_FLASH_ADDR
+    .word default_handler - vectors + APP_FLASH_ADDR
+    .word default_handler - vectors + APP_FLASH_ADDR
+    .word default_handler - vectors + APP_FLASH_ADDR
+    .word default_handler - vectors + APP_FLASH_ADDR
+    .word default_handler - vectors + APP_FLASH_ADDR
+    .word default_handler - vectors + APP_FLASH_ADDR
+    .word default_handler - vectors + APP_FLASH_ADDR
+    .word default_handler - vectors + APP_FLASH_ADDR
+    .word default_handler - vectors + APP_FLASH_ADDR
+    .word default_handler - vectors + APP_FLASH_ADDR
+
+    .thumb_func
+reset_handler:
+    // The FPU is enabled first, as the bootloader may jump here with it disabled
+    ldr r0, =SCB_CPACR
+    ldr r1, [r0]
+    orr r1, r1, #(0xF << 20)
+    str r1, [r0]
+    dsb
+    isb
+
+    ldr r0, =RAM_ADDR
+    ldr r1, =(data_load - vectors + APP_FLASH_ADDR)
+    movs r2, #DATA_SIZE
+    bl memcpy_words
+
+    ldr r0, =(RAM_ADDR + DATA_SIZE)
+    movs r1, #0
+    movs r2, #(BSS_SIZE - DATA_SIZE)
+    bl memset_words
+
+    bl clock_init
+    bl gpio_init
+    bl usart2_init
+    bl systick_init
+
+    ldr r0, =(banner - vectors + APP_FLASH_ADDR)
+    bl usart2_puts
+
+    // CRC of the code and strings ahead of the CRC table
+    ldr r0, =APP_FLASH_ADDR
+    ldr r1, =(crc16_table - vectors)
+    ldr r2, =0xFFFF
+    bl crc16_ccitt
+    ldr r1, =image_crc
+    str r0, [r1]
+
+    ldr r4, =tick_count
+    ldr r5, =next_blink_ms
+    ldr r6, =next_report_ms
+main_loop:
+    wfi
+    ldr r0, [r4]
+
+    ldr r1, [r5]
+    subs r2, r0, r1
+    bmi 1f
+    ldr r2, =blink_period_ms
+    ldr r2, [r2]
+    add r1, r1, r2
+    str r1, [r5]
+    bl led_toggle
+    ldr r0, [r4]
+1:
+    ldr r1, [r6]
+    subs r2, r0, r1
+    bmi main_loop
+    ldr r2, =report_period_ms
+    ldr r2, [r2]
+    add r1, r1, r2
+    str r1, [r6]
+    bl report
+    b main_loop
+    .ltorg
+
+// - Copies r2 bytes, a multiple of 4, from r1 to r0
+    .thumb_func
+memcpy_words:
+    cbz r2, 2f
+1:
+    ldr r3, [r1], #4
+    str r3, [r0], #4
+    subs r2, r2, #4
+    bne 1b
+2:
+    bx lr
+
+// - Sets r2 bytes, a multiple of 4, at r0 to the word r1
+    .thumb_func
+memset_words:
+    cbz r2, 2f
+1:
+    str r1, [r0], #4
+    subs r2, r2, #4
+    bne 1b
+2:
+    bx lr
+
+// - Runs SYSCLK from the PLL at 9 times the 8 MHz HSE, with APB1 at half of that
+    .thumb_func
+clock_init:
+    ldr r0, =RCC_BASE
+    ldr r1, [r0, #RCC_CR]
+    orr r1, r1, #(1 << 16)                  // HSEON
+    str r1, [r0, #RCC_CR]
+1:
+    ldr r1, [r0, #RCC_CR]
+    tst r1, #(1 << 17)                      // HSERDY
+    beq 1b
+
+    // Two wait states above 48 MHz, with the prefetch buffer
+    ldr r2, =FLASH_ACR
+    movs r1, #0x12
+    str r1, [r2]
+
+    ldr r1, =((7 << 18) | (1 << 16) | (4 << 8))   // PLLMUL x9, PLLSRC HSE, PPRE1 /2
+    str r1, [r0, #RCC_CFGR]
+    ldr r1, [r0, #RCC_CR]
+    orr r1, r1, #(1 << 24)                  // PLLON
+    str r1, [r0, #RCC_CR]
+1:
+    ldr r1, [r0, #RCC_CR]
+    tst r1, #(1 << 25)                      // PLLRDY
+    beq 1b
+
+    ldr r1, [r0, #RCC_CFGR]
+    bic r1, r1, #3
+    orr r1, r1, #2                          // SW PLL
+    str r1, [r0, #RCC_CFGR]
+1:
+    ldr r1, [r0, #RCC_CFGR]
+    and r1, r1, #(3 << 2)
+    cmp r1, #(2 << 2)                       // SWS PLL
+    bne 1b
+    bx lr
+
+// - Drives the LED pin, and hands PA2 to USART2 TX
+    .thumb_func
+gpio_init:
+    ldr r0, =RCC_BASE
+    ldr r1, [r0, #RCC_AHBENR]
+    orr r1, r1, #((1 << 17) | (1 << 18))    // IOPAEN, IOPBEN
+    str r1, [r0, #RCC_AHBENR]
+
+    ldr r0, =GPIOB_BASE
+    ldr r1, [r0, #GPIO_MODER]
+    bic r1, r1, #(3 << (LED_PIN*2))
+    orr r1, r1, #(1 << (LED_PIN*2))
+    str r1, [r0, #GPIO_MODER]
+
+    ldr r0, =GPIOA_BASE
+    ldr r1, [r0, #GPIO_AFRL]
+    bic r1, r1, #(0xF << 8)
+    orr r1, r1, #(7 << 8)                   // AF7
+    str r1, [r0, #GPIO_AFRL]
+    ldr r1, [r0, #GPIO_OSPEEDR]
+    orr r1, r1, #(3 << 4)
+    str r1, [r0, #GPIO_OSPEEDR]
+    ldr r1, [r0, #GPIO_MODER]
+    bic r1, r1, #(3 << 4)
+    orr r1, r1, #(2 << 4)
+    str r1, [r0, #GPIO_MODER]
+    bx lr
+
+    .thumb_func
+led_toggle:
+    ldr r0, =GPIOB_BASE
+    ldr r1, [r0, #GPIO_ODR]
+    tst r1, #(1 << LED_PIN)
+    ite eq
+    moveq r1, #(1 << LED_PIN)
+    movne r1, #(1 << (LED_PIN+16))
+    str r1, [r0, #GPIO_BSRR]
+    bx lr
+
+    .thumb_func
+usart2_init:
+    ldr r0, =RCC_BASE
+    ldr r1, [r0, #RCC_APB1ENR]
+    orr r1, r1, #(1 << 17)                  // USART2EN
+    str r1, [r0, #RCC_APB1ENR]
+
+    ldr r0, =USART2_BASE
+    ldr r1, =((SYSCLK_HZ/2 + USART2_BAUD/2) / USART2_BAUD)
+    str r1, [r0, #USART_BRR]
+    movs r1, #((1 << 3) | (1 << 0))         // TE, UE
+    str r1, [r0, #USART_CR1]
+    bx lr
+
+// - Sends the character in r0, waiting for the transmit register to empty
+    .thumb_func
+usart2_putc:
+    ldr r1, =USART2_BASE
+1:
+    ldr r2, [r1, #USART_ISR]
+    tst r2, #(1 << 7)                       // TXE
+    beq 1b
+    strb r0, [r1, #USART_TDR]
+    bx lr
+
+// - Sends the zero terminated string at r0
+    .thumb_func
+usart2_puts:
+    push {r4, lr}
+    mov r4, r0
+1:
+    ldrb r0, [r4], #1
+    cbz r0, 2f
+    bl usart2_putc
+    b 1b
+2:
+    pop {r4, pc}
+
+// - Sends r0 in decimal
+    .thumb_func
+usart2_put_dec:
+    push {r4, r5, lr}
+    ldr r4, =(fmt_buf + 11)
+    movs r1, #0
+    strb r1, [r4]
+    movs r5, #10
+1:
+    udiv r1, r0, r5
+    mls r2, r1, r5, r0
+    adds r2, r2, #'0'
+    strb r2, [r4, #-1]!
+    movs r0, r1
+    bne 1b
+    mov r0, r4
+    bl usart2_puts
+    pop {r4, r5, pc}
+
+// - Sends the low r1 nibbles of r0 in hexadecimal
+    .thumb_func
+usart2_put_hex:
+    push {r4, r5, lr}
+    mov r4, r0
+    lsls r5, r1, #2
+1:
+    subs r5, r5, #4
+    lsr r0, r4, r5
+    and r0, r0, #0xF
+    cmp r0, #10
+    ite lo
+    addlo r0, r0, #'0'
+    addhs r0, r0, #('a' - 10)
+    bl usart2_putc
+    cmp r5, #0
+    bne 1b
+    pop {r4, r5, pc}
+
+    .thumb_func
+report:
+    push {r4, lr}
+    ldr r0, =(uptime_str - vectors + APP_FLASH_ADDR)
+    bl usart2_puts
+    ldr r0, =tick_count
+    ldr r0, [r0]
+    bl usart2_put_dec
+    ldr r0, =(crc_str - vectors + APP_FLASH_ADDR)
+    bl usart2_puts
+    ldr r0, =image_crc
+    ldr r0, [r0]
+    movs r1, #4
+    bl usart2_put_hex
+    ldr r0, =(newline_str - vectors + APP_FLASH_ADDR)
+    bl usart2_puts
+    pop {r4, pc}
+
+// - Interrupts every millisecond, at the lowest priority
+    .thumb_func
+systick_init:
+    ldr r0, =SCB_SHPR3
+    ldr r1, [r0]
+    orr r1, r1, #(0xF0 << 24)
+    str r1, [r0]
+
+    ldr r0, =SYST_CSR
+    ldr r1, =(SYSCLK_HZ/1000 - 1)
+    str r1, [r0, #4]                        // RVR
+    movs r1, #0
+    str r1, [r0, #8]                        // CVR
+    movs r1, #7                             // CLKSOURCE, TICKINT, ENABLE
+    str r1, [r0]
+    bx lr
+
+// - Returns in r0 the CRC16-CCITT of the r1 bytes at r0, starting from r2
+    .thumb_func
+crc16_ccitt:
+    push {r4, lr}
+    ldr r4, =(crc16_table - vectors + APP_FLASH_ADDR)
+    cbz r1, 2f
+1:
+    ldrb r3, [r0], #1
+    eor r3, r3, r2, lsr #8
+    ldrh r3, [r4, r3, lsl #1]
+    eor r2, r3, r2, lsl #8
+    uxth r2, r2
+    subs r1, r1, #1
+    bne 1b
+2:
+    mov r0, r2
+    pop {r4, pc}
+
+    .thumb_func
+systick_handler:
+    ldr r0, =tick_count
+    ldr r1, [r0]
+    adds r1, r1, #1
+    str r1, [r0]
+    bx lr
+
+    .thumb_func
+hardfault_handler:
+    cpsid i
+    ldr r0, =(hardfault_str - vectors + APP_FLASH_ADDR)
+    bl usart2_puts
+1:
+    b 1b
+
+    .thumb_func
+nmi_handler:
+    .thumb_func
+default_handler:
+    b default_handler
+    .ltorg
+
+banner:
+    .asciz "\r\nblinky_stm32f302x8 "
+    .asciz "built for the OpenMotorDrive bootloader\r\n"
+uptime_str:
+    .asciz "uptime "
+crc_str:
+    .asciz " ms, image crc 0x"
+newline_str:
+    .asciz "\r\n"
+hardfault_str:
+    .asciz "hard fault\r\n"
+
+    .balign 4
+data_load:
+    .word 500                               // blink_period_ms
+    .word 1000                              // report_period_ms
+
+    .balign 4
+crc16_table:
+    .hword 0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7
+    .hword 0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF
+    .hword 0x1231, 0x0210, 0x3273, 0x2252, 0x52B5, 0x4294, 0x72F7, 0x62D6
+    .hword 0x9339, 0x8318, 0xB37B, 0xA35A, 0xD3BD, 0xC39C, 0xF3FF, 0xE3DE
+    .hword 0x2462, 0x3443, 0x0420, 0x1401, 0x64E6, 0x74C7, 0x44A4, 0x5485
+    .hword 0xA56A, 0xB54B, 0x8528, 0x9509, 0xE5EE, 0xF5CF, 0xC5AC, 0xD58D
+    .hword 0x3653, 0x2672, 0x1611, 0x0630, 0x76D7, 0x66F6, 0x5695, 0x46B4
+    .hword 0xB75B, 0xA77A, 0x9719, 0x8738, 0xF7DF, 0xE7FE, 0xD79D, 0xC7BC
+    .hword 0x48C4, 0x58E5, 0x6886, 0x78A7, 0x0840, 0x1861, 0x2802, 0x3823
+    .hword 0xC9CC, 0xD9ED, 0xE98E, 0xF9AF, 0x8948, 0x9969, 0xA90A, 0xB92B
+    .hword 0x5AF5, 0x4AD4, 0x7AB7, 0x6A96, 0x1A71, 0x0A50, 0x3A33, 0x2A12
+    .hword 0xDBFD, 0xCBDC, 0xFBBF, 0xEB9E, 0x9B79, 0x8B58, 0xBB3B, 0xAB1A
+    .hword 0x6CA6, 0x7C87, 0x4CE4, 0x5CC5, 0x2C22, 0x3C03, 0x0C60, 0x1C41
+    .hword 0xEDAE, 0xFD8F, 0xCDEC, 0xDDCD, 0xAD2A, 0xBD0B, 0x8D68, 0x9D49
+    .hword 0x7E97, 0x6EB6, 0x5ED5, 0x4EF4, 0x3E13, 0x2E32, 0x1E51, 0x0E70
+    .hword 0xFF9F, 0xEFBE, 0xDFDD, 0xCFFC, 0xBF1B, 0xAF3A, 0x9F59, 0x8F78
+    .hword 0x9188, 0x81A9, 0xB1CA, 0xA1EB, 0xD10C, 0xC12D, 0xF14E, 0xE16F
+    .hword 0x1080, 0x00A1, 0x30C2, 0x20E3, 0x5004, 0x4025, 0x7046, 0x6067
+    .hword 0x83B9, 0x9398, 0xA3FB, 0xB3DA, 0xC33D, 0xD31C, 0xE37F, 0xF35E
+    .hword 0x02B1, 0x1290, 0x22F3, 0x32D2, 0x4235, 0x5214, 0x6277, 0x7256
+    .hword 0xB5EA, 0xA5CB, 0x95A8, 0x8589, 0xF56E, 0xE54F, 0xD52C, 0xC50D
+    .hword 0x34E2, 0x24C3, 0x14A0, 0x0481, 0x7466, 0x6447, 0x5424, 0x4405
+    .hword 0xA7DB, 0xB7FA, 0x8799, 0x97B8, 0xE75F, 0xF77E, 0xC71D, 0xD73C
+    .hword 0x26D3, 0x36F2, 0x0691, 0x16B0, 0x6657, 0x7676, 0x4615, 0x5634
+    .hword 0xD94C, 0xC96D, 0xF90E, 0xE92F, 0x99C8, 0x89E9, 0xB98A, 0xA9AB
+    .hword 0x5844, 0x4865, 0x7806, 0x6827, 0x18C0, 0x08E1, 0x3882, 0x28A3
+    .hword 0xCB7D, 0xDB5C, 0xEB3F, 0xFB1E, 0x8BF9, 0x9BD8, 0xABBB, 0xBB9A
+    .hword 0x4A75, 0x5A54, 0x6A37, 0x7A16, 0x0AF1, 0x1AD0, 0x2AB3, 0x3A92
+    .hword 0xFD2E, 0xED0F, 0xDD6C, 0xCD4D, 0xBDAA, 0xAD8B, 0x9DE8, 0x8DC9
+    .hword 0x7C26, 0x6C07, 0x5C64, 0x4C45, 0x3CA2, 0x2C83, 0x1CE0, 0x0CC1
+    .hword 0xEF1F, 0xFF3E, 0xCF5D, 0xDF7C, 0xAF9B, 0xBFBA, 0x8FD9, 0x9FF8
+    .hword 0x6E17, 0x7E36, 0x4E55, 0x5E74, 0x2E93, 0x3EB2, 0x0ED1, 0x1EF0
+
+image_end:
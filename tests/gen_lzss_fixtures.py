@@ -0,0 +1,60 @@
+#!/usr/bin/env python3
+# Writes the LZSS test fixtures: for each input, <name>.bin and its compression by lzss_compress from
+# tools/uavcan_upload.py as <name>.lz, listed in "index". The inputs are generated, plus the firmware images checked in
+# under fixtures/.
+
+import glob
+import os
+import random
+import sys
+
+FIXTURES_DIR = os.path.join(os.path.dirname(os.path.abspath(__file__)), 'fixtures')
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), '..', 'tools'))
+import uavcan_upload
+
+def make_inputs():
+    rng = random.Random(1)
+
+    inputs = {}
+    inputs['empty'] = b''
+    inputs['single'] = b'\x5a'
+    inputs['zeros'] = bytes(10000)
+    inputs['random'] = bytes(rng.getrandbits(8) for _ in range(5000))
+
+    # Repeats at exactly the largest distance and one byte beyond it
+    block = bytes(rng.getrandbits(8) for _ in range(uavcan_upload.LZSS_MAX_DISTANCE))
+    inputs['max_distance'] = block + block + b'\x00' + block
+
+    # Words from a small vocabulary, as in code and tables, giving matches of every length and distance
+    vocab = [bytes(rng.getrandbits(8) for _ in range(rng.randint(1, 8))) for _ in range(64)]
+    inputs['words'] = b''.join(rng.choice(vocab) for _ in range(20000))
+
+    text = b'The quick brown fox jumps over the lazy dog. '
+    inputs['text'] = b''.join(text[:rng.randint(1, len(text))] for _ in range(2000))
+
+    for path in sorted(glob.glob(os.path.join(FIXTURES_DIR, '*.bin'))):
+        with open(path, 'rb') as f:
+            inputs[os.path.splitext(os.path.basename(path))[0]] = f.read()
+
+    return inputs
+
+def main():
+    out_dir = sys.argv[1]
+    os.makedirs(out_dir, exist_ok=True)
+
+    names = []
+    for name, data in sorted(make_inputs().items()):
+        compressed = uavcan_upload.lzss_compress(data)
+        assert uavcan_upload.lzss_decompress(compressed) == data
+        with open(os.path.join(out_dir, name + '.bin'), 'wb') as f:
+            f.write(data)
+        with open(os.path.join(out_dir, name + '.lz'), 'wb') as f:
+            f.write(compressed)
+        names.append(name)
+
+    with open(os.path.join(out_dir, 'index'), 'w') as f:
+        f.write(''.join(name + '\n' for name in names))
+
+if __name__ == '__main__':
+    main()
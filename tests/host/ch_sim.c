@@ -0,0 +1,441 @@
+#include <sim.h>
+#include <setjmp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static systime_t sim_systime;
+static bool sim_locked;
+
+static virtual_timer_t* vt_list_head;
+
+static thread_t* thread_list_head;
+static thread_t* current_thread;
+static jmp_buf suspend_jmp;
+
+void chSysHalt(const char* reason) {
+    fprintf(stderr, "chSysHalt: %s\n", reason);
+    abort();
+}
+
+void chSysLock(void) {
+    chDbgAssert(!sim_locked, "chSysLock while locked");
+    sim_locked = true;
+}
+
+void chSysUnlock(void) {
+    chDbgAssert(sim_locked, "chSysUnlock while unlocked");
+    sim_locked = false;
+}
+
+void chSysLockFromISR(void) {
+    chSysLock();
+}
+
+void chSysUnlockFromISR(void) {
+    chSysUnlock();
+}
+
+void chDbgCheckClassI(void) {
+    chDbgAssert(sim_locked, "I-class function called while unlocked");
+}
+
+void chDbgCheckClassS(void) {
+    chDbgAssert(sim_locked, "S-class function called while unlocked");
+}
+
+void chSchRescheduleS(void) {
+    chDbgCheckClassS();
+}
+
+//
+// Virtual timers
+//
+
+systime_t chVTGetSystemTimeX(void) {
+    return sim_systime;
+}
+
+systime_t chVTTimeElapsedSinceX(systime_t start) {
+    return sim_systime - start;
+}
+
+void chVTObjectInit(virtual_timer_t* vtp) {
+    vtp->armed = false;
+    vtp->func = NULL;
+    vtp->next = NULL;
+}
+
+void chVTResetI(virtual_timer_t* vtp) {
+    chDbgCheckClassI();
+
+    if (!vtp->armed) {
+        return;
+    }
+
+    virtual_timer_t** vt_ptr = &vt_list_head;
+    while (*vt_ptr != vtp) {
+        vt_ptr = &(*vt_ptr)->next;
+    }
+    *vt_ptr = vtp->next;
+    vtp->armed = false;
+}
+
+void chVTReset(virtual_timer_t* vtp) {
+    chSysLock();
+    chVTResetI(vtp);
+    chSysUnlock();
+}
+
+void chVTSetI(virtual_timer_t* vtp, systime_t delay, vtfunc_t vtfunc, void* par) {
+    chDbgCheckClassI();
+    chDbgCheck(delay != TIME_IMMEDIATE && delay != TIME_INFINITE);
+
+    chVTResetI(vtp);
+
+    vtp->expiry_systime = sim_systime + delay;
+    vtp->func = vtfunc;
+    vtp->par = par;
+    vtp->armed = true;
+
+    // Timers with the same expiry fire in the order they were set
+    virtual_timer_t** vt_ptr = &vt_list_head;
+    while (*vt_ptr && (systime_t)((*vt_ptr)->expiry_systime - sim_systime) <= delay) {
+        vt_ptr = &(*vt_ptr)->next;
+    }
+    vtp->next = *vt_ptr;
+    *vt_ptr = vtp;
+}
+
+void chVTSet(virtual_timer_t* vtp, systime_t delay, vtfunc_t vtfunc, void* par) {
+    chSysLock();
+    chVTSetI(vtp, delay, vtfunc, par);
+    chSysUnlock();
+}
+
+bool chVTIsArmedI(virtual_timer_t* vtp) {
+    chDbgCheckClassI();
+    return vtp->armed;
+}
+
+//
+// Threads
+//
+
+thread_t* chThdCreate(const thread_descriptor_t* tdp) {
+    thread_t* tp = calloc(1, sizeof(thread_t));
+    chDbgCheck(tp != NULL);
+
+    tp->state = CH_STATE_READY;
+    tp->name = tdp->name;
+    tp->prio = tdp->prio;
+    tp->funcp = tdp->funcp;
+    tp->arg = tdp->arg;
+
+    tp->next = thread_list_head;
+    thread_list_head = tp;
+    return tp;
+}
+
+thread_t* chThdGetSelfX(void) {
+    return current_thread;
+}
+
+tprio_t chThdSetPriority(tprio_t newprio) {
+    tprio_t oldprio = current_thread ? current_thread->prio : newprio;
+    if (current_thread) {
+        current_thread->prio = newprio;
+    }
+    return oldprio;
+}
+
+void chRegSetThreadName(const char* name) {
+    if (current_thread) {
+        current_thread->name = name;
+    }
+}
+
+msg_t chThdSuspendTimeoutS(thread_reference_t* trp, systime_t timeout) {
+    chDbgCheckClassS();
+    chDbgAssert(current_thread != NULL, "only simulated threads can suspend");
+
+    if (timeout == TIME_IMMEDIATE) {
+        return MSG_TIMEOUT;
+    }
+
+    *trp = current_thread;
+    current_thread->state = CH_STATE_SUSPENDED;
+    current_thread->wakeup_trp = trp;
+    current_thread->wakeup_armed = timeout != TIME_INFINITE;
+    current_thread->wakeup_systime = sim_systime + timeout;
+
+    // Unwind to the scheduler, which restarts the thread from its entry function once it is resumed
+    sim_locked = false;
+    longjmp(suspend_jmp, 1);
+}
+
+msg_t chThdSuspendS(thread_reference_t* trp) {
+    return chThdSuspendTimeoutS(trp, TIME_INFINITE);
+}
+
+void chThdResumeI(thread_reference_t* trp, msg_t msg) {
+    (void)msg;
+
+    chDbgCheckClassI();
+
+    thread_t* tp = *trp;
+    if (tp) {
+        *trp = NULL;
+        tp->wakeup_trp = NULL;
+        tp->wakeup_armed = false;
+        tp->state = CH_STATE_READY;
+    }
+}
+
+void chThdResumeS(thread_reference_t* trp, msg_t msg) {
+    chThdResumeI(trp, msg);
+}
+
+void chThdResume(thread_reference_t* trp, msg_t msg) {
+    chSysLock();
+    chThdResumeI(trp, msg);
+    chSysUnlock();
+}
+
+//
+// Mutexes
+//
+
+void chMtxObjectInit(mutex_t* mp) {
+    mp->cnt = 0;
+}
+
+void chMtxLock(mutex_t* mp) {
+    mp->cnt++;
+}
+
+void chMtxLockS(mutex_t* mp) {
+    chDbgCheckClassS();
+    mp->cnt++;
+}
+
+void chMtxUnlock(mutex_t* mp) {
+    chDbgAssert(mp->cnt > 0, "mutex not locked");
+    mp->cnt--;
+}
+
+void chMtxUnlockS(mutex_t* mp) {
+    chDbgCheckClassS();
+    chMtxUnlock(mp);
+}
+
+//
+// Memory
+//
+
+void* chCoreAllocAligned(size_t size, unsigned align) {
+    void* ret;
+    if (posix_memalign(&ret, align < sizeof(void*) ? sizeof(void*) : align, size ? size : 1) != 0) {
+        return NULL;
+    }
+    memset(ret, 0, size);
+    return ret;
+}
+
+void* chCoreAllocAlignedI(size_t size, unsigned align) {
+    chDbgCheckClassI();
+    return chCoreAllocAligned(size, align);
+}
+
+void* chCoreAlloc(size_t size) {
+    return chCoreAllocAligned(size, PORT_NATURAL_ALIGN);
+}
+
+void* chCoreAllocI(size_t size) {
+    return chCoreAllocAlignedI(size, PORT_NATURAL_ALIGN);
+}
+
+void chPoolObjectInit(memory_pool_t* mp, size_t size, memgetfunc_t provider) {
+    chDbgCheck(size >= sizeof(struct pool_header));
+    mp->next = NULL;
+    mp->object_size = size;
+    mp->provider = provider;
+}
+
+void chPoolAddI(memory_pool_t* mp, void* objp) {
+    chDbgCheckClassI();
+    struct pool_header* php = objp;
+    php->next = mp->next;
+    mp->next = php;
+}
+
+void chPoolFreeI(memory_pool_t* mp, void* objp) {
+    chPoolAddI(mp, objp);
+}
+
+void chPoolFree(memory_pool_t* mp, void* objp) {
+    chSysLock();
+    chPoolFreeI(mp, objp);
+    chSysUnlock();
+}
+
+void chPoolLoadArray(memory_pool_t* mp, void* p, size_t n) {
+    chSysLock();
+    for (size_t i=0; i<n; i++) {
+        chPoolAddI(mp, (uint8_t*)p + i*mp->object_size);
+    }
+    chSysUnlock();
+}
+
+void* chPoolAllocI(memory_pool_t* mp) {
+    chDbgCheckClassI();
+
+    struct pool_header* objp = mp->next;
+    if (objp) {
+        mp->next = objp->next;
+    } else if (mp->provider) {
+        objp = mp->provider(mp->object_size, PORT_NATURAL_ALIGN);
+    }
+    return objp;
+}
+
+void* chPoolAlloc(memory_pool_t* mp) {
+    chSysLock();
+    void* ret = chPoolAllocI(mp);
+    chSysUnlock();
+    return ret;
+}
+
+//
+// Mailboxes
+//
+
+void chMBObjectInit(mailbox_t* mbp, msg_t* buf, cnt_t n) {
+    mbp->buffer = buf;
+    mbp->size = n;
+    mbp->rd = 0;
+    mbp->cnt = 0;
+}
+
+msg_t chMBPostI(mailbox_t* mbp, msg_t msg) {
+    chDbgCheckClassI();
+
+    if (mbp->cnt == mbp->size) {
+        return MSG_TIMEOUT;
+    }
+
+    mbp->buffer[(mbp->rd + mbp->cnt) % mbp->size] = msg;
+    mbp->cnt++;
+    return MSG_OK;
+}
+
+msg_t chMBFetch(mailbox_t* mbp, msg_t* msgp, systime_t timeout) {
+    chDbgAssert(timeout == TIME_IMMEDIATE, "blocking mailbox fetch is not simulated");
+
+    chSysLock();
+    if (mbp->cnt == 0) {
+        chSysUnlock();
+        return MSG_TIMEOUT;
+    }
+
+    *msgp = mbp->buffer[mbp->rd];
+    mbp->rd = (mbp->rd + 1) % mbp->size;
+    mbp->cnt--;
+    chSysUnlock();
+    return MSG_OK;
+}
+
+cnt_t chMBGetUsedCountI(mailbox_t* mbp) {
+    chDbgCheckClassI();
+    return mbp->cnt;
+}
+
+//
+// Scheduler
+//
+
+static thread_t* sim_get_ready_thread(void) {
+    thread_t* ret = NULL;
+    for (thread_t* tp = thread_list_head; tp != NULL; tp = tp->next) {
+        if (tp->state == CH_STATE_READY && (!ret || tp->prio > ret->prio)) {
+            ret = tp;
+        }
+    }
+    return ret;
+}
+
+static void sim_run_thread(thread_t* tp) {
+    current_thread = tp;
+    tp->state = CH_STATE_CURRENT;
+
+    if (setjmp(suspend_jmp) == 0) {
+        tp->funcp(tp->arg);
+        current_thread->state = CH_STATE_FINAL;
+    }
+
+    chDbgAssert(!sim_locked, "thread returned with the system locked");
+    current_thread = NULL;
+}
+
+void sim_run_ready_threads(void) {
+    chDbgAssert(current_thread == NULL, "sim_run_ready_threads called from a simulated thread");
+
+    thread_t* tp;
+    while ((tp = sim_get_ready_thread()) != NULL) {
+        sim_run_thread(tp);
+    }
+}
+
+// Returns the ticks until the next virtual timer or thread timeout, or TIME_INFINITE if there is none
+static systime_t sim_get_ticks_to_next_event(void) {
+    systime_t ret = TIME_INFINITE;
+
+    if (vt_list_head) {
+        ret = vt_list_head->expiry_systime - sim_systime;
+    }
+
+    for (thread_t* tp = thread_list_head; tp != NULL; tp = tp->next) {
+        if (tp->state == CH_STATE_SUSPENDED && tp->wakeup_armed && (systime_t)(tp->wakeup_systime - sim_systime) < ret) {
+            ret = tp->wakeup_systime - sim_systime;
+        }
+    }
+
+    return ret;
+}
+
+static void sim_fire_due_events(void) {
+    while (vt_list_head && vt_list_head->expiry_systime == sim_systime) {
+        virtual_timer_t* vtp = vt_list_head;
+        vt_list_head = vtp->next;
+        vtp->armed = false;
+        vtp->func(vtp->par);
+        chDbgAssert(!sim_locked, "virtual timer callback returned with the system locked");
+    }
+
+    for (thread_t* tp = thread_list_head; tp != NULL; tp = tp->next) {
+        if (tp->state == CH_STATE_SUSPENDED && tp->wakeup_armed && tp->wakeup_systime == sim_systime) {
+            *tp->wakeup_trp = NULL;
+            tp->wakeup_trp = NULL;
+            tp->wakeup_armed = false;
+            tp->state = CH_STATE_READY;
+        }
+    }
+}
+
+void sim_run_for(systime_t ticks) {
+    systime_t t_end = sim_systime + ticks;
+
+    while (true) {
+        sim_run_ready_threads();
+
+        systime_t ticks_remaining = t_end - sim_systime;
+        systime_t ticks_to_next_event = sim_get_ticks_to_next_event();
+        if (ticks_to_next_event > ticks_remaining) {
+            sim_systime = t_end;
+            return;
+        }
+
+        sim_systime += ticks_to_next_event;
+        sim_fire_due_events();
+    }
+}
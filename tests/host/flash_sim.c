@@ -0,0 +1,118 @@
+#include <flash_sim.h>
+#include <check.h>
+#include <common/ctor.h>
+#include <modules/flash/flash.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+static uint8_t (*flash_sim_pages)[FLASH_SIM_PAGE_SIZE];
+static uint32_t flash_sim_power_loss_countdown;
+static uint32_t flash_sim_op_count;
+static uint32_t flash_sim_erase_count;
+
+static bool flash_sim_power_fails(void);
+
+// The pages exist before anything that could read them, as flash does
+RUN_ON(CH_HAL_INIT) {
+    flash_sim_pages = mmap(NULL, FLASH_SIM_NUM_PAGES*FLASH_SIM_PAGE_SIZE, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+    CHECK(flash_sim_pages != MAP_FAILED);
+    memset(flash_sim_pages, 0xff, FLASH_SIM_NUM_PAGES*FLASH_SIM_PAGE_SIZE);
+}
+
+void flash_sim_set_power_loss_countdown(uint32_t ops) {
+    flash_sim_power_loss_countdown = ops;
+}
+
+uint32_t flash_sim_get_op_count(void) {
+    return flash_sim_op_count;
+}
+
+uint32_t flash_sim_get_erase_count(void) {
+    return flash_sim_erase_count;
+}
+
+bool flash_erase_page(void* page_addr) {
+    int16_t page = flash_get_page_num(page_addr);
+    CHECK(page >= 0 && flash_get_page_addr(page) == page_addr);
+
+    if (flash_sim_power_fails()) {
+        // Erasing sets bits, so an interrupted erase has set some of them
+        for (uint32_t i=0; i<FLASH_SIM_PAGE_SIZE; i++) {
+            flash_sim_pages[page][i] |= (uint8_t)rand();
+        }
+        _exit(FLASH_SIM_POWER_LOSS_EXIT_CODE);
+    }
+
+    memset(flash_sim_pages[page], 0xff, FLASH_SIM_PAGE_SIZE);
+    flash_sim_erase_count++;
+    return true;
+}
+
+// The buffers are concatenated and an odd last byte is padded with zero, as by the STM32F3 driver
+bool flash_write(void* address, uint8_t num_bufs, struct flash_write_buf_s* bufs) {
+    if (num_bufs == 0 || !address || (size_t)address % 2 != 0) {
+        return false;
+    }
+
+    size_t len = 0;
+    for (uint8_t i=0; i<num_bufs; i++) {
+        len += bufs[i].len;
+    }
+    len += len % 2;
+    if (len == 0) {
+        return true;
+    }
+
+    uint8_t* target = address;
+    int16_t page = flash_get_page_num(target);
+    CHECK(page >= 0 && flash_get_page_num(target+len-1) == page);
+
+    uint8_t data[FLASH_SIM_PAGE_SIZE];
+    size_t data_len = 0;
+    for (uint8_t i=0; i<num_bufs; i++) {
+        memcpy(&data[data_len], bufs[i].data, bufs[i].len);
+        data_len += bufs[i].len;
+    }
+    if (data_len < len) {
+        data[data_len] = 0;
+    }
+
+    for (size_t i=0; i<len; i+=2) {
+        if (flash_sim_power_fails()) {
+            // An interrupted program has cleared some of the bits it was going to
+            target[i] &= data[i] | (uint8_t)rand();
+            target[i+1] &= data[i+1] | (uint8_t)rand();
+            _exit(FLASH_SIM_POWER_LOSS_EXIT_CODE);
+        }
+
+        target[i] &= data[i];
+        target[i+1] &= data[i+1];
+    }
+
+    return true;
+}
+
+int16_t flash_get_page_num(void* address) {
+    uint8_t* ptr = address;
+    if (ptr < flash_sim_pages[0] || ptr >= flash_sim_pages[FLASH_SIM_NUM_PAGES]) {
+        return -1;
+    }
+    return (ptr - flash_sim_pages[0]) / FLASH_SIM_PAGE_SIZE;
+}
+
+void* flash_get_page_addr(uint32_t page) {
+    return flash_sim_pages[page];
+}
+
+uint32_t flash_get_page_ofs(uint32_t page) {
+    return page*FLASH_SIM_PAGE_SIZE;
+}
+
+static bool flash_sim_power_fails(void) {
+    flash_sim_op_count++;
+    if (flash_sim_power_loss_countdown == 0) {
+        return false;
+    }
+    return --flash_sim_power_loss_countdown == 0;
+}
@@ -0,0 +1,204 @@
+#pragma once
+
+// Host simulation of the subset of the ChibiOS/RT API used by the framework. The system time only advances in
+// sim_run_for(), virtual timers fire in time order and threads run cooperatively. See sim.h.
+
+#include <framework_conf.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define TRUE 1
+#define FALSE 0
+
+#define CH_CFG_ST_FREQUENCY 10000
+#define CH_CFG_USE_MUTEXES_RECURSIVE TRUE
+
+#ifndef CH_DBG_ENABLE_CHECKS
+#define CH_DBG_ENABLE_CHECKS TRUE
+#endif
+
+typedef uint32_t systime_t;
+typedef intptr_t msg_t; // wide enough to carry a pointer, as the framework posts pointers through mailboxes
+typedef uint32_t tprio_t;
+typedef int32_t cnt_t;
+typedef uint8_t tstate_t;
+typedef uint64_t stkalign_t;
+
+#define TIME_IMMEDIATE ((systime_t)0)
+#define TIME_INFINITE ((systime_t)-1)
+
+#define MSG_OK ((msg_t)0)
+#define MSG_TIMEOUT ((msg_t)-1)
+#define MSG_RESET ((msg_t)-2)
+
+#define IDLEPRIO ((tprio_t)1)
+#define LOWPRIO ((tprio_t)2)
+#define NORMALPRIO ((tprio_t)128)
+#define HIGHPRIO ((tprio_t)255)
+
+#define S2ST(sec) ((systime_t)((uint32_t)(sec) * (uint32_t)CH_CFG_ST_FREQUENCY))
+#define MS2ST(msec) ((systime_t)(((uint32_t)(msec) * (uint32_t)CH_CFG_ST_FREQUENCY + 999UL) / 1000UL))
+#define US2ST(usec) ((systime_t)(((uint32_t)(usec) * (uint32_t)CH_CFG_ST_FREQUENCY + 999999UL) / 1000000UL))
+#define LL_S2ST(sec) ((systime_t)((uint64_t)(sec) * CH_CFG_ST_FREQUENCY))
+#define LL_MS2ST(msec) ((systime_t)(((uint64_t)(msec) * CH_CFG_ST_FREQUENCY + 999) / 1000))
+#define LL_US2ST(usec) ((systime_t)(((uint64_t)(usec) * CH_CFG_ST_FREQUENCY + 999999) / 1000000))
+#define ST2S(n) (((n) + CH_CFG_ST_FREQUENCY - 1UL) / CH_CFG_ST_FREQUENCY)
+#define ST2MS(n) (((n) * 1000UL + CH_CFG_ST_FREQUENCY - 1UL) / CH_CFG_ST_FREQUENCY)
+#define ST2US(n) (((n) * 1000000UL + CH_CFG_ST_FREQUENCY - 1UL) / CH_CFG_ST_FREQUENCY)
+
+void chSysHalt(const char* reason);
+
+#define _CH_SIM_STR(x) #x
+#define _CH_SIM_XSTR(x) _CH_SIM_STR(x)
+#define chDbgCheck(c) do { if (!(c)) { chSysHalt(__FILE__ ":" _CH_SIM_XSTR(__LINE__) ": chDbgCheck(" #c ")"); } } while (0)
+#define chDbgAssert(c, r) do { if (!(c)) { chSysHalt(__FILE__ ":" _CH_SIM_XSTR(__LINE__) ": " r); } } while (0)
+
+//
+// System lock. Nesting or unbalanced calls halt, as with CH_DBG_SYSTEM_STATE_CHECK.
+//
+
+void chSysLock(void);
+void chSysUnlock(void);
+void chSysLockFromISR(void);
+void chSysUnlockFromISR(void);
+void chDbgCheckClassI(void);
+void chDbgCheckClassS(void);
+void chSchRescheduleS(void);
+
+//
+// Virtual timers
+//
+
+typedef void (*vtfunc_t)(void* p);
+
+typedef struct ch_virtual_timer {
+    systime_t expiry_systime;
+    vtfunc_t func;
+    void* par;
+    bool armed;
+    struct ch_virtual_timer* next;
+} virtual_timer_t;
+
+systime_t chVTGetSystemTimeX(void);
+systime_t chVTTimeElapsedSinceX(systime_t start);
+void chVTObjectInit(virtual_timer_t* vtp);
+void chVTSetI(virtual_timer_t* vtp, systime_t delay, vtfunc_t vtfunc, void* par);
+void chVTSet(virtual_timer_t* vtp, systime_t delay, vtfunc_t vtfunc, void* par);
+void chVTResetI(virtual_timer_t* vtp);
+void chVTReset(virtual_timer_t* vtp);
+bool chVTIsArmedI(virtual_timer_t* vtp);
+
+//
+// Threads. A suspended thread is restarted from its entry function once it is resumed, which is only equivalent to
+// returning from the suspend call for threads that loop without keeping state on the stack, such as worker threads.
+//
+
+#define CH_STATE_READY ((tstate_t)0)
+#define CH_STATE_CURRENT ((tstate_t)1)
+#define CH_STATE_SUSPENDED ((tstate_t)3)
+#define CH_STATE_FINAL ((tstate_t)15)
+
+typedef void (*tfunc_t)(void* p);
+
+#define THD_FUNCTION(tname, arg) void tname(void* arg)
+#define THD_WORKING_AREA_SIZE(n) ((size_t)(n))
+#define THD_WORKING_AREA_BASE(s) ((stkalign_t*)(s))
+#define PORT_WORKING_AREA_ALIGN sizeof(stkalign_t)
+#define PORT_NATURAL_ALIGN sizeof(void*)
+
+typedef struct ch_thread {
+    tstate_t state;
+    const char* name;
+    tprio_t prio;
+    tfunc_t funcp;
+    void* arg;
+    bool wakeup_armed;
+    systime_t wakeup_systime;
+    struct ch_thread** wakeup_trp;
+    struct ch_thread* next;
+} thread_t;
+
+typedef thread_t* thread_reference_t;
+
+typedef struct {
+    const char* name;
+    stkalign_t* wbase;
+    stkalign_t* wend;
+    tprio_t prio;
+    tfunc_t funcp;
+    void* arg;
+} thread_descriptor_t;
+
+thread_t* chThdCreate(const thread_descriptor_t* tdp);
+thread_t* chThdGetSelfX(void);
+tprio_t chThdSetPriority(tprio_t newprio);
+void chRegSetThreadName(const char* name);
+msg_t chThdSuspendS(thread_reference_t* trp);
+msg_t chThdSuspendTimeoutS(thread_reference_t* trp, systime_t timeout);
+void chThdResumeI(thread_reference_t* trp, msg_t msg);
+void chThdResumeS(thread_reference_t* trp, msg_t msg);
+void chThdResume(thread_reference_t* trp, msg_t msg);
+
+//
+// Mutexes. Only one thread runs at a time and threads never block while holding one, so they only need to exist.
+//
+
+typedef struct {
+    uint32_t cnt;
+} mutex_t;
+
+#define MUTEX_DECL(name) mutex_t name = {0}
+
+void chMtxObjectInit(mutex_t* mp);
+void chMtxLock(mutex_t* mp);
+void chMtxLockS(mutex_t* mp);
+void chMtxUnlock(mutex_t* mp);
+void chMtxUnlockS(mutex_t* mp);
+
+//
+// Memory
+//
+
+typedef void* (*memgetfunc_t)(size_t size, unsigned align);
+
+struct pool_header {
+    struct pool_header* next;
+};
+
+typedef struct {
+    struct pool_header* next;
+    size_t object_size;
+    memgetfunc_t provider;
+} memory_pool_t;
+
+#define MEMORYPOOL_DECL(name, size, provider) memory_pool_t name = {NULL, size, provider}
+
+void* chCoreAlloc(size_t size);
+void* chCoreAllocI(size_t size);
+void* chCoreAllocAligned(size_t size, unsigned align);
+void* chCoreAllocAlignedI(size_t size, unsigned align);
+
+void chPoolObjectInit(memory_pool_t* mp, size_t size, memgetfunc_t provider);
+void chPoolLoadArray(memory_pool_t* mp, void* p, size_t n);
+void* chPoolAllocI(memory_pool_t* mp);
+void* chPoolAlloc(memory_pool_t* mp);
+void chPoolFreeI(memory_pool_t* mp, void* objp);
+void chPoolFree(memory_pool_t* mp, void* objp);
+void chPoolAddI(memory_pool_t* mp, void* objp);
+
+//
+// Mailboxes
+//
+
+typedef struct {
+    msg_t* buffer;
+    cnt_t size;
+    cnt_t rd;
+    cnt_t cnt;
+} mailbox_t;
+
+void chMBObjectInit(mailbox_t* mbp, msg_t* buf, cnt_t n);
+msg_t chMBPostI(mailbox_t* mbp, msg_t msg);
+msg_t chMBFetch(mailbox_t* mbp, msg_t* msgp, systime_t timeout);
+cnt_t chMBGetUsedCountI(mailbox_t* mbp);
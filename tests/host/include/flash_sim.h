@@ -0,0 +1,21 @@
+#pragma once
+
+#include <framework_conf.h>
+#include <stdint.h>
+
+// RAM emulation of the modules/flash API, with FLASH_SIM_NUM_PAGES pages of FLASH_SIM_PAGE_SIZE bytes as set in
+// framework_conf.h. As on the STM32F3, programming goes a halfword at a time and only clears bits. The pages are
+// shared with forked child processes, so that a test can boot the device under test again on the same flash.
+
+#define FLASH_SIM_POWER_LOSS_EXIT_CODE 42
+
+// - Makes power fail during the flash operation ops operations from now, counting each halfword programmed and each
+//   page erased. The interrupted operation is left partly done and the process ends with
+//   FLASH_SIM_POWER_LOSS_EXIT_CODE. 0 disarms it.
+void flash_sim_set_power_loss_countdown(uint32_t ops);
+
+// - Returns the number of flash operations so far, counted as for flash_sim_set_power_loss_countdown.
+uint32_t flash_sim_get_op_count(void);
+
+// - Returns the number of pages erased so far, which are also counted by flash_sim_get_op_count.
+uint32_t flash_sim_get_erase_count(void);
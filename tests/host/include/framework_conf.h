@@ -0,0 +1,32 @@
+#pragma once
+
+//
+// Configure worker threads
+//
+
+#define CAN_AUTOBAUD_WORKER_THREAD                      lpwork_thread
+
+#define CAN_TRX_WORKER_THREAD                           can_thread
+#define CAN_EXPIRE_WORKER_THREAD                        can_thread
+
+//
+// Configure topic groups
+//
+
+#define PUBSUB_DEFAULT_TOPIC_GROUP default_topic_group
+
+//
+// Configure flash and params, see flash_sim.h
+//
+
+#ifndef FLASH_SIM_NUM_PAGES
+#define FLASH_SIM_NUM_PAGES 4
+#endif
+
+#ifndef FLASH_SIM_PAGE_SIZE
+#define FLASH_SIM_PAGE_SIZE 512
+#endif
+
+#define BOARD_PARAM_NUM_SECTORS FLASH_SIM_NUM_PAGES
+#define BOARD_PARAM_SECTOR_ADDR(n) flash_get_page_addr(n)
+#define BOARD_PARAM_SECTOR_SIZE(n) FLASH_SIM_PAGE_SIZE
@@ -0,0 +1,4 @@
+#pragma once
+
+// The host tests have no HAL. Headers that include hal.h only need what ch.h provides.
+#include <ch.h>
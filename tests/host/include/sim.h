@@ -0,0 +1,10 @@
+#pragma once
+
+#include <ch.h>
+
+// - Runs every ready thread until it suspends, fires the virtual timers and thread timeouts that are due, and repeats
+//   until the system time has advanced by ticks. Threads run in priority order and are never preempted.
+void sim_run_for(systime_t ticks);
+
+// - Runs every ready thread until it suspends, without advancing the system time.
+void sim_run_ready_threads(void);
@@ -0,0 +1,89 @@
+// Checks copy_bit_array against a reference that copies one bit at a time, and against copy_bit_array_bitwise, for
+// random offsets and lengths.
+
+#include <check.h>
+#include <common/bit_array.h>
+#include <stdbool.h>
+#include <string.h>
+
+#define BUF_SIZE 64
+#define NUM_ITERATIONS 200000
+
+static uint32_t rand_state = 1;
+
+static uint32_t rand_u32(void) {
+    // xorshift32
+    rand_state ^= rand_state << 13;
+    rand_state ^= rand_state >> 17;
+    rand_state ^= rand_state << 5;
+    return rand_state;
+}
+
+static void fill_random(uint8_t* buf, size_t len) {
+    for (size_t i=0; i<len; i++) {
+        buf[i] = (uint8_t)rand_u32();
+    }
+}
+
+static bool get_bit(const uint8_t* buf, uint32_t ofs) {
+    return (buf[ofs/8] >> (7 - ofs%8)) & 1;
+}
+
+static void set_bit(uint8_t* buf, uint32_t ofs, bool value) {
+    if (value) {
+        buf[ofs/8] |= (uint8_t)(0x80 >> (ofs%8));
+    } else {
+        buf[ofs/8] &= (uint8_t)~(0x80 >> (ofs%8));
+    }
+}
+
+static void copy_bit_array_reference(const uint8_t* src, uint32_t src_offset, uint32_t src_len, uint8_t* dst, uint32_t dst_offset) {
+    for (uint32_t i=0; i<src_len; i++) {
+        set_bit(dst, dst_offset+i, get_bit(src, src_offset+i));
+    }
+}
+
+static void check_copy(uint32_t src_offset, uint32_t src_len, uint32_t dst_offset) {
+    uint8_t src[BUF_SIZE];
+    uint8_t dst_init[BUF_SIZE];
+    uint8_t dst_expected[BUF_SIZE];
+    uint8_t dst[BUF_SIZE];
+    uint8_t dst_bitwise[BUF_SIZE];
+
+    fill_random(src, sizeof(src));
+    fill_random(dst_init, sizeof(dst_init));
+
+    memcpy(dst_expected, dst_init, sizeof(dst_init));
+    memcpy(dst, dst_init, sizeof(dst_init));
+    memcpy(dst_bitwise, dst_init, sizeof(dst_init));
+
+    copy_bit_array_reference(src, src_offset, src_len, dst_expected, dst_offset);
+    copy_bit_array(src, src_offset, src_len, dst, dst_offset);
+    copy_bit_array_bitwise(src, src_offset, src_len, dst_bitwise, dst_offset);
+
+    if (memcmp(dst, dst_expected, sizeof(dst)) != 0 || memcmp(dst_bitwise, dst_expected, sizeof(dst)) != 0) {
+        fprintf(stderr, "mismatch: src_offset=%u src_len=%u dst_offset=%u\n", src_offset, src_len, dst_offset);
+        CHECK(false);
+    }
+}
+
+int main(void) {
+    // Every combination of sub-byte offsets for short and word-sized lengths
+    for (uint32_t src_offset=0; src_offset<16; src_offset++) {
+        for (uint32_t dst_offset=0; dst_offset<16; dst_offset++) {
+            for (uint32_t src_len=0; src_len<=72; src_len++) {
+                check_copy(src_offset, src_len, dst_offset);
+            }
+        }
+    }
+
+    for (uint32_t i=0; i<NUM_ITERATIONS; i++) {
+        uint32_t src_offset = rand_u32() % (BUF_SIZE*8);
+        uint32_t dst_offset = rand_u32() % (BUF_SIZE*8);
+        uint32_t max_len = BUF_SIZE*8 - (src_offset > dst_offset ? src_offset : dst_offset);
+        check_copy(src_offset, rand_u32() % (max_len+1), dst_offset);
+    }
+
+    printf("test_bit_array: pass\n");
+    return 0;
+}
@@ -0,0 +1,156 @@
+// Runs can_autobaud against peers on the virtual CAN bus. The default virtual node is the device under test, which
+// can_autobaud starts in silent mode at 1 Mbit/s.
+
+#include <sim.h>
+#include <check.h>
+#include <modules/can/can.h>
+#include <modules/can_driver_virtual/can_driver_virtual.h>
+#include <modules/pubsub/pubsub.h>
+#include <modules/worker_thread/worker_thread.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+WORKER_THREAD_SPAWN(lpwork_thread, LOWPRIO, 1024)
+WORKER_THREAD_SPAWN(can_thread, LOWPRIO, 1024)
+
+PUBSUB_TOPIC_GROUP_CREATE(default_topic_group, 4096)
+
+#define NUM_PEERS 2
+
+static struct can_driver_virtual_node_s peer_nodes[NUM_PEERS];
+static struct can_instance_s* peers[NUM_PEERS];
+static uint8_t next_peer_idx;
+static struct worker_thread_timer_task_s peer_traffic_task;
+static uint32_t frames_to_corrupt;
+
+static struct can_instance_s* get_dut(void) {
+    return can_get_instance(0);
+}
+
+static struct can_driver_virtual_node_s* get_dut_node(void) {
+    return can_driver_virtual_get_default_bus()->node_list_head;
+}
+
+// The peers take turns, so that each frame on the bus is a separate piece of evidence
+static void peer_send_frame(void) {
+    struct can_tx_frame_s* frame_list = can_allocate_tx_frames(peers[next_peer_idx], NULL, 1);
+    CHECK(frame_list != NULL);
+
+    memset(&frame_list->content, 0, sizeof(frame_list->content));
+    frame_list->content.IDE = 1;
+    frame_list->content.EID = 0x1000 + next_peer_idx;
+    frame_list->content.DLC = 8;
+
+    can_enqueue_tx_frames(peers[next_peer_idx], &frame_list, MS2ST(100), NULL);
+    next_peer_idx = (next_peer_idx + 1) % NUM_PEERS;
+}
+
+static void peer_traffic_task_func(struct worker_thread_timer_task_s* task) {
+    (void)task;
+    peer_send_frame();
+}
+
+static bool corrupt_frames(const struct can_frame_s* frame, void* ctx) {
+    (void)frame;
+    (void)ctx;
+
+    if (frames_to_corrupt > 0) {
+        frames_to_corrupt--;
+        return true;
+    }
+    return false;
+}
+
+// Brings up the peers at the bus baudrate while the device under test is stopped, so that they have confirmed their
+// baudrate and only the device under test is left for can_autobaud to switch
+static void start_bus(uint32_t baudrate, bool auto_retransmit, systime_t traffic_period) {
+    struct can_driver_virtual_bus_s* bus = can_driver_virtual_get_default_bus();
+
+    can_stop(get_dut());
+    can_driver_virtual_bus_set_baudrate(bus, baudrate);
+
+    for (uint8_t i=0; i<NUM_PEERS; i++) {
+        peers[i] = can_driver_virtual_attach(bus, &peer_nodes[i], i+1);
+        CHECK(peers[i] != NULL);
+        can_start(peers[i], false, true, baudrate);
+    }
+
+    for (uint8_t i=0; i<NUM_PEERS; i++) {
+        peer_send_frame();
+    }
+    sim_run_for(MS2ST(5));
+
+    for (uint8_t i=0; i<NUM_PEERS; i++) {
+        CHECK(can_get_baudrate_confirmed(peers[i]));
+        can_set_auto_retransmit_mode(peers[i], auto_retransmit);
+    }
+
+    can_start(get_dut(), true, true, 1000000);
+    can_driver_virtual_bus_set_error_inject_cb(bus, corrupt_frames, NULL);
+
+    peer_send_frame();
+    worker_thread_add_timer_task(&lpwork_thread, &peer_traffic_task, peer_traffic_task_func, NULL, traffic_period, true);
+}
+
+static void check_dut_confirmed(uint32_t baudrate) {
+    CHECK(can_get_baudrate(get_dut()) == baudrate);
+    CHECK(can_get_baudrate_confirmed(get_dut()));
+    CHECK(!get_dut_node()->silent);
+}
+
+// A busy bus at another baudrate produces errors at every wrong candidate, which is abandoned after one sample window
+static void test_busy_bus(void) {
+    start_bus(250000, true, MS2ST(1));
+
+    sim_run_for(MS2ST(100));
+    check_dut_confirmed(250000);
+}
+
+// A few corrupted frames before the first valid one must not move the device off the correct baudrate
+static void test_noise_below_threshold(void) {
+    frames_to_corrupt = 3;
+    start_bus(1000000, false, MS2ST(10));
+
+    sim_run_for(MS2ST(50));
+    CHECK(frames_to_corrupt == 0);
+    check_dut_confirmed(1000000);
+}
+
+// Sparse traffic at another baudrate stays below the error threshold, so the candidate is only abandoned after the dwell
+static void test_quiet_bus(void) {
+    start_bus(500000, true, MS2ST(400));
+
+    sim_run_for(MS2ST(900));
+    CHECK(can_get_baudrate(get_dut()) == 1000000);
+    CHECK(!can_get_baudrate_confirmed(get_dut()));
+
+    sim_run_for(MS2ST(1000));
+    check_dut_confirmed(500000);
+}
+
+// Each scenario runs in a child process, which starts from the state the constructors left behind
+static bool run_test(const char* name, void (*test_func)(void)) {
+    fflush(stdout);
+    pid_t pid = fork();
+    CHECK(pid >= 0);
+
+    if (pid == 0) {
+        test_func();
+        exit(0);
+    }
+
+    int status;
+    CHECK(waitpid(pid, &status, 0) == pid);
+    bool passed = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    printf("%s: %s\n", name, passed ? "pass" : "FAIL");
+    return passed;
+}
+
+int main(void) {
+    bool passed = true;
+    passed &= run_test("busy_bus", test_busy_bus);
+    passed &= run_test("noise_below_threshold", test_noise_below_threshold);
+    passed &= run_test("quiet_bus", test_quiet_bus);
+    return passed ? 0 : 1;
+}
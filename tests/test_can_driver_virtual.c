@@ -0,0 +1,88 @@
+// Checks that stopping a virtual CAN node completes the frames in its mailboxes as failed, including the one that is cut
+// short on the bus, and that frames still waiting in the tx queue are transmitted once the node is restarted.
+
+#include <sim.h>
+#include <check.h>
+#include <modules/can/can.h>
+#include <modules/can_driver_virtual/can_driver_virtual.h>
+#include <modules/pubsub/pubsub.h>
+#include <modules/worker_thread/worker_thread.h>
+#include <stdio.h>
+#include <string.h>
+
+WORKER_THREAD_SPAWN(lpwork_thread, LOWPRIO, 1024)
+WORKER_THREAD_SPAWN(can_thread, LOWPRIO, 1024)
+
+PUBSUB_TOPIC_GROUP_CREATE(default_topic_group, 4096)
+
+static struct can_driver_virtual_node_s peer_node;
+static struct pubsub_topic_s completion_topic;
+static struct worker_thread_listener_task_s completion_listener_task;
+static uint32_t num_succeeded;
+static uint32_t num_failed;
+
+static void completion_handler(size_t msg_size, const void* buf, void* ctx) {
+    (void)msg_size;
+    (void)ctx;
+    const struct can_transmit_completion_msg_s* msg = buf;
+
+    if (msg->transmit_success) {
+        num_succeeded++;
+    } else {
+        num_failed++;
+    }
+}
+
+static void send_frame(struct can_instance_s* instance, uint32_t eid) {
+    struct can_tx_frame_s* frame_list = can_allocate_tx_frames(instance, NULL, 1);
+    CHECK(frame_list != NULL);
+
+    memset(&frame_list->content, 0, sizeof(frame_list->content));
+    frame_list->content.IDE = 1;
+    frame_list->content.EID = eid;
+    frame_list->content.DLC = 8;
+
+    can_enqueue_tx_frames(instance, &frame_list, MS2ST(100), &completion_topic);
+}
+
+int main(void) {
+    struct can_driver_virtual_bus_s* bus = can_driver_virtual_get_default_bus();
+    struct can_instance_s* dut = can_get_instance(0);
+    struct can_driver_virtual_node_s* dut_node = bus->node_list_head;
+
+    pubsub_init_topic(&completion_topic, NULL);
+    worker_thread_add_listener_task(&lpwork_thread, &completion_listener_task, &completion_topic, completion_handler, NULL);
+
+    struct can_instance_s* peer = can_driver_virtual_attach(bus, &peer_node, 1);
+    CHECK(peer != NULL);
+    can_start(peer, false, true, bus->baudrate);
+    can_start(dut, false, true, bus->baudrate);
+
+    // A frame is only loaded if it outranks every loaded frame, so the mailboxes are filled in rising priority. The last
+    // frame has the lowest priority and waits in the tx queue.
+    for (uint32_t i=0; i<CAN_DRIVER_VIRTUAL_NUM_TX_MAILBOXES; i++) {
+        send_frame(dut, 0x1000 + CAN_DRIVER_VIRTUAL_NUM_TX_MAILBOXES - i);
+    }
+    send_frame(dut, 0x2000);
+    for (uint32_t i=0; i<CAN_DRIVER_VIRTUAL_NUM_TX_MAILBOXES; i++) {
+        CHECK(dut_node->tx_mailbox_pending[i]);
+    }
+    CHECK(bus->transmitting_node == dut_node);
+
+    can_stop(dut);
+    sim_run_for(MS2ST(10));
+
+    CHECK(num_failed == CAN_DRIVER_VIRTUAL_NUM_TX_MAILBOXES);
+    CHECK(num_succeeded == 0);
+    CHECK(bus->frames_completed == 0);
+
+    can_start(dut, false, true, bus->baudrate);
+    sim_run_for(MS2ST(10));
+
+    CHECK(num_failed == CAN_DRIVER_VIRTUAL_NUM_TX_MAILBOXES);
+    CHECK(num_succeeded == 1);
+    CHECK(bus->frames_completed == 1);
+
+    printf("can_driver_virtual: pass\n");
+    return 0;
+}
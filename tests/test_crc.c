@@ -0,0 +1,86 @@
+// Checks the CRC kernels selected by CRC_TABLE_BITS and CRC32_SLICE_BY_4 against bit-by-bit references. The Makefile
+// builds this file once per configuration.
+
+#include <check.h>
+#include <common/crc64_we.h>
+#include <common/helpers.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define MAX_LEN 300
+
+static uint16_t crc16_ccitt_reference(const uint8_t* buf, size_t len, uint16_t crc) {
+    for (size_t i=0; i<len*8; i++) {
+        bool bit = ((crc >> 15) ^ (buf[i/8] >> (7-i%8))) & 1;
+        crc = (uint16_t)(crc << 1) ^ (bit ? 0x1021 : 0);
+    }
+    return crc;
+}
+
+static uint32_t crc32_reference(const uint8_t* buf, size_t len, uint32_t crc) {
+    crc = ~crc;
+    for (size_t i=0; i<len*8; i++) {
+        bool bit = (crc ^ (buf[i/8] >> (i%8))) & 1;
+        crc = (crc >> 1) ^ (bit ? 0xEDB88320 : 0);
+    }
+    return ~crc;
+}
+
+static uint64_t crc64_we_reference(const uint8_t* buf, size_t len, uint64_t crc) {
+    crc = ~crc;
+    for (size_t i=0; i<len*8; i++) {
+        bool bit = ((crc >> 63) ^ (buf[i/8] >> (7-i%8))) & 1;
+        crc = (crc << 1) ^ (bit ? 0x42F0E1EBA9EA3693ULL : 0);
+    }
+    return ~crc;
+}
+
+// The standard check values over "123456789"
+static void test_check_values(void) {
+    const uint8_t* check = (const uint8_t*)"123456789";
+
+    CHECK(crc16_ccitt(check, 9, 0xFFFF) == 0x29B1);
+    CHECK(crc32(check, 9, 0) == 0xCBF43926);
+    CHECK(crc64_we(check, 9, 0) == 0x62EC59E3F1A4F00AULL);
+}
+
+// Every length and alignment up to MAX_LEN, covering the slice-by-4 head and tail, with random seeds, and split into
+// two calls to check that the CRCs chain
+static void test_random_buffers(void) {
+    static uint8_t buf[MAX_LEN+4];
+
+    for (size_t i=0; i<sizeof(buf); i++) {
+        buf[i] = rand();
+    }
+
+    for (size_t offset=0; offset<4; offset++) {
+        for (size_t len=0; len<=MAX_LEN; len++) {
+            const uint8_t* data = &buf[offset];
+            uint16_t seed16 = rand();
+            uint32_t seed32 = ((uint32_t)rand() << 16) ^ rand();
+            uint64_t seed64 = ((uint64_t)seed32 << 32) ^ ((uint32_t)rand() << 16) ^ rand();
+            size_t split = len ? (size_t)rand() % len : 0;
+
+            uint16_t crc16_expected = crc16_ccitt_reference(data, len, seed16);
+            CHECK(crc16_ccitt(data, len, seed16) == crc16_expected);
+            CHECK(crc16_ccitt(data+split, len-split, crc16_ccitt(data, split, seed16)) == crc16_expected);
+
+            uint32_t crc32_expected = crc32_reference(data, len, seed32);
+            CHECK(crc32(data, len, seed32) == crc32_expected);
+            CHECK(crc32(data+split, len-split, crc32(data, split, seed32)) == crc32_expected);
+
+            uint64_t crc64_expected = crc64_we_reference(data, len, seed64);
+            CHECK(crc64_we(data, len, seed64) == crc64_expected);
+            CHECK(crc64_we(data+split, len-split, crc64_we(data, split, seed64)) == crc64_expected);
+        }
+    }
+}
+
+int main(void) {
+    srand(1);
+    test_check_values();
+    test_random_buffers();
+    printf("crc (CRC_TABLE_BITS=%d, CRC32_SLICE_BY_4=%d): pass\n", CRC_TABLE_BITS, CRC32_SLICE_BY_4);
+    return 0;
+}
@@ -0,0 +1,159 @@
+// Checks the way platform_stm32f302x8.c drives the STM32F3 CRC unit when PLATFORM_STM32F302X8_USE_HW_CRC is set. The
+// unit is emulated from its description in RM0316: INIT is loaded into the CRC register on RESET, each byte written to
+// DR is bit-reversed if REV_IN is byte-wise and then shifted in MSB first, and reading DR returns the CRC register,
+// bit-reversed over 32 bits if REV_OUT is set.
+//
+// The register sequences below must be kept the same as in platform_stm32f302x8.c, including the 64 byte chunks that
+// reload the unit from the running CRC.
+
+#include <check.h>
+#include <common/helpers.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define MAX_LEN 300
+#define HW_CRC_CHUNK_LEN 64
+
+#define CRC_CR_RESET      (1U << 0)
+#define CRC_CR_POLYSIZE_0 (1U << 3)
+#define CRC_CR_POLYSIZE_1 (1U << 4)
+#define CRC_CR_REV_IN_0   (1U << 5)
+#define CRC_CR_REV_IN_1   (1U << 6)
+#define CRC_CR_REV_OUT    (1U << 7)
+
+struct crc_unit_s {
+    uint32_t POL;
+    uint32_t CR;
+    uint32_t INIT;
+    uint32_t crc;
+};
+
+static struct crc_unit_s crc_unit;
+
+static uint32_t rbit(uint32_t x) {
+    uint32_t ret = 0;
+    for (uint8_t i=0; i<32; i++) {
+        ret |= ((x >> i) & 1) << (31-i);
+    }
+    return ret;
+}
+
+static uint8_t get_polysize(void) {
+    switch (crc_unit.CR & (CRC_CR_POLYSIZE_0|CRC_CR_POLYSIZE_1)) {
+        case 0:
+            return 32;
+        case CRC_CR_POLYSIZE_0:
+            return 16;
+        case CRC_CR_POLYSIZE_1:
+            return 8;
+        default:
+            return 7;
+    }
+}
+
+static void crc_unit_write_cr(uint32_t cr) {
+    crc_unit.CR = cr & ~CRC_CR_RESET;
+    if (cr & CRC_CR_RESET) {
+        crc_unit.crc = crc_unit.INIT;
+    }
+}
+
+static void crc_unit_write_dr8(uint8_t data) {
+    uint8_t polysize = get_polysize();
+    uint32_t mask = polysize == 32 ? 0xFFFFFFFF : (1UL << polysize) - 1;
+
+    // Only byte-wise input reversal is emulated, as that is all the platform uses with byte writes
+    CHECK((crc_unit.CR & (CRC_CR_REV_IN_0|CRC_CR_REV_IN_1)) != CRC_CR_REV_IN_1 && (crc_unit.CR & (CRC_CR_REV_IN_0|CRC_CR_REV_IN_1)) != (CRC_CR_REV_IN_0|CRC_CR_REV_IN_1));
+    if (crc_unit.CR & CRC_CR_REV_IN_0) {
+        data = rbit(data) >> 24;
+    }
+
+    uint32_t crc = crc_unit.crc & mask;
+    for (int8_t i=7; i>=0; i--) {
+        bool bit = ((crc >> (polysize-1)) ^ (data >> i)) & 1;
+        crc = ((crc << 1) ^ (bit ? crc_unit.POL : 0)) & mask;
+    }
+    crc_unit.crc = crc;
+}
+
+static uint32_t crc_unit_read_dr(void) {
+    return (crc_unit.CR & CRC_CR_REV_OUT) ? rbit(crc_unit.crc) : crc_unit.crc;
+}
+
+static void hw_crc_begin(uint32_t polynomial, uint32_t cr, uint32_t init) {
+    crc_unit.POL = polynomial;
+    crc_unit_write_cr(cr);
+    crc_unit.INIT = init;
+    crc_unit_write_cr(cr | CRC_CR_RESET);
+}
+
+static void hw_crc_feed(const uint8_t* buf, size_t len) {
+    for (size_t i=0; i<len; i++) {
+        crc_unit_write_dr8(buf[i]);
+    }
+}
+
+static uint16_t hw_crc16_ccitt(const void *buf, size_t len, uint16_t crc) {
+    const uint8_t* data = buf;
+
+    while (len > 0) {
+        size_t chunk_len = MIN(len, HW_CRC_CHUNK_LEN);
+
+        hw_crc_begin(0x1021, CRC_CR_POLYSIZE_0, crc);
+        hw_crc_feed(data, chunk_len);
+        crc = (uint16_t)crc_unit_read_dr();
+
+        data += chunk_len;
+        len -= chunk_len;
+    }
+
+    return crc;
+}
+
+static uint32_t hw_crc32(const uint8_t *buf, uint32_t len, uint32_t crc) {
+    while (len > 0) {
+        uint32_t chunk_len = MIN(len, HW_CRC_CHUNK_LEN);
+
+        hw_crc_begin(0x04C11DB7, CRC_CR_REV_IN_0 | CRC_CR_REV_OUT, rbit(~crc));
+        hw_crc_feed(buf, chunk_len);
+        crc = ~crc_unit_read_dr();
+
+        buf += chunk_len;
+        len -= chunk_len;
+    }
+
+    return crc;
+}
+
+// The software kernels in src/common/crc.c are the reference, as test_crc.c checks them bit by bit
+int main(void) {
+    static uint8_t buf[MAX_LEN];
+    const uint8_t* check = (const uint8_t*)"123456789";
+
+    CHECK(hw_crc16_ccitt(check, 9, 0xFFFF) == 0x29B1);
+    CHECK(hw_crc32(check, 9, 0) == 0xCBF43926);
+
+    srand(1);
+    for (size_t i=0; i<sizeof(buf); i++) {
+        buf[i] = rand();
+    }
+
+    // Lengths around the chunk boundaries, with random seeds, and split into two calls to check that the CRCs chain
+    for (size_t len=0; len<=MAX_LEN; len++) {
+        uint16_t seed16 = rand();
+        uint32_t seed32 = ((uint32_t)rand() << 16) ^ rand();
+        size_t split = len ? (size_t)rand() % len : 0;
+
+        uint16_t crc16_expected = crc16_ccitt(buf, len, seed16);
+        CHECK(hw_crc16_ccitt(buf, len, seed16) == crc16_expected);
+        CHECK(hw_crc16_ccitt(buf+split, len-split, hw_crc16_ccitt(buf, split, seed16)) == crc16_expected);
+
+        uint32_t crc32_expected = crc32(buf, len, seed32);
+        CHECK(hw_crc32(buf, len, seed32) == crc32_expected);
+        CHECK(hw_crc32(buf+split, len-split, hw_crc32(buf, split, seed32)) == crc32_expected);
+    }
+
+    printf("crc_stm32_hw: pass\n");
+    return 0;
+}
@@ -0,0 +1,90 @@
+// Checks when flash_journal_compaction_due asks for the oldest sector to be compacted, on a journal of two sectors: not
+// while every entry in it is live, however full the newest sector is, and as soon as one of them has been superseded.
+
+#include <flash_sim.h>
+#include <modules/flash/flash.h>
+#include <modules/param/flash_journal.h>
+#include <check.h>
+#include <stdio.h>
+#include <string.h>
+
+#define NUM_SECTORS 2
+#define MAX_KEYS 64
+
+struct __attribute__((packed)) key_value_s {
+    uint8_t key;
+    uint32_t value;
+};
+
+static struct flash_journal_sector_s sectors[NUM_SECTORS];
+static struct flash_journal_instance_s journal;
+static const struct flash_journal_entry_s* index_entries[MAX_KEYS];
+
+static bool entry_live(const struct flash_journal_entry_s* entry, void* ctx) {
+    (void)ctx;
+    return index_entries[((const struct key_value_s*)entry->data)->key] == entry;
+}
+
+static void rebuild_index(void) {
+    memset(index_entries, 0, sizeof(index_entries));
+    const struct flash_journal_entry_s* entry = NULL;
+    while (flash_journal_iterate(&journal, &entry)) {
+        index_entries[((const struct key_value_s*)entry->data)->key] = entry;
+    }
+}
+
+static void store(uint8_t key, uint32_t value) {
+    struct key_value_s key_value = {key, value};
+    CHECK(flash_journal_write(&journal, sizeof(key_value), &key_value));
+    index_entries[key] = flash_journal_get_last_entry(&journal);
+}
+
+static size_t get_head_sector_used(void) {
+    if (journal.num_open_sectors == 0) {
+        return 0;
+    }
+
+    const struct flash_journal_sector_s* sector = &sectors[journal.open_sectors[journal.num_open_sectors-1]];
+    return (size_t)sector->end_ptr - (size_t)sector->flash_page_ptr;
+}
+
+static void init_journal(void) {
+    for (uint8_t i=0; i<NUM_SECTORS; i++) {
+        sectors[i].flash_page_ptr = (struct flash_journal_entry_s*)flash_get_page_addr(i);
+        sectors[i].flash_page_size = FLASH_SIM_PAGE_SIZE;
+    }
+    flash_journal_init(&journal, 1, NUM_SECTORS, sectors);
+    rebuild_index();
+}
+
+int main(void) {
+    init_journal();
+    CHECK(flash_journal_erase(&journal));
+
+    // Distinct keys past three quarters of the sector, all of them live
+    uint8_t num_keys = 0;
+    while (get_head_sector_used() < FLASH_SIM_PAGE_SIZE/4*3) {
+        CHECK(num_keys < MAX_KEYS);
+        store(num_keys, num_keys);
+        num_keys++;
+    }
+    CHECK(!flash_journal_compaction_due(&journal, entry_live, NULL));
+
+    // As after a reboot
+    init_journal();
+    CHECK(flash_journal_count_entries(&journal) == num_keys);
+    CHECK(!flash_journal_compaction_due(&journal, entry_live, NULL));
+
+    store(0, 1000);
+    CHECK(flash_journal_compaction_due(&journal, entry_live, NULL));
+
+    uint32_t erase_count = flash_sim_get_erase_count();
+    CHECK(flash_journal_compact_oldest_sector(&journal, entry_live, NULL));
+    rebuild_index();
+    CHECK(flash_sim_get_erase_count() == erase_count+1);
+    CHECK(flash_journal_count_entries(&journal) == num_keys);
+    CHECK(!flash_journal_compaction_due(&journal, entry_live, NULL));
+
+    printf("test_flash_journal: pass\n");
+    return 0;
+}
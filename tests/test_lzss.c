@@ -0,0 +1,169 @@
+// Decompresses the output of lzss_compress from tools/uavcan_upload.py, which gen_lzss_fixtures.py writes to the
+// directory given as the argument, feeding the decoder in random chunks as the bootloader receives it.
+
+#include <check.h>
+#include <common/lzss.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NUM_SPLITS 50
+
+struct buffer_s {
+    uint8_t* data;
+    size_t len;
+};
+
+struct output_s {
+    uint8_t* data;
+    size_t len;
+    size_t size;
+};
+
+static struct buffer_s read_file(const char* dir, const char* name, const char* ext) {
+    char path[256];
+    snprintf(path, sizeof(path), "%s/%s%s", dir, name, ext);
+
+    FILE* f = fopen(path, "rb");
+    CHECK(f != NULL);
+
+    struct buffer_s buf = {NULL, 0};
+    uint8_t chunk[4096];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0) {
+        buf.data = realloc(buf.data, buf.len+n);
+        CHECK(buf.data != NULL);
+        memcpy(&buf.data[buf.len], chunk, n);
+        buf.len += n;
+    }
+    fclose(f);
+
+    return buf;
+}
+
+static void output_func(uint8_t byte, void* ctx) {
+    struct output_s* output = ctx;
+    CHECK(output->len < output->size);
+    output->data[output->len++] = byte;
+}
+
+// Checks that history reads stay within LZSS_MAX_DISTANCE, as the bootloader reads them back from flash
+static uint8_t history_func(uint32_t ofs, void* ctx) {
+    struct output_s* output = ctx;
+    CHECK(ofs < output->len);
+    CHECK(output->len - ofs <= LZSS_MAX_DISTANCE);
+    return output->data[ofs];
+}
+
+// Mostly short chunks, so that every decoder state is split across feeds, with the occasional long one
+static size_t random_chunk_len(size_t remaining) {
+    size_t len;
+    switch (rand() % 4) {
+        case 0:
+            len = 1;
+            break;
+        case 1:
+            len = 1 + rand() % 8;
+            break;
+        case 2:
+            len = 1 + rand() % 256;
+            break;
+        default:
+            len = 1 + rand() % 4096;
+            break;
+    }
+    return len < remaining ? len : remaining;
+}
+
+static void test_round_trip(const struct buffer_s* compressed, const struct buffer_s* expected) {
+    struct output_s output = {malloc(expected->len+1), 0, expected->len};
+    CHECK(output.data != NULL);
+
+    for (uint32_t split=0; split<=NUM_SPLITS; split++) {
+        struct lzss_decoder_s decoder;
+        lzss_decoder_init(&decoder, output_func, history_func, &output);
+        output.len = 0;
+
+        // The first pass feeds the whole stream at once
+        size_t ofs = 0;
+        while (ofs < compressed->len) {
+            size_t len = split == 0 ? compressed->len : random_chunk_len(compressed->len - ofs);
+            CHECK(!lzss_decoder_finished(&decoder));
+            CHECK(lzss_decoder_feed(&decoder, &compressed->data[ofs], len));
+            ofs += len;
+
+            CHECK(lzss_decoder_header_complete(&decoder) == (ofs >= LZSS_HEADER_SIZE));
+            if (lzss_decoder_header_complete(&decoder)) {
+                CHECK(lzss_decoder_get_output_size(&decoder) == expected->len);
+            }
+        }
+
+        CHECK(lzss_decoder_finished(&decoder));
+        CHECK(output.len == expected->len);
+        CHECK(expected->len == 0 || memcmp(output.data, expected->data, expected->len) == 0);
+
+        // Nothing may follow the last item
+        uint8_t trailing = 0xff;
+        CHECK(!lzss_decoder_feed(&decoder, &trailing, 1));
+    }
+
+    free(output.data);
+}
+
+static bool decode_all(const uint8_t* buf, size_t len, uint8_t* out, size_t out_size) {
+    struct output_s output = {out, 0, out_size};
+    struct lzss_decoder_s decoder;
+    lzss_decoder_init(&decoder, output_func, history_func, &output);
+    return lzss_decoder_feed(&decoder, buf, len) && lzss_decoder_finished(&decoder);
+}
+
+static void test_malformed(void) {
+    uint8_t out[16];
+
+    // A literal, then a match of 3 at distance 1
+    const uint8_t valid[] = {'O', 'D', 'L', 'Z', 4, 0, 0, 0, 0x01, 'a', 0x00, 0x00};
+    CHECK(decode_all(valid, sizeof(valid), out, sizeof(out)));
+    CHECK(memcmp(out, "aaaa", 4) == 0);
+
+    const uint8_t bad_magic[] = {'O', 'D', 'L', 'Y', 4, 0, 0, 0, 0x01, 'a', 0x00, 0x00};
+    CHECK(!decode_all(bad_magic, sizeof(bad_magic), out, sizeof(out)));
+
+    const uint8_t distance_before_start[] = {'O', 'D', 'L', 'Z', 4, 0, 0, 0, 0x01, 'a', 0x01, 0x00};
+    CHECK(!decode_all(distance_before_start, sizeof(distance_before_start), out, sizeof(out)));
+
+    const uint8_t match_past_size[] = {'O', 'D', 'L', 'Z', 3, 0, 0, 0, 0x01, 'a', 0x00, 0x00};
+    CHECK(!decode_all(match_past_size, sizeof(match_past_size), out, sizeof(out)));
+
+    const uint8_t truncated[] = {'O', 'D', 'L', 'Z', 4, 0, 0, 0, 0x01, 'a', 0x00};
+    CHECK(!decode_all(truncated, sizeof(truncated), out, sizeof(out)));
+}
+
+int main(int argc, char** argv) {
+    CHECK(argc == 2);
+    const char* dir = argv[1];
+
+    char index_path[256];
+    snprintf(index_path, sizeof(index_path), "%s/index", dir);
+    FILE* index = fopen(index_path, "r");
+    CHECK(index != NULL);
+
+    srand(1);
+
+    char name[64];
+    uint32_t num_fixtures = 0;
+    while (fscanf(index, "%63s", name) == 1) {
+        struct buffer_s compressed = read_file(dir, name, ".lz");
+        struct buffer_s expected = read_file(dir, name, ".bin");
+        test_round_trip(&compressed, &expected);
+        free(compressed.data);
+        free(expected.data);
+        num_fixtures++;
+    }
+    fclose(index);
+    CHECK(num_fixtures > 0);
+
+    test_malformed();
+
+    printf("test_lzss: pass (%u streams)\n", (unsigned)num_fixtures);
+    return 0;
+}
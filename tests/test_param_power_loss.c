@@ -0,0 +1,207 @@
+// Cuts the power at random points while params are stored and loaded, and checks that every param comes back with
+// either its old or its new value, and that the journal keeps working afterwards.
+//
+// Every boot of the device under test is a child process, forked just before PARAM_INIT so that it starts from the
+// same state as at reset. The flash pages are shared with it, so they carry over from one boot to the next. The parent
+// process decides what each boot stores and when the power fails, and checks what the next boot loads.
+
+#include <check.h>
+#include <common/ctor.h>
+#include <flash_sim.h>
+#include <modules/param/param.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define NUM_ROUNDS 5000
+#define NUM_UINT32_PARAMS 16
+#define STRING_PARAM_MAX_LEN 16
+
+struct param_values_s {
+    uint32_t uint32_values[NUM_UINT32_PARAMS];
+    char string_value[STRING_PARAM_MAX_LEN+1];
+};
+
+// Written by the parent before each boot, and by the boot to report back
+struct boot_s {
+    uint32_t store_power_loss_countdown;
+    struct param_values_s values_to_store;
+    bool booted;
+    bool stored;
+    struct param_values_s loaded_values;
+};
+
+static struct boot_s* boot;
+
+static uint32_t uint32_params[NUM_UINT32_PARAMS];
+static char uint32_param_names[NUM_UINT32_PARAMS][8];
+static struct param_descriptor_uint32_s uint32_param_descriptors[NUM_UINT32_PARAMS];
+
+PARAM_DEFINE_STRING_PARAM_STATIC(string_param, "str", "default", STRING_PARAM_MAX_LEN)
+
+static void get_param_values(struct param_values_s* values) {
+    memset(values, 0, sizeof(*values));
+    memcpy(values->uint32_values, uint32_params, sizeof(uint32_params));
+    strcpy(values->string_value, string_param);
+}
+
+static void set_param_values(const struct param_values_s* values) {
+    memcpy(uint32_params, values->uint32_values, sizeof(uint32_params));
+    strcpy(string_param, values->string_value);
+}
+
+// Changes about one value in four, so that stores append a few entries and compaction has stale ones to drop
+static void make_new_param_values(const struct param_values_s* old_values, struct param_values_s* new_values) {
+    *new_values = *old_values;
+
+    for (uint8_t i=0; i<NUM_UINT32_PARAMS; i++) {
+        if (rand() % 4 == 0) {
+            new_values->uint32_values[i] = ((uint32_t)rand() << 16) ^ (uint32_t)rand();
+        }
+    }
+
+    if (rand() % 4 == 0) {
+        size_t len = rand() % (STRING_PARAM_MAX_LEN+1);
+        for (size_t i=0; i<len; i++) {
+            new_values->string_value[i] = 'a' + rand() % 26;
+        }
+        new_values->string_value[len] = 0;
+    }
+}
+
+// Checks that each value the boot loaded is one of the two it may have
+static void check_loaded_values(uint32_t round, const struct param_values_s* old_values, const struct param_values_s* new_values) {
+    const struct param_values_s* loaded = &boot->loaded_values;
+
+    for (uint8_t i=0; i<NUM_UINT32_PARAMS; i++) {
+        if (loaded->uint32_values[i] != old_values->uint32_values[i] && loaded->uint32_values[i] != new_values->uint32_values[i]) {
+            fprintf(stderr, "round %u: p%u is %u, expected %u or %u\n", round, i, loaded->uint32_values[i], old_values->uint32_values[i], new_values->uint32_values[i]);
+            exit(1);
+        }
+    }
+
+    if (strcmp(loaded->string_value, old_values->string_value) != 0 && strcmp(loaded->string_value, new_values->string_value) != 0) {
+        fprintf(stderr, "round %u: str is \"%s\", expected \"%s\" or \"%s\"\n", round, loaded->string_value, old_values->string_value, new_values->string_value);
+        exit(1);
+    }
+}
+
+// A store of a few changed values takes a few dozen flash operations, and one that compacts the journal a few hundred
+static uint32_t random_power_loss_countdown(void) {
+    switch (rand() % 4) {
+        case 0:
+            return 0;
+        case 1:
+            return 1 + rand() % 400;
+        default:
+            return 1 + rand() % 40;
+    }
+}
+
+// - Returns true in the child, which goes on to boot. Returns false in the parent once the boot has ended, normally or
+//   by power loss.
+static bool run_boot(uint32_t boot_power_loss_countdown) {
+    boot->booted = false;
+    boot->stored = false;
+    flash_sim_set_power_loss_countdown(boot_power_loss_countdown);
+
+    fflush(stdout);
+    pid_t pid = fork();
+    CHECK(pid >= 0);
+    if (pid == 0) {
+        return true;
+    }
+
+    flash_sim_set_power_loss_countdown(0);
+
+    int status;
+    CHECK(waitpid(pid, &status, 0) == pid);
+    CHECK(WIFEXITED(status));
+    CHECK(WEXITSTATUS(status) == 0 || WEXITSTATUS(status) == FLASH_SIM_POWER_LOSS_EXIT_CODE);
+    return false;
+}
+
+RUN_BEFORE(PARAM_INIT) {
+    boot = mmap(NULL, sizeof(*boot), PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+    CHECK(boot != MAP_FAILED);
+
+    srand(1);
+
+    // The values params may have after the next boot. They differ where a store lost power, until the boot resolves it.
+    struct param_values_s old_values;
+    memset(&old_values, 0, sizeof(old_values));
+    for (uint8_t i=0; i<NUM_UINT32_PARAMS; i++) {
+        old_values.uint32_values[i] = i;
+    }
+    strcpy(old_values.string_value, "default");
+    struct param_values_s new_values = old_values;
+
+    uint32_t num_store_power_losses = 0;
+    uint32_t num_boot_power_losses = 0;
+
+    for (uint32_t round=0; round<NUM_ROUNDS; round++) {
+        struct param_values_s values_to_store;
+        make_new_param_values(&new_values, &values_to_store);
+        boot->values_to_store = values_to_store;
+        boot->store_power_loss_countdown = random_power_loss_countdown();
+
+        // Power may also fail while the journal is loaded or compacted at boot, so boots are retried until one gets
+        // through. Whatever the earlier ones did, the values must stay the same.
+        while (true) {
+            if (run_boot(random_power_loss_countdown())) {
+                return;
+            }
+            if (boot->booted) {
+                break;
+            }
+            num_boot_power_losses++;
+        }
+
+        check_loaded_values(round, &old_values, &new_values);
+        old_values = boot->loaded_values;
+
+        if (boot->stored) {
+            old_values = values_to_store;
+        } else {
+            num_store_power_losses++;
+        }
+        new_values = values_to_store;
+    }
+
+    printf("test_param_power_loss: pass (%u rounds, power lost in %u stores and %u boots)\n", NUM_ROUNDS, num_store_power_losses, num_boot_power_losses);
+    exit(0);
+}
+
+RUN_AFTER(PARAM_INIT) {
+    for (uint8_t i=0; i<NUM_UINT32_PARAMS; i++) {
+        snprintf(uint32_param_names[i], sizeof(uint32_param_names[i]), "p%u", i);
+        uint32_param_descriptors[i] = (struct param_descriptor_uint32_s){{PARAM_TYPE_UINT32, 0, uint32_param_names[i], &uint32_params[i]}, i, 0, UINT32_MAX};
+        param_register((const struct param_descriptor_header_s*)&uint32_param_descriptors[i]);
+    }
+}
+
+// Only the boots forked above get here
+int main(void) {
+    flash_sim_set_power_loss_countdown(0);
+
+    get_param_values(&boot->loaded_values);
+    boot->booted = true;
+
+    param_acquire();
+    set_param_values(&boot->values_to_store);
+    flash_sim_set_power_loss_countdown(boot->store_power_loss_countdown);
+    CHECK(param_store_all());
+    flash_sim_set_power_loss_countdown(0);
+    boot->stored = true;
+
+    // Values that are already in the journal aren't written again
+    uint32_t op_count = flash_sim_get_op_count();
+    CHECK(param_store_all());
+    CHECK(flash_sim_get_op_count() == op_count);
+    param_release();
+
+    return 0;
+}
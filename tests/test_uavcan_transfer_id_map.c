@@ -0,0 +1,108 @@
+// Checks the transfer ID map in modules/uavcan/uavcan_transfer_id_map.c: that every entry of a working area that isn't a
+// multiple of the window size is used, that keys keep their transfer ids, and that the least recently used entry of a
+// window is the one evicted.
+
+#include <modules/uavcan/uavcan_transfer_id_map.h>
+#include <check.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_ENTRIES 128
+
+static struct uavcan_transfer_id_map_s map;
+static struct uavcan_transfer_id_map_entry_s map_mem[MAX_ENTRIES];
+
+static size_t get_entry_idx(const uint8_t* transfer_id) {
+    CHECK(transfer_id);
+    for (size_t i=0; i<map.num_entries; i++) {
+        if (&map_mem[i].transfer_id == transfer_id) {
+            return i;
+        }
+    }
+    CHECK(false);
+    return 0;
+}
+
+// - Returns the first entry of the window a message data type id hashes to
+static size_t get_window_idx(uint16_t data_type_id) {
+    // Retrieving inserts the key, so the map is restored afterwards
+    static struct uavcan_transfer_id_map_entry_s saved_mem[MAX_ENTRIES];
+    struct uavcan_transfer_id_map_s saved_map = map;
+    memcpy(saved_mem, map_mem, sizeof(map_mem));
+
+    size_t window_idx = get_entry_idx(uavcan_transfer_id_map_retrieve(&map, false, data_type_id, 0));
+
+    map = saved_map;
+    memcpy(map_mem, saved_mem, sizeof(map_mem));
+    return window_idx;
+}
+
+// The default 128 byte working area holds 25 entries
+static void test_all_entries_used(void) {
+    uavcan_transfer_id_map_init(&map, 128, map_mem);
+    CHECK(map.num_entries == 25);
+    CHECK(map.num_ways == 4);
+
+    bool used[MAX_ENTRIES] = {false};
+    for (uint16_t data_type_id=0; data_type_id<2048; data_type_id++) {
+        used[get_entry_idx(uavcan_transfer_id_map_retrieve(&map, false, data_type_id, 0))] = true;
+    }
+    for (size_t i=0; i<map.num_entries; i++) {
+        CHECK(used[i]);
+    }
+}
+
+static void test_transfer_ids_kept(void) {
+    uavcan_transfer_id_map_init(&map, sizeof(map_mem), map_mem);
+    CHECK(map.num_entries == MAX_ENTRIES);
+
+    // Fewer keys than one window holds can't evict each other
+    for (uint16_t data_type_id=0; data_type_id<UAVCAN_TRANSFER_ID_MAP_WAYS; data_type_id++) {
+        *uavcan_transfer_id_map_retrieve(&map, false, data_type_id, 0) = data_type_id+10;
+    }
+    *uavcan_transfer_id_map_retrieve(&map, true, 1, 42) = 99;
+
+    for (uint16_t data_type_id=0; data_type_id<UAVCAN_TRANSFER_ID_MAP_WAYS; data_type_id++) {
+        CHECK(*uavcan_transfer_id_map_retrieve(&map, false, data_type_id, 0) == data_type_id+10);
+    }
+    CHECK(*uavcan_transfer_id_map_retrieve(&map, true, 1, 42) == 99);
+    CHECK(*uavcan_transfer_id_map_retrieve(&map, true, 1, 43) == 0);
+    CHECK(*uavcan_transfer_id_map_retrieve(&map, false, 1, 42) == 11);
+}
+
+static void test_lru_eviction(void) {
+    uavcan_transfer_id_map_init(&map, 16*sizeof(map_mem[0]), map_mem);
+
+    // Find a window's worth of keys, plus one more, that hash to the same window
+    uint16_t keys[UAVCAN_TRANSFER_ID_MAP_WAYS+1];
+    size_t num_keys = 0;
+    size_t window_idx = get_window_idx(0);
+    for (uint16_t data_type_id=0; num_keys<UAVCAN_TRANSFER_ID_MAP_WAYS+1; data_type_id++) {
+        if (get_window_idx(data_type_id) == window_idx) {
+            keys[num_keys++] = data_type_id;
+        }
+    }
+
+    for (size_t i=0; i<UAVCAN_TRANSFER_ID_MAP_WAYS; i++) {
+        *uavcan_transfer_id_map_retrieve(&map, false, keys[i], 0) = i+1;
+    }
+
+    // Use the oldest key again, so that the second oldest is the least recently used
+    CHECK(*uavcan_transfer_id_map_retrieve(&map, false, keys[0], 0) == 1);
+    CHECK(*uavcan_transfer_id_map_retrieve(&map, false, keys[UAVCAN_TRANSFER_ID_MAP_WAYS], 0) == 0);
+
+    CHECK(*uavcan_transfer_id_map_retrieve(&map, false, keys[0], 0) == 1);
+    for (size_t i=2; i<UAVCAN_TRANSFER_ID_MAP_WAYS; i++) {
+        CHECK(*uavcan_transfer_id_map_retrieve(&map, false, keys[i], 0) == i+1);
+    }
+    CHECK(*uavcan_transfer_id_map_retrieve(&map, false, keys[1], 0) == 0);
+}
+
+int main(void) {
+    test_all_entries_used();
+    test_transfer_ids_kept();
+    test_lru_eviction();
+    printf("uavcan_transfer_id_map: pass\n");
+    return 0;
+}
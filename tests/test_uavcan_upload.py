@@ -0,0 +1,278 @@
+#!/usr/bin/env python3
+# Drives the UploadScheduler from tools/uavcan_upload.py with a fake node, node monitor and clock, standing in for
+# pyuavcan and the nodes being updated.
+
+import contextlib
+import io
+import os
+import sys
+import types
+import unittest
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), '..', 'tools'))
+import uavcan_upload
+
+IMAGE_PATH = 'fw.bin'
+IMAGE = bytes(range(256))*20
+
+class FakeMessage(object):
+    def __init__(self, **fields):
+        self.__dict__.update(fields)
+
+class FakeError(object):
+    OK = 0
+    NOT_FOUND = 2
+
+    def __init__(self):
+        self.value = None
+
+class FakeReadResponse(object):
+    def __init__(self):
+        self.data = bytearray()
+        self.error = FakeError()
+
+class FakeGetInfoResponse(object):
+    def __init__(self):
+        self.size = 0
+        self.entry_type = FakeMessage(flags=0, FLAG_FILE=1, FLAG_READABLE=8)
+        self.error = FakeError()
+
+def make_fake_uavcan():
+    file = types.SimpleNamespace(
+        Read=types.SimpleNamespace(Response=FakeReadResponse),
+        GetInfo=types.SimpleNamespace(Response=FakeGetInfoResponse),
+        BeginFirmwareUpdate=types.SimpleNamespace(Request=FakeMessage),
+        Path=FakeMessage)
+    return types.SimpleNamespace(protocol=types.SimpleNamespace(file=file))
+
+class FakeClock(object):
+    def __init__(self):
+        self.now = 1000.
+
+    def time(self):
+        return self.now
+
+class FakeNode(object):
+    node_id = 126
+
+    def __init__(self):
+        self.handlers = []
+        self.begin_requests = []
+        self.responses = []
+
+    def add_handler(self, data_type, handler):
+        self.handlers.append((data_type, handler))
+
+    def request(self, msg, node_id, callback):
+        self.begin_requests.append((node_id, msg, callback))
+
+    def respond(self, resp, node_id, transfer_id, priority):
+        self.responses.append((node_id, transfer_id, priority, resp))
+
+class FakeNodeMonitor(object):
+    MODE_OPERATIONAL = 0
+    MODE_MAINTENANCE = 2
+    MODE_SOFTWARE_UPDATE = 3
+
+    def __init__(self):
+        self.modes = {}
+
+    def exists(self, node_id):
+        return node_id in self.modes
+
+    def get(self, node_id):
+        status = FakeMessage(mode=self.modes[node_id], MODE_MAINTENANCE=self.MODE_MAINTENANCE)
+        return FakeMessage(status=status)
+
+class UploadSchedulerTest(unittest.TestCase):
+    def setUp(self):
+        self.clock = FakeClock()
+        self.patches = [(uavcan_upload, 'uavcan', make_fake_uavcan()), (uavcan_upload, 'time', self.clock)]
+        self.saved = [(obj, name, getattr(obj, name)) for obj, name, _ in self.patches]
+        for obj, name, value in self.patches:
+            setattr(obj, name, value)
+        self.output = contextlib.redirect_stdout(io.StringIO())
+        self.output.__enter__()
+
+        self.node = FakeNode()
+        self.node_monitor = FakeNodeMonitor()
+
+    def tearDown(self):
+        self.output.__exit__(None, None, None)
+        for obj, name, value in self.saved:
+            setattr(obj, name, value)
+
+    def make_scheduler(self, max_concurrent=0, bandwidth=0, stall_timeout=10., max_attempts=3):
+        return uavcan_upload.UploadScheduler(self.node, self.node_monitor, IMAGE_PATH, IMAGE, max_concurrent, bandwidth, stall_timeout, max_attempts)
+
+    def read(self, scheduler, node_id, ofs, transfer_id=0, path=IMAGE_PATH):
+        e = FakeMessage(
+            request=FakeMessage(path=FakeMessage(path=path.encode()), offset=ofs),
+            transfer=FakeMessage(source_node_id=node_id, transfer_id=transfer_id, transfer_priority=30))
+        return scheduler.read_handler(e)
+
+    def advance(self, scheduler, seconds, step=0.01):
+        end = self.clock.now + seconds
+        while self.clock.now < end:
+            self.clock.now += step
+            scheduler.spin()
+
+    def begun(self):
+        return [node_id for node_id, _, _ in self.node.begin_requests]
+
+    def test_read_and_getinfo(self):
+        scheduler = self.make_scheduler()
+        resp = self.read(scheduler, 10, 256)
+        self.assertEqual(resp.error.value, resp.error.OK)
+        self.assertEqual(bytes(resp.data), IMAGE[256:512])
+
+        resp = self.read(scheduler, 10, len(IMAGE)-10)
+        self.assertEqual(bytes(resp.data), IMAGE[-10:])
+
+        resp = self.read(scheduler, 10, 0, path='other.bin')
+        self.assertEqual(resp.error.value, resp.error.NOT_FOUND)
+
+        resp = scheduler.getinfo_handler(FakeMessage(request=FakeMessage(path=FakeMessage(path=IMAGE_PATH.encode()))))
+        self.assertEqual(resp.size, len(IMAGE))
+        self.assertEqual(resp.error.value, resp.error.OK)
+
+    def test_max_concurrent(self):
+        scheduler = self.make_scheduler(max_concurrent=2)
+        for node_id in [10, 11, 12, 11]:
+            scheduler.enqueue(node_id)
+        self.assertEqual(self.begun(), [10, 11])
+        self.assertEqual(scheduler.waiting, [12])
+
+        scheduler.finish(11, True)
+        self.assertEqual(self.begun(), [10, 11, 12])
+        scheduler.finish(10, True)
+        scheduler.finish(12, True)
+        self.assertFalse(scheduler.busy())
+
+    def test_unlimited_concurrency(self):
+        scheduler = self.make_scheduler(max_concurrent=0)
+        for node_id in range(10, 20):
+            scheduler.enqueue(node_id)
+        self.assertEqual(self.begun(), list(range(10, 20)))
+
+    def test_bandwidth_budget(self):
+        bandwidth = 2000
+        scheduler = self.make_scheduler(bandwidth=bandwidth)
+        scheduler.enqueue(10)
+        scheduler.enqueue(11)
+
+        # Both nodes keep 4 reads outstanding, far more than the budget allows
+        next_ofs = {10: 0, 11: 0}
+        bytes_sent = 0
+        for _ in range(1000):
+            for node_id in next_ofs:
+                while sum(1 for key in scheduler.response_queue if key[0] == node_id) < 4:
+                    self.assertIsNone(self.read(scheduler, node_id, next_ofs[node_id] % len(IMAGE)))
+                    next_ofs[node_id] += 256
+            num_responses = len(self.node.responses)
+            self.advance(scheduler, 0.01)
+            bytes_sent += sum(len(resp.data) for _, _, _, resp in self.node.responses[num_responses:])
+
+        # 10 seconds at the budget, give or take the one response that may overdraw it
+        self.assertGreaterEqual(bytes_sent, 10*bandwidth - 256)
+        self.assertLessEqual(bytes_sent, 10*bandwidth + 256)
+
+        # Neither node is starved
+        served = [scheduler.active[node_id].bytes_served for node_id in (10, 11)]
+        self.assertLess(abs(served[0]-served[1]), 2048)
+
+    def test_retried_read_replaces_queued_response(self):
+        scheduler = self.make_scheduler(bandwidth=1000)
+        scheduler.enqueue(10)
+        self.assertIsNone(self.read(scheduler, 10, 0, transfer_id=1))
+        self.assertIsNone(self.read(scheduler, 10, 256, transfer_id=2))
+        self.assertIsNone(self.read(scheduler, 10, 0, transfer_id=3))
+        self.assertEqual(len(scheduler.response_queue), 2)
+
+        # The retry keeps the original's place in the queue, but answers with its own transfer ID
+        self.advance(scheduler, 2.)
+        self.assertEqual([(node_id, transfer_id) for node_id, transfer_id, _, _ in self.node.responses], [(10, 3), (10, 2)])
+
+    def test_finish_drops_queued_responses(self):
+        scheduler = self.make_scheduler(bandwidth=1000)
+        scheduler.enqueue(10)
+        self.read(scheduler, 10, 0)
+        scheduler.finish(10, False)
+        self.advance(scheduler, 1.)
+        self.assertEqual(self.node.responses, [])
+
+    def test_stall_requeues_until_max_attempts(self):
+        scheduler = self.make_scheduler(max_concurrent=1, stall_timeout=5., max_attempts=2)
+        scheduler.enqueue(10)
+        scheduler.enqueue(11)
+
+        # Node 10 reads for a while and then stops, and gives up its slot to node 11
+        for _ in range(4):
+            self.read(scheduler, 10, 0)
+            self.advance(scheduler, 1.)
+        self.assertEqual(list(scheduler.active), [10])
+        self.advance(scheduler, 5.1)
+        self.assertEqual(list(scheduler.active), [11])
+        self.assertEqual(scheduler.waiting, [10])
+
+        # Node 11 never reads
+        self.advance(scheduler, 5.1)
+        self.assertEqual(list(scheduler.active), [10])
+
+        # Second attempts of both stall too, after which both are given up on
+        self.advance(scheduler, 10.2)
+        self.assertEqual(self.begun(), [10, 11, 10, 11])
+        self.assertEqual(scheduler.given_up, {10, 11})
+        self.assertFalse(scheduler.busy())
+
+        scheduler.enqueue(10)
+        self.assertFalse(scheduler.busy())
+
+    def test_abandoned_update_fails(self):
+        scheduler = self.make_scheduler(max_attempts=3)
+
+        # Maintenance mode from before the node begins the update doesn't count
+        self.node_monitor.modes[10] = FakeNodeMonitor.MODE_MAINTENANCE
+        scheduler.enqueue(10)
+        self.advance(scheduler, 1.)
+        self.assertIn(10, scheduler.active)
+
+        self.node_monitor.modes[10] = FakeNodeMonitor.MODE_SOFTWARE_UPDATE
+        self.read(scheduler, 10, 0)
+        self.advance(scheduler, 1.)
+        self.assertIn(10, scheduler.active)
+
+        # The bootloader abandons the update
+        self.node_monitor.modes[10] = FakeNodeMonitor.MODE_MAINTENANCE
+        self.advance(scheduler, 0.1)
+        self.assertEqual(self.begun(), [10, 10])
+        self.assertEqual(scheduler.active[10].attempt, 2)
+        self.assertEqual(scheduler.active[10].bytes_served, 0)
+
+    def test_rejected_begin_fails(self):
+        scheduler = self.make_scheduler(max_attempts=2)
+        scheduler.enqueue(10)
+
+        _, msg, callback = self.node.begin_requests[-1]
+        self.assertEqual(msg.image_file_remote_path.path, IMAGE_PATH)
+        callback(FakeMessage(response=FakeMessage(error=1, ERROR_OK=0)))
+        self.assertEqual(self.begun(), [10, 10])
+
+        # No response at all
+        self.node.begin_requests[-1][2](None)
+        self.assertEqual(scheduler.given_up, {10})
+        self.assertFalse(scheduler.busy())
+
+    def test_success_resets_attempts(self):
+        scheduler = self.make_scheduler(stall_timeout=1., max_attempts=2)
+        scheduler.enqueue(10)
+        self.advance(scheduler, 1.1)
+        self.assertEqual(scheduler.active[10].attempt, 2)
+        scheduler.finish(10, True)
+        self.assertNotIn(10, scheduler.attempts)
+
+        scheduler.enqueue(10)
+        self.assertEqual(scheduler.active[10].attempt, 1)
+
+if __name__ == '__main__':
+    unittest.main()
@@ -1,7 +1,14 @@
-import uavcan
 import sys
 import os
 import argparse
+import time
+import collections
+
+# Only needed to talk to a bus. The LZSS functions and the scheduler can be used without it, as by tests/.
+try:
+    import uavcan
+except ImportError:
+    uavcan = None
 
 def get_firmware_crc_provided(data):
     import struct
@@ -24,58 +31,298 @@ def get_firmware_crc_provided(data):
 
     return fields[8]
 
-parser = argparse.ArgumentParser()
-parser.add_argument('node_name', nargs=1)
-parser.add_argument('firmware_name', nargs=1)
-parser.add_argument('bus', nargs=1)
-parser.add_argument('--discovery_time', nargs=1, default=5)
-args = parser.parse_args()
-
-with open(args.firmware_name[0], 'rb') as f:
-    firmware_crc = get_firmware_crc_provided(f.read())
-
-print('%X' % (firmware_crc,))
-update_complete = {}
-
-def monitor_update_handler(e):
-    global update_complete
-    if e.event_id == node_monitor.UpdateEvent.EVENT_ID_INFO_UPDATE:
-        print(e.entry)
-        if e.entry.info.name == args.node_name[0]:
-            if e.entry.info.software_version.image_crc != firmware_crc:
-                if e.entry.status.mode != e.entry.status.MODE_SOFTWARE_UPDATE:
-                    print('updating %u' % (e.entry.node_id,))
-                    req_msg = uavcan.protocol.file.BeginFirmwareUpdate.Request(source_node_id=node.node_id, image_file_remote_path=uavcan.protocol.file.Path(path=args.firmware_name[0]))
-                    node.request(req_msg, e.entry.node_id, update_response_handler)
-                update_complete[e.entry.node_id] = False
+# file.Read responses carry at most this many bytes, and a shorter one marks the end of the file
+FILE_READ_MAX_SIZE = 256
+
+# LZSS format decompressed by the bootloader, see include/common/lzss.h
+LZSS_MAGIC = b"ODLZ"
+LZSS_MAX_DISTANCE = 4096
+LZSS_MIN_MATCH = 3
+LZSS_MAX_MATCH = 18
+LZSS_MAX_CHAIN = 64
+
+def lzss_compress(data):
+    import struct
+    out = bytearray(LZSS_MAGIC + struct.pack('<I', len(data)))
+    chains = {}
+    flags_idx = None
+    num_items = 8
+
+    i = 0
+    while i < len(data):
+        best_len = 0
+        best_dist = 0
+        key = bytes(data[i:i+LZSS_MIN_MATCH])
+        if len(key) == LZSS_MIN_MATCH:
+            max_len = min(LZSS_MAX_MATCH, len(data)-i)
+            for j in reversed(chains.get(key, [])[-LZSS_MAX_CHAIN:]):
+                if i-j > LZSS_MAX_DISTANCE:
+                    break
+                l = LZSS_MIN_MATCH
+                while l < max_len and data[j+l] == data[i+l]:
+                    l += 1
+                if l > best_len:
+                    best_len = l
+                    best_dist = i-j
+                    if l == max_len:
+                        break
+
+        if num_items == 8:
+            flags_idx = len(out)
+            out.append(0)
+            num_items = 0
+
+        if best_len >= LZSS_MIN_MATCH:
+            d = best_dist-1
+            out.append(d & 0xff)
+            out.append(((d >> 8) << 4) | (best_len-LZSS_MIN_MATCH))
+            step = best_len
+        else:
+            out[flags_idx] |= 1 << num_items
+            out.append(data[i])
+            step = 1
+        num_items += 1
+
+        for k in range(i, i+step):
+            chains.setdefault(bytes(data[k:k+LZSS_MIN_MATCH]), []).append(k)
+        i += step
+
+    return bytes(out)
+
+def lzss_decompress(data):
+    import struct
+    assert data[:4] == LZSS_MAGIC
+    size, = struct.unpack('<I', data[4:8])
+    out = bytearray()
+    i = 8
+    while len(out) < size:
+        flags = data[i]
+        i += 1
+        for bit in range(8):
+            if len(out) == size:
+                break
+            if flags & (1 << bit):
+                out.append(data[i])
+                i += 1
             else:
-                print('%u up to date' % (e.entry.node_id,))
-                update_complete[e.entry.node_id] = True
+                dist = (data[i] | ((data[i+1] >> 4) << 8)) + 1
+                length = (data[i+1] & 0x0f) + LZSS_MIN_MATCH
+                i += 2
+                for _ in range(length):
+                    out.append(out[-dist])
+    assert i == len(data)
+    return bytes(out)
 
+class NodeProgress(object):
+    def __init__(self, attempt):
+        self.attempt = attempt
+        self.start_time = time.time()
+        self.last_read_time = self.start_time
+        self.ofs = 0
+        self.bytes_served = 0
 
-def update_response_handler(e):
-    assert e.response.error == e.response.ERROR_OK
+class UploadScheduler(object):
+    # Serves one image from memory to any number of nodes, and starts at most max_concurrent updates at once.
+    # With a bandwidth budget, file.Read responses are queued and sent at no more than that many data bytes per second.
+    # A retried read replaces its queued response rather than being sent twice.
+    # An update fails if the node stops reading for stall_timeout seconds, or the node monitor sees it back in
+    # maintenance mode, which the bootloader enters when it abandons an update. A failed node gives up its slot and is
+    # queued again, until it has been tried max_attempts times.
+    def __init__(self, node, node_monitor, image_path, image, max_concurrent, bandwidth, stall_timeout, max_attempts):
+        self.node = node
+        self.node_monitor = node_monitor
+        self.image_path = image_path
+        self.image = memoryview(image)
+        self.max_concurrent = max_concurrent
+        self.bandwidth = bandwidth
+        self.stall_timeout = stall_timeout
+        self.max_attempts = max_attempts
+        self.waiting = []
+        self.active = {}
+        self.attempts = {}
+        self.given_up = set()
+        self.response_queue = collections.OrderedDict()
+        self.tokens = 0.
+        self.last_refill_time = time.time()
+        self.last_report_time = time.time()
 
-node = uavcan.make_node(args.bus[0])
-node.node_id = 126
+        node.add_handler(uavcan.protocol.file.Read, self.read_handler)
+        node.add_handler(uavcan.protocol.file.GetInfo, self.getinfo_handler)
 
-file_server = uavcan.app.file_server.FileServer(node, [args.firmware_name[0]])
-node_monitor = uavcan.app.node_monitor.NodeMonitor(node)
-allocator = uavcan.app.dynamic_node_id.CentralizedServer(node, node_monitor)
-node_monitor.add_update_handler(monitor_update_handler)
+    def busy(self):
+        return len(self.waiting) > 0 or len(self.active) > 0
 
-# discover nodes
-import time
-tstart = time.time()
-while time.time()-tstart < float(args.discovery_time[0]):
-    try:
-        node.spin(1)
-    except:
-        pass
-
-# wait for updates to complete
-while False in update_complete.values():
-    try:
-        node.spin(1)
-    except:
-        pass
+    def enqueue(self, node_id):
+        if node_id in self.waiting or node_id in self.active or node_id in self.given_up:
+            return
+        self.waiting.append(node_id)
+        self.start_waiting()
+
+    def finish(self, node_id, success):
+        if node_id not in self.active:
+            return
+        progress = self.active.pop(node_id)
+        elapsed = time.time()-progress.start_time
+        print('%u %s in %.1f s, %u bytes served' % (node_id, 'updated' if success else 'update failed', elapsed, progress.bytes_served))
+        for key in [key for key in self.response_queue if key[0] == node_id]:
+            del self.response_queue[key]
+        if success:
+            self.attempts.pop(node_id, None)
+        self.start_waiting()
+
+    def fail(self, node_id, reason):
+        if node_id not in self.active:
+            return
+        print('%u %s' % (node_id, reason))
+        self.finish(node_id, False)
+        if self.attempts[node_id] < self.max_attempts:
+            self.enqueue(node_id)
+        else:
+            print('giving up on %u after %u attempts' % (node_id, self.attempts[node_id]))
+            self.given_up.add(node_id)
+
+    def start_waiting(self):
+        while self.waiting and (self.max_concurrent == 0 or len(self.active) < self.max_concurrent):
+            node_id = self.waiting.pop(0)
+            self.attempts[node_id] = self.attempts.get(node_id, 0) + 1
+            print('updating %u, attempt %u' % (node_id, self.attempts[node_id]))
+            self.active[node_id] = NodeProgress(self.attempts[node_id])
+            req_msg = uavcan.protocol.file.BeginFirmwareUpdate.Request(source_node_id=self.node.node_id, image_file_remote_path=uavcan.protocol.file.Path(path=self.image_path))
+            self.node.request(req_msg, node_id, lambda e, node_id=node_id: self.begin_response_handler(node_id, e))
+
+    def begin_response_handler(self, node_id, e):
+        if not e:
+            self.fail(node_id, 'did not respond to BeginFirmwareUpdate')
+        elif e.response.error != e.response.ERROR_OK:
+            self.fail(node_id, 'rejected BeginFirmwareUpdate')
+
+    def read_handler(self, e):
+        resp = uavcan.protocol.file.Read.Response()
+        if e.request.path.path.decode() != self.image_path:
+            resp.error.value = resp.error.NOT_FOUND
+            return resp
+
+        ofs = e.request.offset
+        data = self.image[ofs:ofs+FILE_READ_MAX_SIZE]
+        resp.data = bytearray(data)
+        resp.error.value = resp.error.OK
+
+        node_id = e.transfer.source_node_id
+        if node_id in self.active:
+            progress = self.active[node_id]
+            progress.last_read_time = time.time()
+            progress.ofs = max(progress.ofs, ofs+len(data))
+            progress.bytes_served += len(data)
+
+        if self.bandwidth == 0:
+            return resp
+
+        self.response_queue[(node_id, ofs)] = (e.transfer.transfer_id, e.transfer.transfer_priority, resp, len(data))
+        return None
+
+    def getinfo_handler(self, e):
+        resp = uavcan.protocol.file.GetInfo.Response()
+        if e.request.path.path.decode() != self.image_path:
+            resp.error.value = resp.error.NOT_FOUND
+            return resp
+
+        resp.size = len(self.image)
+        resp.entry_type.flags = resp.entry_type.FLAG_FILE | resp.entry_type.FLAG_READABLE
+        resp.error.value = resp.error.OK
+        return resp
+
+    def check_failed(self, t_now):
+        for node_id, progress in list(self.active.items()):
+            if t_now-progress.last_read_time > self.stall_timeout:
+                self.fail(node_id, 'stalled')
+            # Only once the node has read from this attempt, as it may still report maintenance mode from before it
+            # began the update
+            elif progress.bytes_served > 0 and self.node_monitor.exists(node_id):
+                status = self.node_monitor.get(node_id).status
+                if status.mode == status.MODE_MAINTENANCE:
+                    self.fail(node_id, 'abandoned the update')
+
+    def spin(self):
+        t_now = time.time()
+        self.check_failed(t_now)
+
+        # Up to a tenth of a second of budget may be spent at once, so a burst never queues much on the bus
+        self.tokens = min(self.tokens + (t_now-self.last_refill_time)*self.bandwidth, max(self.bandwidth*0.1, FILE_READ_MAX_SIZE))
+        self.last_refill_time = t_now
+        while self.response_queue and self.tokens > 0:
+            (node_id, ofs), (transfer_id, priority, resp, size) = self.response_queue.popitem(last=False)
+            self.node.respond(resp, node_id, transfer_id, priority)
+            self.tokens -= size
+
+        if t_now-self.last_report_time >= 1 and self.active:
+            self.last_report_time = t_now
+            for node_id, progress in sorted(self.active.items()):
+                elapsed = t_now-progress.start_time
+                rate = progress.ofs/elapsed if elapsed > 0 else 0
+                eta = '%.0f s' % ((len(self.image)-progress.ofs)/rate,) if rate > 0 else '?'
+                print('%u: %u/%u bytes, %.1f kB/s, ETA %s' % (node_id, progress.ofs, len(self.image), rate/1000., eta))
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument('node_name', nargs=1)
+    parser.add_argument('firmware_name', nargs=1)
+    parser.add_argument('bus', nargs=1)
+    parser.add_argument('--discovery_time', type=float, default=5., help='seconds to look for nodes before exiting once no updates are left')
+    parser.add_argument('--compress', action='store_true', help='serve an LZSS compressed image, which the bootloader decompresses as it writes')
+    parser.add_argument('--max_concurrent', type=int, default=0, help='number of nodes updated at once, 0 for all')
+    parser.add_argument('--bandwidth', type=int, default=0, help='file.Read data budget in bytes per second, 0 for unlimited. Each node keeps 4 reads of 256 bytes in flight and retries after 0.5 s, so keep max_concurrent*1024/bandwidth well under that.')
+    parser.add_argument('--stall_timeout', type=float, default=10., help='seconds without a file.Read from an updating node before its update is failed')
+    parser.add_argument('--max_attempts', type=int, default=3, help='number of times a node is tried before it is given up on')
+    args = parser.parse_args()
+
+    if uavcan is None:
+        print('pyuavcan is needed to talk to the bus, install it with pip install uavcan')
+        sys.exit(1)
+
+    with open(args.firmware_name[0], 'rb') as f:
+        firmware = f.read()
+        firmware_crc = get_firmware_crc_provided(firmware)
+
+    print('%X' % (firmware_crc,))
+
+    image_path = args.firmware_name[0]
+    image = firmware
+    if args.compress:
+        image = lzss_compress(firmware)
+        # The bootloader can't recover from a bad stream, so check it before serving it
+        if lzss_decompress(image) != firmware:
+            print('compression round trip failed')
+            sys.exit(1)
+        image_path = args.firmware_name[0] + '.lz'
+        print('compressed %u to %u bytes' % (len(firmware), len(image)))
+
+    def monitor_update_handler(e):
+        if e.event_id == node_monitor.UpdateEvent.EVENT_ID_INFO_UPDATE:
+            print(e.entry)
+            if e.entry.info.name == args.node_name[0]:
+                if e.entry.info.software_version.image_crc != firmware_crc:
+                    if e.entry.status.mode != e.entry.status.MODE_SOFTWARE_UPDATE:
+                        scheduler.enqueue(e.entry.node_id)
+                else:
+                    print('%u up to date' % (e.entry.node_id,))
+                    scheduler.finish(e.entry.node_id, True)
+
+    node = uavcan.make_node(args.bus[0])
+    node.node_id = 126
+
+    node_monitor = uavcan.app.node_monitor.NodeMonitor(node)
+    scheduler = UploadScheduler(node, node_monitor, image_path, image, args.max_concurrent, args.bandwidth, args.stall_timeout, args.max_attempts)
+    allocator = uavcan.app.dynamic_node_id.CentralizedServer(node, node_monitor)
+    node_monitor.add_update_handler(monitor_update_handler)
+
+    # discover nodes, then wait for updates to complete
+    tstart = time.time()
+    while time.time()-tstart < args.discovery_time or scheduler.busy():
+        try:
+            node.spin(0.01)
+        except:
+            pass
+        scheduler.spin()
+
+if __name__ == '__main__':
+    main()